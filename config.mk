@@ -7,7 +7,7 @@ PYTHON = python3
 # edit to set to UCSC browser kent/src
 KENTDIR = ${HOME}/kent/src
 
-KENTINC = -I${KENTDIR}/inc -I${KENTDIR}/hg/inc
+KENTINC = -I${KENTDIR}/inc -I${KENTDIR}/hg/inc -I${KENTDIR}/htslib
 KENTLIBDIR = ${KENTDIR}/lib/${MACH}
 KENTLIBS = ${KENTLIBDIR}/jkhgap.a ${KENTLIBDIR}/jkweb.a ${KENTDIR}/htslib/libhts.a
 LIBS = -lssl -lcrypto -lz -lpthread
@@ -20,7 +20,7 @@ endif
 
 ifeq (${USE_CLANG}, yes)
     CXX = clang++
-    CXXFLAGS = -std=c++11 -Wall -Werror -Wno-sign-compare -Wno-format-security
+    CXXFLAGS = -std=c++11 -pthread -Wall -Werror -Wno-sign-compare -Wno-format-security
     CXXDEBUG = -g -O0 -fno-inline
 else
     # gcc
@@ -31,7 +31,7 @@ else
     else
         CXX = g++
     endif
-    CXXFLAGS = -std=c++11 -Wall -Werror -Wno-sign-compare 
+    CXXFLAGS = -std=c++11 -pthread -Wall -Werror -Wno-sign-compare 
     CXXDEBUG = -g -gdwarf-3 -O0 -fno-default-inline -fno-inline
 endif
 #CXXDEBUG += -pg
@@ -41,4 +41,6 @@ CXXFLAGS += ${KENTINC} ${CXXDEBUG}
 BINDIR = ${ROOT}/bin
 OBJDIR = ${ROOT}/objs
 gencode_backmap = ${BINDIR}/gencode-backmap
+gencode_backmap_bench = ${BINDIR}/gencode-backmap-bench
+gencode_backmap_lib = ${OBJDIR}/libgencode-backmap.a
 gencodeAttrsStats = ${BINDIR}/gencodeAttrsStats
@@ -0,0 +1,106 @@
+"""
+Read the columnar binary mapping info written by gencode-backmap
+--mappingInfoColumnar.  See src/mappingInfoColumnar.hh for the format.
+The file is memory mapped, with integer and code columns returned as
+memoryviews on the file, so loading is independent of the number of rows
+until values are accessed.
+"""
+import mmap
+import struct
+import sys
+
+COLUMN_INT32 = 1
+COLUMN_DICT16 = 2
+COLUMN_DICT32 = 3
+COLUMN_STRING = 4
+
+_fileMagic = b"GBMINFO\0"
+_headerFmt = "<8sIIQ"
+_directoryEntryFmt = "<32sIIQQQ"
+
+
+class MappingInfoColumnarException(Exception):
+    pass
+
+
+class StringArray(object):
+    "array of strings stored as offsets followed by characters"
+    def __init__(self, buf, offset, count):
+        self.offsets = buf[offset:offset + (4 * (count + 1))].cast("I")
+        self.chars = buf[offset + (4 * (count + 1)):]
+        self.count = count
+
+    def __len__(self):
+        return self.count
+
+    def __getitem__(self, i):
+        return str(self.chars[self.offsets[i]:self.offsets[i + 1]], "utf-8")
+
+
+class Column(object):
+    """A column.  The values of a categorical column are indexes into its
+    dictionary, which are available from codes and dictionary."""
+    def __init__(self, name, colType, buf, numRows, dictSize, dataOffset, dictOffset):
+        self.name = name
+        self.type = colType
+        self.codes = self.dictionary = None
+        if colType == COLUMN_INT32:
+            self.values = buf[dataOffset:dataOffset + (4 * numRows)].cast("i")
+        elif colType in (COLUMN_DICT16, COLUMN_DICT32):
+            codeBytes, codeType = (2, "H") if colType == COLUMN_DICT16 else (4, "I")
+            self.codes = buf[dataOffset:dataOffset + (codeBytes * numRows)].cast(codeType)
+            self.dictionary = [s for s in StringArray(buf, dictOffset, dictSize)]
+            self.values = None
+        elif colType == COLUMN_STRING:
+            self.values = StringArray(buf, dataOffset, numRows)
+        else:
+            raise MappingInfoColumnarException("unknown column type {} for {}".format(colType, name))
+
+    def __len__(self):
+        return len(self.codes if self.codes is not None else self.values)
+
+    def __getitem__(self, i):
+        if self.codes is not None:
+            return self.dictionary[self.codes[i]]
+        else:
+            return self.values[i]
+
+
+class MappingInfoColumnar(object):
+    "mapping info columns, by name, in the order of the TSV"
+    def __init__(self, path):
+        if sys.byteorder != "little":
+            raise MappingInfoColumnarException("mapping info columnar files are only supported on little-endian hosts")
+        self.path = path
+        with open(path, "rb") as fh:
+            self._mmap = mmap.mmap(fh.fileno(), 0, access=mmap.ACCESS_READ)
+        buf = memoryview(self._mmap)
+        magic, version, numColumns, self.numRows = struct.unpack_from(_headerFmt, buf, 0)
+        if magic != _fileMagic:
+            raise MappingInfoColumnarException("not a mapping info columnar file: " + path)
+        if version != 1:
+            raise MappingInfoColumnarException("unsupported mapping info columnar version {}: {}".format(version, path))
+        self.columns = []
+        self.columnsByName = {}
+        entryOffset = struct.calcsize(_headerFmt)
+        for i in range(numColumns):
+            name, colType, dictSize, dataOffset, dictOffset, _ = struct.unpack_from(_directoryEntryFmt, buf, entryOffset)
+            entryOffset += struct.calcsize(_directoryEntryFmt)
+            name = name.rstrip(b"\0").decode()
+            column = Column(name, colType, buf, self.numRows, dictSize, dataOffset, dictOffset)
+            self.columns.append(column)
+            self.columnsByName[name] = column
+
+    def __len__(self):
+        return self.numRows
+
+    def __getitem__(self, name):
+        return self.columnsByName[name]
+
+    @property
+    def columnNames(self):
+        return [c.name for c in self.columns]
+
+    def getRow(self, i):
+        "get a row as a list of values, in column order"
+        return [c[i] for c in self.columns]
@@ -1,9 +1,14 @@
 #include "FIOStream.hh"
 #include "gzstream.hh"
+#include "bgzfStreamBuf.hh"
+#include "asyncStreamBuf.hh"
 #include <unistd.h>
 
 // FIXME: drop file name of "-" convention
 
+/** number of threads used for BGZF compression */
+int FIOStream::sCompressThreads = 1;
+
 /* get file name based on "-" or "" being stdio */
 static const string getRealFileName(const string& fileName,
                                     int ioMode) {
@@ -35,10 +40,16 @@ streambuf* FIOStream::openStreamBuf(const string& fileName,
                                     bool compressed,
                                     ios_base::openmode ioMode) {
     fGZFileBuf= NULL;
+    fBgzfFileBuf = NULL;
     fFileBuf = NULL;
+    fAsyncBuf = NULL;
 
     streambuf* strBuf = NULL;
-    if (compressed) {
+    if (compressed and ((ioMode & ios::out) or BgzfStreamBuf::isBgzfFile(fileName))) {
+        // htslib block compressed read or write
+        fBgzfFileBuf = new BgzfStreamBuf();
+        strBuf = fBgzfFileBuf->open(fileName, ioMode, sCompressThreads);
+    } else if (compressed) {
         // zlib based read or write
         fGZFileBuf = new gzstreambuf();
         strBuf = fGZFileBuf->open(fileName.c_str(), ioMode);
@@ -50,30 +61,52 @@ streambuf* FIOStream::openStreamBuf(const string& fileName,
     if (strBuf == NULL) {
         throw ios_base::failure(string("can't open \"") + fileName + "\" for " + ((ioMode & ios::out) ? "write" : "read") + " access");
     }
+    if (ioMode & ios::out) {
+        fAsyncBuf = new AsyncStreamBuf(strBuf);
+        strBuf = fAsyncBuf;
+    }
     return strBuf;
 }
 
 /**
- * Close the underlying file.
+ * Close the underlying file, return false if there were errors.
  */
-void FIOStream::close() {
+bool FIOStream::closeFile() {
+    if ((fAsyncBuf != NULL) and not fAsyncBuf->finish()) {
+        setstate(ios::badbit);
+    }
     if (fGZFileBuf != NULL) {
         fGZFileBuf->close();
+    } else if (fBgzfFileBuf != NULL) {
+        if (fBgzfFileBuf->isOpen() && (fBgzfFileBuf->close() == NULL)) {
+            setstate(ios::badbit);
+        }
     } else if (fFileBuf != NULL) {
         fFileBuf->close();
     }
-    if (bad()) {
+    return not bad();
+}
+
+/**
+ * Close the underlying file, throwing an exception if there were
+ * write errors.
+ */
+void FIOStream::close() {
+    if (not closeFile()) {
         throw ios_base::failure("I/O error on " + getFileName());
     }
 }
 
 /**
- * Destructor.
+ * Destructor, closes the file if needed, but doesn't report errors.
  */
 FIOStream::~FIOStream() {
-    close();
+    closeFile();
+    delete fAsyncBuf;
     if (fGZFileBuf != NULL) {
         delete fGZFileBuf;
+    } else if (fBgzfFileBuf != NULL) {
+        delete fBgzfFileBuf;
     } else if (fFileBuf != NULL) {
         delete fFileBuf;
     }
@@ -7,12 +7,17 @@
 #include <fstream>
 using namespace std;
 class gzstreambuf;
+class BgzfStreamBuf;
+class AsyncStreamBuf;
 class filebuf;
 
 /**
  * File iostream that supports gzipped files.  Automatically detects
  * gzipped input stream and decompresses.  On output, if the file
- * ends in .gz, the file is compressed.  Otherwise it is not compressed.
+ * ends in .gz, the file is compressed in BGZF format, which is readable
+ * by gzip.  Otherwise it is not compressed.  BGZF input is detected and
+ * read with htslib.  Output is compressed and written by a background
+ * thread.
  */
 class FIOStream: public iostream {
  private:
@@ -21,11 +26,21 @@ class FIOStream: public iostream {
 
     /** zlib streambuf, if using zlib */
     gzstreambuf* fGZFileBuf;
+
+    /** BGZF streambuf, if using BGZF */
+    BgzfStreamBuf* fBgzfFileBuf;
+
+    /** background writer in front of the file streambuf, for output */
+    AsyncStreamBuf* fAsyncBuf;
+
+    /** number of threads used for BGZF compression */
+    static int sCompressThreads;
     
     /** filebuf, if not using zlib */
     basic_filebuf<char>* fFileBuf;
 
     /** Internal methods */
+    bool closeFile();
     streambuf* openStreamBuf(const string& fileName,
                              bool compressed,
                              ios_base::openmode ioMode = ios::in);
@@ -51,12 +66,20 @@ class FIOStream: public iostream {
     FIOStream(const string& fileName,
               ios_base::openmode ioMode = ios::in);
 
-    /** Close the underlying file. */
+    /** Close the underlying file, throwing an exception if there were
+     * write errors.  Should be called before the destructor on output
+     * files to check for errors. */
     void close();
 
-    /** Destructor.*/
+    /** Destructor, closes the file if needed, but doesn't report errors. */
     virtual ~FIOStream();
 
+    /** Set the number of threads used to compress or decompress BGZF
+     * files that are opened after this call. */
+    static void setCompressThreads(int numThreads) {
+        sCompressThreads = numThreads;
+    }
+
     /** Get the file name. */
     const string& getFileName() const {
         return fFileName;
@@ -64,7 +87,7 @@ class FIOStream: public iostream {
 
     /** Determined if the file is compressed. */
     bool isCompressed() const {
-        return (fGZFileBuf != NULL);
+        return (fGZFileBuf != NULL) || (fBgzfFileBuf != NULL);
     }
 
     /** read a line, return false if on EOF */
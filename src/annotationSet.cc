@@ -1,6 +1,8 @@
 #include "annotationSet.hh"
 #include <stdexcept>
 #include <iostream>
+#include <string.h>
+#include <errno.h>
 #include "transMap.hh"
 #include "globals.hh"
 #include "gxf.hh"
@@ -46,7 +48,7 @@ void AnnotationSet::freeLocationMap() {
 
 /* generate key with PAR */
 string AnnotationSet::mkFeatureIdKey(const string& typeId,
-                                     bool isParY) const {
+                                     bool isParY) {
     if (isParY) {
         return typeId + GxfFeature::PAR_Y_SUFFIX;
     } else {
@@ -55,31 +57,25 @@ string AnnotationSet::mkFeatureIdKey(const string& typeId,
 }
 
 /* insert feature in a map */
-void AnnotationSet::insertInFeatureMap(const string& key,
+void AnnotationSet::insertInFeatureMap(const StringView& key,
                                        FeatureNode* feature,
-                                       FeatureMap& featureMap) {
-    if (featureMap.find(key) != featureMap.end()) {
-        if (gVerbose) {
-            cerr << "NOTE: key already in FeatureMap: " << key << endl;
-        }
+                                       FeatureIdIndex& featureMap) {
+    if ((not featureMap.add(key, feature->isParY(), feature)) and gVerbose) {
+        cerr << "NOTE: key already in FeatureMap: " << mkFeatureIdKey(key.toString(), feature->isParY()) << endl;
     }
-    featureMap[key].push_back(feature);
 }
 
 /* link a gene or transcript feature into the maps */
 void AnnotationSet::addFeature(FeatureNode* feature) {
     assert(feature->isGeneOrTranscript());
     // record by id and name
-    insertInFeatureMap(mkFeatureIdKey(getBaseId(feature->getTypeId()), feature->isParY()),
-                       feature, fIdFeatureMap);
+    insertInFeatureMap(getBaseIdView(feature->getTypeId()), feature, fIdFeatureMap);
     if (feature->getHavanaTypeId() != "") {
-        insertInFeatureMap(mkFeatureIdKey(getBaseId(feature->getHavanaTypeId()), feature->isParY()),
-                           feature, fIdFeatureMap);
+        insertInFeatureMap(getBaseIdView(feature->getHavanaTypeId()), feature, fIdFeatureMap);
     }
     // save gene name when real and unique
     if (feature->isGene() and useGeneNameForMappingKey(feature)) {
-        insertInFeatureMap(mkFeatureIdKey(feature->getTypeName(), feature->isParY()),
-                           feature, fNameFeatureMap);
+        insertInFeatureMap(feature->getTypeName(), feature, fNameFeatureMap);
     }
     if (fLocationMap != NULL) {
         addLocationMap(feature);
@@ -93,7 +89,7 @@ void AnnotationSet::addGene(FeatureNode* gene) {
     addFeature(gene);
     for (size_t i = 0; i < gene->getNumChildren(); i++) {
         FeatureNode* transcript = gene->getChild(i);
-        if (transcript->getType() != GxfFeature::TRANSCRIPT) {
+        if (transcript->getTypeCode() != GXF_TRANSCRIPT_TYPE) {
             throw logic_error("gene record has child that is not of type transcript: " + transcript->toString());
         }
         addFeature(transcript);
@@ -117,19 +113,16 @@ void AnnotationSet::processRecord(GxfParser *gxfParser,
  * if the name or id is duplicated in the GxF, it can't be used as an index and
  * NULL is returned.
  */
-FeatureNode* AnnotationSet::getFeatureByKey(const string& baseId,
+FeatureNode* AnnotationSet::getFeatureByKey(const StringView& baseId,
                                            bool isParY,
-                                           const FeatureMap& featureMap) const {
-    string key = mkFeatureIdKey(baseId, isParY);
-    FeatureMapConstIter it = featureMap.find(key);
-    if (it == featureMap.end()) {
+                                           const FeatureIdIndex& featureMap) const {
+    const FeatureNodeVector* features = featureMap.find(baseId, isParY);
+    if (features == NULL) {
         return NULL;
-    } else if (it->second.size() > 1) {
+    } else if (features->size() > 1) {
         return NULL;
-    } else if (it->second[0]->isParY() != isParY) {
-        throw logic_error("PAR target feature hack confused: " + key);
     } else {
-        return it->second[0];
+        return (*features)[0];
     }
 }
 
@@ -137,20 +130,53 @@ FeatureNode* AnnotationSet::getFeatureByKey(const string& baseId,
  * special handling for PARs. Getting node is used if you need whole tree. */
 FeatureNode* AnnotationSet::getFeatureById(const string& id,
                                            bool isParY) const {
-    return getFeatureByKey(getBaseId(id), isParY, fIdFeatureMap);
+    if (fGeneIndex != NULL) {
+        return getLazyFeature(fGeneIndex->findId(getBaseId(id), isParY));
+    }
+    return getFeatureByKey(getBaseIdView(id), isParY, fIdFeatureMap);
 }
 
 /* get a target gene or transcript node with same name or NULL.
  * special handling for PARs. Getting node is used if you need whole tree. */
 FeatureNode* AnnotationSet::getFeatureByName(const string& name,
                                              bool isParY) const {
+    if (fGeneIndex != NULL) {
+        return getLazyFeature(fGeneIndex->findName(name, isParY));
+    }
     return getFeatureByKey(name, isParY, fNameFeatureMap);
 }
 
+/* get a feature of a lazy set, parsing and caching the gene if this is the
+ * first lookup */
+FeatureNode* AnnotationSet::getLazyFeature(const GeneOffsetIndex::FeatureRef* featureRef) const {
+    if (featureRef == NULL) {
+        return NULL;
+    }
+    lock_guard<mutex> lock(fLazyMutex);
+    FeatureNode*& gene = fLazyGenes[featureRef->geneIdx];
+    if (gene == NULL) {
+        gene = fGeneIndex->readGene(featureRef->geneIdx, fLazyGxfIn);
+    }
+    if (featureRef->featureIdx == 0) {
+        return gene;
+    } else {
+        return gene->getChild(featureRef->featureIdx - 1);
+    }
+}
+
+/* error if operation needs all genes and this is a lazy set */
+void AnnotationSet::checkNotLazy(const char* operation) const {
+    if (fGeneIndex != NULL) {
+        throw logic_error(string("AnnotationSet::") + operation + " not supported on lazily loaded annotations from "
+                          + fGeneIndex->getGxfFile());
+    }
+}
+
 /* find overlapping features */
 FeatureNodeVector AnnotationSet::findOverlappingFeatures(const string& seqid,
                                                          int start,
                                                          int end) {
+    checkNotLazy("findOverlappingFeatures");
     if (fLocationMap == NULL) {
         buildLocationMap();
     }
@@ -170,8 +196,8 @@ bool AnnotationSet::isOverlappingGene(const FeatureNode* gene,
                                       float minSimilarity,
                                       bool manualOnlyTranscripts) {
     return overlappingFeature->isGene()
-        and (gene->getMaxTranscriptSimilarity(overlappingFeature,
-                                                  manualOnlyTranscripts) >= minSimilarity);
+        and (fGeneSimilarity.getMaxTranscriptSimilarity(gene, overlappingFeature,
+                                                        manualOnlyTranscripts) >= minSimilarity);
 }
 
 /* find overlapping genes with minimum similarity at the transcript level */
@@ -195,13 +221,66 @@ FeatureNodeVector AnnotationSet::findOverlappingGenes(const FeatureNode* gene,
 AnnotationSet::AnnotationSet(const string& gxfFile,
                              const GenomeSizeMap* genomeSizes):
     fLocationMap(NULL),
-    fGenomeSizes(genomeSizes) {
+    fGenomeSizes(genomeSizes),
+    fGeneIndex(NULL) {
     GxfParser* gxfParser = GxfParser::factory(gxfFile);
+    load(gxfParser);
+    delete gxfParser;
+}
+
+/* constructor, load gene and transcript objects from a GxF stream */
+AnnotationSet::AnnotationSet(istream& gxfIn,
+                             GxfFormat gxfFormat,
+                             const GenomeSizeMap* genomeSizes):
+    fLocationMap(NULL),
+    fGenomeSizes(genomeSizes),
+    fGeneIndex(NULL) {
+    GxfParser* gxfParser = GxfParser::factory(gxfIn, gxfFormat);
+    load(gxfParser);
+    delete gxfParser;
+}
+
+/* constructor for a lazy set, takes ownership of geneIndex */
+AnnotationSet::AnnotationSet(GeneOffsetIndex* geneIndex,
+                             const GenomeSizeMap* genomeSizes):
+    fLocationMap(NULL),
+    fGenomeSizes(genomeSizes),
+    fGeneIndex(geneIndex),
+    fLazyGxfIn(geneIndex->getGxfFile().c_str(), ios::in | ios::binary) {
+    if (not fLazyGxfIn.is_open()) {
+        string gxfFile = geneIndex->getGxfFile();
+        delete fGeneIndex;
+        throw ios_base::failure("can't open GxF file \"" + gxfFile + "\": " + strerror(errno));
+    }
+}
+
+/* factory for a set that parses genes on first lookup */
+AnnotationSet* AnnotationSet::factoryLazy(const string& gxfFile,
+                                          const string& indexFile,
+                                          const GenomeSizeMap* genomeSizes) {
+    return new AnnotationSet(GeneOffsetIndex::factory(gxfFile, indexFile), genomeSizes);
+}
+
+/* load all genes from a parser */
+void AnnotationSet::load(GxfParser *gxfParser) {
     GxfRecord* gxfRecord;
     while ((gxfRecord = gxfParser->next()) != NULL) {
         processRecord(gxfParser, gxfRecord);
     }
-    delete gxfParser;
+}
+
+/* remove all genes, returning them with ownership passed to the caller */
+FeatureNodeVector AnnotationSet::releaseGenes() {
+    checkNotLazy("releaseGenes");
+    if (fLocationMap != NULL) {
+        freeLocationMap();
+    }
+    fIdFeatureMap.clear();
+    fNameFeatureMap.clear();
+    fGeneSimilarity.clear();
+    FeatureNodeVector genes;
+    genes.swap(fGenes);
+    return genes;
 }
 
 /* destructor */
@@ -212,6 +291,10 @@ AnnotationSet::~AnnotationSet() {
     for (int i = 0; i < fGenes.size(); i++) {
         delete fGenes[i];
     }
+    for (map<int, FeatureNode*>::iterator it = fLazyGenes.begin(); it != fLazyGenes.end(); it++) {
+        delete it->second;
+    }
+    delete fGeneIndex;
 }
 
 /* sort gene in gencode order */
@@ -223,6 +306,7 @@ static void sortGencodeGene(FeatureNode* gene) {
 }
 
 void AnnotationSet::sortGencode() {
+    checkNotLazy("sortGencode");
     sortGenes();
     for (int i = 0; i < fGenes.size(); i++) {
         sortGencodeGene(fGenes[i]);
@@ -237,10 +321,9 @@ void AnnotationSet::outputSeqRegion(const string& seqId,
 }
 
 /* output GFF3 mapped ##sequence-region if not already written */
-void AnnotationSet::outputMappedSeqRegionIfNeed(const FeatureNode* gene,
-                                                GxfWriter& gxfFh) {
+void AnnotationSet::writeSeqRegionIfNeeded(const string& seqId,
+                                           GxfWriter& gxfFh) {
     if (gxfFh.getFormat() == GFF3_FORMAT) {
-        const string& seqId = gene->getSeqid();
         if (fGenomeSizes->have(seqId) and (not checkRecordSeqRegionWritten(seqId))) {
             outputSeqRegion(seqId, fGenomeSizes->get(seqId), gxfFh);
         }
@@ -266,17 +349,11 @@ void AnnotationSet::dump(ostream& fh) const {
 }
 
 /* dump one of the id/name maps */
-void AnnotationSet::dumpFeatureMap(const FeatureMap& featureMap,
+void AnnotationSet::dumpFeatureMap(const FeatureIdIndex& featureMap,
                                    const string& label,
                                    ostream& fh) const {
     fh << ">>> " << label << endl;
-    for (FeatureMapConstIter it = featureMap.begin(); it != featureMap.end(); it++) {
-        fh << it->first << ":";
-        for (int i = 0; i < it->second.size(); i++) {
-            fh << " " << it->second[i]->getTypeId();
-        }
-        fh << endl;
-    }
+    featureMap.dump(fh);
 }
 
 /* print id maps for debugging */
@@ -287,8 +364,9 @@ void AnnotationSet::dumpIdMaps(ostream& fh) const {
 
 /* output genes */
 void AnnotationSet::write(GxfWriter& gxfFh) {
+    checkNotLazy("write");
     for (int iGene = 0; iGene < fGenes.size(); iGene++) {
-        outputMappedSeqRegionIfNeed(fGenes[iGene], gxfFh);
+        writeSeqRegionIfNeeded(fGenes[iGene]->getSeqid(), gxfFh);
         outputFeature(fGenes[iGene], gxfFh);
     }
 }
@@ -8,7 +8,12 @@
 #include "gxf.hh"
 #include <map>
 #include <stdexcept>
+#include <mutex>
+#include <fstream>
 #include "featureTree.hh"
+#include "geneSimilarity.hh"
+#include "featureIdIndex.hh"
+#include "geneOffsetIndex.hh"
 struct genomeRangeTree;
 class GenomeSizeMap;
 class GxfWriter;
@@ -25,19 +30,16 @@ class AnnotationSet {
         FeatureNode* feature;
     };
 
-    // map of gene or transcripts id or name feature object.  If feature is in
-    // PAR_Y, suffix is added to key.  A list is kept because occasionally
-    // gene names or HAVANA gene ids are duplicated incorrectly on multiple genes.
-    // it this case, we can't the result.
-    typedef map<const string, FeatureNodeVector> FeatureMap;
-    typedef FeatureMap::iterator FeatureMapIter;
-    typedef FeatureMap::const_iterator FeatureMapConstIter;
+    // index of gene or transcripts id or name feature object, keyed with the
+    // PAR_Y flag.  A list is kept because occasionally gene names or HAVANA
+    // gene ids are duplicated incorrectly on multiple genes.  it this case,
+    // we can't the result.
 
-    // map by base id of genes and transcripts (not exons).
-    FeatureMap fIdFeatureMap;
+    // index by base id of genes and transcripts (not exons).
+    FeatureIdIndex fIdFeatureMap;
 
-    // map by names of genes  small non-coding RNAs are know to have non-unique names and are not included.
-    FeatureMap fNameFeatureMap;
+    // index by names of genes  small non-coding RNAs are know to have non-unique names and are not included.
+    FeatureIdIndex fNameFeatureMap;
 
     // list of all gene features found
     FeatureNodeVector fGenes;
@@ -45,24 +47,34 @@ class AnnotationSet {
     // map of location to feature
     struct genomeRangeTree* fLocationMap;
 
+    // cached exon similarity of genes found by findOverlappingGenes
+    GeneSimilarity fGeneSimilarity;
+
     // mapped sequence ids that have been written
     StringSet fSeqRegionsWritten;
 
     // optional table of chromosome sequence sizes
     const GenomeSizeMap* fGenomeSizes;
 
-    string mkFeatureIdKey(const string& typeId,
-                          bool isParY) const;
-    void insertInFeatureMap(const string& key,
+    // If not NULL, genes are not loaded, they are parsed from the file
+    // using this index when first looked up and cached.  Lookups are thread
+    // safe.
+    GeneOffsetIndex* fGeneIndex;
+    mutable std::mutex fLazyMutex;
+    mutable ifstream fLazyGxfIn;
+    mutable map<int, FeatureNode*> fLazyGenes;
+
+    void insertInFeatureMap(const StringView& key,
                             FeatureNode* feature,
-                            FeatureMap& featureMap);
+                            FeatureIdIndex& featureMap);
     void addFeature(FeatureNode* feature);
     void processRecord(GxfParser *gxfParser,
                        GxfRecord* gxfRecord);
+    void load(GxfParser *gxfParser);
     void addLocationMap(FeatureNode* feature);
     void buildLocationMap();
     void freeLocationMap();
-    void dumpFeatureMap(const FeatureMap& featureMap,
+    void dumpFeatureMap(const FeatureIdIndex& featureMap,
                         const string& label,
                         ostream& fh) const;
     bool isOverlappingGene(const FeatureNode* gene,
@@ -70,9 +82,13 @@ class AnnotationSet {
                            float minSimilarity,
                            bool manualOnlyTranscripts);
 
-    FeatureNode* getFeatureByKey(const string& baseKey,
+    FeatureNode* getFeatureByKey(const StringView& baseKey,
                                  bool isParY,
-                                 const FeatureMap& featureMap) const;
+                                 const FeatureIdIndex& featureMap) const;
+    AnnotationSet(GeneOffsetIndex* geneIndex,
+                  const GenomeSizeMap* genomeSizes);
+    FeatureNode* getLazyFeature(const GeneOffsetIndex::FeatureRef* featureRef) const;
+    void checkNotLazy(const char* operation) const;
 
     /* check if a seqregion for seqid has been written, if so, return true,
      * otherwise record it and return false.  */
@@ -87,20 +103,43 @@ class AnnotationSet {
     void outputSeqRegion(const string& seqId,
                          int size,
                          GxfWriter& gxfFh);
-    void outputMappedSeqRegionIfNeed(const FeatureNode* gene,
-                                     GxfWriter& mappedGxfFh);
     void outputFeature(const FeatureNode* feature,
                        GxfWriter& gxfFh) const;
 
     public:
+    /* generate id map key, with suffix for PAR */
+    static string mkFeatureIdKey(const string& typeId,
+                                 bool isParY);
+
     /* constructor, load gene and transcript objects from a GxF */
     AnnotationSet(const string& gxfFile,
                   const GenomeSizeMap* genomeSizes=NULL);
 
+    /* constructor, load gene and transcript objects from a GxF stream,
+     * such as an in-memory buffer */
+    AnnotationSet(istream& gxfIn,
+                  GxfFormat gxfFormat,
+                  const GenomeSizeMap* genomeSizes=NULL);
+
     /* constructor, empty set */
     AnnotationSet(const GenomeSizeMap* genomeSizes=NULL):
         fLocationMap(NULL),
-        fGenomeSizes(genomeSizes) {
+        fGenomeSizes(genomeSizes),
+        fGeneIndex(NULL) {
+    }
+
+    /* Factory for a set that only supports getFeatureById and
+     * getFeatureByName.  Genes are parsed from gxfFile when one of their
+     * features is first looked up, using the offset index in indexFile,
+     * which is built if it doesn't exist or is out of date.  gxfFile must
+     * not be compressed, see GeneOffsetIndex::canIndex(). */
+    static AnnotationSet* factoryLazy(const string& gxfFile,
+                                      const string& indexFile,
+                                      const GenomeSizeMap* genomeSizes=NULL);
+
+    /* is this a lazily loaded set? */
+    bool isLazy() const {
+        return fGeneIndex != NULL;
     }
 
     /* destructor */
@@ -109,6 +148,10 @@ class AnnotationSet {
     /* add a gene the maps */
     void addGene(FeatureNode* gene);
 
+    /* remove all genes, returning them with ownership passed to the
+     * caller */
+    FeatureNodeVector releaseGenes();
+
     /* get a gene or transcript with same base id or NULL.  special
      * handling for PARs. */
     FeatureNode* getFeatureById(const string& id,
@@ -124,13 +167,16 @@ class AnnotationSet {
                                           int start,
                                           int end);
     
-    /* find overlapping genes with minimum similarity at the transcript level */
+    /* find overlapping genes with minimum similarity at the transcript
+     * level.  Similarities are cached, so gene must not be freed while
+     * this object is in use. */
     FeatureNodeVector findOverlappingGenes(const FeatureNode* gene,
                                        float minSimilarity,
                                        bool manualOnlyTranscripts);
 
-    /* get list of all gene features */
+    /* get list of all gene features, not available for a lazy set */
     const FeatureNodeVector& getGenes() const {
+        checkNotLazy("getGenes");
         return fGenes;
     }
 
@@ -150,6 +196,12 @@ class AnnotationSet {
 
     /* output genes */
     void write(GxfWriter& gxfFh);
+
+    /* Write a GFF3 ##sequence-region for a sequence, if the size is known
+     * and it has not already been written by this object.  Used when genes
+     * are written in sorted order by some other means. */
+    void writeSeqRegionIfNeeded(const string& seqId,
+                                GxfWriter& gxfFh);
 };
 
 #endif
@@ -0,0 +1,148 @@
+/*
+ * streambuf that writes on a background thread.
+ */
+#include "asyncStreamBuf.hh"
+
+/* constructor, sink must outlive this object */
+AsyncStreamBuf::AsyncStreamBuf(streambuf* sink):
+    fSink(sink),
+    fCurrent(NULL),
+    fNumPending(0),
+    fDone(false),
+    fWriteError(false) {
+    startBuffer();
+    fWriter = thread(&AsyncStreamBuf::writerMain, this);
+}
+
+/* destructor, finish() should be called first to detect errors */
+AsyncStreamBuf::~AsyncStreamBuf() {
+    finish();
+    delete fCurrent;
+    for (size_t i = 0; i < fFree.size(); i++) {
+        delete fFree[i];
+    }
+}
+
+/* get an empty buffer to fill, reusing a written one if available */
+void AsyncStreamBuf::startBuffer() {
+    {
+        unique_lock<mutex> lock(fMutex);
+        if (fFree.empty()) {
+            fCurrent = NULL;
+        } else {
+            fCurrent = fFree.back();
+            fFree.pop_back();
+        }
+    }
+    if (fCurrent == NULL) {
+        fCurrent = new vector<char>(bufferSize);
+    }
+    char* buf = &((*fCurrent)[0]);
+    setp(buf, buf + bufferSize);
+}
+
+/* pass the filled part of the current buffer to the writer, waiting if the
+ * queue is full */
+void AsyncStreamBuf::queueBuffer() {
+    fCurrent->resize(pptr() - pbase());
+    {
+        unique_lock<mutex> lock(fMutex);
+        while (fQueue.size() >= maxQueued) {
+            fQueueChanged.wait(lock);
+        }
+        fQueue.push_back(fCurrent);
+        fNumPending++;
+    }
+    fCurrent = NULL;
+    fQueueChanged.notify_all();
+}
+
+/* I/O thread, writes buffers until done */
+void AsyncStreamBuf::writerMain() {
+    while (true) {
+        vector<char>* buf = NULL;
+        {
+            unique_lock<mutex> lock(fMutex);
+            while (fQueue.empty() and not fDone) {
+                fQueueChanged.wait(lock);
+            }
+            if (fQueue.empty()) {
+                break;  // done and drained
+            }
+            buf = fQueue.front();
+            fQueue.pop_front();
+        }
+        fQueueChanged.notify_all();
+        bool isOk = (fSink->sputn(&((*buf)[0]), buf->size()) == streamsize(buf->size()));
+        buf->resize(bufferSize);
+        unique_lock<mutex> lock(fMutex);
+        if (not isOk) {
+            fWriteError = true;
+        }
+        fFree.push_back(buf);
+        fNumPending--;
+        lock.unlock();
+        fQueueChanged.notify_all();
+    }
+}
+
+/* wait for all queued buffers to be written */
+void AsyncStreamBuf::waitWritten() {
+    unique_lock<mutex> lock(fMutex);
+    while (fNumPending > 0) {
+        fQueueChanged.wait(lock);
+    }
+}
+
+/* buffer is full */
+int AsyncStreamBuf::overflow(int c) {
+    if (fCurrent == NULL) {
+        return EOF;  // finished
+    }
+    queueBuffer();
+    startBuffer();
+    if (c != EOF) {
+        *pptr() = c;
+        pbump(1);
+    }
+    return (c == EOF) ? 0 : c;
+}
+
+/* write the buffered data and flush the sink, returning -1 if there were
+ * write errors */
+int AsyncStreamBuf::sync() {
+    if (fCurrent != NULL) {
+        if (pptr() > pbase()) {
+            queueBuffer();
+            startBuffer();
+        }
+        waitWritten();
+        if (fSink->pubsync() < 0) {
+            fWriteError = true;
+        }
+    }
+    return fWriteError ? -1 : 0;
+}
+
+/* write remaining data and stop the I/O thread, returning false if
+ * there were write errors. */
+bool AsyncStreamBuf::finish() {
+    if (fWriter.joinable()) {
+        if (pptr() > pbase()) {
+            queueBuffer();
+        }
+        {
+            unique_lock<mutex> lock(fMutex);
+            fDone = true;
+        }
+        fQueueChanged.notify_all();
+        fWriter.join();
+        delete fCurrent;
+        fCurrent = NULL;
+        setp(NULL, NULL);
+        if (fSink->pubsync() < 0) {
+            fWriteError = true;
+        }
+    }
+    return not fWriteError;
+}
@@ -0,0 +1,60 @@
+/*
+ * streambuf that writes on a background thread.
+ */
+#ifndef asyncStreamBuf_hh
+#define asyncStreamBuf_hh
+#include <string>
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+using namespace std;
+
+/*
+ * Output streambuf that hands filled buffers through a bounded queue to a
+ * dedicated I/O thread, which writes them to another streambuf.  This
+ * overlaps formatting with compression and writing.  The caller blocks only
+ * when the queue is full.  A stream flush waits for the queued buffers to
+ * be written and fails if there were write errors, so it should not be
+ * done for every line.  finish() also reports write errors.
+ */
+class AsyncStreamBuf: public streambuf {
+    private:
+    static const size_t bufferSize = 1024 * 1024;
+    static const size_t maxQueued = 4;
+
+    streambuf* fSink;         // not owned
+    vector<char>* fCurrent;   // buffer being filled
+    deque<vector<char>*> fQueue;  // filled buffers to write
+    vector<vector<char>*> fFree;  // buffers available for reuse
+    size_t fNumPending;       // buffers queued or being written
+    bool fDone;               // no more buffers will be queued
+    bool fWriteError;         // error from the sink
+    mutex fMutex;
+    condition_variable fQueueChanged;
+    thread fWriter;
+
+    void startBuffer();
+    void queueBuffer();
+    void waitWritten();
+    void writerMain();
+
+    protected:
+    virtual int overflow(int c = EOF);
+    virtual int sync();
+
+    public:
+    /* constructor, sink must outlive this object */
+    AsyncStreamBuf(streambuf* sink);
+
+    /* destructor, finish() should be called first to detect errors */
+    virtual ~AsyncStreamBuf();
+
+    /* write remaining data and stop the I/O thread, returning false if
+     * there were write errors. */
+    bool finish();
+};
+
+#endif
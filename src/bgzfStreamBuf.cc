@@ -0,0 +1,120 @@
+/*
+ * streambuf for BGZF block compressed files.
+ */
+#include "bgzfStreamBuf.hh"
+#include <stdio.h>
+#include <sys/stat.h>
+#include "htslib/bgzf.h"
+
+/* number of blocks queued per compression thread */
+static const int blocksPerThread = 256;
+
+/* open the file with numThreads compression threads, returning NULL on
+ * error */
+BgzfStreamBuf* BgzfStreamBuf::open(const string& fileName,
+                                   ios_base::openmode ioMode,
+                                   int numThreads) {
+    if (fBgzf != NULL) {
+        return NULL;
+    }
+    fIsWrite = (ioMode & ios::out) != 0;
+    fBgzf = bgzf_open(fileName.c_str(), (fIsWrite ? "w" : "r"));
+    if (fBgzf == NULL) {
+        return NULL;
+    }
+    // failure just means it isn't supported, such as reading with older htslib
+    bgzf_mt(fBgzf, numThreads, blocksPerThread);
+    if (fIsWrite) {
+        setp(fBuffer, fBuffer + (bufferSize - 1));
+    } else {
+        setg(fBuffer, fBuffer, fBuffer);
+    }
+    return this;
+}
+
+/* close the file, returning NULL on error */
+BgzfStreamBuf* BgzfStreamBuf::close() {
+    if (fBgzf == NULL) {
+        return NULL;
+    }
+    bool isOk = true;
+    if (fIsWrite and (flushBuffer() == EOF)) {
+        isOk = false;
+    }
+    if (bgzf_close(fBgzf) < 0) {
+        isOk = false;
+    }
+    fBgzf = NULL;
+    return isOk ? this : NULL;
+}
+
+/* pass buffered output to BGZF, returning EOF on error */
+int BgzfStreamBuf::flushBuffer() {
+    int num = pptr() - pbase();
+    if ((num > 0) and (bgzf_write(fBgzf, pbase(), num) != num)) {
+        return EOF;
+    }
+    pbump(-num);
+    return num;
+}
+
+/* buffer is full */
+int BgzfStreamBuf::overflow(int c) {
+    if ((fBgzf == NULL) or not fIsWrite) {
+        return EOF;
+    }
+    if (c != EOF) {
+        *pptr() = c;
+        pbump(1);
+    }
+    if (flushBuffer() == EOF) {
+        return EOF;
+    }
+    return (c == EOF) ? 0 : c;
+}
+
+/* read the next buffer */
+int BgzfStreamBuf::underflow() {
+    if (gptr() < egptr()) {
+        return traits_type::to_int_type(*gptr());
+    }
+    if ((fBgzf == NULL) or fIsWrite) {
+        return EOF;
+    }
+    ssize_t num = bgzf_read(fBgzf, fBuffer, bufferSize);
+    if (num <= 0) {
+        return EOF;
+    }
+    setg(fBuffer, fBuffer, fBuffer + num);
+    return traits_type::to_int_type(*gptr());
+}
+
+/* Pass buffered data to BGZF.  This doesn't force a BGZF block to be
+ * written, as that would create small blocks on every stream flush. */
+int BgzfStreamBuf::sync() {
+    if ((fBgzf != NULL) and fIsWrite and (flushBuffer() == EOF)) {
+        return -1;
+    }
+    return 0;
+}
+
+/* Check if a file starts with a BGZF block header.  Return false if
+ * it is not, can't be opened, or is not a regular file. */
+bool BgzfStreamBuf::isBgzfFile(const string& fileName) {
+    // don't consume input from a pipe
+    struct stat statBuf;
+    if ((stat(fileName.c_str(), &statBuf) < 0) or not S_ISREG(statBuf.st_mode)) {
+        return false;
+    }
+    FILE* fh = fopen(fileName.c_str(), "r");
+    if (fh == NULL) {
+        return false;
+    }
+    unsigned char header[16];
+    size_t num = fread(header, 1, sizeof(header), fh);
+    fclose(fh);
+    // gzip magic, deflate, FEXTRA flag, with `BC' extra subfield
+    return (num == sizeof(header))
+        and (header[0] == 0x1f) and (header[1] == 0x8b) and (header[2] == 8)
+        and ((header[3] & 4) != 0) and (header[12] == 'B') and (header[13] == 'C');
+}
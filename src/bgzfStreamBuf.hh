@@ -0,0 +1,64 @@
+/*
+ * streambuf for BGZF block compressed files.
+ */
+#ifndef bgzfStreamBuf_hh
+#define bgzfStreamBuf_hh
+#include <string>
+#include <iostream>
+using namespace std;
+struct BGZF;
+
+/*
+ * streambuf that reads or writes BGZF files using htslib.  BGZF is a series
+ * of gzip members, so the output can be read by any gzip reader and is
+ * tabix-indexable.  When writing, blocks are compressed by a pool of
+ * background threads, overlapping compression with the caller.  Reading can
+ * also use threads if supported by htslib.  Both input and output will not
+ * be used together.
+ */
+class BgzfStreamBuf: public streambuf {
+    private:
+    static const int bufferSize = 65536;
+    BGZF* fBgzf;
+    bool fIsWrite;
+    char fBuffer[bufferSize];
+
+    int flushBuffer();
+
+    protected:
+    virtual int overflow(int c = EOF);
+    virtual int underflow();
+    virtual int sync();
+
+    public:
+    /* constructor */
+    BgzfStreamBuf():
+        fBgzf(NULL),
+        fIsWrite(false) {
+    }
+
+    /* destructor */
+    virtual ~BgzfStreamBuf() {
+        close();
+    }
+
+    /* open the file with numThreads compression threads, returning NULL on
+     * error */
+    BgzfStreamBuf* open(const string& fileName,
+                        ios_base::openmode ioMode,
+                        int numThreads);
+
+    /* close the file, returning NULL on error */
+    BgzfStreamBuf* close();
+
+    /* is the file open? */
+    bool isOpen() const {
+        return fBgzf != NULL;
+    }
+
+    /* Check if a file starts with a BGZF block header.  Return false if
+     * it is not, can't be opened, or is not a regular file. */
+    static bool isBgzfFile(const string& fileName);
+};
+
+#endif
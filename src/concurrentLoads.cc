@@ -0,0 +1,57 @@
+/*
+ * Run independent loading tasks concurrently.
+ */
+#include "concurrentLoads.hh"
+#include "runStats.hh"
+
+/* destructor, waits for any running tasks */
+ConcurrentLoads::~ConcurrentLoads() {
+    join();
+}
+
+/* run a task in a thread, saving any exception */
+void ConcurrentLoads::runTask(const string& phaseName,
+                              function<void()> task,
+                              std::exception_ptr* error) {
+    try {
+        PhaseTimer taskTimer(phaseName, true);
+        task();
+    } catch (...) {
+        *error = std::current_exception();
+    }
+}
+
+/* join all threads and free errors */
+void ConcurrentLoads::join() {
+    for (size_t i = 0; i < fThreads.size(); i++) {
+        fThreads[i].join();
+    }
+    fThreads.clear();
+    for (size_t i = 0; i < fErrors.size(); i++) {
+        delete fErrors[i];
+    }
+    fErrors.clear();
+}
+
+/* start a task */
+void ConcurrentLoads::add(const string& phaseName,
+                          function<void()> task) {
+    fErrors.push_back(new std::exception_ptr());
+    fThreads.push_back(std::thread(runTask, phaseName, task, fErrors.back()));
+}
+
+/* wait for all tasks to finish */
+void ConcurrentLoads::wait() {
+    for (size_t i = 0; i < fThreads.size(); i++) {
+        fThreads[i].join();
+    }
+    fThreads.clear();
+    std::exception_ptr error;
+    for (size_t i = 0; (i < fErrors.size()) and (not error); i++) {
+        error = *fErrors[i];
+    }
+    join();
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
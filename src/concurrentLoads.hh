@@ -0,0 +1,43 @@
+/*
+ * Run independent loading tasks concurrently.
+ */
+#ifndef concurrentLoads_hh
+#define concurrentLoads_hh
+#include <string>
+#include <vector>
+#include <functional>
+#include <thread>
+#include <exception>
+using namespace std;
+
+/*
+ * Run each added task on its own thread, such as loading independent input
+ * files, with wait() acting as a barrier.  Used for I/O and parse bound
+ * loads, so there is no limit on the number of threads.  Each task is timed
+ * as a phase of the given name.  The first exception thrown by a task is
+ * rethrown by wait() after all tasks have finished.
+ */
+class ConcurrentLoads {
+    private:
+    vector<std::thread> fThreads;
+    vector<std::exception_ptr*> fErrors;  // indexed by task; allocated so threads never see a resize
+
+    static void runTask(const string& phaseName,
+                        function<void()> task,
+                        std::exception_ptr* error);
+    void join();
+
+    public:
+    /* destructor, waits for any running tasks */
+    ~ConcurrentLoads();
+
+    /* start a task */
+    void add(const string& phaseName,
+             function<void()> task);
+
+    /* wait for all tasks to finish, rethrowing the first error in the
+     * order the tasks were added */
+    void wait();
+};
+
+#endif
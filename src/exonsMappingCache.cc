@@ -0,0 +1,184 @@
+/*
+ * Persistent cache of the genomic mappings of transcript exons.
+ */
+#include "exonsMappingCache.hh"
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+/* file starts with a header line of:
+ *   #exonsMappingCache v1 alignFileSize alignFileMTime swapMap
+ * followed by an entry for each exons PSL:
+ *   >numMapped srcPslColumns
+ *   mappedPsl
+ *   ...
+ * All query names are empty. */
+static const string cacheHeaderPrefix = "#exonsMappingCache\tv1\t";
+static const int pslNumCols = 21;
+
+/* constructor, loads the cache file if it exists and is current for
+ * the alignment file */
+ExonsMappingCache::ExonsMappingCache(const string& cacheFile,
+                                     const string& alignFile,
+                                     bool swapMap):
+    fCacheFile(cacheFile),
+    fAlignFile(alignFile),
+    fSwapMap(swapMap),
+    fModified(false) {
+    load();
+}
+
+/* destructor */
+ExonsMappingCache::~ExonsMappingCache() {
+    for (EntryMap::iterator it = fEntries.begin(); it != fEntries.end(); it++) {
+        it->second.free();
+    }
+}
+
+/* get the part of the header identifying the alignment file */
+string ExonsMappingCache::getAlignFileKey() const {
+    struct stat st;
+    if (stat(fAlignFile.c_str(), &st) < 0) {
+        throw ios_base::failure("can't stat \"" + fAlignFile + "\": " + strerror(errno));
+    }
+    return to_string(st.st_size) + "\t" + to_string(st.st_mtime) + "\t" + toString(fSwapMap);
+}
+
+/* make the key for a source PSL, which excludes the query name */
+string ExonsMappingCache::makeKey(const struct psl* srcPsl) {
+    static char noName[] = "";
+    struct psl keyPsl = *srcPsl;
+    keyPsl.qName = noName;
+    return pslToString(&keyPsl);
+}
+
+/* parse a PSL line, modifying the line */
+struct psl* ExonsMappingCache::parsePsl(string& line) {
+    char* row[pslNumCols];
+    int numCols = 0;
+    char* col = &(line[0]);
+    while (true) {
+        if (numCols == pslNumCols) {
+            numCols++;  // too many
+            break;
+        }
+        row[numCols++] = col;
+        char* tab = strchr(col, '\t');
+        if (tab == NULL) {
+            break;
+        }
+        *tab = '\0';
+        col = tab + 1;
+    }
+    if (numCols != pslNumCols) {
+        throw invalid_argument("invalid PSL in exons mapping cache");
+    }
+    return pslLoad(row);
+}
+
+/* copy a PSL, changing the query name */
+struct psl* ExonsMappingCache::cloneWithQName(const struct psl* psl,
+                                              const char* qName) {
+    struct psl* newPsl = pslClone(const_cast<struct psl*>(psl));
+    freeMem(newPsl->qName);
+    newPsl->qName = cloneString(qName);
+    return newPsl;
+}
+
+/* load the cache file if it exists and is current for the alignment file */
+void ExonsMappingCache::load() {
+    ifstream fh(fCacheFile.c_str());
+    if (not fh.is_open()) {
+        return;  // no cache yet
+    }
+    string line;
+    if ((not getline(fh, line)) or (line != cacheHeaderPrefix + getAlignFileKey())) {
+        return;  // out of date, will be replaced
+    }
+    try {
+        while (getline(fh, line)) {
+            if ((line.size() < 2) or (line[0] != '>')) {
+                throw invalid_argument("expected entry header");
+            }
+            size_t itab = line.find('\t');
+            if (itab == string::npos) {
+                throw invalid_argument("invalid entry header");
+            }
+            int numMapped = stringToInt(line.substr(1, itab - 1));
+            PslVector& mappedPsls = fEntries[line.substr(itab + 1)];
+            for (int i = 0; i < numMapped; i++) {
+                if (not getline(fh, line)) {
+                    throw invalid_argument("truncated entry");
+                }
+                mappedPsls.push_back(parsePsl(line));
+            }
+        }
+    } catch (const exception& ex) {
+        throw invalid_argument("corrupt exons mapping cache \"" + fCacheFile + "\": " + ex.what());
+    }
+}
+
+/* Get a copy of the cached mapped PSLs for srcPsl, with the query name
+ * of srcPsl.  Return false if not cached. */
+bool ExonsMappingCache::get(const struct psl* srcPsl,
+                            PslVector& mappedPsls) const {
+    string key = makeKey(srcPsl);
+    lock_guard<mutex> lock(fMutex);
+    EntryMap::const_iterator it = fEntries.find(key);
+    if (it == fEntries.end()) {
+        return false;
+    }
+    for (size_t i = 0; i < it->second.size(); i++) {
+        mappedPsls.push_back(cloneWithQName(it->second[i], srcPsl->qName));
+    }
+    return true;
+}
+
+/* add the mapped PSLs for srcPsl to the cache, copying them */
+void ExonsMappingCache::add(const struct psl* srcPsl,
+                            const PslVector& mappedPsls) {
+    string key = makeKey(srcPsl);
+    lock_guard<mutex> lock(fMutex);
+    if (fEntries.find(key) == fEntries.end()) {
+        PslVector& entryPsls = fEntries[key];
+        for (size_t i = 0; i < mappedPsls.size(); i++) {
+            entryPsls.push_back(cloneWithQName(mappedPsls[i], ""));
+        }
+        fModified = true;
+    }
+}
+
+/* write the cache file if there are new entries. It is written to a
+ * temporary file then renamed, so that a partial cache is never seen */
+void ExonsMappingCache::write() {
+    lock_guard<mutex> lock(fMutex);
+    if (not fModified) {
+        return;
+    }
+    string tmpCacheFile = fCacheFile + ".tmp." + toString(getpid());
+    ofstream fh(tmpCacheFile.c_str());
+    if (not fh.is_open()) {
+        throw ios_base::failure("can't open exons mapping cache \"" + tmpCacheFile + "\" for write access: " + strerror(errno));
+    }
+    fh << cacheHeaderPrefix << getAlignFileKey() << "\n";
+    for (EntryMap::const_iterator it = fEntries.begin(); it != fEntries.end(); it++) {
+        fh << '>' << it->second.size() << '\t' << it->first << "\n";
+        for (size_t i = 0; i < it->second.size(); i++) {
+            fh << pslToString(it->second[i]) << "\n";
+        }
+    }
+    fh.close();
+    if (fh.fail()) {
+        unlink(tmpCacheFile.c_str());
+        throw ios_base::failure("error writing exons mapping cache \"" + tmpCacheFile + "\"");
+    }
+    if (rename(tmpCacheFile.c_str(), fCacheFile.c_str()) < 0) {
+        unlink(tmpCacheFile.c_str());
+        throw ios_base::failure("can't rename \"" + tmpCacheFile + "\" to \"" + fCacheFile + "\": " + strerror(errno));
+    }
+    fModified = false;
+}
@@ -0,0 +1,64 @@
+/*
+ * Persistent cache of the genomic mappings of transcript exons.
+ */
+#ifndef exonsMappingCache_hh
+#define exonsMappingCache_hh
+#include <string>
+#include <unordered_map>
+#include <mutex>
+#include "pslOps.hh"
+using namespace std;
+
+/*
+ * Cache of the results of mapping the exons of transcripts through the
+ * genomic mapping alignments, saved in a file between runs.  This allows
+ * repeated runs of the same annotations with different options to skip
+ * the genomic projection.  Entries are keyed by the exons PSL excluding
+ * the query name, so they are independent of the transcript id.  The
+ * mapped PSLs are stored before selection of the best mapping, which
+ * depends on the options.  The size and modification time of the
+ * alignment file and the swap flag are recorded in the cache and it is
+ * discarded if they don't match.  Access is thread-safe.
+ */
+class ExonsMappingCache {
+    private:
+    typedef unordered_map<string, PslVector> EntryMap;
+
+    const string fCacheFile;
+    const string fAlignFile;
+    const bool fSwapMap;
+    EntryMap fEntries;   // owns the PSLs, which have empty query names
+    bool fModified;      // new entries need to be written
+    mutable mutex fMutex;
+
+    string getAlignFileKey() const;
+    static string makeKey(const struct psl* srcPsl);
+    static struct psl* parsePsl(string& line);
+    static struct psl* cloneWithQName(const struct psl* psl,
+                                      const char* qName);
+    void load();
+
+    public:
+    /* constructor, loads the cache file if it exists and is current for
+     * the alignment file */
+    ExonsMappingCache(const string& cacheFile,
+                      const string& alignFile,
+                      bool swapMap);
+
+    /* destructor */
+    ~ExonsMappingCache();
+
+    /* Get a copy of the cached mapped PSLs for srcPsl, with the query name
+     * of srcPsl.  Return false if not cached. */
+    bool get(const struct psl* srcPsl,
+             PslVector& mappedPsls) const;
+
+    /* add the mapped PSLs for srcPsl to the cache, copying them */
+    void add(const struct psl* srcPsl,
+             const PslVector& mappedPsls);
+
+    /* write the cache file if there are new entries */
+    void write();
+};
+
+#endif
@@ -0,0 +1,100 @@
+/*
+ * Hash index of features by base id or name.
+ */
+#include "featureIdIndex.hh"
+#include <stdint.h>
+#include <algorithm>
+
+/* constructor */
+FeatureIdIndex::FeatureIdIndex() {
+    clear();
+}
+
+/* remove all entries */
+void FeatureIdIndex::clear() {
+    Slot emptySlot = {-1, 0};
+    fEntries.clear();
+    fSlots.assign(initialCapacity, emptySlot);
+}
+
+/* FNV-1a hash of the key, with the PAR_Y flag as the low bit */
+size_t FeatureIdIndex::hashKey(const StringView& key,
+                               bool isParY) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < key.size(); i++) {
+        hash = (hash ^ static_cast<unsigned char>(key[i])) * 1099511628211ULL;
+    }
+    return (size_t(hash) << 1) | (isParY ? 1 : 0);
+}
+
+/* get the slot containing a key, or the empty slot where it would be
+ * inserted */
+size_t FeatureIdIndex::findSlot(const StringView& key,
+                                bool isParY,
+                                size_t hash) const {
+    size_t mask = fSlots.size() - 1;
+    // the low bit is the PAR flag, so start with the hashed bits
+    for (size_t iSlot = (hash >> 1) & mask; ; iSlot = (iSlot + 1) & mask) {
+        const Slot& slot = fSlots[iSlot];
+        if ((slot.entryIdx < 0)
+            or ((slot.hash == hash) and keyEquals(fEntries[slot.entryIdx], key, isParY))) {
+            return iSlot;
+        }
+    }
+}
+
+/* double the number of slots and reinsert the entries */
+void FeatureIdIndex::grow() {
+    Slot emptySlot = {-1, 0};
+    vector<Slot> oldSlots(fSlots.size() * 2, emptySlot);
+    fSlots.swap(oldSlots);
+    size_t mask = fSlots.size() - 1;
+    for (size_t i = 0; i < oldSlots.size(); i++) {
+        if (oldSlots[i].entryIdx >= 0) {
+            size_t iSlot = (oldSlots[i].hash >> 1) & mask;
+            while (fSlots[iSlot].entryIdx >= 0) {
+                iSlot = (iSlot + 1) & mask;
+            }
+            fSlots[iSlot] = oldSlots[i];
+        }
+    }
+}
+
+/* add a feature under a key, returning false if there were already
+ * features with the key. */
+bool FeatureIdIndex::add(const StringView& key,
+                         bool isParY,
+                         FeatureNode* feature) {
+    size_t hash = hashKey(key, isParY);
+    size_t iSlot = findSlot(key, isParY, hash);
+    bool isNew = (fSlots[iSlot].entryIdx < 0);
+    if (isNew) {
+        // keep load factor at or below one half
+        if (2 * (fEntries.size() + 1) > fSlots.size()) {
+            grow();
+            iSlot = findSlot(key, isParY, hash);
+        }
+        fSlots[iSlot].entryIdx = fEntries.size();
+        fSlots[iSlot].hash = hash;
+        fEntries.push_back(Entry(key, isParY));
+    }
+    fEntries[fSlots[iSlot].entryIdx].features.push_back(feature);
+    return isNew;
+}
+
+/* print sorted entries for debugging */
+void FeatureIdIndex::dump(ostream& fh) const {
+    vector<pair<string, int> > keys;
+    for (size_t i = 0; i < fEntries.size(); i++) {
+        keys.push_back(make_pair(fEntries[i].key + (fEntries[i].isParY ? GxfFeature::PAR_Y_SUFFIX : ""), i));
+    }
+    sort(keys.begin(), keys.end());
+    for (size_t i = 0; i < keys.size(); i++) {
+        const FeatureNodeVector& features = fEntries[keys[i].second].features;
+        fh << keys[i].first << ":";
+        for (size_t j = 0; j < features.size(); j++) {
+            fh << " " << features[j]->getTypeId();
+        }
+        fh << endl;
+    }
+}
@@ -0,0 +1,84 @@
+/*
+ * Hash index of features by base id or name.
+ */
+#ifndef featureIdIndex_hh
+#define featureIdIndex_hh
+#include <string.h>
+#include <string>
+#include <vector>
+#include <ostream>
+#include "typeOps.hh"
+#include "featureTree.hh"
+using namespace std;
+
+/*
+ * Open-addressing hash table of features keyed on a base id or name plus the
+ * PAR_Y flag.  Each distinct key is stored once, and the flag is kept as a
+ * separate bit of the key rather than as a suffix, so lookups are done on a
+ * view of the id and don't allocate.  A list of features is kept for each
+ * key, as occasionally ids or names are incorrectly duplicated.  Slots use
+ * linear probing and store the key hash to avoid most key comparisons.
+ * Lookups are thread-safe when no features are being added.
+ */
+class FeatureIdIndex {
+    private:
+    static const size_t initialCapacity = 1024;  // power of two
+
+    /* features with a key */
+    struct Entry {
+        string key;
+        bool isParY;
+        FeatureNodeVector features;
+        Entry(const StringView& key,
+              bool isParY):
+            key(key.toString()), isParY(isParY) {
+        }
+    };
+
+    /* hash table slot, entryIdx is -1 if empty */
+    struct Slot {
+        int entryIdx;
+        size_t hash;
+    };
+
+    vector<Entry> fEntries;  // in order added
+    vector<Slot> fSlots;     // size is a power of two
+
+    static size_t hashKey(const StringView& key,
+                          bool isParY);
+    bool keyEquals(const Entry& entry,
+                   const StringView& key,
+                   bool isParY) const {
+        return (entry.isParY == isParY) and (entry.key.size() == key.size())
+            and (memcmp(entry.key.data(), key.data(), key.size()) == 0);
+    }
+    size_t findSlot(const StringView& key,
+                    bool isParY,
+                    size_t hash) const;
+    void grow();
+
+    public:
+    /* constructor */
+    FeatureIdIndex();
+
+    /* add a feature under a key, returning false if there were already
+     * features with the key. */
+    bool add(const StringView& key,
+             bool isParY,
+             FeatureNode* feature);
+
+    /* get the features with a key, or NULL if none */
+    const FeatureNodeVector* find(const StringView& key,
+                                  bool isParY) const {
+        const Slot& slot = fSlots[findSlot(key, isParY, hashKey(key, isParY))];
+        return (slot.entryIdx < 0) ? NULL : &(fEntries[slot.entryIdx].features);
+    }
+
+    /* remove all entries */
+    void clear();
+
+    /* print sorted entries for debugging */
+    void dump(ostream& fh) const;
+};
+
+#endif
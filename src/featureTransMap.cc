@@ -5,6 +5,8 @@
 #include "featureTree.hh"
 #include "pslOps.hh"
 #include "pslMapping.hh"
+#include "exonsMappingCache.hh"
+#include <string.h>
 
 /**
  * Check assumption of feature order being increasing on positive strand and
@@ -12,7 +14,7 @@
  */
 bool FeaturesToPsl::checkFeatureOrder(const FeatureNodeVector& features) {
     for (int iFeat = 1; iFeat < features.size(); iFeat++) {
-        if (features[0]->getStrand() == "+") {
+        if (features[0]->getStrandChar() == '+') {
             if (features[iFeat]->getStart() <= features[iFeat-1]->getEnd()) {
                 return false;
             }
@@ -54,9 +56,9 @@ struct psl* FeaturesToPsl::makeFeaturesPsl(const string& qName,
                                            const FeatureNodeVector& features) {
     char strand[3] = {'+', features[0]->getStrand()[0], '\0'};
 
-    struct psl* psl = pslNew(toCharStr(qName), qSize, 0, qSize,
-                             toCharStr(features[0]->getSeqid()), tSize, tStart, tEnd,
-                             strand, features.size(), 0);
+    struct psl* psl = pslCompactNew(qName.c_str(), qSize, 0, qSize,
+                                    features[0]->getSeqid().c_str(), tSize, tStart, tEnd,
+                                    strand, features.size());
     makePslBlocks(psl, features);
     if (pslCheck(toCharStr("converted GxF"), stderr, psl) > 0) {
         throw invalid_argument("invalid PSL created: " + pslToString(psl));
@@ -75,7 +77,7 @@ struct psl* FeaturesToPsl::toPsl(const string& qName,
     }
     int qSize = sumFeatureSizes(features);
     int tStart, tEnd;
-    if (features[0]->getStrand() == "+") {
+    if (features[0]->getStrandChar() == '+') {
         tStart = features[0]->getStart()-1;
         tEnd = features[features.size()-1]->getEnd();
     } else {
@@ -138,3 +140,102 @@ PslMapping* FeatureTransMap::mapFeature(const string& qName,
     features.push_back(const_cast<FeatureNode*>(feature));
     return mapFeatures(qName, features);
 }
+
+/* Map multiple sets of features with one pass over the alignments of the
+ * first TransMap. */
+void FeatureTransMap::mapFeatureSets(const StringVector& qNames,
+                                     const vector<FeatureNodeVector>& featureSets,
+                                     vector<PslMapping*>& mappings,
+                                     ExonsMappingCache* cache,
+                                     bool keepPruned) const {
+    mappings.assign(featureSets.size(), NULL);
+    PslVector srcPsls;
+    vector<int> srcIdxs;
+    for (int i = 0; i < featureSets.size(); i++) {
+        const FeatureNodeVector& features = featureSets[i];
+        if (fTransMaps[0]->haveQuerySeq(features[0]->getSeqid())) {
+            int tSize = fTransMaps[0]->getQuerySeqSize(features[0]->getSeqid()); // target is mapping query
+            struct psl* srcPsl = FeaturesToPsl::toPsl(qNames[i], tSize, features);
+            PslVector cachedPsls;
+            if ((cache != NULL) and cache->get(srcPsl, cachedPsls)) {
+                mappings[i] = new PslMapping(srcPsl, cachedPsls);
+            } else {
+                srcPsls.push_back(srcPsl);
+                srcIdxs.push_back(i);
+            }
+        }
+    }
+
+    vector<PslVector> firstMappedPsls, firstPrunedPsls;
+    fTransMaps[0]->mapPsls(srcPsls, firstMappedPsls, (keepPruned ? &firstPrunedPsls : NULL));
+    for (int j = 0; j < srcPsls.size(); j++) {
+        PslVector mappedPsls;
+        if (fTransMaps.size() == 1) {
+            mappedPsls = firstMappedPsls[j];
+        } else {
+            mapPslVector(firstMappedPsls[j], 1, mappedPsls);
+            firstMappedPsls[j].free();
+        }
+        if (cache != NULL) {
+            cache->add(srcPsls[j], mappedPsls);
+        }
+        mappings[srcIdxs[j]] = new PslMapping(srcPsls[j], mappedPsls);
+        if (keepPruned) {
+            PslVector prunedPsls;
+            if (fTransMaps.size() == 1) {
+                prunedPsls = firstPrunedPsls[j];
+            } else {
+                mapPslVector(firstPrunedPsls[j], 1, prunedPsls);
+                firstPrunedPsls[j].free();
+            }
+            mappings[srcIdxs[j]]->setPrunedPsls(prunedPsls);
+        }
+    }
+}
+
+/* constructor, exonsMapping must outlive this object */
+ViaExonsFeatureTransMap::ViaExonsFeatureTransMap(const PslMapping* exonsMapping):
+    fGenomeToExonsPsl(pslCompactClone(exonsMapping->getSrcPsl())),
+    fExonsToGenomePsl(exonsMapping->getMappedPsl()) {
+    pslSwap(fGenomeToExonsPsl, FALSE);
+}
+
+/* destructor */
+ViaExonsFeatureTransMap::~ViaExonsFeatureTransMap() {
+    pslCompactFree(&fGenomeToExonsPsl);
+}
+
+/* does the target of an input PSL overlap the query of a mapping PSL */
+bool ViaExonsFeatureTransMap::pslOverlaps(const struct psl* inPsl,
+                                          const struct psl* mapPsl) {
+    return (strcmp(inPsl->tName, mapPsl->qName) == 0)
+        and (inPsl->tStart < mapPsl->qEnd) and (mapPsl->qStart < inPsl->tEnd);
+}
+
+/* map a PSL through one alignment, if it overlaps */
+void ViaExonsFeatureTransMap::mapThrough(struct psl* inPsl,
+                                         struct psl* mapPsl,
+                                         PslVector& mappedPsls) {
+    if (pslOverlaps(inPsl, mapPsl)) {
+        TransMap::mapPslPair(inPsl, mapPsl, mappedPsls);
+    }
+}
+
+/* map a single feature, NULL if it's not on the source sequence */
+PslMapping* ViaExonsFeatureTransMap::mapFeature(const string& qName,
+                                                const FeatureNode* feature) const {
+    if (feature->getSeqid() != fGenomeToExonsPsl->qName) {
+        return NULL;
+    }
+    FeatureNodeVector features;
+    features.push_back(const_cast<FeatureNode*>(feature));
+    struct psl* srcPsl = FeaturesToPsl::toPsl(qName, fGenomeToExonsPsl->qSize, features);
+    PslVector exonsPsls;
+    mapThrough(srcPsl, fGenomeToExonsPsl, exonsPsls);
+    PslVector mappedPsls;
+    for (int i = 0; i < exonsPsls.size(); i++) {
+        mapThrough(exonsPsls[i], fExonsToGenomePsl, mappedPsls);
+    }
+    exonsPsls.free();
+    return new PslMapping(srcPsl, mappedPsls);
+}
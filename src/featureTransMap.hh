@@ -7,6 +7,7 @@
 #include "featureTree.hh"
 struct psl;
 class PslMapping;
+class ExonsMappingCache;
 
 /* conversion of a list of features to a PSL */
 class FeaturesToPsl {
@@ -19,8 +20,8 @@ class FeaturesToPsl {
                                        int qSize, int tStart, int tEnd, int tSize,
                                        const FeatureNodeVector& features);
     public:
-    /* create a psl from a list of features. Assumes features are sorter in
-     * ascending order.  */
+    /* create a compact psl from a list of features. Assumes features are
+     * sorter in ascending order.  */
     static struct psl* toPsl(const string& qName,
                              int tSize,
                              const FeatureNodeVector& features);
@@ -68,8 +69,49 @@ class FeatureTransMap {
     PslMapping* mapFeature(const string& qName,
                            const FeatureNode* feature) const;
 
+    /* Map multiple sets of features, such as the exons of each transcript
+     * of a gene, with one pass over the alignments of the first TransMap.
+     * The mapping of each set is returned in mappings in the same order, or
+     * NULL if its sequence isn't in the mapping alignments.  If cache is not
+     * NULL, cached results are used and new results are added to it.  If
+     * keepPruned is set, the mappings through the alignments dropped by the
+     * mapping candidate limit are also saved in the mappings, to be written
+     * with the others. */
+    void mapFeatureSets(const StringVector& qNames,
+                        const vector<FeatureNodeVector>& featureSets,
+                        vector<PslMapping*>& mappings,
+                        ExonsMappingCache* cache = NULL,
+                        bool keepPruned = false) const;
+
 };
 
+/*
+ * Two-level mapping of the features of a transcript through the alignments
+ * of its exons: [genomeA->exonsA] => [exonsA->genomeB].  This projects
+ * directly through the alignment pair, rather than building a TransMap for
+ * each transcript.
+ */
+class ViaExonsFeatureTransMap {
+    private:
+    struct psl* fGenomeToExonsPsl;   // swapped exons source PSL (owned)
+    struct psl* fExonsToGenomePsl;   // exons mapped PSL (not owned)
+
+    static bool pslOverlaps(const struct psl* inPsl,
+                            const struct psl* mapPsl);
+    static void mapThrough(struct psl* inPsl,
+                           struct psl* mapPsl,
+                           PslVector& mappedPsls);
+
+    public:
+    /* constructor, exonsMapping must outlive this object */
+    ViaExonsFeatureTransMap(const PslMapping* exonsMapping);
+
+    /* destructor */
+    ~ViaExonsFeatureTransMap();
 
+    /* map a single feature, NULL if it's not on the source sequence */
+    PslMapping* mapFeature(const string& qName,
+                           const FeatureNode* feature) const;
+};
 
 #endif
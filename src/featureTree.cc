@@ -374,7 +374,7 @@ void FeatureNode::dump(ostream& fh) const {
 }
 
 /* compare chrom names to emulate GENCODE sorting */
-static bool chromLessThan(const string& a, const string& b) {
+bool chromLessThan(const string& a, const string& b) {
     // chrom vs non-chrom; ucsc names have chr_accession, so check for that too
     bool aIsChr = (a.find("chr") == 0) or (a.find("_") == string::npos);
     bool bIsChr = (b.find("chr") == 0) or (b.find("_") == string::npos);
@@ -502,7 +502,7 @@ bool GeneTree::loadGeneRecord(GxfParser *gxfParser,
         return true;
     } else {
         GxfFeature* feature = dynamic_cast<GxfFeature*>(gxfRecord);
-        if (feature->getType() == GxfFeature::GENE) {
+        if (feature->getTypeCode() == GXF_GENE_TYPE) {
             queuedRecords.push_back(gxfRecord); // next gene
             return false;
         } else {
@@ -544,7 +544,7 @@ void GeneTree::fixGxfAnnotations(FeatureNode* geneTreeRoot) {
  */
 FeatureNode* GeneTree::loadGene(GxfParser *gxfParser,
                                 GxfFeature* geneFeature) {
-    assert(geneFeature->getType() == GxfFeature::GENE);
+    assert(geneFeature->getTypeCode() == GXF_GENE_TYPE);
 
     FeatureNode* geneTreeRoot = new FeatureNode(geneFeature);
     FeatureNode* geneTreeLeaf = geneTreeRoot;  // were we are currently working
@@ -8,6 +8,7 @@
 #include "gxf.hh"
 #include <ostream>
 #include "remapStatus.hh"
+#include "objectPool.hh"
 
 
 // FIXME: add the substituted target stuff caused this to step into hacky
@@ -31,6 +32,9 @@ extern const string REMAP_TARGET_STATUS_ATTR;
 * able to map gene. Value version   */
 extern const string REMAP_SUBSTITUTED_MISSING_TARGET_ATTR;
 
+/* compare chrom names to emulate GENCODE sorting */
+bool chromLessThan(const string& a, const string& b);
+
 class FeatureNode;
 /* Vector of Feature objects */
 class FeatureNodeVector: public vector<FeatureNode*> {
@@ -95,6 +99,15 @@ class FeatureNode {
         }
     }
 
+    /* allocate nodes from a pool */
+    static void* operator new(size_t size) {
+        return ObjectPool<sizeof(FeatureNode)>::alloc(size);
+    }
+    static void operator delete(void* ptr,
+                                size_t size) {
+        ObjectPool<sizeof(FeatureNode)>::release(ptr, size);
+    }
+
     /* accessors */
     FeatureNode* getParent() {
         return fParent;
@@ -146,6 +159,9 @@ class FeatureNode {
     const string& getType() const {
         return fFeature->getType();
     }
+    GxfTypeCode getTypeCode() const {
+        return fFeature->getTypeCode();
+    }
     int getStart() const {
         return fFeature->getStart();
     }
@@ -165,6 +181,10 @@ class FeatureNode {
     const string& getStrand() const {
         return fFeature->getStrand();
     }
+    /* get the strand as a character */
+    char getStrandChar() const {
+        return fFeature->getStrandChar();
+    }
     const string& getPhase() const {
         return fFeature->getPhase();
     }
@@ -225,17 +245,17 @@ class FeatureNode {
     
     /* is this a gene? */
     bool isGene() const {
-        return (fFeature->getType() == GxfFeature::GENE);
+        return (fFeature->getTypeCode() == GXF_GENE_TYPE);
     }
 
     /* is this a transcript? */
     bool isTranscript() const {
-        return (fFeature->getType() == GxfFeature::TRANSCRIPT);
+        return (fFeature->getTypeCode() == GXF_TRANSCRIPT_TYPE);
     }
 
     /* is this an exon? */
     bool isExon() const {
-        return (fFeature->getType() == GxfFeature::EXON);
+        return (fFeature->getTypeCode() == GXF_EXON_TYPE);
     }
 
     /* is this a gene or transcript */
@@ -537,6 +557,13 @@ class ResultFeatureTrees {
 /* vector of mapped resulting feature */
 class ResultFeatureTreesVector: public vector<ResultFeatureTrees> {
     public:
+    /* free all trees and clear vector */
+    void free() {
+        for (int i = 0; i < size(); i++) {
+            ((*this)[i]).free();
+        }
+        clear();
+    }
     bool haveMapped() const {
         for (int i = 0; i < size(); i++) {
             if (((*this)[i]).mapped != NULL) {
@@ -654,6 +681,15 @@ static inline string getBaseId(const string& id) {
     return baseId;
 }
 
+/* Get a view of the base id, without the version, if it exists.  The view
+ * references id.
+ */
+static inline StringView getBaseIdView(const string& id) {
+    assert(not (stringStartsWith(id, "ENSGR") or stringStartsWith(id, "ENSTR")));
+    size_t idot = id.find_last_of('.');
+    return StringView(id.data(), (idot == string::npos) ? id.size() : idot);
+}
+
 /* 
  * Get the id with mapping version (_N) removed, if it exists.
  */
@@ -4,6 +4,7 @@
 #include "featureTreePolish.hh"
 #include <stdexcept>
 #include <algorithm>
+#include <list>
 #include "annotationSet.hh"
 #include <iostream>
 #include "frame.hh"
@@ -18,29 +19,6 @@ static const bool DEBUG = false;
  */
 static const int maxCloseGapSize = 6;
 
-/* node, feature and index in transcript */
-class NodeIndex {
-    public:
-    FeatureNode* feat;
-    int idx;
-
-    NodeIndex(FeatureNode* feature,
-              int idx):
-        feat(feature), idx(idx) {
-    }
-
-    NodeIndex():
-        feat(NULL), idx(-1) {
-    }
-
-    bool isNull() const {
-        return feat == NULL;
-    }
-};
-
-typedef vector<NodeIndex> NodeIndexVector;
-
-
 /* sort features in all transcripts */
 static void sortGeneContaining(FeatureNode* gene) {
     for (int i = 0; i < gene->getNumChildren(); i++) {
@@ -59,60 +37,10 @@ static void setExonNumber(FeatureNode *feature, int exonNum) {
     feature->getAttrs().update(AttrVal(GxfFeature::EXON_NUMBER_ATTR, toString(exonNum)));
 }
 
-/* next exon feature index, starting at position */
-static NodeIndex getNextExon(FeatureNode* transcript,
-                             int iFeat) {
-    // assumes exons are in order
-    for (int jFeat = iFeat; jFeat < transcript->getNumChildren(); jFeat++) {
-        if (transcript->getChild(jFeat)->getType() == GxfFeature::EXON) {
-            return NodeIndex(transcript->getChild(jFeat), jFeat);
-        }
-    }
-    return NodeIndex();
-}
-
-/* Make sure features is after the exon in the transcript array, as this
- * ordering is counted on by where the merged features get inserted. */
-static void ensureFeatureOrder(const NodeIndex& exon,
-                               int iFeat) {
-    if (iFeat < exon.idx) {
-        throw logic_error("ensureFeatureOrder: feature order is not as expected");
-    }
-}
-
-/* CDS feature index overlapping exon  */
-static NodeIndex getOverlappingCds(FeatureNode* transcript,
-                                   const NodeIndex& exon) {
-    // assumes CDS are after exon, but doesn't insist on immediately after
-    for (int iFeat = exon.idx + 1; iFeat < transcript->getNumChildren(); iFeat++) {
-        if ((transcript->getChild(iFeat)->getType() == GxfFeature::CDS)
-            and (transcript->getChild(iFeat)->overlaps(exon.feat))) {
-            ensureFeatureOrder(exon, iFeat);
-            return NodeIndex(transcript->getChild(iFeat), iFeat);
-        }
-    }
-    return NodeIndex();
-}
-
-/*  features overlapping exon, including CDS. */
-static NodeIndexVector getExonOverlapping(FeatureNode* transcript,
-                                          const NodeIndex& exon) {
-    // assumes overlap are after exon, but doesn't insist on immediately after
-    NodeIndexVector feats;
-    for (int iFeat = exon.idx + 1; iFeat < transcript->getNumChildren(); iFeat++) {
-        if ((transcript->getChild(iFeat)->getType() != GxfFeature::EXON)
-            and (transcript->getChild(iFeat)->overlaps(exon.feat))) {
-            ensureFeatureOrder(exon, iFeat);
-            feats.push_back(NodeIndex(transcript->getChild(iFeat), iFeat));
-        }
-    }
-    return feats;
-}
-
 /* Merge two feature records */
 static string getMergePhase(FeatureNode* feature1, FeatureNode* feature2) {
    if (feature1->getPhase() != ".") {
-        if (feature1->getStrand() == "+") {
+        if (feature1->getStrandChar() == '+') {
             return feature1->getPhase();
         } else {
             return feature2->getPhase();
@@ -149,177 +77,263 @@ static FeatureNode* mergeFeatureRecs(FeatureNode* transcript,
     return mkMergeNode(transcript, newFeature, feature1);
 }
 
-/* find feature of specified type or -1 */
-static int findOverType(const string& featType,
-                        NodeIndexVector& overs,
-                        int startIdx = 0) {
-    for (int i = 0; i < overs.size(); i++) {
-        if (overs[i].feat->getType() == featType) {
-            return i;
+/*
+ * Merging of the gaps in the exons of one transcript.  The children are
+ * copied to a list, so the edits of a merge don't shift them, and the
+ * scan positions are iterators into it.
+ *
+ * The scan reproduces the results of the original index-based scan over
+ * the children.  After a merge, the merged exon was inserted after the
+ * exon following it and the scan continued with the merged exon.  Thus
+ * of a run of more than two exon fragments, only the first two merge, and
+ * an exon with no other features stops the next pair from being checked.
+ * The mapped annotations depend on these decisions, so they are kept.
+ * The prefix is the nodes before the first exon being merged, which are
+ * not changed by the merge.
+ */
+class TranscriptGapMerger {
+    private:
+    typedef list<FeatureNode*> FeatureNodeList;
+    typedef FeatureNodeList::iterator NodeIter;
+    typedef vector<NodeIter> NodeIterVector;
+
+    FeatureNode* fTranscript;
+    FeatureNodeList fNodes;
+    NodeIter fScan;           // where the next exon is searched for
+    NodeIter fPrefixEnd;      // end of nodes in fPrefixMaxStart0
+    int fPrefixMaxStart0;     // max start of nodes before fPrefixEnd
+
+    /* reset computation of the prefix maximum start */
+    void resetPrefix() {
+        fPrefixEnd = fNodes.begin();
+        fPrefixMaxStart0 = -1;
+    }
+
+    /* extend the prefix maximum start to the nodes before a position */
+    void extendPrefix(NodeIter pos) {
+        for (; fPrefixEnd != pos; ++fPrefixEnd) {
+            fPrefixMaxStart0 = max(fPrefixMaxStart0, (*fPrefixEnd)->getStart0());
         }
     }
-    return -1;
-}
 
-/* merge if possible */
-static FeatureNode* mergeCopyOther(FeatureNode* transcript,
-                                   FeatureNode* feature,
-                                   NodeIndexVector& overs2,
-                                   BoolVector& done2) {
-    int i2 = findOverType(feature->getType(), overs2);
-    if (i2 < 0) {
-        return feature->cloneFeature();
-    } else {
-        FeatureNode* newFeat = mergeFeatureRecs(transcript, feature, overs2[i2].feat);
-        done2[i2] = true;
-        return newFeat;
+    /* advance a position, stopping at the end */
+    NodeIter advanceNode(NodeIter pos, int count) {
+        for (int i = 0; (i < count) and (pos != fNodes.end()); i++) {
+            ++pos;
+        }
+        return pos;
     }
-}
-
-/* merge or copy overlapping other features */
-static FeatureNodeVector mergeCopyOthers(FeatureNode* transcript,
-                                         int exonNum,
-                                         NodeIndexVector& overs1,
-                                         NodeIndexVector& overs2) {
-    FeatureNodeVector merged;
-    BoolVector done2;
-    done2.resize(overs2.size());
 
-    for (int i1 = 0; i1 < overs1.size(); i1++) {
-        FeatureNode* feat = mergeCopyOther(transcript, overs1[i1].feat, overs2, done2);
-        setExonNumber(feat, exonNum);
-        merged.push_back(feat);
+    /* next exon, starting at position */
+    NodeIter getNextExon(NodeIter pos) {
+        // assumes exons are in order
+        while ((pos != fNodes.end()) and ((*pos)->getTypeCode() != GXF_EXON_TYPE)) {
+            ++pos;
+        }
+        return pos;
     }
 
-    // copy those that haven't been merged
-    for (int i2 = 0; i2 < overs2.size(); i2++) {
-        if (not done2[i2]) {
-            FeatureNode* feat = overs2[i2].feat->cloneFeature();
-            setExonNumber(feat, exonNum);
-            merged.push_back(feat);
+    /* CDS feature following an exon that overlaps it, or end. Features
+     * starting after the exon end the search, as the features that
+     * follow them don't overlap it. */
+    NodeIter getOverlappingCds(NodeIter exon) {
+        for (NodeIter pos = next(exon); (pos != fNodes.end()) and ((*pos)->getStart() <= (*exon)->getEnd()); ++pos) {
+            if (((*pos)->getTypeCode() == GXF_CDS_TYPE) and (*pos)->overlaps(*exon)) {
+                return pos;
+            }
         }
+        return fNodes.end();
     }
-    return merged;
-}
 
-/* clear out nodes that have been replaced */
-static void removeReplacedNodes(FeatureNode* transcript,
-                                NodeIndexVector& overs) {
-    for (int i = 0; i < overs.size(); i++) {
-        delete transcript->removeChild(transcript->getChildIdx(overs[i].feat));
+    /* features following an exon that overlap it, including CDS */
+    NodeIterVector getExonOverlapping(NodeIter exon) {
+        NodeIterVector overs;
+        for (NodeIter pos = next(exon); (pos != fNodes.end()) and ((*pos)->getStart() <= (*exon)->getEnd()); ++pos) {
+            if (((*pos)->getTypeCode() != GXF_EXON_TYPE) and (*pos)->overlaps(*exon)) {
+                overs.push_back(pos);
+            }
+        }
+        return overs;
     }
-}
 
-/* insert or append a node */
-static void insertNode(FeatureNode* transcript,
-                       int iFeat,
-                       FeatureNode* feat) {
-    FeatureNodeVector& children = transcript->getChildren();
-    assert(iFeat <= children.size());
-    if (iFeat >= children.size()) {
-        children.push_back(feat);
-    } else {
-        children.insert(children.begin() + (iFeat + 1), feat);
-    }
-}
-                             
-/* add new nodes at position iFeat */
-static void addNewNodes(FeatureNode* transcript,
-                        int iFeat,
-                        FeatureNode* mergedExon,
-                        FeatureNodeVector& mergedOthers) {
-    insertNode(transcript, iFeat++, mergedExon);
-    for (int i = 0; i < mergedOthers.size(); i++) {
-        insertNode(transcript, iFeat++, mergedOthers[i]);
+    static bool preservesFrame(const FeatureNode* cds1,
+                               const FeatureNode* cds2) {
+        int gapSize = cds2->getStart0() - cds1->getEnd();
+        Frame frame1(Frame::fromPhaseStr(cds1->getPhase()));
+        Frame frame2(Frame::fromPhaseStr(cds2->getPhase()));
+        if (cds1->getStrandChar() == '+') {
+            return frame1.incr(cds1->length() + gapSize) == frame2;
+        } else {
+            return frame2.incr(cds2->length() + gapSize) == frame1;
+        }
     }
-}
 
-/* find the insert point for replaced records after deletions */
-static int findInsertPoint(const FeatureNode* transcript,
-                           const FeatureNode* mergedExon) {
-    const FeatureNodeVector& children = transcript->getChildren();
-    for (int iChild = 0; iChild < children.size(); iChild++) {
-        if (children[iChild]->getStart0() >= mergedExon->getEnd()) {
-            return iChild;
+    /* Check if two exons can be merged */
+    bool canMergeExonRecs(NodeIter exon1,
+                          NodeIter exon2) {
+        if (((*exon2)->getStart0() - (*exon1)->getEnd()) > maxCloseGapSize) {
+            return false;   // gap over threshold
         }
+        NodeIter cds1 = getOverlappingCds(exon1);
+        NodeIter cds2 = getOverlappingCds(exon2);
+        if ((cds1 != fNodes.end()) and (cds2 != fNodes.end())
+            and (not preservesFrame(*cds1, *cds2))) {
+            return false;   // CDS on both sides and not keeping frame
+        }
+        return true;
     }
-    return children.size();
-}
-
-/* Merge two exon records, index in feature array of exon1 stays the same,
- * everything above it might change */
-static void mergeExonRecs(FeatureNode* transcript,
-                          NodeIndex& exon1, NodeIndex& exon2) {
-    // N.B. this recreates records even if they could just moved to keep book
-    // keeping easier, as this is not performance-sensitive.
-    FeatureNode* mergedExon = mergeFeatureRecs(transcript, exon1.feat, exon2.feat);
-
-    // other features
-    NodeIndexVector overs1 = getExonOverlapping(transcript, exon1);
-    NodeIndexVector overs2 = getExonOverlapping(transcript, exon2);
-    FeatureNodeVector mergedOthers = mergeCopyOthers(transcript, getExonNumber(mergedExon),
-                                                     overs1, overs2);
-
-    // delete replaced features
-    delete transcript->removeChild(transcript->getChildIdx(exon1.feat));
-    delete transcript->removeChild(transcript->getChildIdx(exon2.feat));
-    removeReplacedNodes(transcript, overs1);
-    removeReplacedNodes(transcript, overs2);
-    
-    addNewNodes(transcript, findInsertPoint(transcript, mergedExon),
-                mergedExon, mergedOthers);
-}
-
-static bool preservesFrame(NodeIndex& cds1,
-                           NodeIndex& cds2) {
-    int gapSize = cds2.feat->getStart0() - cds1.feat->getEnd();
-    Frame frame1(Frame::fromPhaseStr(cds1.feat->getPhase()));
-    Frame frame2(Frame::fromPhaseStr(cds2.feat->getPhase()));
-    if (cds1.feat->getStrand() == "+") {
-        return frame1.incr(cds1.feat->length() + gapSize) == frame2;
-    } else {
-        return frame2.incr(cds2.feat->length() + gapSize) == frame1;
-    }
-}
 
-/* Check and possible merge two exon */
-static bool canMergeExonRecs(FeatureNode* transcript,
-                             NodeIndex& exon1,
-                             NodeIndex& exon2) {
-    if ((exon2.feat->getStart0() - exon1.feat->getEnd()) > maxCloseGapSize) {
-        return false;   // gap over threshold
+    /* find the first feature of specified type or -1 */
+    static int findOverType(const string& featType,
+                            const NodeIterVector& overs) {
+        for (int i = 0; i < overs.size(); i++) {
+            if ((*overs[i])->getType() == featType) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    /* Merge the other features overlapping two exons with those of the
+     * same type.  Features that are not merged are kept.  Features that
+     * are merged are flagged in replaced1 and replaced2. */
+    FeatureNodeVector mergeOthers(int exonNum,
+                                  const NodeIterVector& overs1,
+                                  const NodeIterVector& overs2,
+                                  BoolVector& replaced1,
+                                  BoolVector& replaced2) {
+        FeatureNodeVector mergedOthers;
+        for (int i1 = 0; i1 < overs1.size(); i1++) {
+            FeatureNode* feat = *overs1[i1];
+            int i2 = findOverType(feat->getType(), overs2);
+            if (i2 >= 0) {
+                feat = mergeFeatureRecs(fTranscript, feat, *overs2[i2]);
+                replaced1[i1] = true;
+                replaced2[i2] = true;
+            }
+            setExonNumber(feat, exonNum);
+            mergedOthers.push_back(feat);
+        }
+        for (int i2 = 0; i2 < overs2.size(); i2++) {
+            if (not replaced2[i2]) {
+                setExonNumber(*overs2[i2], exonNum);
+                mergedOthers.push_back(*overs2[i2]);
+            }
+        }
+        return mergedOthers;
     }
-    NodeIndex cds1 = getOverlappingCds(transcript, exon1);
-    NodeIndex cds2 = getOverlappingCds(transcript, exon2);
-    if ((not cds1.isNull()) and (not cds2.isNull())
-        and (not preservesFrame(cds1, cds2))) {
-        return false;   // CDS on both sides and not keeping frame
+
+    /* remove nodes from the list, freeing the ones that were replaced */
+    void removeNodes(const NodeIterVector& overs,
+                     const BoolVector& replaced) {
+        for (int i = 0; i < overs.size(); i++) {
+            if (replaced[i]) {
+                delete *overs[i];
+            }
+            fNodes.erase(overs[i]);
+        }
     }
-    return true;
-}
 
-/* Merge gaps in exons causes by gaps in alignments. */
-static void mergeTranscriptGaps(FeatureNode* transcript) {
-    int iFeat = 0;
-    bool anyMerged = false;
-    while (true) {
-        NodeIndex exon1 = getNextExon(transcript, iFeat);
-        if (exon1.isNull()) {
-            break;
+    /* find the node the merged features are inserted after, or end */
+    NodeIter findInsertPoint(NodeIter pos,
+                             const FeatureNode* mergedExon) {
+        while ((pos != fNodes.end()) and ((*pos)->getStart0() < mergedExon->getEnd())) {
+            ++pos;
         }
-        iFeat = exon1.idx + 1;
-        NodeIndex exon2 = getNextExon(transcript, iFeat);
-        if (exon2.isNull()) {
-            break;
+        return pos;
+    }
+
+    /* Merge two exon records and set the scan to continue after the
+     * node that takes the place of exon1. */
+    void mergeExonRecs(NodeIter exon1,
+                       NodeIter exon2) {
+        FeatureNode* mergedExon = mergeFeatureRecs(fTranscript, *exon1, *exon2);
+        NodeIterVector overs1 = getExonOverlapping(exon1);
+        NodeIterVector overs2 = getExonOverlapping(exon2);
+        for (int i2 = 0; i2 < overs2.size(); i2++) {
+            if (std::find(overs1.begin(), overs1.end(), overs2[i2]) != overs1.end()) {
+                throw logic_error("mergeExonRecs: feature overlaps both merged exons");
+            }
         }
-        if (canMergeExonRecs(transcript, exon1, exon2)) {
-            mergeExonRecs(transcript, exon1, exon2);
-            anyMerged = true;
+        BoolVector replaced1(overs1.size(), false), replaced2(overs2.size(), false);
+        FeatureNodeVector mergedOthers = mergeOthers(getExonNumber(mergedExon), overs1, overs2,
+                                                     replaced1, replaced2);
+
+        // exon1 and the features replaced all follow the prefix, so the
+        // node taking the place of exon1 is found from the one before it.
+        // The merged features are inserted after the first node starting
+        // after the merged exon.  This is normally at or after that node,
+        // only when it is in the prefix does the scan position need to be
+        // found by index.
+        bool inPrefix = (fPrefixMaxStart0 >= mergedExon->getEnd());
+        int exon1Idx = inPrefix ? distance(fNodes.begin(), exon1) : 0;
+        bool atBegin = (exon1 == fNodes.begin());
+        NodeIter before = atBegin ? fNodes.end() : prev(exon1);
+        delete *exon1;
+        delete *exon2;
+        fNodes.erase(exon1);
+        fNodes.erase(exon2);
+        removeNodes(overs1, replaced1);
+        removeNodes(overs2, replaced2);
+        NodeIter slot = atBegin ? fNodes.begin() : next(before);
+
+        NodeIter insertAfter = findInsertPoint((inPrefix ? fNodes.begin() : slot), mergedExon);
+        NodeIter insertPos = (insertAfter == fNodes.end()) ? insertAfter : next(insertAfter);
+        NodeIter mergedPos = fNodes.insert(insertPos, mergedExon);
+        fNodes.insert(insertPos, mergedOthers.begin(), mergedOthers.end());
+        if (inPrefix) {
+            fScan = advanceNode(fNodes.begin(), exon1Idx + 1);
+            resetPrefix();
         } else {
-            iFeat++;
+            if (slot == fNodes.end()) {
+                slot = mergedPos;  // appended after the prefix
+            }
+            fScan = next(slot);
+            fPrefixEnd = slot;
         }
     }
-    if (anyMerged) {
+
+    public:
+    TranscriptGapMerger(FeatureNode* transcript):
+        fTranscript(transcript),
+        fNodes(transcript->getChildren().begin(), transcript->getChildren().end()) {
+        fScan = fNodes.begin();
+        resetPrefix();
+    }
+
+    /* Merge gaps, return true if any were merged.  The transcript
+     * children are only updated if there were merges. */
+    bool merge() {
+        bool anyMerged = false;
+        while (true) {
+            NodeIter exon1 = getNextExon(fScan);
+            if (exon1 == fNodes.end()) {
+                break;
+            }
+            NodeIter exon2 = getNextExon(next(exon1));
+            if (exon2 == fNodes.end()) {
+                break;
+            }
+            if (canMergeExonRecs(exon1, exon2)) {
+                extendPrefix(exon1);
+                mergeExonRecs(exon1, exon2);
+                anyMerged = true;
+            } else {
+                fScan = advanceNode(exon1, 2);
+            }
+        }
+        if (anyMerged) {
+            FeatureNodeVector& children = fTranscript->getChildren();
+            children.assign(fNodes.begin(), fNodes.end());
+        }
+        return anyMerged;
+    }
+};
+
+/* Merge gaps in exons causes by gaps in alignments. */
+static void mergeTranscriptGaps(FeatureNode* transcript) {
+    TranscriptGapMerger merger(transcript);
+    if (merger.merge()) {
         transcript->getChildren().sortContaining();
     }
 }
@@ -335,7 +349,7 @@ static void mergeGeneGaps(FeatureNode* gene) {
 static void renumberTranscript(FeatureNode* transcript) {
     int exonNum = 0;
     for (int i = 0; i < transcript->getNumChildren(); i++) {
-        if (transcript->getChild(i)->getType() == GxfFeature::EXON) {
+        if (transcript->getChild(i)->getTypeCode() == GXF_EXON_TYPE) {
             exonNum++;
         }
         setExonNumber(transcript->getChild(i), exonNum);
@@ -471,18 +485,20 @@ static bool compareGeneFeatures(const FeatureNode* prevFeature,
     return compareMappedFeatures(prevFeature, newFeature, attrNames, idAttrNames);
 }
 
+/* attributes compared for features of other types (CDS, exon, etc) */
+static const StringVector otherAttrNames = {
+    GxfFeature::EXON_NUMBER_ATTR,
+    GxfFeature::TAG_ATTR
+};
+static const StringVector otherIdAttrNames = {
+    GxfFeature::EXON_ID_ATTR,
+};
+
 /* compare a mapped feature of other types (CDS, exon, etc). with previous
  * mapped features.  This is not recursive */
 static bool compareOtherFeatures(const FeatureNode* prevFeature,
                                              const FeatureNode* newFeature) {
-    static const StringVector attrNames = {
-        GxfFeature::EXON_NUMBER_ATTR,
-        GxfFeature::TAG_ATTR
-    };
-    static const StringVector idAttrNames = {
-        GxfFeature::EXON_ID_ATTR,
-    };
-    return compareMappedFeatures(prevFeature, newFeature, attrNames, idAttrNames);
+    return compareMappedFeatures(prevFeature, newFeature, otherAttrNames, otherIdAttrNames);
 }
 
 /* recursively compare descendant features of a transcript with previous mapped
@@ -512,6 +528,70 @@ static bool compareMappedTranscriptsDescendants(const FeatureNode* prevParent,
     }
 }
 
+/* add a string to a FNV-1a fingerprint, followed by a zero byte so
+ * adjacent fields can't run together */
+static void fingerprintAdd(uint64_t& fingerprint,
+                           const string& str) {
+    for (size_t i = 0; i <= str.size(); i++) {
+        fingerprint = (fingerprint ^ static_cast<unsigned char>(str.c_str()[i])) * 1099511628211ULL;
+    }
+}
+
+/* add an integer to a fingerprint */
+static void fingerprintAdd(uint64_t& fingerprint,
+                           int val) {
+    for (int i = 0; i < 4; i++) {
+        fingerprint = (fingerprint ^ ((val >> (8 * i)) & 0xff)) * 1099511628211ULL;
+    }
+}
+
+/* add attributes to a fingerprint, the same as compared by compareAttrVals */
+static void fingerprintAddAttrs(uint64_t& fingerprint,
+                                const FeatureNode* feature,
+                                const StringVector& attrNames,
+                                bool isIdAttrs) {
+    for (int i = 0; i < attrNames.size(); i++) {
+        const AttrVal* attr = feature->getAttrs().find(attrNames[i]);
+        fingerprintAdd(fingerprint, (attr == NULL) ? -1 : int(attr->getVals().size()));
+        if (attr != NULL) {
+            for (int iVal = 0; iVal < attr->getVals().size(); iVal++) {
+                fingerprintAdd(fingerprint, isIdAttrs ? getPreMappedId(attr->getVal(iVal)) : attr->getVal(iVal));
+            }
+        }
+    }
+}
+
+/* recursively add the descendants of a feature to a fingerprint, covering
+ * everything compared by compareMappedTranscriptsDescendants */
+static void fingerprintAddDescendants(uint64_t& fingerprint,
+                                      const FeatureNode* parent) {
+    fingerprintAdd(fingerprint, int(parent->getNumChildren()));
+    if (parent->getNumChildren() > 0) {
+        FeatureNodeVector children(parent->getChildren());
+        children.sortContaining();
+        for (int i = 0; i < children.size(); i++) {
+            const FeatureNode* child = children[i];
+            fingerprintAdd(fingerprint, child->getSource());
+            fingerprintAdd(fingerprint, child->getStart());
+            fingerprintAdd(fingerprint, child->getEnd());
+            fingerprintAdd(fingerprint, child->getStrand());
+            fingerprintAdd(fingerprint, child->getPhase());
+            fingerprintAddAttrs(fingerprint, child, otherAttrNames, false);
+            fingerprintAddAttrs(fingerprint, child, otherIdAttrNames, true);
+            fingerprintAddDescendants(fingerprint, child);
+        }
+    }
+}
+
+/* Compute a fingerprint of the mapped structure of a transcript, with
+ * mapping versions removed from ids.  Transcripts that are the same by
+ * compareMappedTranscriptsDescendants have the same fingerprint. */
+static uint64_t getTranscriptFingerprint(const FeatureNode* transcript) {
+    uint64_t fingerprint = 14695981039346656037ULL;
+    fingerprintAddDescendants(fingerprint, transcript);
+    return fingerprint;
+}
+
 /* add a mapping version to an id */
 static void setMappingVersionInId(FeatureNode* feature,
                                   const AttrVal* attr,
@@ -555,13 +635,33 @@ const FeatureNode* FeatureTreePolish::getPrevMappedFeature(const FeatureNode* ne
     }
 }
 
+/* get the fingerprint of a previous mapped transcript, computing it on
+ * first use */
+uint64_t FeatureTreePolish::getPrevTranscriptFingerprint(const FeatureNode* prevTranscript) const {
+    PrevFingerprintMap::const_iterator it = fPrevTranscriptFingerprints.find(prevTranscript);
+    if (it != fPrevTranscriptFingerprints.end()) {
+        return it->second;
+    }
+    uint64_t fingerprint = getTranscriptFingerprint(prevTranscript);
+    fPrevTranscriptFingerprints[prevTranscript] = fingerprint;
+    return fingerprint;
+}
+
+/* is a transcript the same as the previous mapping?  Fingerprints are
+ * compared first, with a full comparison only if they match. */
+bool FeatureTreePolish::isSameAsPrevTranscript(const FeatureNode* prevTranscript,
+                                               const FeatureNode* transcript) const {
+    return (getPrevTranscriptFingerprint(prevTranscript) == getTranscriptFingerprint(transcript))
+        and compareMappedTranscriptsDescendants(prevTranscript, transcript);
+}
+
 /* Added mapping version numbers.  Return true if transcript is the same
  * as the previous or new, or false if it has changed */
 bool FeatureTreePolish::setTranscriptMappingVersion(FeatureNode* transcript) const {
     // find previous transcript, if it exists and derive version from it.
     const FeatureNode* prevTranscript = getPrevMappedFeature(transcript);
     bool transcriptSame = (prevTranscript == NULL)
-        or compareMappedTranscriptsDescendants(prevTranscript, transcript);
+        or isSameAsPrevTranscript(prevTranscript, transcript);
     int mappingVersion = getFeatureMappingVersion(prevTranscript, transcriptSame);
   
     recursiveSetMappingVersion(transcript, GxfFeature::TRANSCRIPT_ID_ATTR, GxfFeature::TRANSCRIPT_HAVANA_ATTR, mappingVersion);
@@ -582,16 +682,32 @@ bool FeatureTreePolish::setTranscriptMappingVersion(FeatureNode* transcript) con
     }
 }
 
-/* get the exon mapping version for all exon records.  This is the
- * maximum exon mapping version, or 1 if all exons are passed through.
+/* get the exon mapping version of each pre-mapped exon id of a gene.  This
+ * is the maximum exon mapping version of the exon records with the id, or 1
+ * if they are all passed through.
  */
-static int getExonMappingVersion(FeatureNodeVector& exonFeatures)  {
-    int maxMappingVersion = 1;
-    for (int i = 0; i < exonFeatures.size(); i++) {
-        int mappingVersion = getMappingVersion(exonFeatures[i]->getAttrValue(GxfFeature::EXON_ID_ATTR));
-        maxMappingVersion = max(mappingVersion, maxMappingVersion);
+static void collectExonMappingVersions(const FeatureNode* root,
+                                       FeatureTreePolish::ExonIdVersionMap& exonIdVersionMap) {
+    for (int i = 0; i < root->getNumChildren(); i++) {
+        const FeatureNode* child = root->getChild(i);
+        if (child->isExon()) {
+            const string& exonId = child->getTypeId();
+            int& maxMappingVersion = exonIdVersionMap.insert(make_pair(getPreMappedId(exonId), 1)).first->second;
+            maxMappingVersion = max(getMappingVersion(exonId), maxMappingVersion);
+        }
+        collectExonMappingVersions(child, exonIdVersionMap);
     }
-    return maxMappingVersion;
+}
+
+/* get the exon mapping versions of a previous mapped gene, computing them
+ * on first use */
+const FeatureTreePolish::ExonIdVersionMap& FeatureTreePolish::getPrevExonMappingVersions(const FeatureNode* prevGene) const {
+    PrevExonVersionsMap::iterator it = fPrevExonMappingVersions.find(prevGene);
+    if (it == fPrevExonMappingVersions.end()) {
+        it = fPrevExonMappingVersions.insert(make_pair(prevGene, ExonIdVersionMap())).first;
+        collectExonMappingVersions(prevGene, it->second);
+    }
+    return it->second;
 }
 
 /* Added mapping version numbers to a exon feature */
@@ -604,9 +720,7 @@ static void setExonMappingVersion(FeatureNode* exonFeature,
 /* Added mapping version numbers to a set of exons feeatures with the same id */
 static void setExonMappingVersion(const string& exonId,
                                   FeatureNodeVector& exonFeatures,
-                                  FeatureNodeVector* prevExonFeatures) {
-    int mappingVersion = (prevExonFeatures != NULL)
-        ? getExonMappingVersion(*prevExonFeatures) : 1;
+                                  int mappingVersion) {
     for (int i = 0; i < exonFeatures.size(); i++) {
         if (isRemapped(exonFeatures[i])) {
             setExonMappingVersion(exonFeatures[i], mappingVersion);
@@ -615,18 +729,17 @@ static void setExonMappingVersion(const string& exonId,
 }
 
 /* Added mapping version numbers to all exons */
-static void setExonsMappingVersions(const FeatureNode* prevGene,
-                                    FeatureNode* gene) {
+void FeatureTreePolish::setExonsMappingVersions(const FeatureNode* prevGene,
+                                                FeatureNode* gene) const {
     // exon id scope is gene
-    FeatureTreePolish::ExonIdExonMap prevExonIdExonMap, exonIdExonMap;
-    if (prevGene != NULL) {
-        collectExons(prevGene, prevExonIdExonMap);
-    }
+    static const ExonIdVersionMap noPrevExons;
+    const ExonIdVersionMap& prevExonVersions = (prevGene != NULL) ? getPrevExonMappingVersions(prevGene) : noPrevExons;
+    ExonIdExonMap exonIdExonMap;
     collectExons(gene, exonIdExonMap);
-    for (FeatureTreePolish::ExonIdExonMapIter exonIdIter = exonIdExonMap.begin(); exonIdIter != exonIdExonMap.end(); exonIdIter++) {
-        FeatureTreePolish::ExonIdExonMapIter prevExonIdIter = prevExonIdExonMap.find(exonIdIter->first);
-        FeatureNodeVector* prevExonFeatures = (prevExonIdIter != prevExonIdExonMap.end()) ? &prevExonIdIter->second : NULL;
-        setExonMappingVersion(exonIdIter->first, exonIdIter->second, prevExonFeatures);
+    for (ExonIdExonMapIter exonIdIter = exonIdExonMap.begin(); exonIdIter != exonIdExonMap.end(); exonIdIter++) {
+        ExonIdVersionMap::const_iterator prevIter = prevExonVersions.find(exonIdIter->first);
+        int mappingVersion = (prevIter != prevExonVersions.end()) ? prevIter->second : 1;
+        setExonMappingVersion(exonIdIter->first, exonIdIter->second, mappingVersion);
     }
 }
 
@@ -5,6 +5,7 @@
 #define featureTreePolish_hh
 #include <assert.h>
 #include <map>
+#include <stdint.h>
 #include "featureTree.hh"
 class AnnotationSet;
 
@@ -23,10 +24,26 @@ class FeatureTreePolish {
     typedef ExonIdExonMap::iterator ExonIdExonMapIter;
     typedef ExonIdExonMap::const_iterator ExonIdExonMapConstIter;
 
+    // maximum mapping version of previous exons, by pre-mapped exon id
+    typedef map<string, int> ExonIdVersionMap;
+
     private:
+    typedef map<const FeatureNode*, uint64_t> PrevFingerprintMap;
+    typedef map<const FeatureNode*, ExonIdVersionMap> PrevExonVersionsMap;
+
     const AnnotationSet* fPreviousMappedAnotations; // maybe NULL
+
+    // computed once for each previous mapped transcript or gene used
+    mutable PrevFingerprintMap fPrevTranscriptFingerprints;
+    mutable PrevExonVersionsMap fPrevExonMappingVersions;
     
     const FeatureNode* getPrevMappedFeature(const FeatureNode* newFeature) const;
+    uint64_t getPrevTranscriptFingerprint(const FeatureNode* prevTranscript) const;
+    bool isSameAsPrevTranscript(const FeatureNode* prevTranscript,
+                                const FeatureNode* transcript) const;
+    const ExonIdVersionMap& getPrevExonMappingVersions(const FeatureNode* prevGene) const;
+    void setExonsMappingVersions(const FeatureNode* prevGene,
+                                 FeatureNode* gene) const;
     bool setTranscriptMappingVersion(FeatureNode* transcript) const;
     bool setTranscriptsMappingVersions(FeatureNode* gene) const;
     void setGeneMappingVersion(FeatureNode* gene) const;
@@ -38,7 +55,8 @@ class FeatureTreePolish {
         fPreviousMappedAnotations(previousMappedAnotations) {
     }
     
-    /* last minute fix-ups */
+    /* last minute fix-ups.  Caches information about the previous mapped
+     * genes, so must only be called by one thread at a time. */
     void polishGene(FeatureNode* gene) const;
 };
 
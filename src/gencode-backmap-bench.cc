@@ -0,0 +1,388 @@
+/*
+ * microbenchmarks of the core operations of gencode-backmap.
+ */
+#include <getopt.h>
+#include <algorithm>
+#include <time.h>
+#include <sys/resource.h>
+#include "gxf.hh"
+#include "typeOps.hh"
+#include "FIOStream.hh"
+#include "transMap.hh"
+#include "featureTransMap.hh"
+#include "pslMapping.hh"
+#include "annotationSet.hh"
+#include "featureTreePolish.hh"
+#include "frame.hh"
+#include "globals.hh"
+#include <sstream>
+
+/* get the current monotonic time in seconds */
+static double getNow() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + (now.tv_nsec * 1.0e-9);
+}
+
+/* get the process peak RSS in megabytes */
+static double getPeakRssMb() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) < 0) {
+        return 0.0;
+    }
+    return usage.ru_maxrss / 1024.0;  // kilobytes on Linux
+}
+
+/*
+ * Run benchmarks and write one TSV row of results for each.
+ */
+class BenchRunner {
+    private:
+    int fIterations;
+    FIOStream fOut;
+
+    public:
+    /* constructor, write the header */
+    BenchRunner(int iterations,
+                const string& resultsTsv):
+        fIterations(iterations),
+        fOut(resultsTsv, ios::out) {
+        fOut << "benchmark\titerations\titems\tbestSecs\tmeanSecs\titemsPerSec\tpeakRssMb" << endl;
+        fOut.setf(ios::fixed);
+        fOut.precision(6);
+    }
+
+    /* Run a benchmark function fIterations times.  The function returns the
+     * number of items processed, which must be the same each time. */
+    template<typename Func>
+    void run(const string& name,
+             Func func) {
+        double bestSecs = 0.0, totalSecs = 0.0;
+        long items = 0;
+        for (int i = 0; i < fIterations; i++) {
+            double startTime = getNow();
+            items = func();
+            double secs = getNow() - startTime;
+            bestSecs = (i == 0) ? secs : min(bestSecs, secs);
+            totalSecs += secs;
+        }
+        fOut << name << "\t" << fIterations << "\t" << items << "\t"
+             << bestSecs << "\t" << (totalSecs / fIterations) << "\t"
+             << ((bestSecs > 0.0) ? (items / bestSecs) : 0.0) << "\t"
+             << getPeakRssMb() << endl;
+        if (gVerbose) {
+            cerr << name << ": " << bestSecs << " secs" << endl;
+        }
+    }
+
+    /* finish writing results */
+    void close() {
+        fOut.close();
+        if (fOut.fail()) {
+            throw ios_base::failure("error writing benchmark results");
+        }
+    }
+};
+
+/* parse all records in a GxF file, optionally saving them */
+static long parseGxf(const string& gxfFile,
+                     vector<GxfRecord*>* records) {
+    GxfParser* gxfParser = GxfParser::factory(gxfFile);
+    long cnt = 0;
+    GxfRecord* gxfRecord;
+    while ((gxfRecord = gxfParser->next()) != NULL) {
+        cnt++;
+        if (records != NULL) {
+            records->push_back(gxfRecord);
+        } else {
+            delete gxfRecord;
+        }
+    }
+    delete gxfParser;
+    return cnt;
+}
+
+/* write GxF records */
+static long writeGxf(const vector<GxfRecord*>& records,
+                     GxfFormat gxfFormat,
+                     const string& outGxf) {
+    GxfWriter* gxfWriter = GxfWriter::factory(outGxf, PAR_ID_HACK_NEW, gxfFormat);
+    for (size_t i = 0; i < records.size(); i++) {
+        gxfWriter->write(records[i]);
+    }
+    delete gxfWriter;
+    return records.size();
+}
+
+/* collect the ids and sorted exons of all transcripts */
+static void getTranscriptsExons(const AnnotationSet& annotations,
+                                StringVector& qNames,
+                                vector<FeatureNodeVector>& exonSets) {
+    const FeatureNodeVector& genes = annotations.getGenes();
+    for (size_t iGene = 0; iGene < genes.size(); iGene++) {
+        const FeatureNodeVector& transcripts = genes[iGene]->getChildren();
+        for (size_t iTrans = 0; iTrans < transcripts.size(); iTrans++) {
+            FeatureNodeVector exons;
+            transcripts[iTrans]->getMatchingType(exons, GxfFeature::EXON);
+            if (exons.size() > 0) {
+                qNames.push_back(transcripts[iTrans]->getTypeId());
+                exonSets.push_back(exons);
+            }
+        }
+    }
+}
+
+/* build an exons PSL for each transcript with a mappable sequence */
+static void makeExonsPsls(const TransMap* transMap,
+                          const StringVector& qNames,
+                          const vector<FeatureNodeVector>& exonSets,
+                          PslVector& exonsPsls) {
+    for (size_t i = 0; i < exonSets.size(); i++) {
+        const string& seqid = exonSets[i][0]->getSeqid();
+        if (transMap->haveQuerySeq(seqid)) {
+            exonsPsls.push_back(FeaturesToPsl::toPsl(qNames[i], transMap->getQuerySeqSize(seqid), exonSets[i]));
+        }
+    }
+}
+
+/* map each PSL with TransMap::mapPsl */
+static long benchMapPsl(const TransMap* transMap,
+                        const PslVector& exonsPsls) {
+    for (size_t i = 0; i < exonsPsls.size(); i++) {
+        PslVector mappedPsls = transMap->mapPsl(exonsPsls[i]);
+        mappedPsls.free();
+    }
+    return exonsPsls.size();
+}
+
+/* map the exons of each transcript with FeatureTransMap::mapFeatures,
+ * saving the mappings if requested */
+static long benchMapFeatures(const FeatureTransMap& featureTransMap,
+                             const StringVector& qNames,
+                             const vector<FeatureNodeVector>& exonSets,
+                             vector<PslMapping*>* mappings) {
+    for (size_t i = 0; i < exonSets.size(); i++) {
+        PslMapping* mapping = featureTransMap.mapFeatures(qNames[i], exonSets[i]);
+        if (mappings != NULL) {
+            mappings->push_back(mapping);
+        } else {
+            delete mapping;
+        }
+    }
+    return exonSets.size();
+}
+
+/* sort the mapped PSLs of each mapping */
+static long benchSortMappedPsls(const vector<PslMapping*>& mappings) {
+    long cnt = 0;
+    for (size_t i = 0; i < mappings.size(); i++) {
+        if (mappings[i] != NULL) {
+            mappings[i]->sortMappedPsls();
+            cnt++;
+        }
+    }
+    return cnt;
+}
+
+/* Make the GFF3 of a gene with a coding transcript mapped as fragments
+ * separated by one base gaps that keep the frame, as produced by mapping
+ * through a gappy chain.  Polishing merges the first two fragments of
+ * every three, as the fragment following a merged pair is skipped. */
+static string makeFragmentedGene(int numFragments) {
+    static const int fragSize = 10, gapSize = 1;
+    static const string commonAttrs = "gene_id=G1.1;transcript_id=T1.1;remap_status=full_contig";
+    int end = numFragments * (fragSize + gapSize);
+    ostringstream gff3;
+    gff3 << "chr1\tHAVANA\tgene\t1\t" << end << "\t.\t+\t.\tID=G1.1;gene_id=G1.1;gene_type=protein_coding;gene_name=G1;remap_status=full_contig\n"
+         << "chr1\tHAVANA\ttranscript\t1\t" << end << "\t.\t+\t.\tID=T1.1;Parent=G1.1;" << commonAttrs << "\n";
+    Frame frame(Frame::F0);
+    for (int i = 0; i < numFragments; i++) {
+        int start = 1 + (i * (fragSize + gapSize));
+        string exonAttrs = "exon_number=" + toString(i + 1) + ";exon_id=E" + toString(i + 1) + ".1;" + commonAttrs;
+        gff3 << "chr1\tHAVANA\texon\t" << start << "\t" << (start + fragSize - 1) << "\t.\t+\t.\tID=exon:T1.1:" << (i + 1)
+             << ";Parent=T1.1;" << exonAttrs << "\n"
+             << "chr1\tHAVANA\tCDS\t" << start << "\t" << (start + fragSize - 1) << "\t.\t+\t" << frame.toPhaseStr()
+             << "\tID=CDS:T1.1;Parent=T1.1;" << exonAttrs << "\n";
+        frame = frame.incr(fragSize + gapSize);
+    }
+    return gff3.str();
+}
+
+/* parse a gene from GFF3 text */
+static FeatureNode* parseGeneText(const string& geneText) {
+    istringstream geneIn(geneText);
+    GxfParser* gxfParser = GxfParser::factory(geneIn, GFF3_FORMAT);
+    FeatureNode* gene = NULL;
+    GxfRecord* gxfRecord;
+    while ((gxfRecord = gxfParser->next()) != NULL) {
+        if ((gene == NULL) and instanceOf(gxfRecord, GxfFeature)) {
+            gene = GeneTree::geneTreeFactory(gxfParser, dynamic_cast<GxfFeature*>(gxfRecord));
+        } else {
+            delete gxfRecord;
+        }
+    }
+    delete gxfParser;
+    return gene;
+}
+
+/* Polish a gene with a heavily fragmented transcript, merging the gaps.
+ * The genes are parsed before timing, one per iteration, since polishing
+ * modifies them.  With a linear merge, the fragments per second stays the
+ * same as the number of fragments increases. */
+static void benchPolishFragmented(BenchRunner& bench,
+                                  int iterations,
+                                  int numFragments) {
+    string geneText = makeFragmentedGene(numFragments);
+    vector<FeatureNode*> genes;
+    for (int i = 0; i < iterations; i++) {
+        genes.push_back(parseGeneText(geneText));
+    }
+    FeatureTreePolish featureTreePolish(NULL);
+    int iGene = 0;
+    bench.run("FeatureTreePolish::polishGene " + toString(numFragments) + " fragments", [&]() {
+            featureTreePolish.polishGene(genes[iGene++]);
+            return long(numFragments);
+        });
+    for (int i = 0; i < genes.size(); i++) {
+        delete genes[i];
+    }
+}
+
+/* run all benchmarks */
+static void gencodeBackmapBench(const string& inGxfFile,
+                                const string& mappingAligns,
+                                bool swapMap,
+                                int iterations,
+                                const string& resultsTsv) {
+    BenchRunner bench(iterations, resultsTsv);
+    GxfFormat gxfFormat = gxfFormatFromFileName(inGxfFile);
+    string formatName = (gxfFormat == GFF3_FORMAT) ? "gff3" : "gtf";
+
+    bench.run("parse " + formatName, [&]() {
+            return parseGxf(inGxfFile, NULL);
+        });
+
+    vector<GxfRecord*> records;
+    parseGxf(inGxfFile, &records);
+    bench.run("write " + formatName, [&]() {
+            return writeGxf(records, gxfFormat, "/dev/null");
+        });
+    for (size_t i = 0; i < records.size(); i++) {
+        delete records[i];
+    }
+
+    TransMap* transMap = NULL;
+    bench.run("load mapping alignments", [&]() {
+            delete transMap;
+            transMap = TransMap::factoryFromFile(mappingAligns, swapMap);
+            return 1L;
+        });
+
+    AnnotationSet annotations(inGxfFile);
+    StringVector qNames;
+    vector<FeatureNodeVector> exonSets;
+    getTranscriptsExons(annotations, qNames, exonSets);
+    PslVector exonsPsls;
+    makeExonsPsls(transMap, qNames, exonSets, exonsPsls);
+
+    bench.run("TransMap::mapPsl", [&]() {
+            return benchMapPsl(transMap, exonsPsls);
+        });
+    exonsPsls.freeCompact();
+
+    FeatureTransMap featureTransMap(transMap);
+    bench.run("FeatureTransMap::mapFeatures", [&]() {
+            return benchMapFeatures(featureTransMap, qNames, exonSets, NULL);
+        });
+
+    vector<PslMapping*> mappings;
+    benchMapFeatures(featureTransMap, qNames, exonSets, &mappings);
+    bench.run("PslMapping::sortMappedPsls", [&]() {
+            return benchSortMappedPsls(mappings);
+        });
+    for (size_t i = 0; i < mappings.size(); i++) {
+        delete mappings[i];
+    }
+    delete transMap;
+
+    static const int numFragments[] = {100, 1000, 10000};
+    for (int i = 0; i < ArraySize(numFragments); i++) {
+        benchPolishFragmented(bench, iterations, numFragments[i]);
+    }
+    bench.close();
+}
+
+/* usage message and abort */
+static const char* usage =
+    "gencode-backmap-bench [options] inGxf mappingAligns resultsTsv\n"
+    "\n"
+    "Run microbenchmarks of parsing, writing and mapping using the\n"
+    "annotations and alignments, and of polishing synthetic genes with\n"
+    "increasingly fragmented transcripts, writing a TSV with a row for each\n"
+    "benchmark.\n"
+    "\n"
+    "Options:\n"
+    "  --swapMap - swap the query and target sides of the mapping alignments.\n"
+    "  --iterations=n - number of times to run each benchmark; the best and mean\n"
+    "    times are reported. Defaults to 3.\n"
+    "  --verbose - print each benchmark time to stderr.\n"
+    "Arguments:\n"
+    "  inGxf - Input GENCODE GFF3 or GTF file.\n"
+    "  mappingAligns - Alignments between the two genomes.\n"
+    "  resultsTsv - TSV file of results; columns are benchmark name, iterations,\n"
+    "    items processed per iteration, best and mean seconds, items per second\n"
+    "    of the best time and process peak RSS in megabytes.\n"
+    "\n";
+
+const struct option long_options[] = {
+    {"help", 0, NULL, 'h'},
+    {"verbose", 0, NULL, 'v'},
+    {"swapMap", 0, NULL, 's'},
+    {"iterations", 1, NULL, 'n'},
+    {NULL, 0, NULL, 0}
+};
+const char* short_options = "hsn:";
+
+/* Entry point.  Parse arguments. */
+int main(int argc, char *argv[]) {
+    bool swapMap = false;
+    bool help = false;
+    int iterations = 3;
+    opterr = 0;  // we print error message
+    while (true) {
+        int optc = getopt_long(argc, argv, short_options, long_options, NULL);
+        if (optc == -1) {
+            break;
+        } else if (optc == 'h') {
+            help = true;
+            break;  // check no more
+        } else if (optc == 'v') {
+            gVerbose = true;
+        } else if (optc == 's') {
+            swapMap = true;
+        } else if (optc == 'n') {
+            bool isOk = true;
+            iterations = stringToInt(optarg, &isOk);
+            if ((not isOk) or (iterations < 1)) {
+                errAbort(toCharStr("--iterations must be an integer greater than zero: %s"), optarg);
+            }
+        } else {
+            errAbort(toCharStr("invalid option %s"), argv[optind-1]);
+        }
+    }
+    if (help) {
+        cerr << usage;
+        return 1;
+    }
+    if ((argc - optind) != 3) {
+        cerr << "wrong # args: " << usage;
+        return 1;
+    }
+    try {
+        gencodeBackmapBench(argv[optind], argv[optind+1], swapMap, iterations, argv[optind+2]);
+    } catch (const exception& ex) {
+        cerr << "Error: " << ex.what() << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -3,20 +3,32 @@
  * program to map gencode datafiles to older assemblies.
  */
 #include <getopt.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <unistd.h>
 #include "gxf.hh"
 #include "typeOps.hh"
 #include "FIOStream.hh"
 #include "transMap.hh"
+#include "transMapCache.hh"
+#include "exonsMappingCache.hh"
 #include "geneMapper.hh"
 #include "annotationSet.hh"
+#include "srcGenes.hh"
 #include "bedMap.hh"
 #include "globals.hh"
+#include "runStats.hh"
+#include "shardIndex.hh"
+#include "mappingServer.hh"
+#include "concurrentLoads.hh"
+#include "geneOffsetIndex.hh"
+#include "geneSelection.hh"
+#include "mappingSummary.hh"
+#include "mappingInfoColumnar.hh"
+#include "seqAliases.hh"
 #include "gxf.hh"
 #include "./version.h"
 
-/* verbose tracing enabled */
-bool gVerbose = false;
-
 /* check if a file is in the same format as a the input */
 static bool checkGxfFormat(GxfFormat inFormat,
                            const string& gxfFile,
@@ -33,21 +45,239 @@ static bool checkGxfFormat(GxfFormat inFormat,
     }
 }
 
+/* parse a memory size, with an optional K, M, or G suffix, returning 0
+ * if invalid */
+static size_t parseMemorySize(const string& spec) {
+    static const string suffixes = "KMG";
+    size_t mult = 1;
+    string num = spec;
+    size_t iSuffix = (spec.size() > 0) ? suffixes.find(toupper(spec[spec.size() - 1])) : string::npos;
+    if (iSuffix != string::npos) {
+        mult = size_t(1) << (10 * (iSuffix + 1));
+        num = spec.substr(0, spec.size() - 1);
+    }
+    bool isOk = true;
+    int value = stringToInt(num, &isOk);
+    return ((not isOk) or (value < 1)) ? 0 : size_t(value) * mult;
+}
+
+/* additional assembly to map to, from --assembly */
+struct AssemblyMapping {
+    string mappingAligns;
+    string mappedGxfFile;
+    string mappingInfoTsv;
+    string targetGxf;          // empty to share the primary target annotations
+    string previousMappedGxf;  // empty if not incremental
+    string previousSrcGxf;
+};
+typedef vector<AssemblyMapping> AssemblyMappingVector;
+
+/* parse an --assembly spec of
+ * mappingAligns,mappedGxf[,mappingInfoTsv][,name=gxfFile...] */
+static AssemblyMapping parseAssemblySpec(const string& spec) {
+    static const char* usage = "--assembly must be in the form mappingAligns,mappedGxf[,mappingInfoTsv][,targetGxf=file][,previousMappedGxf=file][,previousSrcGxf=file]: %s";
+    StringVector words = stringSplit(spec, ',');
+    if ((words.size() < 2) or (words[0].size() == 0) or (words[1].size() == 0)) {
+        errAbort(toCharStr(usage), spec.c_str());
+    }
+    AssemblyMapping assembly;
+    assembly.mappingAligns = words[0];
+    assembly.mappedGxfFile = words[1];
+    for (size_t i = 2; i < words.size(); i++) {
+        size_t iEq = words[i].find('=');
+        if (iEq == string::npos) {
+            if ((i != 2) or (words[i].size() == 0)) {
+                errAbort(toCharStr(usage), spec.c_str());
+            }
+            assembly.mappingInfoTsv = words[i];
+            continue;
+        }
+        string name = words[i].substr(0, iEq);
+        string value = words[i].substr(iEq + 1);
+        if (value.size() == 0) {
+            errAbort(toCharStr(usage), spec.c_str());
+        } else if (name == "targetGxf") {
+            assembly.targetGxf = value;
+        } else if (name == "previousMappedGxf") {
+            assembly.previousMappedGxf = value;
+        } else if (name == "previousSrcGxf") {
+            assembly.previousSrcGxf = value;
+        } else {
+            errAbort(toCharStr(usage), spec.c_str());
+        }
+    }
+    if ((assembly.previousSrcGxf.size() > 0) and (assembly.previousMappedGxf.size() == 0)) {
+        errAbort(toCharStr("--assembly previousSrcGxf requires previousMappedGxf: %s"), spec.c_str());
+    }
+    return assembly;
+}
+
 /* check all files are in the same format */
 static bool checkGxfFormats(const string& inGxfFile,
                             const string& mappedGxfFile,
                             const string& targetGxf,
-                            const string& previousMappedGxf) {
+                            const string& previousMappedGxf,
+                            const string& previousSrcGxf,
+                            const AssemblyMappingVector& assemblies) {
     GxfFormat inFormat = gxfFormatFromFileName(inGxfFile);
+    for (size_t i = 0; i < assemblies.size(); i++) {
+        if (not (checkGxfFormat(inFormat, assemblies[i].mappedGxfFile, false)
+                 and checkGxfFormat(inFormat, assemblies[i].targetGxf, true)
+                 and checkGxfFormat(inFormat, assemblies[i].previousMappedGxf, true)
+                 and checkGxfFormat(inFormat, assemblies[i].previousSrcGxf, true))) {
+            return false;
+        }
+    }
     return checkGxfFormat(inFormat, mappedGxfFile, false)
         and checkGxfFormat(inFormat, targetGxf, true)
-        and checkGxfFormat(inFormat, previousMappedGxf, true);
+        and checkGxfFormat(inFormat, previousMappedGxf, true)
+        and checkGxfFormat(inFormat, previousSrcGxf, true);
+}
+
+/* check the GTF written in addition to the mapped GFF3 */
+static bool checkMappedGtfFormat(const string& inGxfFile,
+                                 const string& mappedGtfFile) {
+    if (mappedGtfFile == "") {
+        return true;
+    }
+    if (gxfFormatFromFileName(inGxfFile) != GFF3_FORMAT) {
+        cerr << "Error: --mappedGtf requires inGxf to be GFF3" << endl;
+        return false;
+    }
+    return checkGxfFormat(GTF_FORMAT, mappedGtfFile, false);
+}
+
+/* Load the mapping alignments, renaming their sequences if alias files are
+ * specified */
+static TransMap* loadMappingAligns(const string& mappingAligns,
+                                   bool swapMap,
+                                   int numThreads,
+                                   const MappingQueryRanges* queryRanges,
+                                   const string& srcSeqAliasesFile,
+                                   const string& targetSeqAliasesFile) {
+    SeqAliases* srcSeqAliases = (srcSeqAliasesFile.size() > 0) ? new SeqAliases(srcSeqAliasesFile) : NULL;
+    SeqAliases* targetSeqAliases = (targetSeqAliasesFile.size() > 0) ? new SeqAliases(targetSeqAliasesFile) : NULL;
+    TransMap* transMap = NULL;
+    try {
+        transMap = TransMap::factoryFromFile(mappingAligns, swapMap, numThreads, queryRanges,
+                                             srcSeqAliases, targetSeqAliases);
+    } catch (...) {
+        delete srcSeqAliases;
+        delete targetSeqAliases;
+        throw;
+    }
+    delete srcSeqAliases;
+    delete targetSeqAliases;
+    return transMap;
+}
+
+/* Load target or previous annotations.  If lazy is set and the file isn't
+ * compressed, genes are only parsed when looked up, using an index saved
+ * next to the file. */
+static AnnotationSet* loadLookupAnnotations(const string& gxfFile,
+                                            bool lazy) {
+    if (lazy and GeneOffsetIndex::canIndex(gxfFile)) {
+        return AnnotationSet::factoryLazy(gxfFile, gxfFile + ".geneidx");
+    } else {
+        return new AnnotationSet(gxfFile);
+    }
+}
+
+/* Can the target annotations be loaded lazily?  They are fully loaded when
+ * target genes are copied for the --useTargetFor* or --targetPatches
+ * options, unless only selected genes are mapped, which copies no target
+ * genes. */
+static bool isTargetLazy(bool lazy,
+                         unsigned useTargetFlags,
+                         const string& targetPatchBed,
+                         const GeneSelection* geneSelection) {
+    bool copyTargetGenes = ((useTargetFlags & ~GeneMapper::useTargetForPatchRegions) != 0)
+        or (targetPatchBed.size() > 0);
+    return lazy and ((not copyTargetGenes) or (geneSelection != NULL));
+}
+
+/* Map the already loaded source genes to an additional assembly.  The
+ * target annotations are shared with the primary mapping unless the
+ * assembly has its own, previous annotations are only those of the
+ * assembly.  The options specific to the primary mapping alignments are not
+ * used. */
+static void mapAdditionalAssembly(const AssemblyMapping& assembly,
+                                  int assemblyNum,
+                                  const AnnotationSet* srcAnnotations,
+                                  bool swapMap,
+                                  const AnnotationSet* targetAnnotations,
+                                  const string& substituteMissingTargetVersion,
+                                  unsigned useTargetFlags,
+                                  bool onlyManualForTargetSubstituteOverlap,
+                                  ParIdHackMethod parIdHackMethod,
+                                  const string& headerFile,
+                                  int numThreads,
+                                  bool sortedMapping,
+                                  const MappingQueryRanges* queryRanges,
+                                  const GeneSelection* geneSelection,
+                                  bool lazy,
+                                  size_t sortMemory,
+                                  const string& tmpDir) {
+    PhaseTimer assemblyTimer("map assembly " + assembly.mappingAligns);
+    TransMap* genomeTransMap = NULL;
+    AnnotationSet* assemblyTargetAnnotations = NULL;
+    AnnotationSet* previousMappedAnnotations = NULL;
+    AnnotationSet* previousSrcAnnotations = NULL;
+    ConcurrentLoads loads;
+    loads.add("load mapping alignments", [&]() {
+            genomeTransMap = TransMap::factoryFromFile(assembly.mappingAligns, swapMap, numThreads, queryRanges);
+        });
+    if (assembly.targetGxf.size() > 0) {
+        loads.add("load target annotations", [&]() {
+                assemblyTargetAnnotations = loadLookupAnnotations(assembly.targetGxf, isTargetLazy(lazy, useTargetFlags, "", geneSelection));
+            });
+    }
+    if (assembly.previousMappedGxf.size() > 0) {
+        loads.add("load previous mapped annotations", [&]() {
+                previousMappedAnnotations = loadLookupAnnotations(assembly.previousMappedGxf, lazy);
+            });
+    }
+    if (assembly.previousSrcGxf.size() > 0) {
+        loads.add("load previous source annotations", [&]() {
+                previousSrcAnnotations = loadLookupAnnotations(assembly.previousSrcGxf, lazy);
+            });
+    }
+    loads.wait();
+    LoadedSrcGenes srcGenes(srcAnnotations);
+    GxfWriter* mappedGxfFh = GxfWriter::factory(assembly.mappedGxfFile, parIdHackMethod);
+    if (headerFile.size() > 0) {
+        mappedGxfFh->copyFile(headerFile);
+    }
+    FIOStream mappingInfoFh((assembly.mappingInfoTsv.size() > 0) ? assembly.mappingInfoTsv : "/dev/null" , ios::out);
+    GeneMapper geneMapper(&srcGenes, genomeTransMap, NULL,
+                          (assemblyTargetAnnotations != NULL) ? assemblyTargetAnnotations : targetAnnotations,
+                          previousMappedAnnotations, previousSrcAnnotations,
+                          NULL, substituteMissingTargetVersion,
+                          useTargetFlags & ~GeneMapper::useTargetForPatchRegions,
+                          onlyManualForTargetSubstituteOverlap,
+                          numThreads, sortedMapping);
+    if (geneSelection != NULL) {
+        geneMapper.setGeneSelection(geneSelection);
+    }
+    if (sortMemory > 0) {
+        geneMapper.setExternalSort(sortMemory, tmpDir + "/gencode-backmap." + toString(getpid()) + ".asm" + toString(assemblyNum));
+    }
+    geneMapper.mapGxf(*mappedGxfFh, mappingInfoFh, NULL);
+    mappedGxfFh->close();
+    mappingInfoFh.close();
+    delete mappedGxfFh;
+    delete genomeTransMap;
+    delete assemblyTargetAnnotations;
+    delete previousMappedAnnotations;
+    delete previousSrcAnnotations;
 }
 
 /* map to different assembly */
 static void gencodeBackmap(const string& inGxfFile,
                            const string& mappingAligns,
                            bool swapMap,
+                           const string& mappingCache,
+                           const string& exonsMappingCacheFile,
                            const string& substituteMissingTargetVersion,
                            unsigned useTargetFlags,
                            bool onlyManualForTargetSubstituteOverlap,
@@ -58,34 +288,242 @@ static void gencodeBackmap(const string& inGxfFile,
                            const string& targetGxf,
                            const string& targetPatchBed,
                            const string& previousMappedGxf,
-                           const string& transcriptPsls) {
-    TransMap* genomeTransMap = TransMap::factoryFromFile(mappingAligns, swapMap);
-    AnnotationSet srcAnnotations(inGxfFile);
-    AnnotationSet* targetAnnotations = (targetGxf.size() > 0)
-        ? new AnnotationSet(targetGxf) : NULL;
-    AnnotationSet* previousMappedAnnotations = (previousMappedGxf.size() > 0)
-        ? new AnnotationSet(previousMappedGxf) : NULL;
-    BedMap* targetPatchMap = (targetPatchBed.size() > 0)
-        ? new BedMap(targetPatchBed) : NULL;
+                           const string& previousSrcGxf,
+                           const string& transcriptPsls,
+                           int numThreads,
+                           bool streamInput,
+                           bool sortedMapping,
+                           int shardNum,
+                           int numShards,
+                           const string& shardIndexFile,
+                           const StringVector& mergeShardIndexes,
+                           bool lazyAnnotations,
+                           const GeneSelection* geneSelection,
+                           const string& summaryPrefix,
+                           const string& mappingInfoColumnarFile,
+                           size_t sortMemory,
+                           const string& tmpDir,
+                           const AssemblyMappingVector& assemblies,
+                           const string& mappedGtfFile,
+                           const string& srcSeqAliasesFile,
+                           const string& targetSeqAliasesFile) {
+    bool merging = (mergeShardIndexes.size() > 0);
+    bool lazy = lazyAnnotations or (geneSelection != NULL);
+    TransMap* genomeTransMap = NULL;
+    ExonsMappingCache* exonsMappingCache = NULL;
+    AnnotationSet* srcAnnotations = NULL;
+    AnnotationSet* targetAnnotations = NULL;
+    AnnotationSet* previousMappedAnnotations = NULL;
+    AnnotationSet* previousSrcAnnotations = NULL;
+    BedMap* targetPatchMap = NULL;
+    MappingQueryRanges* queryRanges = NULL;
+    PhaseTimer loadTimer("load inputs");
+    if (geneSelection != NULL) {
+        // the selected genes determine the mapping alignments to load
+        PhaseTimer srcTimer("load source annotations");
+        srcAnnotations = new AnnotationSet(inGxfFile);
+        queryRanges = new MappingQueryRanges();
+        geneSelection->getSelectedRanges(*srcAnnotations, *queryRanges);
+    }
+    ConcurrentLoads loads;
+    loads.add("load mapping alignments", [&]() {
+            genomeTransMap = (mappingCache.size() > 0)
+                ? TransMapCache::factory(mappingAligns, swapMap, mappingCache, numThreads)
+                : loadMappingAligns(mappingAligns, swapMap, numThreads, queryRanges,
+                                    srcSeqAliasesFile, targetSeqAliasesFile);
+            if (exonsMappingCacheFile.size() > 0) {
+                exonsMappingCache = new ExonsMappingCache(exonsMappingCacheFile, mappingAligns, swapMap);
+            }
+        });
+    if (not (streamInput or merging or (srcAnnotations != NULL))) {
+        loads.add("load source annotations", [&]() {
+                srcAnnotations = new AnnotationSet(inGxfFile);
+            });
+    }
+    if (targetGxf.size() > 0) {
+        loads.add("load target annotations", [&]() {
+                targetAnnotations = loadLookupAnnotations(targetGxf, isTargetLazy(lazy, useTargetFlags, targetPatchBed, geneSelection));
+            });
+    }
+    if (previousMappedGxf.size() > 0) {
+        loads.add("load previous mapped annotations", [&]() {
+                previousMappedAnnotations = loadLookupAnnotations(previousMappedGxf, lazy);
+            });
+    }
+    if (previousSrcGxf.size() > 0) {
+        loads.add("load previous source annotations", [&]() {
+                previousSrcAnnotations = loadLookupAnnotations(previousSrcGxf, lazy);
+            });
+    }
+    if (targetPatchBed.size() > 0) {
+        loads.add("load target patches", [&]() {
+                targetPatchMap = new BedMap(targetPatchBed);
+            });
+    }
+    loads.wait();
+    loadTimer.stop();
+    SrcGenes* srcGenes = NULL;  // not needed to merge
+    if (streamInput and not merging) {
+        srcGenes = new StreamingSrcGenes(inGxfFile);
+    } else if (srcAnnotations != NULL) {
+        srcGenes = new LoadedSrcGenes(srcAnnotations);
+    }
     GxfWriter* mappedGxfFh = GxfWriter::factory(mappedGxfFile, parIdHackMethod);
     if (headerFile.size() > 0) {
         mappedGxfFh->copyFile(headerFile);
     }
+    GxfWriter* mappedGtfFh = NULL;
+    if (mappedGtfFile.size() > 0) {
+        mappedGtfFh = GxfWriter::factory(mappedGtfFile, parIdHackMethod);
+        if (headerFile.size() > 0) {
+            mappedGtfFh->copyFile(headerFile);
+        }
+    }
     FIOStream mappingInfoFh((mappingInfoTsv.size() > 0) ? mappingInfoTsv : "/dev/null" , ios::out);
     FIOStream* transcriptPslFh = (transcriptPsls.size() > 0) ? new FIOStream(transcriptPsls, ios::out) : NULL;
-    GeneMapper geneMapper(&srcAnnotations, genomeTransMap, targetAnnotations, previousMappedAnnotations,
+    GeneMapper geneMapper(srcGenes, genomeTransMap, exonsMappingCache, targetAnnotations,
+                          previousMappedAnnotations, previousSrcAnnotations,
                           targetPatchMap, substituteMissingTargetVersion,
-                          useTargetFlags, onlyManualForTargetSubstituteOverlap);
-    geneMapper.mapGxf(*mappedGxfFh, mappingInfoFh, transcriptPslFh);
+                          useTargetFlags, onlyManualForTargetSubstituteOverlap,
+                          numThreads, sortedMapping);
+    if (geneSelection != NULL) {
+        geneMapper.setGeneSelection(geneSelection);
+    }
+    if (sortMemory > 0) {
+        geneMapper.setExternalSort(sortMemory, tmpDir + "/gencode-backmap." + toString(getpid()));
+    }
+    if (mappedGtfFh != NULL) {
+        geneMapper.setMappedGtfWriter(mappedGtfFh);
+    }
+    MappingSummaries* mappingSummaries = NULL;
+    if (summaryPrefix.size() > 0) {
+        mappingSummaries = new MappingSummaries();
+        geneMapper.setMappingSummaries(mappingSummaries);
+    }
+    MappingInfoColumnar* mappingInfoColumnar = NULL;
+    if (mappingInfoColumnarFile.size() > 0) {
+        mappingInfoColumnar = new MappingInfoColumnar();
+        geneMapper.setMappingInfoColumnar(mappingInfoColumnar);
+    }
+    ShardIndex* shardIndex = NULL;
+    if (numShards > 0) {
+        shardIndex = new ShardIndex(shardNum, numShards, mappedGxfFile, mappingInfoTsv, transcriptPsls);
+        geneMapper.setShard(shardIndex);
+    }
+    if (merging) {
+        geneMapper.mergeShards(mergeShardIndexes, *mappedGxfFh, mappingInfoFh, transcriptPslFh);
+    } else {
+        geneMapper.mapGxf(*mappedGxfFh, mappingInfoFh, transcriptPslFh);
+    }
+    mappedGxfFh->close();
+    if (mappedGtfFh != NULL) {
+        mappedGtfFh->close();
+    }
+    mappingInfoFh.close();
+    if (transcriptPslFh != NULL) {
+        transcriptPslFh->close();
+    }
+    if (mappingSummaries != NULL) {
+        mappingSummaries->write(summaryPrefix);
+        delete mappingSummaries;
+    }
+    if (mappingInfoColumnar != NULL) {
+        mappingInfoColumnar->write(mappingInfoColumnarFile);
+        delete mappingInfoColumnar;
+    }
+    if (shardIndex != NULL) {
+        shardIndex->write(shardIndexFile);
+        delete shardIndex;
+    }
+    if (exonsMappingCache != NULL) {
+        exonsMappingCache->write();
+    }
     delete mappedGxfFh;
-    delete genomeTransMap;
+    delete mappedGtfFh;
+    delete exonsMappingCache;
+    delete srcGenes;
+    delete genomeTransMap;  // only one set of alignments is kept loaded
+    for (size_t i = 0; i < assemblies.size(); i++) {
+        mapAdditionalAssembly(assemblies[i], i + 1, srcAnnotations, swapMap, targetAnnotations,
+                              substituteMissingTargetVersion, useTargetFlags,
+                              onlyManualForTargetSubstituteOverlap, parIdHackMethod,
+                              headerFile, numThreads, sortedMapping, queryRanges,
+                              geneSelection, lazy, sortMemory, tmpDir);
+    }
+    delete srcAnnotations;
     delete targetPatchMap;
     delete targetAnnotations;
     delete previousMappedAnnotations;
+    delete previousSrcAnnotations;
     delete transcriptPslFh;
+    delete queryRanges;
+}
+
+/* keep the mapping alignments and annotations loaded and map requests */
+static void gencodeBackmapServer(const string& socketPath,
+                                 const string& mappingAligns,
+                                 bool swapMap,
+                                 const string& mappingCache,
+                                 const string& substituteMissingTargetVersion,
+                                 unsigned useTargetFlags,
+                                 bool onlyManualForTargetSubstituteOverlap,
+                                 ParIdHackMethod parIdHackMethod,
+                                 const string& headerFile,
+                                 const string& targetGxf,
+                                 const string& targetPatchBed,
+                                 const string& previousMappedGxf,
+                                 const string& previousSrcGxf,
+                                 int numThreads,
+                                 bool lazyAnnotations,
+                                 const string& srcSeqAliasesFile,
+                                 const string& targetSeqAliasesFile) {
+    TransMap* genomeTransMap = NULL;
+    AnnotationSet* targetAnnotations = NULL;
+    AnnotationSet* previousMappedAnnotations = NULL;
+    AnnotationSet* previousSrcAnnotations = NULL;
+    BedMap* targetPatchMap = NULL;
+    ConcurrentLoads loads;
+    loads.add("load mapping alignments", [&]() {
+            genomeTransMap = (mappingCache.size() > 0)
+                ? TransMapCache::factory(mappingAligns, swapMap, mappingCache, numThreads)
+                : loadMappingAligns(mappingAligns, swapMap, numThreads, NULL,
+                                    srcSeqAliasesFile, targetSeqAliasesFile);
+        });
+    if (targetGxf.size() > 0) {
+        loads.add("load target annotations", [&]() {
+                targetAnnotations = loadLookupAnnotations(targetGxf, isTargetLazy(lazyAnnotations, useTargetFlags, targetPatchBed, NULL));
+            });
+    }
+    if (previousMappedGxf.size() > 0) {
+        loads.add("load previous mapped annotations", [&]() {
+                previousMappedAnnotations = loadLookupAnnotations(previousMappedGxf, lazyAnnotations);
+            });
+    }
+    if (previousSrcGxf.size() > 0) {
+        loads.add("load previous source annotations", [&]() {
+                previousSrcAnnotations = loadLookupAnnotations(previousSrcGxf, lazyAnnotations);
+            });
+    }
+    if (targetPatchBed.size() > 0) {
+        loads.add("load target patches", [&]() {
+                targetPatchMap = new BedMap(targetPatchBed);
+            });
+    }
+    loads.wait();
+    MappingServer server(genomeTransMap, targetAnnotations, previousMappedAnnotations,
+                         previousSrcAnnotations, targetPatchMap, substituteMissingTargetVersion,
+                         useTargetFlags, onlyManualForTargetSubstituteOverlap, parIdHackMethod,
+                         headerFile, numThreads);
+    server.serve(socketPath);
+    delete genomeTransMap;
+    delete targetPatchMap;
+    delete targetAnnotations;
+    delete previousMappedAnnotations;
+    delete previousSrcAnnotations;
 }
 
-const string usage = "%s [options] inGxf mappingAligns mappedGxf [mappingInfoTsv]\n\n"
+const string usage = "%s [options] inGxf mappingAligns mappedGxf [mappingInfoTsv]\n"
+    "%s --server=socketPath [options] mappingAligns\n\n"
     "Map GENCODE annotations between assemblies projecting through genomic\n"
     "alignments. This operates on GENCODE GFF3 and GTF files and makes assumptions\n"
     "about their organization.\n\n"
@@ -93,15 +531,36 @@ const string usage = "%s [options] inGxf mappingAligns mappedGxf [mappingInfoTsv
     "  --help - print this message and exit\n"
     "  --verbose - verbose tracing to stderr\n"
     "  --swapMap - swap the query and target sides of the mapping alignments\n"
+    "  --mappingCache=cacheFile - binary cache of the mapping alignments.  If the cache\n"
+    "    exists and was built from the current mappingAligns file with the same --swapMap\n"
+    "    setting, it is loaded instead of mappingAligns, otherwise it is (re)built.\n"
+    "  --exonsMappingCache=cacheFile - cache of the mapping of transcript exons\n"
+    "    through mappingAligns.  Exons in the cache are not remapped, and new mappings\n"
+    "    are added to it.  This speeds up repeated runs of the same annotations with\n"
+    "    different options.  The cache is discarded if it was built from a different\n"
+    "    mappingAligns file or --swapMap setting.\n"
     "  --targetGxf=gxfFile - GFF3 or GTF of gene annotations on target genome.\n"
     "    If specified, require mappings to location of previous version of\n"
     "    gene or transcript.\n"
     "  --previousMappedGxf=gxfFile - GFF3 or GTF of gene annotations on previous mapping.\n"
     "    This is used to determine the mapped version number to append to the ids.\n"
+    "  --previousSrcGxf=gxfFile - GFF3 or GTF of the source gene annotations that were\n"
+    "    mapped to produce --previousMappedGxf.  Genes that are unchanged from this file\n"
+    "    and were completely mapped have their previous mappings reused rather than being\n"
+    "    remapped.  The mappingAligns, target and other options must be the same as\n"
+    "    used for the previous mapping. Requires --previousMappedGxf and can't be used\n"
+    "    with --transcriptPsls.\n"
     "  --headerFile=commentFile - copy contents of this file as comment header for GFF3/GTF output.\n"
     "    Doesn't include GFF3 file type meta comment.\n"
     "  --transcriptPsls=pslFile - write all mapped transcript-level PSL to this file, including\n"
     "    multiple mappers.\n"
+    "  --maxMappingCandidates=n - project each transcript's exons through at most n of\n"
+    "    the overlapping mapping alignments, keeping those whose blocks cover the most\n"
+    "    exon bases.  This bounds the time spent in regions with many overlapping chains,\n"
+    "    such as segmental duplications.  Alignments that are dropped are still\n"
+    "    projected and listed in --transcriptPsls, after the ones used, but the best\n"
+    "    mapping maybe different than with all of them.  The default is no limit.\n"
+    "    Can't be used with --exonsMappingCache.\n"
     "  --substituteMissingTargets=targetVersion - if target GxF is specified and no GENE maps to\n"
     "    the target locus, pass through the original target location.  Only a subset of the\n"
     "    biotypes are substituted. Argument is target GENCODE version that is stored as an attribute\n"
@@ -122,6 +581,111 @@ const string usage = "%s [options] inGxf mappingAligns mappedGxf [mappingInfoTsv
     "    manual transcripts.\n"
     "  --oldStyleParIdHack - use ENSTR style PAR id unique on output rather than the\n"
     "    newer _PAR_Y.  Either form is recognized on input.\n"
+    "  --threads=n - number of threads to use to map genes.  The results are identical\n"
+    "    to mapping with a single thread.  Also used for compressing .gz output, which is\n"
+    "    written in BGZF format, and for parsing uncompressed or BGZF mappingAligns files\n"
+    "    in parallel.  Defaults to 1.\n"
+    "  --streamInput - read inGxf one gene at a time rather than loading it into\n"
+    "    memory.  The file is read twice, so it can't be a pipe.\n"
+    "  --stats=statsFile - write counts, the wall and CPU time and peak memory of each\n"
+    "    phase, a histogram of the time to project genes, and the slowest genes to\n"
+    "    this file.\n"
+    "  --sortedMapping - project genes in genomic order for better locality of\n"
+    "    the mapping alignment lookups, committing the results in input order.\n"
+    "    The results are identical.  This holds the source genes of one chromosome\n"
+    "    in memory at a time.\n"
+    "  --shard=i/n - only map the genes on the source sequences assigned to shard i\n"
+    "    of n, writing the outputs of this shard and --shardIndex.  Sequences are\n"
+    "    assigned to shards to balance their total size.  Target genes are not\n"
+    "    copied and the mapped genes are not sorted; this is done by --mergeShards.\n"
+    "    Requires mappingInfoTsv.\n"
+    "  --shardIndex=indexFile - index of the shard outputs written with --shard.\n"
+    "  --mergeShards=indexFile1,indexFile2,... - merge the outputs of all n shards\n"
+    "    from their index files, producing the same results as mapping all genes in\n"
+    "    one run.  Other options and arguments must be the same as used to map the\n"
+    "    shards, however inGxf is not read.  The merge fails if genes in different\n"
+    "    shards share ids or names, as their mapping could depend on each other.\n"
+    "  --server=socketPath - keep mappingAligns and the target and previous annotations\n"
+    "    loaded, and map GxF fragments sent as requests on a Unix domain socket, or on\n"
+    "    stdin with responses on stdout if socketPath is `-'.  A request is a line of\n"
+    "    `#gencodeBackmap<tab>gff3' or `#gencodeBackmap<tab>gtf', followed by GxF lines,\n"
+    "    terminated by a line of `#end'.  The response is a line of `#mapped' followed by\n"
+    "    the mapped GxF, a line of `#mappingInfo' followed by the mapping info TSV, then\n"
+    "    `#end'. On failure, it is a line of `#error<tab>message' then `#end'.\n"
+    "    Each request is mapped as if it were the entire input and target genes are not\n"
+    "    copied.  The socket server runs until killed.\n"
+    "  --lazyAnnotations - don't load --targetGxf, --previousMappedGxf and\n"
+    "    --previousSrcGxf, parsing a gene from the file when it is first looked up.\n"
+    "    This uses an index of the genes saved in a file with a .geneidx extension\n"
+    "    next to each GxF file, which is built if it doesn't exist or the GxF has\n"
+    "    changed.  Compressed files are always loaded, as is --targetGxf when the\n"
+    "    --useTargetFor* or --targetPatches options are used.  The results are\n"
+    "    identical.\n"
+    "  --region=chrom:start-end - only map the source genes overlapping this region\n"
+    "    of the source genome, in one-based, closed coordinates.  Only the mapping\n"
+    "    alignments overlapping the selected genes are loaded and the target and\n"
+    "    previous annotations are loaded as with --lazyAnnotations.  Each selected\n"
+    "    gene has the same mapping as in a run over all genes, however the gene\n"
+    "    numbers in mappingInfoTsv differ and target genes are not copied.  Used to\n"
+    "    quickly investigate problems at a locus.\n"
+    "  --geneIds=idFile - only map the source genes whose ids or HAVANA ids, with\n"
+    "    or without versions, are listed one per line in this file, as with --region.\n"
+    "    If used with --region, genes must be in the region and in the file.\n"
+    "  --summaryPrefix=prefix - write the standard summary tables of the mapping\n"
+    "    results, counted as the genes are mapped, to files named prefix + table\n"
+    "    + .tsv.  These are the same as produced by bin/mapInfoSummary from\n"
+    "    mappingInfoTsv. The tables are gene, gene.biotype, trans, trans.biotype,\n"
+    "    trans.biocat, trans.biocat.multimap, trans.targetSubst,\n"
+    "    trans.genomicSize.matrix, trans.biocat.matrix, trans.biocat.rowFreq.matrix\n"
+    "    and trans.biocat.columnFreq.matrix.  Can't be used with --shard or\n"
+    "    --mergeShards.\n"
+    "  --mappingInfoColumnar=file - also write the mapping info, with the feature\n"
+    "    source, to a binary columnar file that can be memory mapped, with the\n"
+    "    categorical columns dictionary encoded.  The format is described in\n"
+    "    mappingInfoColumnar.hh and lib/gencode/mappingInfoColumnar.py reads it.\n"
+    "    Can't be used with --shard or --mergeShards.\n"
+    "  --sortMemory=size - don't hold the mapped genes in memory until they are sorted\n"
+    "    and written.  Each gene is formatted when it is mapped, and when the formatted\n"
+    "    genes exceed this size in bytes, with an optional K, M or G suffix, they are\n"
+    "    sorted and saved to a temporary file. These are merged to produce mappedGxf. Combined with --streamInput,\n"
+    "    this bounds the memory used by the annotations. Genes with the same location\n"
+    "    are written in the order they were mapped. Can't be used with --shard,\n"
+    "    --mergeShards or --targetPatches.\n"
+    "  --tmpDir=dir - directory for --sortMemory temporary files, defaults to $TMPDIR\n"
+    "    or /tmp.\n"
+    "  --assembly=mappingAligns,mappedGxf[,mappingInfoTsv][,name=gxfFile...] - also\n"
+    "    map inGxf to another assembly through these alignments, writing its mappedGxf\n"
+    "    and mappingInfoTsv.\n"
+    "    This maybe repeated.  The source genes are parsed once and mapped to each\n"
+    "    assembly in turn, after the primary mapping.  Only one set of alignments is\n"
+    "    loaded at a time.  --swapMap, --targetGxf, --substituteMissingTargets, the\n"
+    "    --useTargetFor* and other mapping options apply to all assemblies, with the\n"
+    "    target annotations shared.  The spec may be followed by targetGxf=gxfFile,\n"
+    "    previousMappedGxf=gxfFile and previousSrcGxf=gxfFile, used for this assembly\n"
+    "    as with the options of the same name.  A targetGxf replaces the shared target\n"
+    "    annotations, which should be given when the assembly is a different genome than\n"
+    "    the primary one. --previousMappedGxf and --previousSrcGxf only apply to the\n"
+    "    primary mapping, so without previousMappedGxf all genes are mapped to the\n"
+    "    assembly.  --mappingCache, --exonsMappingCache, --targetPatches,\n"
+    "    --transcriptPsls, --summaryPrefix, --mappingInfoColumnar and --mappedGtf only\n"
+    "    apply to the primary mapping.\n"
+    "    Can't be used with --streamInput, --shard or --mergeShards.\n"
+    "  --mappedGtf=gtfFile - when inGxf is GFF3, also write the mapped genes as GTF,\n"
+    "    with the PAR ids modified as for GTF.  This gives the results of mapping the\n"
+    "    corresponding GENCODE GTF without a second run, with the attributes in\n"
+    "    their GFF3 order.  Can't be used with --shard or --sortMemory, although it\n"
+    "    maybe used with --mergeShards.\n"
+    "  --srcSeqAliases=liftFile - rename the source genome sequences of mappingAligns\n"
+    "    as they are loaded, using a UCSC lift file that only renames sequences,\n"
+    "    such as created by ncbiAssemblyReportConvert lift.  All sequences must be in\n"
+    "    the file with the same size.  This replaces editing the alignments with\n"
+    "    ucscLiftEdit.  The source side is the query after --swapMap.\n"
+    "  --targetSeqAliases=liftFile - rename the target genome sequences of\n"
+    "    mappingAligns in the same way.  An alignment of a sequence whose size\n"
+    "    differs from the lift file, such as the UCSC hg19 chrM, is replaced by an\n"
+    "    identity alignment if both sides are renamed to the same sequence of the same\n"
+    "    size, as done by ucscLiftEdit, otherwise it is an error.  The sequence\n"
+    "    aliases can't be used with --mappingCache, --exonsMappingCache or --assembly.\n"
     "Arguments:\n"
     "  inGxf - Input GENCODE GFF3 or GTF file. The format is identified\n"
     "          by a .gff3 or .gtf extension, it maybe compressed with gzip with an\n"
@@ -136,8 +700,11 @@ const struct option long_options[] = {
     {"help", 0, NULL, 'h'},
     {"verbose", 0, NULL, 'v'},
     {"swapMap", 0, NULL, 's'},
+    {"mappingCache", 1, NULL, 'C'},
+    {"exonsMappingCache", 1, NULL, 'E'},
     {"targetGxf", 1, NULL, 't'}, 
     {"previousMappedGxf", 1, NULL, 'M'}, 
+    {"previousSrcGxf", 1, NULL, 'I'},
     {"targetPatches", 1, NULL, 'T'}, 
     {"headerFile", 1, NULL, 'H'},
     {"transcriptPsls", 1, NULL, 'p'},
@@ -147,6 +714,26 @@ const struct option long_options[] = {
     {"useTargetForPseudoGenes", 0, NULL, 'P'},
     {"onlyManualForTargetSubstituteOverlap", 0, NULL, 'O'},
     {"oldStyleParIdHack", 0, NULL, 'Q'},
+    {"threads", 1, NULL, 'j'},
+    {"streamInput", 0, NULL, 'S'},
+    {"sortedMapping", 0, NULL, 'W'},
+    {"stats", 1, NULL, 'X'},
+    {"shard", 1, NULL, 'D'},
+    {"shardIndex", 1, NULL, 'K'},
+    {"mergeShards", 1, NULL, 'G'},
+    {"server", 1, NULL, 'R'},
+    {"lazyAnnotations", 0, NULL, 'L'},
+    {"region", 1, NULL, 'r'},
+    {"geneIds", 1, NULL, 'i'},
+    {"summaryPrefix", 1, NULL, 'Y'},
+    {"mappingInfoColumnar", 1, NULL, 'B'},
+    {"sortMemory", 1, NULL, 'Z'},
+    {"tmpDir", 1, NULL, 'U'},
+    {"assembly", 1, NULL, 'a'},
+    {"mappedGtf", 1, NULL, 'g'},
+    {"srcSeqAliases", 1, NULL, 'e'},
+    {"targetSeqAliases", 1, NULL, 'F'},
+    {"maxMappingCandidates", 1, NULL, 'c'},
     {NULL, 0, NULL, 0}
 };
 const char* short_options = "hst:p:m:n";
@@ -159,16 +746,39 @@ static void prUsage() {
 /* Entry point.  Parse arguments. */
 int main(int argc, char *argv[]) {
     bool swapMap = false;
+    string mappingCache;
+    string exonsMappingCache;
     bool help = false;
     unsigned useTargetFlags = 0;
     string targetGxf;
     string targetPatchBed;
     string headerFile;
     string previousMappedGxf;
+    string previousSrcGxf;
     string transcriptPsls;
     string substituteMissingTargetVersion;
     ParIdHackMethod parIdHackMethod = PAR_ID_HACK_NEW;
     bool onlyManualForTargetSubstituteOverlap = false;
+    int numThreads = 1;
+    bool streamInput = false;
+    bool sortedMapping = false;
+    string statsFile;
+    int shardNum = 0, numShards = 0;
+    string shardIndexFile;
+    StringVector mergeShardIndexes;
+    string serverSocket;
+    bool lazyAnnotations = false;
+    string region;
+    string geneIdsFile;
+    string summaryPrefix;
+    string mappingInfoColumnarFile;
+    size_t sortMemory = 0;
+    string tmpDir = (getenv("TMPDIR") != NULL) ? getenv("TMPDIR") : "/tmp";
+    AssemblyMappingVector assemblies;
+    string mappedGtfFile;
+    string srcSeqAliasesFile;
+    string targetSeqAliasesFile;
+    int maxMappingCandidates = 0;
     opterr = 0;  // we print error message
     while (true) {
         int optc = getopt_long(argc, argv, short_options, long_options, NULL);
@@ -181,6 +791,10 @@ int main(int argc, char *argv[]) {
             gVerbose = true;
         } else if (optc == 's') {
             swapMap = true;
+        } else if (optc == 'C') {
+            mappingCache = string(optarg);
+        } else if (optc == 'E') {
+            exonsMappingCache = string(optarg);
         } else if (optc == 't') {
             targetGxf = string(optarg);
         } else if (optc == 'T') {
@@ -190,6 +804,8 @@ int main(int argc, char *argv[]) {
             headerFile = string(optarg);
         } else if (optc == 'M') {
             previousMappedGxf = string(optarg);
+        } else if (optc == 'I') {
+            previousSrcGxf = string(optarg);
         } else if (optc == 'p') {
             transcriptPsls = string(optarg);
         } else if (optc == 'm') {
@@ -204,6 +820,68 @@ int main(int argc, char *argv[]) {
             useTargetFlags |= GeneMapper::useTargetForPseudoGenes;
         } else if (optc == 'Q') {
             parIdHackMethod = PAR_ID_HACK_OLD;
+        } else if (optc == 'j') {
+            bool isOk = true;
+            numThreads = stringToInt(optarg, &isOk);
+            if ((not isOk) or (numThreads < 1)) {
+                errAbort(toCharStr("--threads must be an integer greater than zero: %s"), optarg);
+            }
+        } else if (optc == 'S') {
+            streamInput = true;
+        } else if (optc == 'W') {
+            sortedMapping = true;
+        } else if (optc == 'X') {
+            statsFile = string(optarg);
+        } else if (optc == 'D') {
+            try {
+                ShardIndex::parseShardSpec(optarg, shardNum, numShards);
+            } catch (const exception& ex) {
+                errAbort(toCharStr("--shard: %s"), ex.what());
+            }
+        } else if (optc == 'K') {
+            shardIndexFile = string(optarg);
+        } else if (optc == 'G') {
+            mergeShardIndexes = stringSplit(optarg, ',');
+        } else if (optc == 'R') {
+            serverSocket = string(optarg);
+        } else if (optc == 'L') {
+            lazyAnnotations = true;
+        } else if (optc == 'r') {
+            region = string(optarg);
+            try {
+                string seqid;
+                int start, end;
+                GeneSelection::parseRegion(region, seqid, start, end);
+            } catch (const exception& ex) {
+                errAbort(toCharStr("--region: %s"), ex.what());
+            }
+        } else if (optc == 'i') {
+            geneIdsFile = string(optarg);
+        } else if (optc == 'Y') {
+            summaryPrefix = string(optarg);
+        } else if (optc == 'B') {
+            mappingInfoColumnarFile = string(optarg);
+        } else if (optc == 'Z') {
+            sortMemory = parseMemorySize(optarg);
+            if (sortMemory == 0) {
+                errAbort(toCharStr("--sortMemory must be a size greater than zero, with an optional K, M, or G suffix: %s"), optarg);
+            }
+        } else if (optc == 'U') {
+            tmpDir = string(optarg);
+        } else if (optc == 'a') {
+            assemblies.push_back(parseAssemblySpec(optarg));
+        } else if (optc == 'g') {
+            mappedGtfFile = string(optarg);
+        } else if (optc == 'e') {
+            srcSeqAliasesFile = string(optarg);
+        } else if (optc == 'F') {
+            targetSeqAliasesFile = string(optarg);
+        } else if (optc == 'c') {
+            bool isOk = true;
+            maxMappingCandidates = stringToInt(optarg, &isOk);
+            if ((not isOk) or (maxMappingCandidates < 1)) {
+                errAbort(toCharStr("--maxMappingCandidates must be an integer greater than zero: %s"), optarg);
+            }
         } else {
             errAbort(toCharStr("invalid option %s"), argv[optind-1]);
         }
@@ -214,7 +892,44 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
+    bool aliasing = (srcSeqAliasesFile.size() > 0) or (targetSeqAliasesFile.size() > 0);
+    if (aliasing and ((mappingCache.size() > 0) or (exonsMappingCache.size() > 0) or (assemblies.size() > 0))) {
+        errAbort(toCharStr("--srcSeqAliases and --targetSeqAliases can't be used with --mappingCache, --exonsMappingCache or --assembly"));
+    }
+    if ((maxMappingCandidates > 0) and (exonsMappingCache.size() > 0)) {
+        errAbort(toCharStr("--maxMappingCandidates can't be used with --exonsMappingCache"));
+    }
+    TransMap::setMaxMappingCandidates(maxMappingCandidates);
+
     int nposargs = (argc - optind);
+    if (serverSocket.size() > 0) {
+        if (nposargs != 1) {
+            cerr << "wrong # args: ";
+            prUsage();
+            return 1;
+        }
+        if ((numShards > 0) or (mergeShardIndexes.size() > 0) or (transcriptPsls.size() > 0)
+            or (region.size() > 0) or (geneIdsFile.size() > 0) or (summaryPrefix.size() > 0)
+            or (mappingInfoColumnarFile.size() > 0) or (assemblies.size() > 0) or (mappedGtfFile.size() > 0)) {
+            errAbort(toCharStr("--server can't be used with --shard, --mergeShards, --transcriptPsls, --region, --geneIds, --summaryPrefix, --mappingInfoColumnar, --assembly or --mappedGtf"));
+        }
+        if ((previousSrcGxf.size() > 0) and (previousMappedGxf.size() == 0)) {
+            errAbort(toCharStr("--previousSrcGxf requires --previousMappedGxf"));
+        }
+        FIOStream::setCompressThreads(numThreads);
+        try {
+            gencodeBackmapServer(serverSocket, argv[optind], swapMap, mappingCache,
+                                 substituteMissingTargetVersion, useTargetFlags,
+                                 onlyManualForTargetSubstituteOverlap, parIdHackMethod,
+                                 headerFile, targetGxf, targetPatchBed, previousMappedGxf,
+                                 previousSrcGxf, numThreads, lazyAnnotations,
+                                 srcSeqAliasesFile, targetSeqAliasesFile);
+        } catch (const exception& ex) {
+            cerr << "Error: " << ex.what() << endl;
+            return 1;
+        }
+        return 0;
+    }
     if ((nposargs < 3) or (nposargs > 4)) {
         cerr << "wrong # args: ";
         prUsage();
@@ -225,20 +940,72 @@ int main(int argc, char *argv[]) {
     string mappedGxfFile = argv[optind+2];
     string mappingInfoTsv = (nposargs > 3) ? argv[optind+3] : "";
 
-    if (not checkGxfFormats(inGxfFile, mappedGxfFile, targetGxf, previousMappedGxf)) {
+    if ((previousSrcGxf.size() > 0) and (previousMappedGxf.size() == 0)) {
+        errAbort(toCharStr("--previousSrcGxf requires --previousMappedGxf"));
+    }
+    if ((previousSrcGxf.size() > 0) and (transcriptPsls.size() > 0)) {
+        errAbort(toCharStr("--previousSrcGxf can't be used with --transcriptPsls"));
+    }
+    if ((numShards > 0) != (shardIndexFile.size() > 0)) {
+        errAbort(toCharStr("--shard and --shardIndex must be used together"));
+    }
+    if ((numShards > 0) and (mergeShardIndexes.size() > 0)) {
+        errAbort(toCharStr("--shard can't be used with --mergeShards"));
+    }
+    if ((numShards > 0) and (mappingInfoTsv.size() == 0)) {
+        errAbort(toCharStr("--shard requires mappingInfoTsv"));
+    }
+    if (((summaryPrefix.size() > 0) or (mappingInfoColumnarFile.size() > 0))
+        and ((numShards > 0) or (mergeShardIndexes.size() > 0))) {
+        errAbort(toCharStr("--summaryPrefix and --mappingInfoColumnar can't be used with --shard or --mergeShards"));
+    }
+    if ((sortMemory > 0) and ((numShards > 0) or (mergeShardIndexes.size() > 0) or (targetPatchBed.size() > 0))) {
+        errAbort(toCharStr("--sortMemory can't be used with --shard, --mergeShards or --targetPatches"));
+    }
+    if ((assemblies.size() > 0) and (streamInput or (numShards > 0) or (mergeShardIndexes.size() > 0))) {
+        errAbort(toCharStr("--assembly can't be used with --streamInput, --shard or --mergeShards"));
+    }
+    if ((mappedGtfFile.size() > 0) and ((numShards > 0) or (sortMemory > 0))) {
+        errAbort(toCharStr("--mappedGtf can't be used with --shard or --sortMemory"));
+    }
+    bool selecting = (region.size() > 0) or (geneIdsFile.size() > 0);
+    if (selecting and (streamInput or (numShards > 0) or (mergeShardIndexes.size() > 0))) {
+        errAbort(toCharStr("--region and --geneIds can't be used with --streamInput, --shard or --mergeShards"));
+    }
+    if (not checkGxfFormats(inGxfFile, mappedGxfFile, targetGxf, previousMappedGxf, previousSrcGxf, assemblies)
+        or not checkMappedGtfFormat(inGxfFile, mappedGtfFile)) {
         return 1;
     }
     
+    FIOStream::setCompressThreads(numThreads);
+    if (statsFile.size() > 0) {
+        gRunStats = new RunStats();
+    }
+    GeneSelection* geneSelection = NULL;
     try {
-        gencodeBackmap(inGxfFile, mappingAligns, swapMap,
+        PhaseTimer totalTimer("total");
+        if (selecting) {
+            geneSelection = new GeneSelection(region, geneIdsFile);
+        }
+        gencodeBackmap(inGxfFile, mappingAligns, swapMap, mappingCache, exonsMappingCache,
                        substituteMissingTargetVersion, useTargetFlags,
                        onlyManualForTargetSubstituteOverlap, parIdHackMethod,
                        headerFile, mappedGxfFile, mappingInfoTsv,
                        targetGxf, targetPatchBed, previousMappedGxf,
-                       transcriptPsls);
+                       previousSrcGxf, transcriptPsls, numThreads, streamInput, sortedMapping,
+                       shardNum, numShards, shardIndexFile, mergeShardIndexes,
+                       lazyAnnotations, geneSelection, summaryPrefix,
+                       mappingInfoColumnarFile, sortMemory, tmpDir, assemblies,
+                       mappedGtfFile, srcSeqAliasesFile, targetSeqAliasesFile);
+        totalTimer.stop();
+        if (gRunStats != NULL) {
+            gRunStats->write(statsFile);
+        }
     } catch (const exception& ex) {
         cerr << "Error: " << ex.what() << endl;
         return 1;
     }
+    delete geneSelection;
+    delete gRunStats;
     return 0;
 }
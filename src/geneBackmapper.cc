@@ -0,0 +1,144 @@
+/*
+ * Library interface for mapping genes in-process.
+ */
+#include "geneBackmapper.hh"
+#include "geneMapper.hh"
+#include "annotationSet.hh"
+#include "srcGenes.hh"
+#include "transMap.hh"
+#include "bedMap.hh"
+#include "concurrentLoads.hh"
+#include "globals.hh"
+#include <sstream>
+
+/* verbose tracing enabled */
+bool gVerbose = false;
+
+/* Constructor from loaded objects, which are owned by this object */
+GeneBackmapper::GeneBackmapper(TransMap* genomeTransMap,
+                               AnnotationSet* targetAnnotations,
+                               AnnotationSet* previousMappedAnnotations,
+                               AnnotationSet* previousSrcAnnotations,
+                               BedMap* targetPatchMap,
+                               const Options& options):
+    fGenomeTransMap(genomeTransMap),
+    fTargetAnnotations(targetAnnotations),
+    fPreviousMappedAnnotations(previousMappedAnnotations),
+    fPreviousSrcAnnotations(previousSrcAnnotations),
+    fTargetPatchMap(targetPatchMap),
+    fOptions(options) {
+}
+
+/* Factory from files */
+GeneBackmapper* GeneBackmapper::factoryFromFiles(const string& mappingAligns,
+                                                 bool swapMap,
+                                                 const string& targetGxf,
+                                                 const string& previousMappedGxf,
+                                                 const string& previousSrcGxf,
+                                                 const string& targetPatchBed,
+                                                 const Options& options) {
+    TransMap* genomeTransMap = NULL;
+    AnnotationSet* targetAnnotations = NULL;
+    AnnotationSet* previousMappedAnnotations = NULL;
+    AnnotationSet* previousSrcAnnotations = NULL;
+    BedMap* targetPatchMap = NULL;
+    ConcurrentLoads loads;
+    loads.add("load mapping alignments", [&]() {
+            genomeTransMap = TransMap::factoryFromFile(mappingAligns, swapMap);
+        });
+    if (targetGxf.size() > 0) {
+        loads.add("load target annotations", [&]() {
+                targetAnnotations = new AnnotationSet(targetGxf);
+            });
+    }
+    if (previousMappedGxf.size() > 0) {
+        loads.add("load previous mapped annotations", [&]() {
+                previousMappedAnnotations = new AnnotationSet(previousMappedGxf);
+            });
+    }
+    if (previousSrcGxf.size() > 0) {
+        loads.add("load previous source annotations", [&]() {
+                previousSrcAnnotations = new AnnotationSet(previousSrcGxf);
+            });
+    }
+    if (targetPatchBed.size() > 0) {
+        loads.add("load target patches", [&]() {
+                targetPatchMap = new BedMap(targetPatchBed);
+            });
+    }
+    try {
+        loads.wait();
+    } catch (...) {
+        delete genomeTransMap;
+        delete targetAnnotations;
+        delete previousMappedAnnotations;
+        delete previousSrcAnnotations;
+        delete targetPatchMap;
+        throw;
+    }
+    return new GeneBackmapper(genomeTransMap, targetAnnotations, previousMappedAnnotations,
+                              previousSrcAnnotations, targetPatchMap, options);
+}
+
+/* parse annotations from a GFF3 or GTF in memory */
+AnnotationSet* GeneBackmapper::parseAnnotations(const string& gxfText,
+                                                GxfFormat gxfFormat) {
+    istringstream gxfIn(gxfText);
+    return new AnnotationSet(gxfIn, gxfFormat);
+}
+
+/* destructor */
+GeneBackmapper::~GeneBackmapper() {
+    delete fGenomeTransMap;
+    delete fTargetAnnotations;
+    delete fPreviousMappedAnnotations;
+    delete fPreviousSrcAnnotations;
+    delete fTargetPatchMap;
+}
+
+/* Map a gene tree */
+GeneBackmapper::GeneResult* GeneBackmapper::mapGene(const FeatureNode* srcGene) const {
+    AnnotationSet srcAnnotations;
+    srcAnnotations.addGene(srcGene->cloneTree());
+    LoadedSrcGenes srcGenes(&srcAnnotations);
+    GeneMapper geneMapper(&srcGenes, fGenomeTransMap, NULL, fTargetAnnotations,
+                          fPreviousMappedAnnotations, fPreviousSrcAnnotations,
+                          fTargetPatchMap, fOptions.substituteTargetVersion,
+                          fOptions.useTargetFlags, fOptions.onlyManualForTargetSubstituteOverlap);
+    geneMapper.setCopyTargetGenes(false);
+    ResultFeatureTreesVector geneResults;
+    geneMapper.setGeneResults(&geneResults);
+
+    AnnotationSet mappedSet(&fGenomeTransMap->fTargetSizes);
+    AnnotationSet unmappedSet(&fGenomeTransMap->fQuerySizes);
+    ostringstream mappingInfoFh;
+    geneMapper.mapGenes(mappedSet, unmappedSet, mappingInfoFh, NULL);
+
+    // take ownership of the trees from the sets
+    mappedSet.releaseGenes();
+    unmappedSet.releaseGenes();
+    GeneResult* result = new GeneResult(srcGene);
+    if (geneResults.size() > 0) {
+        result->trees = geneResults[0];
+        result->trees.src = srcGene;
+    }
+    string mappingInfo = mappingInfoFh.str();
+    result->mappingInfo = mappingInfo.substr(mappingInfo.find('\n') + 1);  // drop header
+    return result;
+}
+
+/* Map all genes in srcAnnotations, the same as a gencode-backmap run */
+void GeneBackmapper::mapAnnotations(const AnnotationSet* srcAnnotations,
+                                    GxfWriter& mappedGxfFh,
+                                    ostream& mappingInfoFh,
+                                    ostream* transcriptPslFh,
+                                    int numThreads) const {
+    LoadedSrcGenes srcGenes(srcAnnotations);
+    GeneMapper geneMapper(&srcGenes, fGenomeTransMap, NULL, fTargetAnnotations,
+                          fPreviousMappedAnnotations, fPreviousSrcAnnotations,
+                          fTargetPatchMap, fOptions.substituteTargetVersion,
+                          fOptions.useTargetFlags, fOptions.onlyManualForTargetSubstituteOverlap,
+                          numThreads);
+    geneMapper.mapGxf(mappedGxfFh, mappingInfoFh, transcriptPslFh);
+    mappedGxfFh.flush();
+}
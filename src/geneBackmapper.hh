@@ -0,0 +1,120 @@
+/*
+ * Library interface for mapping genes in-process.
+ */
+#ifndef geneBackmapper_hh
+#define geneBackmapper_hh
+#include <string>
+#include <iostream>
+#include "gxf.hh"
+#include "featureTree.hh"
+using namespace std;
+class TransMap;
+class AnnotationSet;
+class BedMap;
+
+/*
+ * Interface for programs that embed the mapping rather than running
+ * gencode-backmap.  The mapping alignments and the target and previous
+ * annotations are loaded once, from files or in-memory buffers, and genes are
+ * then mapped without any files.  Mapping methods are const and
+ * thread-safe, so genes can be mapped concurrently on the caller's threads.
+ * Each call is independent: the genes passed are mapped as if they were the
+ * entire input.
+ */
+class GeneBackmapper {
+    public:
+    /* mapping options, defaults are the same as gencode-backmap */
+    struct Options {
+        string substituteTargetVersion;  // --substituteMissingTargets, empty if not substituting
+        unsigned useTargetFlags;         // GeneMapper::useTargetFor* flags
+        bool onlyManualForTargetSubstituteOverlap;
+        ParIdHackMethod parIdHackMethod;  // PAR id style for GTF output
+
+        Options():
+            useTargetFlags(0),
+            onlyManualForTargetSubstituteOverlap(false),
+            parIdHackMethod(PAR_ID_HACK_NEW) {
+        }
+    };
+
+    /*
+     * Result of mapping one gene.  The trees are owned by this object.  The
+     * remap and target status are obtained from trees.getRemapStatus() and
+     * trees.getTargetStatus().  If no trees are set, the gene was not
+     * mapped because of its type or a conflict with another gene, which is
+     * described in the mapping info.
+     */
+    class GeneResult {
+        public:
+        ResultFeatureTrees trees;  // src is the gene that was passed
+        string mappingInfo;        // mapping info TSV rows, without header
+
+        /* constructor */
+        GeneResult(const FeatureNode* srcGene):
+            trees(srcGene) {
+        }
+
+        /* destructor */
+        ~GeneResult() {
+            trees.free();
+        }
+
+        private:
+        GeneResult(const GeneResult&);
+        GeneResult& operator=(const GeneResult&);
+    };
+
+    private:
+    TransMap* fGenomeTransMap;
+    AnnotationSet* fTargetAnnotations;          // NULLs if not used
+    AnnotationSet* fPreviousMappedAnnotations;
+    AnnotationSet* fPreviousSrcAnnotations;
+    BedMap* fTargetPatchMap;
+    const Options fOptions;
+
+    GeneBackmapper(const GeneBackmapper&);
+    GeneBackmapper& operator=(const GeneBackmapper&);
+
+    public:
+    /* Constructor from loaded objects, which are owned by this object.  Any
+     * but genomeTransMap maybe NULL. */
+    GeneBackmapper(TransMap* genomeTransMap,
+                   AnnotationSet* targetAnnotations,
+                   AnnotationSet* previousMappedAnnotations,
+                   AnnotationSet* previousSrcAnnotations,
+                   BedMap* targetPatchMap,
+                   const Options& options);
+
+    /* Factory from files, which are the same as the gencode-backmap options
+     * of the same name.  Empty file names are not used.  The files are
+     * loaded concurrently. */
+    static GeneBackmapper* factoryFromFiles(const string& mappingAligns,
+                                            bool swapMap,
+                                            const string& targetGxf,
+                                            const string& previousMappedGxf,
+                                            const string& previousSrcGxf,
+                                            const string& targetPatchBed,
+                                            const Options& options);
+
+    /* parse annotations from a GFF3 or GTF in memory */
+    static AnnotationSet* parseAnnotations(const string& gxfText,
+                                           GxfFormat gxfFormat);
+
+    /* destructor */
+    ~GeneBackmapper();
+
+    /* Map a gene tree, which is not modified. Target genes are not
+     * copied. */
+    GeneResult* mapGene(const FeatureNode* srcGene) const;
+
+    /* Map all genes in srcAnnotations, the same as a gencode-backmap run,
+     * including copying target genes if requested by the options.  The
+     * transcript PSL output is optional. */
+    void mapAnnotations(const AnnotationSet* srcAnnotations,
+                        GxfWriter& mappedGxfFh,
+                        ostream& mappingInfoFh,
+                        ostream* transcriptPslFh = NULL,
+                        int numThreads = 1) const;
+};
+
+#endif
@@ -4,17 +4,35 @@
 #include "bedMap.hh"
 #include <fstream>
 #include <iostream>
+#include <sstream>
 #include <stdexcept>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <algorithm>
 #include "transcriptMapper.hh"
 #include "annotationSet.hh"
+#include "srcGenes.hh"
 #include "featureTreePolish.hh"
 #include "globals.hh"
+#include "runStats.hh"
 #include "gxf.hh"
+#include "FIOStream.hh"
+#include "transMap.hh"
+#include "geneSelection.hh"
+#include "mappingSummary.hh"
+#include "mappingInfoColumnar.hh"
+#include "sortedGeneRuns.hh"
 
 
 /* fraction of gene expansion that causes a rejection */
 const float geneExpansionThreshold = 0.50;
 
+/* number of genes projected ahead per thread in a batch when mapping with
+ * multiple threads.  This bounds the memory used by results waiting to be
+ * saved in gene order. */
+static const int premapGenesPerThread = 64;
+
 /*  mapinfo TSV headers, terminated by NULL */
 static const char* mappingInfoHeaders[] = {
     "geneNum", "recType", "featType",
@@ -30,7 +48,7 @@ void GeneMapper::outputInfoHeader(ostream& mappingInfoFh) const {
         }
         mappingInfoFh << mappingInfoHeaders[i];
     }
-    mappingInfoFh << endl;
+    mappingInfoFh << "\n";
 }
 
 /* output info record */
@@ -55,7 +73,13 @@ void GeneMapper::outputInfo(const string& recType,
                   << remapStatusToStr(mappingStatus) << "\t"
                   << mappingCount << "\t"
                   << targetStatusToStr(targetStatus)
-                  << endl;
+                  << "\n";
+    if (fMappingSummaries != NULL) {
+        fMappingSummaries->count(recType, featType, feature, mappingStatus, mappingCount, targetStatus);
+    }
+    if (fMappingInfoColumnar != NULL) {
+        fMappingInfoColumnar->add(fCurrentGeneNum, recType, featType, feature, mappingStatus, mappingCount, targetStatus);
+    }
 }
 
 /*
@@ -261,32 +285,52 @@ bool GeneMapper::checkAnyGeneTranscriptsMapped(const FeatureNode* gene) const {
     return false;
 }
 
-/* process one transcript */
+/* process one transcript.  This doesn't modify the mapper state, so it
+ * maybe called from multiple threads. */
 ResultFeatureTrees GeneMapper::processTranscript(const FeatureNode* transcript,
-                                                 ostream* transcriptPslFh) {
-    TranscriptMapper transcriptMapper(fGenomeTransMap, transcript, fTargetAnnotations,
+                                                 PslMapping* exonsMapping,
+                                                 ostream* transcriptPslFh) const {
+    TranscriptMapper transcriptMapper(fGenomeTransMap, transcript, exonsMapping, fTargetAnnotations,
                                       isSrcSeqInMapping(transcript), transcriptPslFh);
     ResultFeatureTrees mappedTranscript = transcriptMapper.mapTranscriptFeatures(transcript);
     TargetStatus targetStatus = getTargetAnnotationStatus(&mappedTranscript);
     mappedTranscript.setTargetStatus(targetStatus);
-    recordTranscriptMapped(transcript);
     return mappedTranscript;
 }
 
-/* process all transcripts of gene. */
+/* process all transcripts of gene, the exons of all transcripts are mapped
+ * together. */
 ResultFeatureTreesVector GeneMapper::processTranscripts(const FeatureNode* gene,
-                                                        ostream* transcriptPslFh) {
-    ResultFeatureTreesVector mappedTranscripts;
-    for (size_t i = 0; i < gene->getNumChildren(); i++) {
-        const FeatureNode* transcript = gene->getChild(i);
-        if (transcript->getType() != GxfFeature::TRANSCRIPT) {
-            throw logic_error("gene record has child that is not of type transcript: " + transcript->toString());
+                                                        ostream* transcriptPslFh) const {
+    const FeatureNodeVector& transcripts = gene->getChildren();
+    for (size_t i = 0; i < transcripts.size(); i++) {
+        if (transcripts[i]->getTypeCode() != GXF_TRANSCRIPT_TYPE) {
+            throw logic_error("gene record has child that is not of type transcript: " + transcripts[i]->toString());
         }
-        mappedTranscripts.push_back(processTranscript(transcript, transcriptPslFh));
+    }
+    PhaseTimer projectTimer("transcript projection", true);
+    vector<PslMapping*> exonsMappings;
+    TranscriptMapper::mapTranscriptsExons(fGenomeTransMap, fExonsMappingCache, transcripts, exonsMappings,
+                                          (transcriptPslFh != NULL));
+    ResultFeatureTreesVector mappedTranscripts;
+    for (size_t i = 0; i < transcripts.size(); i++) {
+        mappedTranscripts.push_back(processTranscript(transcripts[i], exonsMappings[i], transcriptPslFh));
+    }
+    if (gRunStats != NULL) {
+        gRunStats->addGeneLatency(gene->getTypeId() + " " + gene->getTypeName(), projectTimer.stop());
+        gRunStats->addCount("transcripts projected", transcripts.size());
     }
     return mappedTranscripts;
 }
 
+/* record all transcripts of a gene as mapped, done in gene order after
+ * the transcripts are projected. */
+void GeneMapper::recordTranscriptsMapped(const FeatureNode* gene) {
+    for (size_t i = 0; i < gene->getNumChildren(); i++) {
+        recordTranscriptMapped(gene->getChild(i));
+    }
+}
+
 /* find a matching gene or transcript given by id */
 FeatureNode* GeneMapper::findMatchingBoundingFeature(const FeatureNodeVector& features,
                                                      const FeatureNode* feature) const {
@@ -436,7 +480,7 @@ void GeneMapper::setNumGeneMappings(FeatureNode* mappedGeneTree) const {
 bool GeneMapper::checkForPathologicalGeneRename(const ResultFeatureTrees* mappedGene,
                                                 const FeatureNode* targetGene) const {
     return (getBaseId(mappedGene->src->getTypeId()) != getBaseId(targetGene->getTypeId()))
-        and (fSrcAnnotations->getFeatureById(targetGene->getTypeId(), targetGene->isParY()) != NULL);
+        and fSrcGenes->haveFeatureId(targetGene->getTypeId(), targetGene->isParY());
 }
 
 /* should we substitute target version of gene?  */
@@ -550,7 +594,7 @@ void GeneMapper::substituteTarget(ResultFeatureTrees* mappedGene) {
 void GeneMapper::updateMappedGeneBounds(const FeatureNode* mappedTranscript,
                                         string& seqid, string& strand,
                                         int& start, int& end) const {
-    assert(mappedTranscript->getType() == GxfFeature::TRANSCRIPT);
+    assert(mappedTranscript->getTypeCode() == GXF_TRANSCRIPT_TYPE);
     if (seqid == "") {
         // first
         seqid = mappedTranscript->getSeqid();
@@ -630,16 +674,27 @@ ResultFeatureTrees GeneMapper::buildGeneFeature(const FeatureNode* srcGeneTree,
 /* save mapped gene features  */
 void GeneMapper::saveMapped(ResultFeatureTrees& mappedGene,
                             AnnotationSet& mappedSet) {
+    if (fGeneResults != NULL) {
+        fGeneResults->push_back(mappedGene);
+    }
     // either one of target or mapped is saved
+    FeatureNode* gene = NULL;
     if (mappedGene.target != NULL) {
-        recordGeneMapped(mappedGene.target);
-        mappedSet.addGene(mappedGene.target);
+        gene = mappedGene.target;
         mappedGene.target = NULL;
     } else if (mappedGene.mapped != NULL) {
-        recordGeneMapped(mappedGene.mapped);
-        mappedSet.addGene(mappedGene.mapped);
+        gene = mappedGene.mapped;
         mappedGene.mapped = NULL;
     }
+    if (gene != NULL) {
+        recordGeneMapped(gene);
+        if (fSortedGeneRuns != NULL) {
+            fSortedGeneRuns->add(gene);
+            delete gene;
+        } else {
+            mappedSet.addGene(gene);
+        }
+    }
 }
 
 /* save unmapped gene features  */
@@ -729,19 +784,19 @@ void GeneMapper::setGeneLevelMappingAttributes(ResultFeatureTrees* mappedGene) {
 }
 
 /*
- * map and output one gene's annotations
+ * map and output one gene's annotations, given the projected transcripts.
  */
 void GeneMapper::mapGene(const FeatureNode* srcGeneTree,
+                         ResultFeatureTreesVector& mappedTranscripts,
                          AnnotationSet& mappedSet,
                          AnnotationSet& unmappedSet,
                          FeatureTreePolish& featureTreePolish,
-                         ostream& mappingInfoFh,
-                         ostream* transcriptPslFh) {
+                         ostream& mappingInfoFh) {
     if (gVerbose) {
         cerr << "mapGene: "  << featureDesc(srcGeneTree) << endl;
     }
     
-    ResultFeatureTreesVector mappedTranscripts = processTranscripts(srcGeneTree, transcriptPslFh);
+    recordTranscriptsMapped(srcGeneTree);
     ResultFeatureTrees mappedGene = buildGeneFeature(srcGeneTree, mappedTranscripts);
     setGeneLevelMappingAttributes(&mappedGene);
     processGeneLevelMapping(&mappedGene);
@@ -751,12 +806,16 @@ void GeneMapper::mapGene(const FeatureNode* srcGeneTree,
     if (mappedGene.mapped == NULL) {
         outputUnmappedGeneInfo(&mappedGene, mappingInfoFh);
         if (shouldSubstituteTarget(&mappedGene)) {
+            PhaseTimer substituteTimer("target substitution");
             substituteTarget(&mappedGene);
             outputTargetGeneInfo(&mappedGene, "targetSubst", mappingInfoFh);
+            substituteTimer.stop();
         }
     }
     if (mappedGene.mapped != NULL) {
+        PhaseTimer polishTimer("polish genes");
         featureTreePolish.polishGene(mappedGene.mapped);
+        polishTimer.stop();
         outputMappedGeneInfo(&mappedGene, mappingInfoFh);  // MUST do before saveGene, as it moved to output sets
     }
     saveMapped(mappedGene, mappedSet);
@@ -765,9 +824,12 @@ void GeneMapper::mapGene(const FeatureNode* srcGeneTree,
 }
 
 /*
- * map and output one gene's annotations
+ * map and output one gene's annotations.  If premappedGene is not NULL, it
+ * contains the already projected transcripts, which are consumed.  If the
+ * previous mapping of the gene can be reused, it is output instead.
  */
 void GeneMapper::maybeMapGene(const FeatureNode* srcGeneTree,
+                              PremappedGene* premappedGene,
                               AnnotationSet& mappedSet,
                               AnnotationSet& unmappedSet,
                               FeatureTreePolish& featureTreePolish,
@@ -788,11 +850,392 @@ void GeneMapper::maybeMapGene(const FeatureNode* srcGeneTree,
             for (int i = 0; i < srcGeneTree->getNumChildren(); i++) {
                 outputInfo("mapSrc", "trans", srcGeneTree->getChild(i), REMAP_STATUS_ERROR, 0, TARGET_STATUS_ERROR, mappingInfoFh);
             }
+            if (premappedGene != NULL) {
+                premappedGene->fMappedTranscripts.free();
+            }
         } else {
             fCurrentGeneNum++;
-            mapGene(srcGeneTree, mappedSet, unmappedSet, featureTreePolish, mappingInfoFh, transcriptPslFh);
+            const FeatureNode* prevMappedGene = getReusableMappedGene(srcGeneTree);
+            if (prevMappedGene != NULL) {
+                reuseMappedGene(srcGeneTree, prevMappedGene, mappedSet, mappingInfoFh);
+            } else if (premappedGene != NULL) {
+                assert(premappedGene->fPremapped);
+                if (transcriptPslFh != NULL) {
+                    *transcriptPslFh << premappedGene->fTranscriptPsls;
+                }
+                mapGene(srcGeneTree, premappedGene->fMappedTranscripts, mappedSet, unmappedSet, featureTreePolish, mappingInfoFh);
+            } else {
+                ResultFeatureTreesVector mappedTranscripts = processTranscripts(srcGeneTree, transcriptPslFh);
+                mapGene(srcGeneTree, mappedTranscripts, mappedSet, unmappedSet, featureTreePolish, mappingInfoFh);
+            }
+        }
+    }
+}
+
+/* compare two feature trees, including attributes and the order of
+ * children */
+static bool sameFeatureTree(const FeatureNode* feature1,
+                            const FeatureNode* feature2) {
+    if ((feature1->getNumChildren() != feature2->getNumChildren())
+        or (feature1->toString() != feature2->toString())) {
+        return false;
+    }
+    for (size_t i = 0; i < feature1->getNumChildren(); i++) {
+        if (not sameFeatureTree(feature1->getChild(i), feature2->getChild(i))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* was a previous feature mapped, rather than substituted from the target */
+static bool isPrevRemapped(const FeatureNode* prevFeature) {
+    return prevFeature->hasAttr(REMAP_STATUS_ATTR)
+        and not prevFeature->hasAttr(REMAP_SUBSTITUTED_MISSING_TARGET_ATTR);
+}
+
+/* find the transcript of a previous mapped gene that was mapped from
+ * srcTranscript, or NULL if there is not exactly one */
+static const FeatureNode* findPrevMappedTranscript(const FeatureNode* prevMappedGene,
+                                                   const FeatureNode* srcTranscript) {
+    const FeatureNode* found = NULL;
+    for (size_t i = 0; i < prevMappedGene->getNumChildren(); i++) {
+        const FeatureNode* prevTranscript = prevMappedGene->getChild(i);
+        if (getPreMappedId(prevTranscript->getTypeId()) == srcTranscript->getTypeId()) {
+            if (found != NULL) {
+                return NULL;
+            }
+            found = prevTranscript;
+        }
+    }
+    return found;
+}
+
+/*
+ * Get the previous mapping of a gene if it can be reused, otherwise NULL.
+ * The source gene must be identical to the previous source gene, and all
+ * of its transcripts must have been mapped.  Genes that were partially
+ * mapped, or where the target was substituted, are remapped, as the
+ * previous mapped GxF doesn't have the unmapped parts.  This assumes that
+ * the genomic mapping and target annotations are unchanged.  It doesn't
+ * modify the mapper state, so it maybe called from multiple threads.
+ */
+const FeatureNode* GeneMapper::getReusableMappedGene(const FeatureNode* srcGeneTree) const {
+    if ((fPreviousSrcAnnotations == NULL) or (fPreviousMappedAnotations == NULL)) {
+        return NULL;
+    }
+    const FeatureNode* prevSrcGene = fPreviousSrcAnnotations->getFeatureById(srcGeneTree->getTypeId(), srcGeneTree->isParY());
+    if ((prevSrcGene == NULL) or (not prevSrcGene->isGene())
+        or (not sameFeatureTree(prevSrcGene, srcGeneTree))) {
+        return NULL;
+    }
+    const FeatureNode* prevMappedGene = fPreviousMappedAnotations->getFeatureById(srcGeneTree->getTypeId(), srcGeneTree->isParY());
+    if ((prevMappedGene == NULL) or (not prevMappedGene->isGene())
+        or (not isPrevRemapped(prevMappedGene))
+        or (getPreMappedId(prevMappedGene->getTypeId()) != srcGeneTree->getTypeId())
+        or (prevMappedGene->getNumChildren() != srcGeneTree->getNumChildren())) {
+        return NULL;
+    }
+    for (size_t i = 0; i < srcGeneTree->getNumChildren(); i++) {
+        const FeatureNode* prevTranscript = findPrevMappedTranscript(prevMappedGene, srcGeneTree->getChild(i));
+        if ((prevTranscript == NULL) or (not isPrevRemapped(prevTranscript))) {
+            return NULL;
         }
     }
+    return prevMappedGene;
+}
+
+/* recursively set the mapping status of a previous mapped feature from its
+ * attributes */
+static void setStatusFromAttrs(FeatureNode* feature) {
+    const AttrVal* remapStatusAttr = feature->findAttr(REMAP_STATUS_ATTR);
+    if (remapStatusAttr != NULL) {
+        feature->setRemapStatus(remapStatusFromStr(remapStatusAttr->getVal()));
+    }
+    const AttrVal* targetStatusAttr = feature->findAttr(REMAP_TARGET_STATUS_ATTR);
+    if (targetStatusAttr != NULL) {
+        feature->setTargetStatus(targetStatusFromStr(targetStatusAttr->getVal()));
+    }
+    const AttrVal* numMappingsAttr = feature->findAttr(REMAP_NUM_MAPPINGS_ATTR);
+    if (numMappingsAttr != NULL) {
+        feature->setNumMappings(stringToInt(numMappingsAttr->getVal()));
+    }
+    for (size_t i = 0; i < feature->getNumChildren(); i++) {
+        setStatusFromAttrs(feature->getChild(i));
+    }
+}
+
+/*
+ * Output a copy of the previous mapping of an unchanged gene, recording
+ * and reporting it the same as a mapped gene.
+ */
+void GeneMapper::reuseMappedGene(const FeatureNode* srcGeneTree,
+                                 const FeatureNode* prevMappedGene,
+                                 AnnotationSet& mappedSet,
+                                 ostream& mappingInfoFh) {
+    if (gVerbose) {
+        cerr << "reuseMappedGene: "  << featureDesc(srcGeneTree) << endl;
+    }
+    if (gRunStats != NULL) {
+        gRunStats->addCount("genes reused");
+    }
+    recordTranscriptsMapped(srcGeneTree);
+    ResultFeatureTrees mappedGene(srcGeneTree, prevMappedGene->cloneTree());
+    setStatusFromAttrs(mappedGene.mapped);
+    outputSrcGeneInfo(&mappedGene, mappingInfoFh);
+    outputMappedGeneInfo(&mappedGene, mappingInfoFh);
+    saveMapped(mappedGene, mappedSet);
+    mappedGene.free();
+}
+
+/*
+ * Project the transcripts of a gene without recording any state, so it can
+ * be run in a worker thread.  PSLs are saved as text if requested.  Genes
+ * whose previous mapping will be reused are not projected.
+ */
+void GeneMapper::premapGene(const FeatureNode* srcGeneTree,
+                            PremappedGene& premappedGene,
+                            bool savePsls) const {
+    if (shouldMapGeneType(srcGeneTree) and (getReusableMappedGene(srcGeneTree) == NULL)) {
+        ostringstream transcriptPslFh;
+        premappedGene.fMappedTranscripts = processTranscripts(srcGeneTree, (savePsls ? &transcriptPslFh : NULL));
+        premappedGene.fTranscriptPsls = transcriptPslFh.str();
+        premappedGene.fPremapped = true;
+    }
+}
+
+/*
+ * Project a batch of genes using a pool of threads.  Each thread takes the
+ * next unclaimed gene, so threads don't sit idle behind large loci.  The
+ * first exception is rethrown after all threads have finished.
+ */
+void GeneMapper::premapGenes(const FeatureNodeVector& srcGenes,
+                             PremappedGeneVector& premappedGenes,
+                             bool savePsls) const {
+    std::atomic<int> nextIdx(0);
+    std::exception_ptr firstError;
+    std::mutex errorMutex;
+    int numGenes = srcGenes.size();
+    auto worker = [&]() {
+        int iGene;
+        while ((iGene = nextIdx++) < numGenes) {
+            try {
+                premapGene(srcGenes[iGene], premappedGenes[iGene], savePsls);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (not firstError) {
+                    firstError = std::current_exception();
+                }
+                nextIdx = numGenes;
+            }
+        }
+    };
+    vector<std::thread> threads;
+    for (int i = 0; i < fNumThreads; i++) {
+        threads.push_back(std::thread(worker));
+    }
+    for (int i = 0; i < threads.size(); i++) {
+        threads[i].join();
+    }
+    if (firstError) {
+        std::rethrow_exception(firstError);
+    }
+}
+
+/* is a source gene in the shard being mapped? */
+bool GeneMapper::inShard(const FeatureNode* srcGeneTree) const {
+    map<string, int>::const_iterator it = fSeqShards.find(srcGeneTree->getSeqid());
+    int shardNum = (it == fSeqShards.end()) ? 1 : it->second;
+    return shardNum == fShardIndex->fShardNum;
+}
+
+/* get the next source gene to map and its index in the input, skipping
+ * genes not in the shard being mapped or not selected.  NULL when no
+ * more. */
+FeatureNode* GeneMapper::nextSrcGene(int& srcGeneIdx) {
+    FeatureNode* srcGene;
+    while ((srcGene = fSrcGenes->nextGene()) != NULL) {
+        srcGeneIdx = fNextSrcGeneIdx++;
+        if (((fShardIndex == NULL) or inShard(srcGene))
+            and ((fGeneSelection == NULL) or fGeneSelection->isSelected(srcGene))) {
+            return srcGene;
+        }
+        fSrcGenes->releaseGene(srcGene);
+    }
+    return NULL;
+}
+
+/* count lines in a string */
+static int countLines(const string& text) {
+    return count(text.begin(), text.end(), '\n');
+}
+
+/*
+ * Map and output a gene with maybeMapGene().  When mapping a shard, the
+ * outputs of the gene are collected to record their counts in the shard
+ * index.
+ */
+void GeneMapper::commitGene(const FeatureNode* srcGeneTree,
+                            int srcGeneIdx,
+                            PremappedGene* premappedGene,
+                            AnnotationSet& mappedSet,
+                            AnnotationSet& unmappedSet,
+                            FeatureTreePolish& featureTreePolish,
+                            ostream& mappingInfoFh,
+                            ostream* transcriptPslFh) {
+    if (fShardIndex == NULL) {
+        maybeMapGene(srcGeneTree, premappedGene, mappedSet, unmappedSet, featureTreePolish, mappingInfoFh, transcriptPslFh);
+        return;
+    }
+    ostringstream geneInfoFh, genePslFh;
+    int prevGeneNum = fCurrentGeneNum;
+    int prevNumMapped = mappedSet.getGenes().size();
+    maybeMapGene(srcGeneTree, premappedGene, mappedSet, unmappedSet, featureTreePolish, geneInfoFh,
+                 ((transcriptPslFh != NULL) ? &genePslFh : NULL));
+    ShardIndex::GeneRecord geneRecord;
+    geneRecord.srcGeneIdx = srcGeneIdx;
+    geneRecord.geneNumIncr = (fCurrentGeneNum != prevGeneNum);
+    geneRecord.numInfoRows = countLines(geneInfoFh.str());
+    geneRecord.numMappedGenes = mappedSet.getGenes().size() - prevNumMapped;
+    geneRecord.numPslRows = countLines(genePslFh.str());
+    if (geneRecord.geneNumIncr or (geneRecord.numInfoRows > 0) or (geneRecord.numMappedGenes > 0) or (geneRecord.numPslRows > 0)) {
+        fShardIndex->fGeneRecords.push_back(geneRecord);
+    }
+    mappingInfoFh << geneInfoFh.str();
+    if (transcriptPslFh != NULL) {
+        *transcriptPslFh << genePslFh.str();
+    }
+}
+
+/* map genes one at a time */
+void GeneMapper::mapGenesSerial(AnnotationSet& mappedSet,
+                                AnnotationSet& unmappedSet,
+                                FeatureTreePolish& featureTreePolish,
+                                ostream& mappingInfoFh,
+                                ostream* transcriptPslFh) {
+    FeatureNode* srcGene;
+    int srcGeneIdx;
+    while ((srcGene = nextSrcGene(srcGeneIdx)) != NULL) {
+        commitGene(srcGene, srcGeneIdx, NULL, mappedSet, unmappedSet, featureTreePolish, mappingInfoFh, transcriptPslFh);
+        fSrcGenes->releaseGene(srcGene);
+    }
+}
+
+/*
+ * map genes in batches, with the transcript projection done in parallel.
+ * The decisions that depend on previously mapped genes are then made
+ * serially in gene order, so the results are identical to a serial run.
+ * Genes that are then found to be already mapped have their projections
+ * discarded.
+ */
+void GeneMapper::mapGenesThreaded(AnnotationSet& mappedSet,
+                                  AnnotationSet& unmappedSet,
+                                  FeatureTreePolish& featureTreePolish,
+                                  ostream& mappingInfoFh,
+                                  ostream* transcriptPslFh) {
+    int batchSize = fNumThreads * premapGenesPerThread;
+    FeatureNodeVector srcGenes;
+    vector<int> srcGeneIdxs;
+    FeatureNode* srcGene;
+    int srcGeneIdx;
+    do {
+        srcGenes.clear();
+        srcGeneIdxs.clear();
+        while ((srcGenes.size() < batchSize) and ((srcGene = nextSrcGene(srcGeneIdx)) != NULL)) {
+            srcGenes.push_back(srcGene);
+            srcGeneIdxs.push_back(srcGeneIdx);
+        }
+        PremappedGeneVector premappedGenes(srcGenes.size());
+        premapGenes(srcGenes, premappedGenes, (transcriptPslFh != NULL));
+        for (int i = 0; i < srcGenes.size(); i++) {
+            commitGene(srcGenes[i], srcGeneIdxs[i], &(premappedGenes[i]), mappedSet, unmappedSet,
+                       featureTreePolish, mappingInfoFh, transcriptPslFh);
+            fSrcGenes->releaseGene(srcGenes[i]);
+        }
+    } while (srcGenes.size() == batchSize);
+}
+
+/* compare genes for sorting by genomic position */
+static bool geneLocationLessThan(const FeatureNode* gene1,
+                                 const FeatureNode* gene2) {
+    int diff = gene1->getSeqid().compare(gene2->getSeqid());
+    if (diff != 0) {
+        return diff < 0;
+    } else {
+        return gene1->getStart() < gene2->getStart();
+    }
+}
+
+/*
+ * Project a run of genes on the same chromosome in location order, so
+ * successive lookups of the mapping alignments are to nearby locations.
+ * The genes are then committed and released in input order.
+ */
+void GeneMapper::mapGeneRunSorted(const FeatureNodeVector& srcGenes,
+                                  const vector<int>& srcGeneIdxs,
+                                  AnnotationSet& mappedSet,
+                                  AnnotationSet& unmappedSet,
+                                  FeatureTreePolish& featureTreePolish,
+                                  ostream& mappingInfoFh,
+                                  ostream* transcriptPslFh) {
+    vector<int> order;
+    for (int i = 0; i < srcGenes.size(); i++) {
+        order.push_back(i);
+    }
+    stable_sort(order.begin(), order.end(),
+                [&srcGenes](int i1, int i2) -> bool {
+                    return geneLocationLessThan(srcGenes[i1], srcGenes[i2]);
+                });
+    FeatureNodeVector sortedGenes;
+    vector<int> sortedIdxs(srcGenes.size());
+    for (int i = 0; i < order.size(); i++) {
+        sortedGenes.push_back(srcGenes[order[i]]);
+        sortedIdxs[order[i]] = i;
+    }
+
+    bool savePsls = (transcriptPslFh != NULL);
+    PremappedGeneVector premappedGenes(sortedGenes.size());
+    if (fNumThreads > 1) {
+        premapGenes(sortedGenes, premappedGenes, savePsls);
+    } else {
+        for (int i = 0; i < sortedGenes.size(); i++) {
+            premapGene(sortedGenes[i], premappedGenes[i], savePsls);
+        }
+    }
+    for (int i = 0; i < srcGenes.size(); i++) {
+        commitGene(srcGenes[i], srcGeneIdxs[i], &(premappedGenes[sortedIdxs[i]]), mappedSet, unmappedSet,
+                   featureTreePolish, mappingInfoFh, transcriptPslFh);
+        fSrcGenes->releaseGene(srcGenes[i]);
+    }
+}
+
+/*
+ * Map genes in runs of consecutive genes on the same chromosome, which is
+ * normally a whole chromosome, projecting each run in genomic order.  The
+ * decisions that depend on previously mapped genes are made in input order,
+ * so the results are identical to mapping in input order.  Only one run of
+ * genes and their projections are kept in memory at a time.
+ */
+void GeneMapper::mapGenesSorted(AnnotationSet& mappedSet,
+                                AnnotationSet& unmappedSet,
+                                FeatureTreePolish& featureTreePolish,
+                                ostream& mappingInfoFh,
+                                ostream* transcriptPslFh) {
+    FeatureNodeVector srcGenes;
+    vector<int> srcGeneIdxs;
+    int srcGeneIdx;
+    FeatureNode* srcGene = nextSrcGene(srcGeneIdx);
+    while (srcGene != NULL) {
+        srcGenes.clear();
+        srcGeneIdxs.clear();
+        const string seqid = srcGene->getSeqid();
+        do {
+            srcGenes.push_back(srcGene);
+            srcGeneIdxs.push_back(srcGeneIdx);
+        } while (((srcGene = nextSrcGene(srcGeneIdx)) != NULL) and (srcGene->getSeqid() == seqid));
+        mapGeneRunSorted(srcGenes, srcGeneIdxs, mappedSet, unmappedSet, featureTreePolish,
+                         mappingInfoFh, transcriptPslFh);
+    }
 }
 
 /* determine if this is a gene type that should not be mapped, returning
@@ -900,23 +1343,242 @@ void GeneMapper::copyTargetGenes(AnnotationSet& mappedSet,
     }
 }
 
+/* copy target genes if requested and sort the mapped genes */
+void GeneMapper::finishMappedSet(AnnotationSet& mappedSet,
+                                 ostream& mappingInfoFh) {
+    if (fCopyTargetGenes and (fUseTargetFlags != 0) and (fTargetAnnotations != NULL)) {
+        PhaseTimer copyTimer("copy target genes");
+        copyTargetGenes(mappedSet, mappingInfoFh);
+    }
+    PhaseTimer sortTimer("sort mapped genes");
+    mappedSet.sortGenes();
+}
+
+/* Only map the source genes on the sequences assigned to a shard */
+void GeneMapper::setShard(ShardIndex* shardIndex) {
+    fShardIndex = shardIndex;
+    fSeqShards = ShardIndex::assignSeqShards(fGenomeTransMap->fQuerySizes, shardIndex->fNumShards);
+    fMappedIdsNames.trackReferenced(&shardIndex->fReferencedIds);
+}
+
+/* Sort mapped genes in runs written to temporary files */
+void GeneMapper::setExternalSort(size_t memoryLimit,
+                                 const string& tmpPrefix) {
+    fSortMemoryLimit = memoryLimit;
+    fSortTmpPrefix = tmpPrefix;
+}
+
 /* Map a GFF3/GTF */
 void GeneMapper::mapGxf(GxfWriter& mappedGxfFh,
                         ostream& mappingInfoFh,
                         ostream* transcriptPslFh) {
+    if ((fSortMemoryLimit > 0) and (fShardIndex == NULL)) {
+        if ((fGeneResults != NULL) or (fUseTargetFlags & useTargetForPatchRegions) or (fMappedGtfFh != NULL)) {
+            throw logic_error("GeneMapper: external sort can't be used with gene results, target patch regions or GTF output");
+        }
+        fSortedGeneRuns = new SortedGeneRuns(mappedGxfFh, fSortTmpPrefix, fSortMemoryLimit);
+    }
     AnnotationSet mappedSet(&fGenomeTransMap->fTargetSizes);
     AnnotationSet unmappedSet(&fGenomeTransMap->fQuerySizes);
+    long numWritten;
+    try {
+        mapGenes(mappedSet, unmappedSet, mappingInfoFh, transcriptPslFh);
+        PhaseTimer writeTimer("write mapped genes");
+        if (fSortedGeneRuns != NULL) {
+            fSortedGeneRuns->write(mappedSet);
+            numWritten = fSortedGeneRuns->getNumGenes();
+            if (gRunStats != NULL) {
+                gRunStats->addCount("mapped gene sort runs", fSortedGeneRuns->getNumRuns());
+            }
+        } else {
+            mappedSet.write(mappedGxfFh);
+            if ((fMappedGtfFh != NULL) and (fShardIndex == NULL)) {
+                mappedSet.write(*fMappedGtfFh);
+            }
+            numWritten = mappedSet.getGenes().size();
+        }
+    } catch (...) {
+        delete fSortedGeneRuns;  // removes run files
+        fSortedGeneRuns = NULL;
+        throw;
+    }
+    delete fSortedGeneRuns;
+    fSortedGeneRuns = NULL;
+    if (gRunStats != NULL) {
+        gRunStats->addCount("source genes mapped", fCurrentGeneNum + 1);
+        gRunStats->addCount("mapped genes written", numWritten);
+        gRunStats->addCount("unmapped genes", unmappedSet.getGenes().size());
+    }
+}
+
+/* Map all source genes, saving the results in mappedSet and unmappedSet */
+void GeneMapper::mapGenes(AnnotationSet& mappedSet,
+                          AnnotationSet& unmappedSet,
+                          ostream& mappingInfoFh,
+                          ostream* transcriptPslFh) {
     FeatureTreePolish featureTreePolish(fPreviousMappedAnotations);
-    
-    const FeatureNodeVector& srcGenes = fSrcAnnotations->getGenes();
     outputInfoHeader(mappingInfoFh);
-    for (int i = 0; i < srcGenes.size(); i++) {
-        maybeMapGene(srcGenes[i], mappedSet, unmappedSet, featureTreePolish, mappingInfoFh, transcriptPslFh);
+    PhaseTimer mapTimer("map genes");
+    if (fSortedMapping) {
+        mapGenesSorted(mappedSet, unmappedSet, featureTreePolish, mappingInfoFh, transcriptPslFh);
+    } else if (fNumThreads > 1) {
+        mapGenesThreaded(mappedSet, unmappedSet, featureTreePolish, mappingInfoFh, transcriptPslFh);
+    } else {
+        mapGenesSerial(mappedSet, unmappedSet, featureTreePolish, mappingInfoFh, transcriptPslFh);
     }
-    if ((fUseTargetFlags != 0) and (fTargetAnnotations != NULL)) {
-        copyTargetGenes(mappedSet, mappingInfoFh);
+    mapTimer.stop();
+    if (fShardIndex != NULL) {
+        // targets are copied and genes sorted when merging
+        fShardIndex->fMappedIds.insert(fMappedIdsNames.begin(), fMappedIdsNames.end());
+    } else {
+        finishMappedSet(mappedSet, mappingInfoFh);
+    }
+}
+
+/* read a line from a shard output file */
+static void readShardLine(istream& fh,
+                          const string& fileName,
+                          string& line) {
+    if (not getline(fh, line)) {
+        throw invalid_argument("shard output file is shorter than described by its index: " + fileName);
     }
-    mappedSet.sortGenes();
-    mappedSet.write(mappedGxfFh);
 }
 
+/* Merge the output of one source gene from a shard, renumbering the
+ * mapping info rows.  Ownership of the mapped genes is passed to mappedSet
+ * and their entries in shardMappedGenes set to NULL. */
+void GeneMapper::mergeShardGene(ShardIndex* shardIndex,
+                                const ShardIndex::GeneRecord& geneRecord,
+                                istream& shardInfoFh,
+                                istream* shardPslFh,
+                                FeatureNodeVector& shardMappedGenes,
+                                size_t& iShardMapped,
+                                AnnotationSet& mappedSet,
+                                ostream& mappingInfoFh,
+                                ostream* transcriptPslFh) {
+    if (geneRecord.geneNumIncr) {
+        fCurrentGeneNum++;
+    }
+    string line;
+    for (int i = 0; i < geneRecord.numInfoRows; i++) {
+        readShardLine(shardInfoFh, shardIndex->fMappingInfoTsv, line);
+        size_t itab = line.find('\t');
+        if (itab == string::npos) {
+            throw invalid_argument("invalid mapping info row in " + shardIndex->fMappingInfoTsv + ": " + line);
+        }
+        mappingInfoFh << fCurrentGeneNum << line.substr(itab) << "\n";
+    }
+    for (int i = 0; i < geneRecord.numPslRows; i++) {
+        readShardLine(*shardPslFh, shardIndex->fTranscriptPsls, line);
+        *transcriptPslFh << line << "\n";
+    }
+    for (int i = 0; i < geneRecord.numMappedGenes; i++) {
+        if (iShardMapped >= shardMappedGenes.size()) {
+            throw invalid_argument("shard mapped GxF has fewer genes than described by its index: " + shardIndex->fMappedGxf);
+        }
+        // pass ownership rather than copying the tree
+        mappedSet.addGene(shardMappedGenes[iShardMapped]);
+        shardMappedGenes[iShardMapped++] = NULL;
+    }
+}
+
+/* Merge the outputs of mapping each shard */
+void GeneMapper::mergeShards(const StringVector& shardIndexFiles,
+                             GxfWriter& mappedGxfFh,
+                             ostream& mappingInfoFh,
+                             ostream* transcriptPslFh) {
+    PhaseTimer loadTimer("load shards");
+    vector<ShardIndex*> shardIndexes;
+    for (size_t i = 0; i < shardIndexFiles.size(); i++) {
+        shardIndexes.push_back(ShardIndex::load(shardIndexFiles[i]));
+    }
+    int numShards = shardIndexes.size();
+    set<int> shardNums;
+    for (int i = 0; i < numShards; i++) {
+        ShardIndex* shardIndex = shardIndexes[i];
+        if (shardIndex->fNumShards != numShards) {
+            throw invalid_argument("expected " + toString(shardIndex->fNumShards) + " shard indexes, got "
+                                   + toString(numShards) + ": " + shardIndexFiles[i]);
+        }
+        if (not shardNums.insert(shardIndex->fShardNum).second) {
+            throw invalid_argument("shard " + toString(shardIndex->fShardNum) + " specified more than once: " + shardIndexFiles[i]);
+        }
+        if ((transcriptPslFh != NULL) and (shardIndex->fTranscriptPsls.size() == 0)) {
+            throw invalid_argument("transcript PSLs requested, but shard has none: " + shardIndexFiles[i]);
+        }
+    }
+
+    // ids or names seen by more than one shard mean shards could have
+    // affected each other's results
+    map<ShardIndex::IdKey, int> referencingShards;
+    for (int i = 0; i < numShards; i++) {
+        const ShardIndex::IdKeySet& referencedIds = shardIndexes[i]->fReferencedIds;
+        for (ShardIndex::IdKeySet::const_iterator it = referencedIds.begin(); it != referencedIds.end(); it++) {
+            map<ShardIndex::IdKey, int>::const_iterator prev = referencingShards.find(*it);
+            if (prev != referencingShards.end()) {
+                throw invalid_argument("id or name \"" + it->first + "\" is used by genes in both shard "
+                                       + toString(shardIndexes[prev->second]->fShardNum) + " and shard "
+                                       + toString(shardIndexes[i]->fShardNum) + ", the shards can't be merged");
+            }
+            referencingShards[*it] = i;
+        }
+        fMappedIdsNames.insert(shardIndexes[i]->fMappedIds.begin(), shardIndexes[i]->fMappedIds.end());
+    }
+
+    vector<FeatureNodeVector> shardMappedGenes(numShards);
+    vector<FIOStream*> shardInfoFhs, shardPslFhs;
+    string line;
+    for (int i = 0; i < numShards; i++) {
+        AnnotationSet shardMappedSet(shardIndexes[i]->fMappedGxf);
+        shardMappedGenes[i] = shardMappedSet.releaseGenes();
+        shardInfoFhs.push_back(new FIOStream(shardIndexes[i]->fMappingInfoTsv));
+        readShardLine(*shardInfoFhs[i], shardIndexes[i]->fMappingInfoTsv, line);  // header
+        shardPslFhs.push_back((transcriptPslFh != NULL) ? new FIOStream(shardIndexes[i]->fTranscriptPsls) : NULL);
+    }
+    loadTimer.stop();
+
+    // merge in input order
+    PhaseTimer mergeTimer("merge shards");
+    AnnotationSet mappedSet(&fGenomeTransMap->fTargetSizes);
+    outputInfoHeader(mappingInfoFh);
+    vector<size_t> iGeneRecords(numShards, 0), iShardMapped(numShards, 0);
+    while (true) {
+        int iNext = -1;
+        for (int i = 0; i < numShards; i++) {
+            const ShardIndex::GeneRecordVector& geneRecords = shardIndexes[i]->fGeneRecords;
+            if ((iGeneRecords[i] < geneRecords.size())
+                and ((iNext < 0) or (geneRecords[iGeneRecords[i]].srcGeneIdx
+                                     < shardIndexes[iNext]->fGeneRecords[iGeneRecords[iNext]].srcGeneIdx))) {
+                iNext = i;
+            }
+        }
+        if (iNext < 0) {
+            break;
+        }
+        mergeShardGene(shardIndexes[iNext], shardIndexes[iNext]->fGeneRecords[iGeneRecords[iNext]++],
+                       *shardInfoFhs[iNext], shardPslFhs[iNext], shardMappedGenes[iNext], iShardMapped[iNext],
+                       mappedSet, mappingInfoFh, transcriptPslFh);
+    }
+    for (int i = 0; i < numShards; i++) {
+        if ((iShardMapped[i] != shardMappedGenes[i].size())
+            or getline(*shardInfoFhs[i], line)
+            or ((shardPslFhs[i] != NULL) and getline(*shardPslFhs[i], line))) {
+            throw invalid_argument("shard outputs have more records than described by its index: " + shardIndexFiles[i]);
+        }
+        delete shardInfoFhs[i];
+        delete shardPslFhs[i];
+        delete shardIndexes[i];
+    }
+    mergeTimer.stop();
+
+    finishMappedSet(mappedSet, mappingInfoFh);
+    PhaseTimer writeTimer("write mapped genes");
+    mappedSet.write(mappedGxfFh);
+    if (fMappedGtfFh != NULL) {
+        mappedSet.write(*fMappedGtfFh);
+    }
+    if (gRunStats != NULL) {
+        gRunStats->addCount("source genes mapped", fCurrentGeneNum + 1);
+        gRunStats->addCount("mapped genes written", mappedSet.getGenes().size());
+    }
+}
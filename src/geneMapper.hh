@@ -6,16 +6,25 @@
 #include "gxf.hh"
 #include "featureTree.hh"
 #include "typeOps.hh"
+#include "shardIndex.hh"
 #include <iostream>
 #include <set>
+#include <map>
+#include <vector>
 class TransMap;
+class ExonsMappingCache;
 class PslMapping;
 struct psl;
 class PslCursor;
 class AnnotationSet;
+class SrcGenes;
 class BedMap;
 class FeatureTreePolish;
 class GxfWriter;
+class GeneSelection;
+class MappingSummaries;
+class MappingInfoColumnar;
+class SortedGeneRuns;
 
 /* class that maps a gene to the new assemble */
 class GeneMapper {
@@ -31,36 +40,67 @@ class GeneMapper {
     /* set of (baseId, isParY) or  (name, isParY) that have been mapped. */
     class MappedIdSet: public set<pair<string, bool> > {
         typedef pair<string, bool> Key;
+        set<Key>* fReferenced;  // if not NULL, all keys used are added
+
+        const Key& reference(const Key& key) const {
+            if (fReferenced != NULL) {
+                fReferenced->insert(key);
+            }
+            return key;
+        }
         public:
+        MappedIdSet():
+            fReferenced(NULL) {
+        }
+        void trackReferenced(set<Key>* referenced) {
+            fReferenced = referenced;
+        }
         void addBaseId(const string& fullid, bool isParY) {
-            insert(Key(getBaseId(fullid), isParY));
+            insert(reference(Key(getBaseId(fullid), isParY)));
         }
         bool haveBaseId(const string& fullid, bool isParY) const {
-            return find(Key(getBaseId(fullid), isParY)) != end();
+            return find(reference(Key(getBaseId(fullid), isParY))) != end();
         }
         void removeBaseId(const string& fullid, bool isParY) {
-            erase(Key(getBaseId(fullid), isParY));
+            erase(reference(Key(getBaseId(fullid), isParY)));
         }
         void addName(const string& name, bool isParY) {
-            insert(Key(name, isParY));
+            insert(reference(Key(name, isParY)));
         }
         bool haveName(const string& name, bool isParY) const {
-            return find(Key(name, isParY)) != end();
+            return find(reference(Key(name, isParY))) != end();
         }
         void removeName(const string& name, bool isParY) {
-            erase(Key(name, isParY));
+            erase(reference(Key(name, isParY)));
         }
     };
 
+    /* transcripts of a gene projected ahead of time by a worker thread,
+     * along with the transcript PSLs that would have been written. */
+    class PremappedGene {
+        public:
+        bool fPremapped;  // was the gene projected?
+        ResultFeatureTreesVector fMappedTranscripts;
+        string fTranscriptPsls;
+
+        PremappedGene():
+            fPremapped(false) {
+        }
+    };
+    typedef vector<PremappedGene> PremappedGeneVector;
     
-    const AnnotationSet* fSrcAnnotations; // source annotations
+    SrcGenes* fSrcGenes; // source genes
     const TransMap* fGenomeTransMap;  // genomic mapping
+    ExonsMappingCache* fExonsMappingCache;  // cache of exon mappings, maybe NULL
     const AnnotationSet* fTargetAnnotations; // targeted genes/transcripts, maybe NULL
     const AnnotationSet* fPreviousMappedAnotations; // previous version
+    const AnnotationSet* fPreviousSrcAnnotations; // source of previous version, enables reuse, maybe NULL
     const BedMap* fTargetPatchMap; // location of patch regions in target genome
     const string fSubstituteTargetVersion;  // pass through targets when gene new gene doesn't map
     unsigned fUseTargetFlags;  // what targets to force.
     bool fOnlyManualForTargetSubstituteOverlap;  // only check manual transcripts when checking target/map overlap
+    int fNumThreads;  // number of threads used to project genes
+    bool fSortedMapping;  // project genes in genomic order
 
     /* set of base ids (gene, transcript, havana) and gene names that have been
      * mapped.  The key is "ident chrom" to handle PAR cases.
@@ -71,6 +111,19 @@ class GeneMapper {
     
     int fCurrentGeneNum;  /* used by output info log to logically group features together,
                            * increments each time a gene is process */ 
+
+    ShardIndex* fShardIndex;  // if only mapping one shard, the index being built, otherwise NULL
+    map<string, int> fSeqShards;  // shard of each source sequence
+    int fNextSrcGeneIdx;  // index in input of next source gene
+    const GeneSelection* fGeneSelection;  // if not NULL, only map the selected source genes
+    bool fCopyTargetGenes;  // copy target genes not mapped, if requested by fUseTargetFlags
+    ResultFeatureTreesVector* fGeneResults;  // if not NULL, results of each gene are added
+    MappingSummaries* fMappingSummaries;  // if not NULL, mapping info records are counted
+    MappingInfoColumnar* fMappingInfoColumnar;  // if not NULL, mapping info records are also saved here
+    size_t fSortMemoryLimit;  // if not zero, mapped genes are sorted in runs of this size
+    string fSortTmpPrefix;    // prefix of sort run files
+    SortedGeneRuns* fSortedGeneRuns;  // if not NULL, mapped genes are saved here rather than the mapped set
+    GxfWriter* fMappedGtfFh;  // if not NULL, mapped genes are also written here as GTF
     
     void outputInfoHeader(ostream& mappingInfoFh) const;
     void outputInfo(const string& recType,
@@ -103,9 +156,11 @@ class GeneMapper {
     bool checkAllGeneTranscriptsMapped(const FeatureNode* gene) const;
     bool checkAnyGeneTranscriptsMapped(const FeatureNode* gene) const;
     ResultFeatureTrees processTranscript(const FeatureNode* transcript,
-                                     ostream* transcriptPslFh);
+                                         PslMapping* exonsMapping,
+                                         ostream* transcriptPslFh) const;
     ResultFeatureTreesVector processTranscripts(const FeatureNode* gene,
-                                            ostream* transcriptPslFh);
+                                                ostream* transcriptPslFh) const;
+    void recordTranscriptsMapped(const FeatureNode* gene);
     FeatureNode* findMatchingBoundingFeature(const FeatureNodeVector& features,
                                              const FeatureNode* srcFeature) const;
     void copyMappingMetadata(const FeatureNode* origFeature,
@@ -145,17 +200,61 @@ class GeneMapper {
     void processGeneLevelMapping(ResultFeatureTrees* mappedGene);
     void setGeneLevelMappingAttributes(ResultFeatureTrees* mappedGene);
     void mapGene(const FeatureNode* srcGeneTree,
+                 ResultFeatureTreesVector& mappedTranscripts,
                  AnnotationSet& mappedSet,
                  AnnotationSet& unmappedSet,
                  FeatureTreePolish& featureTreePolish,
-                 ostream& mappingInfoFh,
-                 ostream* transcriptPslFh);
+                 ostream& mappingInfoFh);
     void maybeMapGene(const FeatureNode* srcGeneTree,
+                      PremappedGene* premappedGene,
                       AnnotationSet& mappedSet,
                       AnnotationSet& unmappedSet,
                       FeatureTreePolish& featureTreePolish,
                       ostream& mappingInfoFh,
                       ostream* transcriptPslFh);
+    const FeatureNode* getReusableMappedGene(const FeatureNode* srcGeneTree) const;
+    void reuseMappedGene(const FeatureNode* srcGeneTree,
+                         const FeatureNode* prevMappedGene,
+                         AnnotationSet& mappedSet,
+                         ostream& mappingInfoFh);
+    void premapGene(const FeatureNode* srcGeneTree,
+                    PremappedGene& premappedGene,
+                    bool savePsls) const;
+    void premapGenes(const FeatureNodeVector& srcGenes,
+                     PremappedGeneVector& premappedGenes,
+                     bool savePsls) const;
+    bool inShard(const FeatureNode* srcGeneTree) const;
+    FeatureNode* nextSrcGene(int& srcGeneIdx);
+    void commitGene(const FeatureNode* srcGeneTree,
+                    int srcGeneIdx,
+                    PremappedGene* premappedGene,
+                    AnnotationSet& mappedSet,
+                    AnnotationSet& unmappedSet,
+                    FeatureTreePolish& featureTreePolish,
+                    ostream& mappingInfoFh,
+                    ostream* transcriptPslFh);
+    void mapGenesSerial(AnnotationSet& mappedSet,
+                        AnnotationSet& unmappedSet,
+                        FeatureTreePolish& featureTreePolish,
+                        ostream& mappingInfoFh,
+                        ostream* transcriptPslFh);
+    void mapGenesThreaded(AnnotationSet& mappedSet,
+                          AnnotationSet& unmappedSet,
+                          FeatureTreePolish& featureTreePolish,
+                          ostream& mappingInfoFh,
+                          ostream* transcriptPslFh);
+    void mapGeneRunSorted(const FeatureNodeVector& srcGenes,
+                          const vector<int>& srcGeneIdxs,
+                          AnnotationSet& mappedSet,
+                          AnnotationSet& unmappedSet,
+                          FeatureTreePolish& featureTreePolish,
+                          ostream& mappingInfoFh,
+                          ostream* transcriptPslFh);
+    void mapGenesSorted(AnnotationSet& mappedSet,
+                        AnnotationSet& unmappedSet,
+                        FeatureTreePolish& featureTreePolish,
+                        ostream& mappingInfoFh,
+                        ostream* transcriptPslFh);
     RemapStatus getNoMapRemapStatus(const FeatureNode* gene) const;
     bool shouldMapGeneType(const FeatureNode* gene) const;
     bool inTargetPatchRegion(const FeatureNode* targetGene);
@@ -168,31 +267,139 @@ class GeneMapper {
                         ostream& mappingInfoFh);
     void copyTargetGenes(AnnotationSet& mappedSet,
                          ostream& mappingInfoFh);
+    void finishMappedSet(AnnotationSet& mappedSet,
+                         ostream& mappingInfoFh);
+    void mergeShardGene(ShardIndex* shardIndex,
+                        const ShardIndex::GeneRecord& geneRecord,
+                        istream& shardInfoFh,
+                        istream* shardPslFh,
+                        FeatureNodeVector& shardMappedGenes,
+                        size_t& iShardMapped,
+                        AnnotationSet& mappedSet,
+                        ostream& mappingInfoFh,
+                        ostream* transcriptPslFh);
     public:
-    /* Constructor */
-    GeneMapper(const AnnotationSet* srcAnnotations,
+    /* Constructor.  If numThreads is greater than one, the projection of
+     * genes is done in parallel; results are identical to a serial run.
+     * If sortedMapping is true, all genes are projected in genomic order
+     * before the results are committed in input order; results are also
+     * identical.  If previousSrcAnnotations is not NULL, genes that are
+     * unchanged from it have their previous mappings reused rather than
+     * being remapped.  If exonsMappingCache is not NULL, it is used to skip
+     * mapping of previously mapped exons. */
+    GeneMapper(SrcGenes* srcGenes,
                const TransMap* genomeTransMap,
+               ExonsMappingCache* exonsMappingCache,
                const AnnotationSet* targetAnnotations,
                const AnnotationSet* previousMappedAnnotations,
+               const AnnotationSet* previousSrcAnnotations,
                const BedMap* targetPatchMap,
                const string& substituteTargetVersion,
                unsigned useTargetFlags,
-               bool onlyManualForTargetSubstituteOverlap):
-        fSrcAnnotations(srcAnnotations),
+               bool onlyManualForTargetSubstituteOverlap,
+               int numThreads = 1,
+               bool sortedMapping = false):
+        fSrcGenes(srcGenes),
         fGenomeTransMap(genomeTransMap),
+        fExonsMappingCache(exonsMappingCache),
         fTargetAnnotations(targetAnnotations),
         fPreviousMappedAnotations(previousMappedAnnotations),
+        fPreviousSrcAnnotations(previousSrcAnnotations),
         fTargetPatchMap(targetPatchMap),
         fSubstituteTargetVersion(substituteTargetVersion),
         fUseTargetFlags(useTargetFlags),
         fOnlyManualForTargetSubstituteOverlap(onlyManualForTargetSubstituteOverlap),
-        fCurrentGeneNum(-1) {
+        fNumThreads(numThreads),
+        fSortedMapping(sortedMapping),
+        fCurrentGeneNum(-1),
+        fShardIndex(NULL),
+        fNextSrcGeneIdx(0),
+        fGeneSelection(NULL),
+        fCopyTargetGenes(true),
+        fGeneResults(NULL),
+        fMappingSummaries(NULL),
+        fMappingInfoColumnar(NULL),
+        fSortMemoryLimit(0),
+        fSortedGeneRuns(NULL),
+        fMappedGtfFh(NULL) {
+    }
+
+    /* If not NULL, the gene-level results of each gene mapped, substituted
+     * or copied are added to geneResults.  The trees remain owned by the
+     * AnnotationSets passed to mapGenes(). */
+    void setGeneResults(ResultFeatureTreesVector* geneResults) {
+        fGeneResults = geneResults;
+    }
+
+    /* If not NULL, each mapping info record is also counted in
+     * mappingSummaries.  The summaries are not owned. */
+    void setMappingSummaries(MappingSummaries* mappingSummaries) {
+        fMappingSummaries = mappingSummaries;
+    }
+
+    /* If not NULL, each mapping info record is also added to
+     * mappingInfoColumnar.  It is not owned. */
+    void setMappingInfoColumnar(MappingInfoColumnar* mappingInfoColumnar) {
+        fMappingInfoColumnar = mappingInfoColumnar;
+    }
+
+    /* Don't keep mapped genes in memory until they are written by
+     * mapGxf().  They are formatted as they are mapped and sorted in runs
+     * of memoryLimit bytes, which are written to temporary files named
+     * tmpPrefix.n.run and merged into the output.  Not used when mapping
+     * shards.  It can't be used with target patch regions or
+     * setGeneResults(), as they require the mapped gene trees. */
+    void setExternalSort(size_t memoryLimit,
+                         const string& tmpPrefix);
+
+    /* If not NULL, the mapped genes are also written to mappedGtfFh, which
+     * must be a GTF writer, when mapping from GFF3.  This requires the
+     * mapped gene trees, so it can't be used with setExternalSort() and
+     * isn't done when mapping a shard.  The writer is not owned. */
+    void setMappedGtfWriter(GxfWriter* mappedGtfFh) {
+        fMappedGtfFh = mappedGtfFh;
+    }
+
+    /* Enable or disable copying of target genes that were not mapped.
+     * Disabled when only mapping some of the source genes, as all
+     * target genes would otherwise be copied. */
+    void setCopyTargetGenes(bool copyTargetGenes) {
+        fCopyTargetGenes = copyTargetGenes;
+    }
+
+    /* Only map the source genes on the sequences assigned to a shard,
+     * recording the outputs of each gene in shardIndex for merging.  The
+     * target genes are not copied and the mapped genes are written in
+     * input order.  The shard index is not owned. */
+    void setShard(ShardIndex* shardIndex);
+
+    /* Only map the selected source genes.  Target genes are not copied.
+     * The selection is not owned. */
+    void setGeneSelection(const GeneSelection* geneSelection) {
+        fGeneSelection = geneSelection;
+        fCopyTargetGenes = false;
     }
 
     /* Map a GFF3/GTF */
     void mapGxf(GxfWriter& mappedGxfFh,
                 ostream& mappingInfoFh,
                 ostream* transcriptPslFh);
+
+    /* Map all source genes, saving the mapped genes, sorted by location,
+     * in mappedSet and the unmapped genes in unmappedSet.  This is mapGxf()
+     * without writing the results. */
+    void mapGenes(AnnotationSet& mappedSet,
+                  AnnotationSet& unmappedSet,
+                  ostream& mappingInfoFh,
+                  ostream* transcriptPslFh);
+
+    /* Merge the outputs of mapping each shard, giving the same results as
+     * mapGxf() of all genes.  The target genes are copied to the merged
+     * results.  Source genes aren't used. */
+    void mergeShards(const StringVector& shardIndexFiles,
+                     GxfWriter& mappedGxfFh,
+                     ostream& mappingInfoFh,
+                     ostream* transcriptPslFh);
 };
 
 #endif
@@ -0,0 +1,276 @@
+/*
+ * Index of the location of genes in a GxF file.
+ */
+#include "geneOffsetIndex.hh"
+#include "featureTree.hh"
+#include "globals.hh"
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+/* file starts with a header line of:
+ *   #geneOffsetIndex v2 gxfFileSize gxfFileMTime gxfFileHash
+ * followed by a line for each gene, with lines for its keys:
+ *   gene offset length
+ *   id featureIdx isParY baseId
+ *   name featureIdx isParY name
+ */
+static const string indexHeaderPrefix = "#geneOffsetIndex\tv2\t";
+
+/* constructor */
+GeneOffsetIndex::GeneOffsetIndex(const string& gxfFile):
+    fGxfFile(gxfFile),
+    fGxfFormat(gxfFormatFromFileName(gxfFile)) {
+}
+
+/* Hash the start and end of the GxF file.  The modification time only has
+ * a resolution of seconds, so a file rewritten with the same size in the
+ * same second would otherwise use a stale index.  Edits usually change the
+ * header or the last genes. */
+string GeneOffsetIndex::getGxfFileHash(off_t fileSize) const {
+    static const off_t hashBlockSize = 64 * 1024;
+    ifstream gxfIn(fGxfFile.c_str(), ios::binary);
+    if (not gxfIn.is_open()) {
+        throw ios_base::failure("can't open GxF file \"" + fGxfFile + "\": " + strerror(errno));
+    }
+    vector<char> buf(min(fileSize, 2 * hashBlockSize));
+    off_t headSize = min(fileSize, hashBlockSize);
+    gxfIn.read(buf.data(), headSize);
+    if (fileSize > headSize) {
+        gxfIn.seekg(fileSize - (buf.size() - headSize));
+        gxfIn.read(buf.data() + headSize, buf.size() - headSize);
+    }
+    if (not gxfIn) {
+        throw ios_base::failure("error reading GxF file \"" + fGxfFile + "\"");
+    }
+    return to_string(StringViewHash()(StringView(buf.data(), buf.size())));
+}
+
+/* get the part of the header identifying the GxF file */
+string GeneOffsetIndex::getGxfFileKey() const {
+    struct stat st;
+    if (stat(fGxfFile.c_str(), &st) < 0) {
+        throw ios_base::failure("can't stat \"" + fGxfFile + "\": " + strerror(errno));
+    }
+    return to_string(st.st_size) + "\t" + to_string(st.st_mtime) + "\t" + getGxfFileHash(st.st_size);
+}
+
+/* add a reference under a key */
+void GeneOffsetIndex::addRef(const string& key,
+                             bool isParY,
+                             const FeatureRef& ref,
+                             FeatureRefMap& refMap) {
+    refMap[FeatureKey(key, isParY)].push_back(ref);
+}
+
+/* add the keys of a gene or transcript, the same as AnnotationSet */
+void GeneOffsetIndex::addFeatureKeys(const FeatureNode* feature,
+                                     const FeatureRef& ref) {
+    addRef(getBaseId(feature->getTypeId()), feature->isParY(), ref, fIdRefs);
+    if (feature->getHavanaTypeId() != "") {
+        addRef(getBaseId(feature->getHavanaTypeId()), feature->isParY(), ref, fIdRefs);
+    }
+    if (feature->isGene() and useGeneNameForMappingKey(feature)) {
+        addRef(feature->getTypeName(), feature->isParY(), ref, fNameRefs);
+    }
+}
+
+/* parse a gene tree from the text of its records */
+FeatureNode* GeneOffsetIndex::parseGene(const string& geneText,
+                                        GxfFormat gxfFormat) {
+    istringstream geneIn(geneText);
+    GxfParser* gxfParser = GxfParser::factory(geneIn, gxfFormat);
+    FeatureNode* gene = NULL;
+    GxfRecord* gxfRecord;
+    while ((gxfRecord = gxfParser->next()) != NULL) {
+        if ((gene == NULL) and instanceOf(gxfRecord, GxfFeature)) {
+            gene = GeneTree::geneTreeFactory(gxfParser, dynamic_cast<GxfFeature*>(gxfRecord));
+        } else {
+            delete gxfRecord;  // trailing comments
+        }
+    }
+    delete gxfParser;
+    if (gene == NULL) {
+        throw invalid_argument("no gene record in indexed GxF text");
+    }
+    return gene;
+}
+
+/* add a gene, given the text of its records */
+void GeneOffsetIndex::addGene(long offset,
+                              const string& geneText) {
+    int geneIdx = fGenes.size();
+    fGenes.push_back(GeneExtent(offset, geneText.size()));
+    FeatureNode* gene = parseGene(geneText, fGxfFormat);
+    addFeatureKeys(gene, FeatureRef(geneIdx, 0));
+    for (size_t i = 0; i < gene->getNumChildren(); i++) {
+        addFeatureKeys(gene->getChild(i), FeatureRef(geneIdx, i + 1));
+    }
+    delete gene;
+}
+
+/* is a line a gene record? */
+static bool isGeneLine(const string& line) {
+    if ((line.size() == 0) or (line[0] == '#')) {
+        return false;
+    }
+    size_t tab1 = line.find('\t');
+    size_t tab2 = (tab1 == string::npos) ? string::npos : line.find('\t', tab1 + 1);
+    if (tab2 == string::npos) {
+        return false;
+    }
+    return line.compare(tab2 + 1, GxfFeature::GENE.size() + 1, GxfFeature::GENE + "\t") == 0;
+}
+
+/* build the index by reading the GxF file.  Records from the start of a
+ * gene to the next gene belong to the gene, which is how GeneTree reads
+ * them. */
+void GeneOffsetIndex::build() {
+    ifstream gxfIn(fGxfFile.c_str());
+    if (not gxfIn.is_open()) {
+        throw ios_base::failure("can't open GxF file \"" + fGxfFile + "\": " + strerror(errno));
+    }
+    string line, geneText;
+    long offset = 0, geneOffset = -1;
+    while (getline(gxfIn, line)) {
+        if (isGeneLine(line)) {
+            if (geneOffset >= 0) {
+                addGene(geneOffset, geneText);
+            }
+            geneOffset = offset;
+            geneText.clear();
+        }
+        if (geneOffset >= 0) {
+            geneText += line;
+            geneText += '\n';
+        }
+        offset += line.size() + 1;
+    }
+    if (gxfIn.bad()) {
+        throw ios_base::failure("error reading GxF file \"" + fGxfFile + "\"");
+    }
+    if (geneOffset >= 0) {
+        addGene(geneOffset, geneText);
+    }
+}
+
+/* load the index if the file exists and is current, return false if not */
+bool GeneOffsetIndex::load(const string& indexFile) {
+    ifstream fh(indexFile.c_str());
+    if (not fh.is_open()) {
+        return false;
+    }
+    string line;
+    if ((not getline(fh, line)) or (line != indexHeaderPrefix + getGxfFileKey())) {
+        return false;  // out of date, will be replaced
+    }
+    try {
+        while (getline(fh, line)) {
+            StringVector cols = stringSplit(line, '\t');
+            if ((cols.size() == 3) and (cols[0] == "gene")) {
+                fGenes.push_back(GeneExtent(stol(cols[1]), stol(cols[2])));
+            } else if ((cols.size() == 4) and ((cols[0] == "id") or (cols[0] == "name"))
+                       and (fGenes.size() > 0)) {
+                addRef(cols[3], (cols[2] == "1"), FeatureRef(fGenes.size() - 1, stringToInt(cols[1])),
+                       ((cols[0] == "id") ? fIdRefs : fNameRefs));
+            } else {
+                throw invalid_argument("invalid line: " + line);
+            }
+        }
+    } catch (const exception& ex) {
+        throw invalid_argument("corrupt gene offset index \"" + indexFile + "\": " + ex.what());
+    }
+    return true;
+}
+
+/* write the index to a temporary file then rename it, so a partial index
+ * is never seen */
+void GeneOffsetIndex::write(const string& indexFile) const {
+    // keys by gene, in the order they are found
+    vector<vector<string> > geneKeys(fGenes.size());
+    const FeatureRefMap* refMaps[2] = {&fIdRefs, &fNameRefs};
+    const char* refTypes[2] = {"id", "name"};
+    for (int iMap = 0; iMap < 2; iMap++) {
+        for (FeatureRefMap::const_iterator it = refMaps[iMap]->begin(); it != refMaps[iMap]->end(); it++) {
+            for (size_t i = 0; i < it->second.size(); i++) {
+                geneKeys[it->second[i].geneIdx].push_back(string(refTypes[iMap]) + "\t" + toString(it->second[i].featureIdx)
+                                                          + "\t" + (it->first.second ? "1" : "0") + "\t" + it->first.first);
+            }
+        }
+    }
+    string tmpIndexFile = indexFile + ".tmp." + toString(getpid());
+    ofstream fh(tmpIndexFile.c_str());
+    if (not fh.is_open()) {
+        throw ios_base::failure("can't open gene offset index \"" + tmpIndexFile + "\" for write access: " + strerror(errno));
+    }
+    fh << indexHeaderPrefix << getGxfFileKey() << "\n";
+    for (size_t iGene = 0; iGene < fGenes.size(); iGene++) {
+        fh << "gene\t" << fGenes[iGene].offset << "\t" << fGenes[iGene].length << "\n";
+        for (size_t i = 0; i < geneKeys[iGene].size(); i++) {
+            fh << geneKeys[iGene][i] << "\n";
+        }
+    }
+    fh.close();
+    if (fh.fail()) {
+        unlink(tmpIndexFile.c_str());
+        throw ios_base::failure("error writing gene offset index \"" + tmpIndexFile + "\"");
+    }
+    if (rename(tmpIndexFile.c_str(), indexFile.c_str()) < 0) {
+        unlink(tmpIndexFile.c_str());
+        throw ios_base::failure("can't rename \"" + tmpIndexFile + "\" to \"" + indexFile + "\": " + strerror(errno));
+    }
+}
+
+/* Load the index from indexFile if it is current, otherwise build and
+ * save it */
+GeneOffsetIndex* GeneOffsetIndex::factory(const string& gxfFile,
+                                          const string& indexFile) {
+    GeneOffsetIndex* geneIndex = new GeneOffsetIndex(gxfFile);
+    try {
+        if (not geneIndex->load(indexFile)) {
+            geneIndex->build();
+            try {
+                geneIndex->write(indexFile);
+            } catch (const ios_base::failure& ex) {
+                if (gVerbose) {
+                    cerr << "NOTE: gene offset index not saved: " << ex.what() << endl;
+                }
+            }
+        }
+    } catch (...) {
+        delete geneIndex;
+        throw;
+    }
+    return geneIndex;
+}
+
+/* get a reference from a map if it is unique */
+const GeneOffsetIndex::FeatureRef* GeneOffsetIndex::findRef(const string& key,
+                                                            bool isParY,
+                                                            const FeatureRefMap& refMap) {
+    FeatureRefMap::const_iterator it = refMap.find(FeatureKey(key, isParY));
+    if ((it == refMap.end()) or (it->second.size() > 1)) {
+        return NULL;
+    } else {
+        return &(it->second[0]);
+    }
+}
+
+/* Parse a gene tree from the GxF file */
+FeatureNode* GeneOffsetIndex::readGene(int geneIdx,
+                                       istream& gxfIn) const {
+    const GeneExtent& extent = fGenes[geneIdx];
+    string geneText(extent.length, '\0');
+    gxfIn.clear();
+    gxfIn.seekg(extent.offset);
+    gxfIn.read(&(geneText[0]), extent.length);
+    if (gxfIn.gcount() != extent.length) {
+        throw ios_base::failure("error reading gene at offset " + to_string(extent.offset)
+                                + " of \"" + fGxfFile + "\", has it changed since it was indexed?");
+    }
+    return parseGene(geneText, fGxfFormat);
+}
@@ -0,0 +1,118 @@
+/*
+ * Index of the location of genes in a GxF file.
+ */
+#ifndef geneOffsetIndex_hh
+#define geneOffsetIndex_hh
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include <map>
+#include <iostream>
+#include "gxf.hh"
+using namespace std;
+class FeatureNode;
+
+/*
+ * Index of the byte range of each gene in an uncompressed GxF file, with the
+ * base ids and names of the genes and transcripts, so a gene tree can be
+ * parsed when one of its features is looked up, without loading the file.
+ * The keys are the same as the AnnotationSet id and name indexes.  The
+ * index is saved in a sidecar file, with the size and modification time of
+ * the GxF, and is rebuilt if they don't match.
+ */
+class GeneOffsetIndex {
+    public:
+    /* reference to a gene or transcript in the index */
+    struct FeatureRef {
+        int geneIdx;
+        int featureIdx;  // 0 for the gene, otherwise transcript featureIdx-1
+        FeatureRef(int geneIdx,
+                   int featureIdx):
+            geneIdx(geneIdx), featureIdx(featureIdx) {
+        }
+    };
+    typedef vector<FeatureRef> FeatureRefVector;
+
+    private:
+    /* location of a gene's records in the file */
+    struct GeneExtent {
+        long offset;
+        long length;
+        GeneExtent(long offset,
+                   long length):
+            offset(offset), length(length) {
+        }
+    };
+    typedef pair<string, bool> FeatureKey;  // id or name and PAR_Y flag
+    typedef map<FeatureKey, FeatureRefVector> FeatureRefMap;
+
+    const string fGxfFile;
+    const GxfFormat fGxfFormat;
+    vector<GeneExtent> fGenes;
+    FeatureRefMap fIdRefs;    // keyed by base id
+    FeatureRefMap fNameRefs;  // keyed by gene name
+
+    GeneOffsetIndex(const string& gxfFile);
+    string getGxfFileHash(off_t fileSize) const;
+    string getGxfFileKey() const;
+    void addRef(const string& key,
+                bool isParY,
+                const FeatureRef& ref,
+                FeatureRefMap& refMap);
+    void addFeatureKeys(const FeatureNode* feature,
+                        const FeatureRef& ref);
+    void addGene(long offset,
+                 const string& geneText);
+    void build();
+    bool load(const string& indexFile);
+    void write(const string& indexFile) const;
+    static const FeatureRef* findRef(const string& key,
+                                     bool isParY,
+                                     const FeatureRefMap& refMap);
+
+    public:
+    /* Load the index from indexFile if it is current for gxfFile,
+     * otherwise build it and try to save it to indexFile.  Failure to
+     * write the index is not an error, it is just rebuilt next time. */
+    static GeneOffsetIndex* factory(const string& gxfFile,
+                                    const string& indexFile);
+
+    /* Can a GxF file be indexed?  Compressed files can't be read at an
+     * offset. */
+    static bool canIndex(const string& gxfFile) {
+        return not stringEndsWith(gxfFile, ".gz");
+    }
+
+    /* get the GxF file */
+    const string& getGxfFile() const {
+        return fGxfFile;
+    }
+
+    /* get the format of the GxF file */
+    GxfFormat getGxfFormat() const {
+        return fGxfFormat;
+    }
+
+    /* get the feature with a base id, or NULL if none or it's not unique */
+    const FeatureRef* findId(const string& baseId,
+                             bool isParY) const {
+        return findRef(baseId, isParY, fIdRefs);
+    }
+
+    /* get the gene with a name, or NULL if none or it's not unique */
+    const FeatureRef* findName(const string& name,
+                               bool isParY) const {
+        return findRef(name, isParY, fNameRefs);
+    }
+
+    /* Parse a gene tree from the GxF file, which must be open and is
+     * shared by the caller between calls. */
+    FeatureNode* readGene(int geneIdx,
+                          istream& gxfIn) const;
+
+    /* parse a gene tree from the text of its records */
+    static FeatureNode* parseGene(const string& geneText,
+                                  GxfFormat gxfFormat);
+};
+
+#endif
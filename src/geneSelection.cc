@@ -0,0 +1,79 @@
+/*
+ * Selection of source genes to map.
+ */
+#include "geneSelection.hh"
+#include "annotationSet.hh"
+#include "featureTree.hh"
+#include "FIOStream.hh"
+#include <stdexcept>
+
+/* constructor */
+GeneSelection::GeneSelection(const string& region,
+                             const string& geneIdsFile):
+    fStart(0),
+    fEnd(0) {
+    if (region.size() > 0) {
+        parseRegion(region, fSeqid, fStart, fEnd);
+    }
+    if (geneIdsFile.size() > 0) {
+        FIOStream idsFh(geneIdsFile);
+        string line;
+        while (getline(idsFh, line)) {
+            string geneId = stringTrim(line);
+            if ((geneId.size() > 0) and (geneId[0] != '#')) {
+                fGeneIds.insert(getBaseId(geneId));
+            }
+        }
+        if (fGeneIds.size() == 0) {
+            throw invalid_argument("no gene ids in " + geneIdsFile);
+        }
+    }
+}
+
+/* parse a region of the form chrom:start-end */
+void GeneSelection::parseRegion(const string& region,
+                                string& seqid,
+                                int& start,
+                                int& end) {
+    size_t colon = region.rfind(':');
+    size_t dash = (colon == string::npos) ? string::npos : region.find('-', colon);
+    bool isOk1 = false, isOk2 = false;
+    if ((colon != string::npos) and (colon > 0) and (dash != string::npos)) {
+        seqid = region.substr(0, colon);
+        start = stringToInt(region.substr(colon + 1, dash - (colon + 1)), &isOk1);
+        end = stringToInt(region.substr(dash + 1), &isOk2);
+    }
+    if ((not isOk1) or (not isOk2) or (start < 1) or (end < start)) {
+        throw invalid_argument("region must be of the form chrom:start-end, with 1 <= start <= end: " + region);
+    }
+}
+
+/* does a gene overlap the region? */
+bool GeneSelection::inRegion(const FeatureNode* gene) const {
+    return (gene->getSeqid() == fSeqid) and (gene->getStart() <= fEnd) and (gene->getEnd() >= fStart);
+}
+
+/* is the gene's id or HAVANA id selected? */
+bool GeneSelection::haveGeneId(const FeatureNode* gene) const {
+    return (fGeneIds.find(getBaseId(gene->getTypeId())) != fGeneIds.end())
+        or ((gene->getHavanaTypeId() != "")
+            and (fGeneIds.find(getBaseId(gene->getHavanaTypeId())) != fGeneIds.end()));
+}
+
+/* is a source gene selected? */
+bool GeneSelection::isSelected(const FeatureNode* gene) const {
+    return ((fSeqid.size() == 0) or inRegion(gene))
+        and ((fGeneIds.size() == 0) or haveGeneId(gene));
+}
+
+/* add the ranges of the selected genes */
+void GeneSelection::getSelectedRanges(const AnnotationSet& srcAnnotations,
+                                      MappingQueryRanges& queryRanges) const {
+    const FeatureNodeVector& genes = srcAnnotations.getGenes();
+    for (size_t i = 0; i < genes.size(); i++) {
+        if (isSelected(genes[i])) {
+            queryRanges.add(genes[i]->getSeqid(), genes[i]->getStart0(), genes[i]->getEnd(), 0);
+        }
+    }
+    queryRanges.build();
+}
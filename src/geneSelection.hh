@@ -0,0 +1,50 @@
+/*
+ * Selection of source genes to map.
+ */
+#ifndef geneSelection_hh
+#define geneSelection_hh
+#include <string>
+#include "typeOps.hh"
+#include "transMap.hh"
+using namespace std;
+class FeatureNode;
+class AnnotationSet;
+
+/*
+ * Selection of the source genes to map with --region and --geneIds, used to
+ * quickly remap a locus.  If both a region and ids are specified, a gene
+ * must match both.
+ */
+class GeneSelection {
+    private:
+    string fSeqid;        // empty if no region
+    int fStart;           // one-based, closed, as in GxF
+    int fEnd;
+    StringSet fGeneIds;   // base ids, empty if not selecting by id
+
+    bool inRegion(const FeatureNode* gene) const;
+    bool haveGeneId(const FeatureNode* gene) const;
+
+    public:
+    /* constructor, region is of the form chrom:start-end, in the one-based
+     * coordinates of GxF files, and geneIdsFile has one gene id per
+     * line, with or without its version.  Either may be empty. */
+    GeneSelection(const string& region,
+                  const string& geneIdsFile);
+
+    /* parse a region of the form chrom:start-end */
+    static void parseRegion(const string& region,
+                            string& seqid,
+                            int& start,
+                            int& end);
+
+    /* is a source gene selected? */
+    bool isSelected(const FeatureNode* gene) const;
+
+    /* Build an index of the zero-based ranges of the selected genes, which
+     * are the only mapping alignment query ranges needed to map them. */
+    void getSelectedRanges(const AnnotationSet& srcAnnotations,
+                           MappingQueryRanges& queryRanges) const;
+};
+
+#endif
@@ -0,0 +1,91 @@
+/*
+ * Exon similarity of genes, with caching.
+ */
+#include "geneSimilarity.hh"
+#include <algorithm>
+
+/* get the sorted exon intervals of a transcript, building them if not
+ * cached */
+const GeneSimilarity::TranscriptExons& GeneSimilarity::getTranscriptExons(const FeatureNode* transcript) {
+    TranscriptExonsMap::iterator it = fTranscriptExons.find(transcript);
+    if (it != fTranscriptExons.end()) {
+        return it->second;
+    }
+    assert(transcript->isTranscript());
+    TranscriptExons& transExons = fTranscriptExons[transcript];
+    transExons.start = transcript->getStart();
+    transExons.end = transcript->getEnd();
+    transExons.exonLength = 0;
+    transExons.isAutomatic = transcript->isAutomatic();
+    for (int iChild = 0; iChild < transcript->getNumChildren(); iChild++) {
+        const FeatureNode* child = transcript->getChild(iChild);
+        if (child->isExon()) {
+            transExons.exons.push_back(make_pair(child->getStart(), child->getEnd()));
+            transExons.exonLength += (child->getEnd() - child->getStart()) + 1;
+        }
+    }
+    sort(transExons.exons.begin(), transExons.exons.end());
+    return transExons;
+}
+
+/* Count the overlapping bases of all pairs of exons of two transcripts.
+ * Exons of trans2 before firstIdx end before the start of the current and
+ * all later exons of trans1, so they can't overlap.  This gives the same
+ * count as comparing all pairs, even if exons of a transcript overlap. */
+int GeneSimilarity::countExonOverlap(const TranscriptExons& trans1,
+                                     const TranscriptExons& trans2) {
+    const vector<pair<int, int> >& exons1 = trans1.exons;
+    const vector<pair<int, int> >& exons2 = trans2.exons;
+    int totalOverlap = 0;
+    size_t firstIdx = 0;
+    for (size_t i1 = 0; i1 < exons1.size(); i1++) {
+        int start1 = exons1[i1].first, end1 = exons1[i1].second;
+        while ((firstIdx < exons2.size()) and (exons2[firstIdx].second < start1)) {
+            firstIdx++;
+        }
+        for (size_t i2 = firstIdx; (i2 < exons2.size()) and (exons2[i2].first <= end1); i2++) {
+            int maxStart = max(start1, exons2[i2].first);
+            int minEnd = min(end1, exons2[i2].second);
+            if (maxStart <= minEnd) {
+                totalOverlap += (minEnd - maxStart) + 1;
+            }
+        }
+    }
+    return totalOverlap;
+}
+
+/* get exon similarity of two transcripts */
+float GeneSimilarity::getExonSimilarity(const TranscriptExons& trans1,
+                                        const TranscriptExons& trans2) {
+    if ((trans1.end < trans2.start) or (trans2.end < trans1.start)) {
+        return 0.0;
+    }
+    int totalOverlap = countExonOverlap(trans1, trans2);
+    return float(2*totalOverlap)/float(trans1.exonLength + trans2.exonLength);
+}
+
+/* get the maximum transcript similarity of two genes, considering
+ * only manual transcripts if requested */
+float GeneSimilarity::getMaxTranscriptSimilarity(const FeatureNode* gene1,
+                                                 const FeatureNode* gene2,
+                                                 bool manualOnlyTranscripts) {
+    assert(gene1->isGene());
+    assert(gene2->isGene());
+    vector<const TranscriptExons*> transExons2;
+    for (int iTrans2 = 0; iTrans2 < gene2->getNumChildren(); iTrans2++) {
+        const TranscriptExons& trans2 = getTranscriptExons(gene2->getChild(iTrans2));
+        if ((not manualOnlyTranscripts) or (not trans2.isAutomatic)) {
+            transExons2.push_back(&trans2);
+        }
+    }
+    float maxSimilarity = 0.0;
+    for (int iTrans1 = 0; (iTrans1 < gene1->getNumChildren()) and (maxSimilarity < 1.0); iTrans1++) {
+        const TranscriptExons& trans1 = getTranscriptExons(gene1->getChild(iTrans1));
+        if ((not manualOnlyTranscripts) or (not trans1.isAutomatic)) {
+            for (size_t iTrans2 = 0; (iTrans2 < transExons2.size()) and (maxSimilarity < 1.0); iTrans2++) {
+                maxSimilarity = max(maxSimilarity, getExonSimilarity(trans1, *transExons2[iTrans2]));
+            }
+        }
+    }
+    return maxSimilarity;
+}
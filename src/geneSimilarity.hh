@@ -0,0 +1,54 @@
+/*
+ * Exon similarity of genes, with caching.
+ */
+#ifndef geneSimilarity_hh
+#define geneSimilarity_hh
+#include <vector>
+#include <unordered_map>
+#include "featureTree.hh"
+using namespace std;
+
+/*
+ * Computes the same similarity as FeatureNode::getMaxTranscriptSimilarity,
+ * the maximum over transcript pairs of twice the overlapping exon bases
+ * divided by the total exon lengths.  The exons of each transcript are
+ * converted once to intervals sorted by start, so a transcript pair is
+ * compared with a linear sweep rather than comparing all pairs of exons, and
+ * transcript pairs whose spans don't overlap are skipped.  Transcripts are
+ * cached by address, so they must not be freed while this object is in
+ * use.  Not thread-safe.
+ */
+class GeneSimilarity {
+    private:
+    /* exon intervals of a transcript, one-based, closed */
+    struct TranscriptExons {
+        int start;
+        int end;
+        int exonLength;
+        bool isAutomatic;
+        vector<pair<int, int> > exons;  // sorted by start
+    };
+    typedef unordered_map<const FeatureNode*, TranscriptExons> TranscriptExonsMap;
+
+    TranscriptExonsMap fTranscriptExons;
+
+    const TranscriptExons& getTranscriptExons(const FeatureNode* transcript);
+    static int countExonOverlap(const TranscriptExons& trans1,
+                                const TranscriptExons& trans2);
+    static float getExonSimilarity(const TranscriptExons& trans1,
+                                   const TranscriptExons& trans2);
+
+    public:
+    /* get the maximum transcript similarity of two genes, considering
+     * only manual transcripts if requested */
+    float getMaxTranscriptSimilarity(const FeatureNode* gene1,
+                                     const FeatureNode* gene2,
+                                     bool manualOnlyTranscripts);
+
+    /* discard all cached results */
+    void clear() {
+        fTranscriptExons.clear();
+    }
+};
+
+#endif
@@ -7,6 +7,8 @@
 #include <cassert>
 #include "typeOps.hh"
 #include <stdexcept>
+#include <unordered_map>
+#include <mutex>
 
 const string GxfFeature::GENE = "gene";
 const string GxfFeature::TRANSCRIPT = "transcript";
@@ -37,18 +39,150 @@ const string GxfFeature::EXON_ID_ATTR = "exon_id";
 const string GxfFeature::EXON_NUMBER_ATTR = "exon_number";
 const string GxfFeature::TAG_ATTR = "tag";
 
+/*
+ * Table of interned attribute names.  Names are never freed.  The tables
+ * are keyed by views of the interned names, so a name is looked up without
+ * making a string.  Each thread keeps a cache of the names it has used, so
+ * the table is only locked the first time a thread sees a name.
+ */
+class AttrNameTable {
+    private:
+    typedef unordered_map<StringView, const AttrName*, StringViewHash> NameMap;
+    NameMap fNames;
+    std::mutex fMutex;
+
+    /* get the interned name, adding it if needed */
+    const AttrName* internShared(const StringView& name) {
+        std::lock_guard<std::mutex> lock(fMutex);
+        NameMap::const_iterator it = fNames.find(name);
+        if (it != fNames.end()) {
+            return it->second;
+        }
+        const AttrName* attrName = new AttrName(name.toString());
+        fNames[StringView(attrName->fName)] = attrName;
+        return attrName;
+    }
+
+    public:
+    /* get the interned name, adding it if needed */
+    const AttrName* intern(const StringView& name) {
+        static thread_local NameMap cache;
+        NameMap::const_iterator it = cache.find(name);
+        if (it != cache.end()) {
+            return it->second;
+        }
+        const AttrName* attrName = internShared(name);
+        cache[StringView(attrName->fName)] = attrName;
+        return attrName;
+    }
+
+    /* get the table, constructed on first use so it is available to static
+     * initializers */
+    static AttrNameTable& get() {
+        static AttrNameTable table;
+        return table;
+    }
+};
+
+/* get the interned name for a string view */
+const AttrName* AttrName::intern(const StringView& name) {
+    return AttrNameTable::get().intern(name);
+}
+
+const AttrName* const GxfFeature::ID_KEY = AttrName::intern(GxfFeature::ID_ATTR);
+const AttrName* const GxfFeature::PARENT_KEY = AttrName::intern(GxfFeature::PARENT_ATTR);
+const AttrName* const GxfFeature::GENE_ID_KEY = AttrName::intern(GxfFeature::GENE_ID_ATTR);
+const AttrName* const GxfFeature::GENE_NAME_KEY = AttrName::intern(GxfFeature::GENE_NAME_ATTR);
+const AttrName* const GxfFeature::GENE_TYPE_KEY = AttrName::intern(GxfFeature::GENE_TYPE_ATTR);
+const AttrName* const GxfFeature::GENE_HAVANA_KEY = AttrName::intern(GxfFeature::GENE_HAVANA_ATTR);
+const AttrName* const GxfFeature::TRANSCRIPT_ID_KEY = AttrName::intern(GxfFeature::TRANSCRIPT_ID_ATTR);
+const AttrName* const GxfFeature::TRANSCRIPT_NAME_KEY = AttrName::intern(GxfFeature::TRANSCRIPT_NAME_ATTR);
+const AttrName* const GxfFeature::TRANSCRIPT_TYPE_KEY = AttrName::intern(GxfFeature::TRANSCRIPT_TYPE_ATTR);
+const AttrName* const GxfFeature::TRANSCRIPT_HAVANA_KEY = AttrName::intern(GxfFeature::TRANSCRIPT_HAVANA_ATTR);
+const AttrName* const GxfFeature::EXON_ID_KEY = AttrName::intern(GxfFeature::EXON_ID_ATTR);
+const AttrName* const GxfFeature::TAG_KEY = AttrName::intern(GxfFeature::TAG_ATTR);
+
 const string GxfFeature::SOURCE_HAVANA = "HAVANA";
 const string GxfFeature::SOURCE_ENSEMBL = "ENSEMBL";
 
 const string GxfFeature::PAR_Y_SUFFIX = "_PAR_Y";
 
+/* get the type code for a column value */
+static GxfTypeCode columnTypeCode(const string& value) {
+    if (value == GxfFeature::GENE) {
+        return GXF_GENE_TYPE;
+    } else if (value == GxfFeature::TRANSCRIPT) {
+        return GXF_TRANSCRIPT_TYPE;
+    } else if (value == GxfFeature::EXON) {
+        return GXF_EXON_TYPE;
+    } else if (value == GxfFeature::CDS) {
+        return GXF_CDS_TYPE;
+    } else {
+        return GXF_OTHER_TYPE;
+    }
+}
+
+/* constructor */
+GxfColumnValue::GxfColumnValue(const string& value):
+    fValue(value),
+    fTypeCode(columnTypeCode(value)) {
+}
+
+/*
+ * Table of interned column values.  Values are never freed.  Each thread
+ * keeps a cache of the values it has used, so the table is only locked the
+ * first time a thread sees a value.
+ */
+class GxfColumnValueTable {
+    private:
+    typedef unordered_map<string, const GxfColumnValue*> ValueMap;
+    ValueMap fValues;
+    std::mutex fMutex;
+
+    /* get the interned value, adding it if needed */
+    const GxfColumnValue* internShared(const string& value) {
+        std::lock_guard<std::mutex> lock(fMutex);
+        ValueMap::const_iterator it = fValues.find(value);
+        if (it != fValues.end()) {
+            return it->second;
+        }
+        const GxfColumnValue* columnValue = new GxfColumnValue(value);
+        fValues[value] = columnValue;
+        return columnValue;
+    }
+
+    public:
+    /* get the interned value, adding it if needed */
+    const GxfColumnValue* intern(const string& value) {
+        static thread_local ValueMap cache;
+        ValueMap::const_iterator it = cache.find(value);
+        if (it != cache.end()) {
+            return it->second;
+        }
+        const GxfColumnValue* columnValue = internShared(value);
+        cache[value] = columnValue;
+        return columnValue;
+    }
+
+    /* get the table, constructed on first use so it is available to static
+     * initializers */
+    static GxfColumnValueTable& get() {
+        static GxfColumnValueTable table;
+        return table;
+    }
+};
+
+/* get the interned value for a string */
+const GxfColumnValue* GxfColumnValue::intern(const string& value) {
+    return GxfColumnValueTable::get().intern(value);
+}
+
 
 /* is a value quotes */
-static bool isQuoted(const string& s) {
+static bool isQuoted(const StringView& s) {
     return ((s.size() > 1) and (s[0] == '"') and (s[s.size()-1] == '"'));
 }
 
-
 /* is a value a integrate or float */
 static bool isNumeric(const string& s) {
     int dotCount = 0;
@@ -66,7 +200,7 @@ static bool isNumeric(const string& s) {
 }
 
 /* strip optional quotes */
-static string stripQuotes(const string& s) {
+static StringView stripQuotes(const StringView& s) {
     if (isQuoted(s)) {
         return s.substr(1, s.size()-2);
     } else {
@@ -75,8 +209,8 @@ static string stripQuotes(const string& s) {
 }
 
 /* is this an attribute that must be hacked to be unique in GTF? */
-static bool isParIdNonUniqAttr(const string& name) {
-    return (name == GxfFeature::GENE_ID_ATTR) or (name == GxfFeature::TRANSCRIPT_ID_ATTR);
+static bool isParIdNonUniqAttr(const AttrName* name) {
+    return (name == GxfFeature::GENE_ID_KEY) or (name == GxfFeature::TRANSCRIPT_ID_KEY);
 }
 
 /* Get format from file name, or error */
@@ -98,29 +232,63 @@ GxfFormat gxfFormatFromFileName(const string& fileName) {
 GxfFeature::GxfFeature(const string& seqid, const string& source, const string& type,
                        int start, int end, const string& score, const string& strand,
                        const string& phase, const AttrVals& attrs):
+    fSeqid(GxfColumnValue::intern(seqid)), fSource(GxfColumnValue::intern(source)),
+    fType(GxfColumnValue::intern(type)),
+    fStart(start), fEnd(end),
+    fScore(GxfColumnValue::intern(score)), fStrand(GxfColumnValue::intern(strand)),
+    fPhase(GxfColumnValue::intern(phase)), fAttrs(attrs) {
+    assert(strand.size() == 1);
+    assert(phase.size() == 1);
+}
+
+/* construct a new feature object from interned values */
+GxfFeature::GxfFeature(const GxfColumnValue* seqid, const GxfColumnValue* source, const GxfColumnValue* type,
+                       int start, int end, const GxfColumnValue* score, const GxfColumnValue* strand,
+                       const GxfColumnValue* phase, const AttrVals& attrs):
     fSeqid(seqid), fSource(source), fType(type),
     fStart(start), fEnd(end),
     fScore(score), fStrand(strand),
     fPhase(phase), fAttrs(attrs) {
-    assert(strand.size() == 1);
-    assert(phase.size() == 1);
+    assert(strand->getValue().size() == 1);
+    assert(phase->getValue().size() == 1);
+}
+
+/* append base columns (excluding attributes) to a buffer */
+void GxfFeature::formatBaseColumns(string& buf) const {
+    buf += fSeqid->getValue();
+    buf += '\t';
+    buf += fSource->getValue();
+    buf += '\t';
+    buf += fType->getValue();
+    buf += '\t';
+    appendInt(buf, fStart);
+    buf += '\t';
+    appendInt(buf, fEnd);
+    buf += '\t';
+    buf += fScore->getValue();
+    buf += '\t';
+    buf += fStrand->getValue();
+    buf += '\t';
+    buf += fPhase->getValue();
+    buf += '\t';
 }
 
 /* return base columns (excluding attributes) as a string */
 string GxfFeature::baseColumnsAsString() const {
-    return fSeqid + "\t" + fSource + "\t" + fType + "\t" + to_string(fStart) + "\t"
-        + to_string(fEnd) + "\t" + fScore + "\t" + fStrand + "\t" + fPhase + "\t";
+    string buf;
+    formatBaseColumns(buf);
+    return buf;
 }
 
 /* get the id based on feature type, or empty string if it doesn't have an
  * id */
 const string& GxfFeature::getTypeId() const {
-    if (fType == GxfFeature::GENE) {
-        return getAttrValue(GxfFeature::GENE_ID_ATTR, emptyString);
-    } else if (fType == GxfFeature::TRANSCRIPT) {
-        return getAttrValue(GxfFeature::TRANSCRIPT_ID_ATTR, emptyString);
-    } else if (fType == GxfFeature::EXON) {
-        return getAttrValue(GxfFeature::EXON_ID_ATTR, emptyString);
+    if (getTypeCode() == GXF_GENE_TYPE) {
+        return getAttrValue(GxfFeature::GENE_ID_KEY, emptyString);
+    } else if (getTypeCode() == GXF_TRANSCRIPT_TYPE) {
+        return getAttrValue(GxfFeature::TRANSCRIPT_ID_KEY, emptyString);
+    } else if (getTypeCode() == GXF_EXON_TYPE) {
+        return getAttrValue(GxfFeature::EXON_ID_KEY, emptyString);
     } else {
         return emptyString;
     }
@@ -129,10 +297,10 @@ const string& GxfFeature::getTypeId() const {
 /* get the havana id based on feature type, or empty string if it doesn't have an
  * id */
 const string& GxfFeature::getHavanaTypeId() const {
-    if (fType == GxfFeature::GENE) {
-        return getAttrValue(GxfFeature::GENE_HAVANA_ATTR, emptyString);
-    } else if (fType == GxfFeature::TRANSCRIPT) {
-        return getAttrValue(GxfFeature::TRANSCRIPT_HAVANA_ATTR, emptyString);
+    if (getTypeCode() == GXF_GENE_TYPE) {
+        return getAttrValue(GxfFeature::GENE_HAVANA_KEY, emptyString);
+    } else if (getTypeCode() == GXF_TRANSCRIPT_TYPE) {
+        return getAttrValue(GxfFeature::TRANSCRIPT_HAVANA_KEY, emptyString);
     } else {
         return emptyString;
     }
@@ -141,10 +309,10 @@ const string& GxfFeature::getHavanaTypeId() const {
 /* get the name based on feature type, or empty string if it doesn't have an
  * id */
 const string& GxfFeature::getTypeName() const {
-    if (fType == GxfFeature::GENE) {
-        return getAttrValue(GxfFeature::GENE_NAME_ATTR, emptyString);
-    } else if (fType == GxfFeature::TRANSCRIPT) {
-        return getAttrValue(GxfFeature::TRANSCRIPT_NAME_ATTR, emptyString);
+    if (getTypeCode() == GXF_GENE_TYPE) {
+        return getAttrValue(GxfFeature::GENE_NAME_KEY, emptyString);
+    } else if (getTypeCode() == GXF_TRANSCRIPT_TYPE) {
+        return getAttrValue(GxfFeature::TRANSCRIPT_NAME_KEY, emptyString);
     } else {
         return emptyString;
     }
@@ -154,10 +322,10 @@ const string& GxfFeature::getTypeName() const {
  * id */
 const string& GxfFeature::getTypeBiotype() const {
     static const string emptyString;
-    if (fType == GxfFeature::GENE) {
-        return getAttrValue(GxfFeature::GENE_TYPE_ATTR, emptyString);
-    } else if (fType == GxfFeature::TRANSCRIPT) {
-        return getAttrValue(GxfFeature::TRANSCRIPT_TYPE_ATTR, emptyString);
+    if (getTypeCode() == GXF_GENE_TYPE) {
+        return getAttrValue(GxfFeature::GENE_TYPE_KEY, emptyString);
+    } else if (getTypeCode() == GXF_TRANSCRIPT_TYPE) {
+        return getAttrValue(GxfFeature::TRANSCRIPT_TYPE_KEY, emptyString);
     } else {
         return emptyString;
     }
@@ -166,32 +334,32 @@ const string& GxfFeature::getTypeBiotype() const {
 /* Parse for GFF 3 */
 class Gff3Parser: public GxfParser {
     private:
+    StringViewVector fAttrParts;  // reused for splitting
+    StringViewVector fValueParts;
 
     /* is this a multi-valued attribute? */
     /* parse ID=ENSG00000223972.5 */
-    static void parseAttr(const string& attrStr,
-                          AttrVals& attrVals) {
+    void parseAttr(const StringView& attrStr,
+                   AttrVals& attrVals) {
         size_t i = attrStr.find('=');
-        if (i == string::npos) {
-            throw invalid_argument("Invalid GFF3 attribute \"" + attrStr + "\"");
+        if (i == StringView::npos) {
+            throw invalid_argument("Invalid GFF3 attribute \"" + attrStr.toString() + "\"");
         }
-        string name = attrStr.substr(0,i);
-        string value = attrStr.substr(i+1);
-        StringVector values = stringSplit(stripQuotes(value), ',');
-        AttrVal* attrVal = new AttrVal(name, values[0]);
+        stringViewSplit(stripQuotes(attrStr.substr(i+1)), ',', fValueParts);
+        AttrVal* attrVal = new AttrVal(AttrName::intern(attrStr.substr(0,i)), fValueParts[0].toString());
         attrVals.push_back(attrVal);
-        for (int i = 1; i < values.size(); i++) {
-            attrVal->addVal(values[i]);
+        for (int i = 1; i < fValueParts.size(); i++) {
+            attrVal->addVal(fValueParts[i].toString());
         }
     }
 
     /* parse: ID=ENSG00000223972.5;gene_id=ENSG00000223972.5 */
-    static AttrVals parseAttrs(const string& attrsStr) {
+    AttrVals parseAttrs(const StringView& attrsStr) {
         AttrVals attrVals;
-        StringVector parts = stringSplit(attrsStr,';');
+        stringViewSplit(attrsStr, ';', fAttrParts);
         // `;' is a separator
-        for (size_t i = 0; i < parts.size(); i++) {
-            parseAttr(stringTrim(parts[i]), attrVals);
+        for (size_t i = 0; i < fAttrParts.size(); i++) {
+            parseAttr(fAttrParts[i].trim(), attrVals);
         }
         return attrVals;
     }
@@ -201,6 +369,11 @@ class Gff3Parser: public GxfParser {
     Gff3Parser(const string& fileName):
         GxfParser(fileName) {
     }
+
+    /* constructor from a stream */
+    Gff3Parser(istream& in):
+        GxfParser(in) {
+    }
  
     /* get the format being parser */
     virtual GxfFormat getFormat() const {
@@ -208,16 +381,20 @@ class Gff3Parser: public GxfParser {
     }
 
     /* parse a feature */
-    virtual GxfFeature* parseFeature(const StringVector& columns) {
-        return new GxfFeature(columns[0], columns[1], columns[2],
-                              stringToInt(columns[3]), stringToInt(columns[4]),
-                              columns[5], columns[6], columns[7], parseAttrs(columns[8]));
+    virtual GxfFeature* parseFeature(const StringViewVector& columns) {
+        return new GxfFeature(GxfColumnValue::intern(columns[0]), GxfColumnValue::intern(columns[1]),
+                              GxfColumnValue::intern(columns[2]),
+                              stringToInt(columns[3].toString()), stringToInt(columns[4].toString()),
+                              GxfColumnValue::intern(columns[5]), GxfColumnValue::intern(columns[6]),
+                              GxfColumnValue::intern(columns[7]), parseAttrs(columns[8]));
     }
 };
     
 /* Parse for GTF */
 class GtfParser: public GxfParser {
     private:
+    StringViewVector fAttrParts;  // reused for splitting
+
     /* if a value has a non-unique hack, remove it */
     static string removeParUniqHack(const string& value) {
         if (stringStartsWith(value, "ENSGR") or stringStartsWith(value, "ENSTR")) {
@@ -230,14 +407,14 @@ class GtfParser: public GxfParser {
     }
     
     /* parse ID=ENSG00000223972.5 */
-    static void parseAttr(const string& attrStr,
+    static void parseAttr(const StringView& attrStr,
                           AttrVals& attrVals) {
         size_t i = attrStr.find(' ');
-        if (i == string::npos) {
-            throw invalid_argument("Invalid GTF attribute \"" + attrStr + "\"");
+        if (i == StringView::npos) {
+            throw invalid_argument("Invalid GTF attribute \"" + attrStr.toString() + "\"");
         }
-        string name = attrStr.substr(0,i);
-        string value = stripQuotes(attrStr.substr(i+1));
+        const AttrName* name = AttrName::intern(attrStr.substr(0,i));
+        string value = stripQuotes(attrStr.substr(i+1)).toString();
         if (isParIdNonUniqAttr(name)) {
             value = removeParUniqHack(value);
         }
@@ -250,12 +427,12 @@ class GtfParser: public GxfParser {
     }
 
     /* parse: gene_id "ENSG00000223972.5"; gene_type "transcribed_unprocessed_pseudogene";  */
-    static AttrVals parseAttrs(const string& attrsStr) {
+    AttrVals parseAttrs(const StringView& attrsStr) {
         AttrVals attrVals;
-        StringVector parts = stringSplit(attrsStr,';');
+        stringViewSplit(attrsStr, ';', fAttrParts);
         // last will be empty, since `;' is a terminator
-        for (size_t i = 0; i < parts.size()-1; i++) {
-            parseAttr(stringTrim(parts[i]),  attrVals);
+        for (size_t i = 0; i < fAttrParts.size()-1; i++) {
+            parseAttr(fAttrParts[i].trim(),  attrVals);
         }
         return attrVals;
     }
@@ -265,6 +442,11 @@ class GtfParser: public GxfParser {
     GtfParser(const string& fileName):
         GxfParser(fileName) {
     }
+
+    /* constructor from a stream */
+    GtfParser(istream& in):
+        GxfParser(in) {
+    }
  
     /* get the format being parser */
     virtual GxfFormat getFormat() const {
@@ -272,41 +454,58 @@ class GtfParser: public GxfParser {
     }
 
      /* parse a feature */
-    virtual GxfFeature* parseFeature(const StringVector& columns) {
-        return new GxfFeature(columns[0], columns[1], columns[2],
-                              stringToInt(columns[3]), stringToInt(columns[4]),
-                              columns[5], columns[6], columns[7], parseAttrs(columns[8]));
+    virtual GxfFeature* parseFeature(const StringViewVector& columns) {
+        return new GxfFeature(GxfColumnValue::intern(columns[0]), GxfColumnValue::intern(columns[1]),
+                              GxfColumnValue::intern(columns[2]),
+                              stringToInt(columns[3].toString()), stringToInt(columns[4].toString()),
+                              GxfColumnValue::intern(columns[5]), GxfColumnValue::intern(columns[6]),
+                              GxfColumnValue::intern(columns[7]), parseAttrs(columns[8]));
     }
 };
 
-/* split a feature line of GFF3 or GTF */
-StringVector GxfParser::splitFeatureLine(const string& line) const {
-    StringVector columns = stringSplit(line, '\t');
-    if (columns.size() != 9) {
-        invalid_argument("invalid row, expected 9 columns: " + line);
+/* split a feature line of GFF3 or GTF into fColumns, which reference the
+ * line */
+void GxfParser::splitFeatureLine(const string& line) {
+    stringViewSplit(line, '\t', fColumns);
+    if (fColumns.size() != 9) {
+        throw invalid_argument("invalid row, expected 9 columns: " + line);
     }
-    return columns;
 }
 
 /* constructor that opens file, which maybe compressed. */
 GxfParser::GxfParser(const string& fileName):
-    fIn(new FIOStream(fileName)) {
+    fFileIn(new FIOStream(fileName)),
+    fIn(fFileIn) {
+}
+
+/* constructor that reads a stream, which is not owned */
+GxfParser::GxfParser(istream& in):
+    fFileIn(NULL),
+    fIn(&in) {
 }
 
 /* destructor */
 GxfParser::~GxfParser() {
-    delete fIn;
+    delete fFileIn;
 }
 
 /* Read the next record */
 GxfRecord* GxfParser::read() {
-    string line;
-    if (not fIn->readLine(line)) {
+    if (fFileIn != NULL) {
+        if (not fFileIn->readLine(fLine)) {
+            return NULL;
+        }
+    } else if (not getline(*fIn, fLine)) {
+        if (fIn->bad()) {
+            throw ios_base::failure("I/O error reading GxF stream");
+        }
         return NULL;
-    } else if ((line.size() > 0) and line[0] != '#') {
-        return parseFeature(splitFeatureLine(line));
+    }
+    if ((fLine.size() > 0) and fLine[0] != '#') {
+        splitFeatureLine(fLine);
+        return parseFeature(fColumns);
     } else {
-        return new GxfLine(line);
+        return new GxfLine(fLine);
     }
 }
 
@@ -337,32 +536,43 @@ GxfParser *GxfParser::factory(const string& fileName,
     }
 }
 
+/* Factory to create a parser reading a stream */
+GxfParser *GxfParser::factory(istream& in,
+                              GxfFormat gxfFormat) {
+    if (gxfFormat == GFF3_FORMAT) {
+        return new Gff3Parser(in);
+    } else if (gxfFormat == GTF_FORMAT) {
+        return new GtfParser(in);
+    } else {
+        throw invalid_argument("GxF format must be specified to parse a stream");
+    }
+}
+
 /* Write for GFF3 */
 class Gff3Writer: public GxfWriter {
     public:
     /* format an attribute */
-    static string formatAttr(const AttrVal* attrVal) {
-        string strAttr = attrVal->getName() + "=";
+    static void formatAttr(const AttrVal* attrVal,
+                           string& buf) {
+        buf += attrVal->getName();
+        buf += '=';
         for (int i = 0; i < attrVal->getVals().size(); i++) {
             if (i > 0) {
-                strAttr += ",";
+                buf += ',';
             }
-            strAttr += attrVal->getVals()[i];
-
+            buf += attrVal->getVals()[i];
         }
-        return strAttr;
     }
 
     /* format attributes */
-    static string formatAttrs(const AttrVals& attrVals) {
-        string strAttrs;
+    static void formatAttrs(const AttrVals& attrVals,
+                            string& buf) {
         for (size_t i = 0; i < attrVals.size(); i++) {
             if (i > 0) {
-                strAttrs += ";"; // separator
+                buf += ';'; // separator
             }
-            strAttrs += formatAttr(attrVals[i]);
+            formatAttr(attrVals[i], buf);
         }
-        return strAttrs;
     }
 
     /* constructor */
@@ -371,14 +581,22 @@ class Gff3Writer: public GxfWriter {
         write("##gff-version 3");
     }
 
+    /* constructor to a stream */
+    Gff3Writer(ostream& out):
+        GxfWriter(out) {
+        write("##gff-version 3");
+    }
+
     /* get the format being parser */
     virtual GxfFormat getFormat() const {
         return GFF3_FORMAT;
     }
 
     /* format a feature line */
-    virtual string formatFeature(const GxfFeature* feature) {
-        return feature->baseColumnsAsString() + formatAttrs(feature->getAttrs());
+    virtual void formatFeature(const GxfFeature* feature,
+                               string& buf) {
+        feature->formatBaseColumns(buf);
+        formatAttrs(feature->getAttrs(), buf);
     }
 };
 
@@ -390,70 +608,76 @@ class GtfWriter: public GxfWriter {
 
     
     /* modify an id in the PAR */
-    string addParUniqHack(const string& id) const {
+    void addParUniqHack(const string& id,
+                        string& buf) const {
         if (fParIdHackMethod == PAR_ID_HACK_OLD) {
             assert(id[5] == '0');
-            return id.substr(0, 4) + "R" + id.substr(5);
+            buf.append(id, 0, 4);
+            buf += 'R';
+            buf.append(id, 5, string::npos);
         } else {
-            return id + "_PAR_Y";
+            buf += id;
+            buf += "_PAR_Y";
         }
     }
 
     /* format an attribute */
-    string formatAttr(const string& name,
-                      const string& val,
-                      bool isParY) const {
+    void formatAttr(const AttrName* name,
+                    const string& val,
+                    bool isParY,
+                    string& buf) const {
         // n.b. this is not general, doesn't handle embedded quotes
         bool numericAttr = isNumeric(val);
-        string strAttr = name + " ";
+        buf += name->getName();
+        buf += ' ';
         if (!numericAttr) {
-            strAttr += "\"";
+            buf += '"';
         }
         if ((!numericAttr) and isParY and isParIdNonUniqAttr(name)) {
-            strAttr += addParUniqHack(val);
+            addParUniqHack(val, buf);
         } else {
-            strAttr += val;
+            buf += val;
         }
         if (!numericAttr) {
-            strAttr += "\"";
+            buf += '"';
         }
-        return strAttr;
     }
 
     /* format an attribute and values */
-    string formatAttr(const AttrVal* attrVal,
-                      bool isParY) const {
-        string strAttr;
+    void formatAttr(const AttrVal* attrVal,
+                    bool isParY,
+                    string& buf) const {
         for (int i = 0; i < attrVal->getVals().size(); i++) {
             if (i > 0) {
-                strAttr += " ";  // same formatting as GENCODE
+                buf += ' ';  // same formatting as GENCODE
             }
-            strAttr += formatAttr(attrVal->getName(), attrVal->getVals()[i], isParY) +  ";";
+            formatAttr(attrVal->getNameKey(), attrVal->getVals()[i], isParY, buf);
+            buf += ';';
         }
-        return strAttr;
     }
     
     /* should this attribute be included */
     bool includeAttr(const AttrVal* attrVal) const {
         // drop GFF3 linkage attributes
-        return not ((attrVal->getName() == GxfFeature::ID_ATTR)
-                    or (attrVal->getName() == GxfFeature::PARENT_ATTR)
+        return not ((attrVal->getNameKey() == GxfFeature::ID_KEY)
+                    or (attrVal->getNameKey() == GxfFeature::PARENT_KEY)
                     or (attrVal->getName() == "remap_original_id"));
     }
     
     /* format attribute */
-    string formatAttrs(const AttrVals& attrVals,
-                       bool isParY) const {
-        string strAttrs;
+    void formatAttrs(const AttrVals& attrVals,
+                     bool isParY,
+                     string& buf) const {
+        bool first = true;
         for (int i = 0; i < attrVals.size(); i++) {
             if (includeAttr(attrVals[i])) {
-                if (strAttrs.size() > 0) {
-                    strAttrs += " ";  // same formatting as GENCODE
+                if (not first) {
+                    buf += ' ';  // same formatting as GENCODE
                 }
-                strAttrs += formatAttr(attrVals[i], isParY);
+                formatAttr(attrVals[i], isParY, buf);
+                first = false;
             }
         }
-        return strAttrs;
     }
     /* constructor */
     GtfWriter(const string& fileName,
@@ -462,25 +686,81 @@ class GtfWriter: public GxfWriter {
         fParIdHackMethod(parIdHackMethod) {
     }
 
+    /* constructor to a stream */
+    GtfWriter(ostream& out,
+              ParIdHackMethod parIdHackMethod):
+        GxfWriter(out),
+        fParIdHackMethod(parIdHackMethod) {
+    }
+
     /* get the format being parser */
     virtual GxfFormat getFormat() const {
         return GTF_FORMAT;
     }
 
     /* format a feature line */
-    virtual string formatFeature(const GxfFeature* feature) {
-        return feature->baseColumnsAsString() + formatAttrs(feature->getAttrs(), feature->isParY());
+    virtual void formatFeature(const GxfFeature* feature,
+                               string& buf) {
+        feature->formatBaseColumns(buf);
+        formatAttrs(feature->getAttrs(), feature->isParY(), buf);
     }
 };
 
 /* constructor that opens file */
 GxfWriter::GxfWriter(const string& fileName):
-    fOut(new FIOStream(fileName, ios::out)) {
+    fFileOut(new FIOStream(fileName, ios::out)),
+    fOut(fFileOut) {
+    fBuf.reserve(bufferSize + 4096);
 }
 
-/* destructor */
+/* constructor that writes a stream, which is not owned */
+GxfWriter::GxfWriter(ostream& out):
+    fFileOut(NULL),
+    fOut(&out) {
+    fBuf.reserve(bufferSize + 4096);
+}
+
+/* destructor, close() should be called first to detect errors */
 GxfWriter::~GxfWriter() {
-    delete fOut;
+    if (fBuf.size() > 0) {
+        fOut->write(fBuf.data(), fBuf.size());
+    }
+    delete fFileOut;
+}
+
+/* check for an error writing the output */
+void GxfWriter::checkOutput() const {
+    if (fOut->fail()) {
+        throw ios_base::failure("I/O error on " + ((fFileOut != NULL) ? fFileOut->getFileName() : string("GxF stream")));
+    }
+}
+
+/* write buffered output */
+void GxfWriter::flush() {
+    if (fBuf.size() > 0) {
+        fOut->write(fBuf.data(), fBuf.size());
+        fBuf.clear();
+    }
+    fOut->flush();
+    checkOutput();
+}
+
+/* write any buffered output and close the file, if one was opened,
+ * throwing an exception on write errors */
+void GxfWriter::close() {
+    flush();
+    if (fFileOut != NULL) {
+        fFileOut->close();
+    }
+}
+
+/* write if the buffer is full */
+void GxfWriter::flushIfFull() {
+    if (fBuf.size() >= bufferSize) {
+        fOut->write(fBuf.data(), fBuf.size());
+        fBuf.clear();
+        checkOutput();
+    }
 }
 
 /* Factory to create a writer. file maybe compressed.  If gxfFormat is
@@ -498,6 +778,19 @@ GxfWriter *GxfWriter::factory(const string& fileName,
     }
 }
 
+/* Factory to create a writer to a stream */
+GxfWriter *GxfWriter::factory(ostream& out,
+                              ParIdHackMethod parIdHackMethod,
+                              GxfFormat gxfFormat) {
+    if (gxfFormat == GFF3_FORMAT) {
+        return new Gff3Writer(out);
+    } else if (gxfFormat == GTF_FORMAT) {
+        return new GtfWriter(out, parIdHackMethod);
+    } else {
+        throw invalid_argument("GxF format must be specified to write a stream");
+    }
+}
+
 /* copy a file to output, normally used for a header */
 void GxfWriter::copyFile(const string& inFile) {
     FIOStream inFh(inFile);
@@ -507,22 +800,42 @@ void GxfWriter::copyFile(const string& inFile) {
     }
 }
 
-/* write one GxF record. */
-void GxfWriter::write(const GxfRecord* gxfRecord) {
-    if (instanceOf(gxfRecord, GxfFeature)) {
-        *fOut << formatFeature(dynamic_cast<const GxfFeature*>(gxfRecord)) << endl;
+/* format one GxF record as a line, appending it to buf */
+void GxfWriter::format(const GxfRecord* gxfRecord,
+                       string& buf) {
+    const GxfFeature* feature = dynamic_cast<const GxfFeature*>(gxfRecord);
+    if (feature != NULL) {
+        formatFeature(feature, buf);
     } else {
-        *fOut << gxfRecord->toString() << endl;
+        buf += gxfRecord->toString();
     }
+    buf += '\n';
+}
+
+/* write one GxF record. */
+void GxfWriter::write(const GxfRecord* gxfRecord) {
+    format(gxfRecord, fBuf);
+    flushIfFull();
 }
 
 /* write one GxF line. */
 void GxfWriter::write(const string& line) {
-    *fOut << line << endl;
+    fBuf += line;
+    fBuf += '\n';
+    flushIfFull();
+}
+
+/* write lines formatted with format() */
+void GxfWriter::writeFormatted(const string& lines) {
+    fBuf += lines;
+    flushIfFull();
 }
 
 /* return feature as a string */
 string GxfFeature::toString() const {
     // just use GFF3 format, this is for debugging, not output
-    return baseColumnsAsString() + Gff3Writer::formatAttrs(getAttrs());
+    string buf;
+    formatBaseColumns(buf);
+    Gff3Writer::formatAttrs(getAttrs(), buf);
+    return buf;
 }
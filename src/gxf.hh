@@ -11,9 +11,11 @@
 #ifndef gxf_hh
 #define gxf_hh
 #include "typeOps.hh"
+#include "objectPool.hh"
 #include <queue>
 #include <stdexcept>
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 using namespace std;
 
@@ -73,17 +75,93 @@ class GxfLine: public string, public GxfRecord {
     }
 };
 
-/* attribute/value pair.  Maybe multi-valued */
-class AttrVal {
+/*
+ * Interned attribute name.  Each distinct name is stored once in a global
+ * table and never freed, so names can be compared by address.  Interning is
+ * thread-safe.
+ */
+class AttrName {
     private:
+    friend class AttrNameTable;
     const string fName;
+
+    AttrName(const string& name):
+        fName(name) {
+    }
+
+    public:
+    /* get the interned name for a string view */
+    static const AttrName* intern(const StringView& name);
+
+    /* get the interned name for a string */
+    static const AttrName* intern(const string& name) {
+        return intern(StringView(name));
+    }
+
+    const string& getName() const {
+        return fName;
+    }
+};
+
+/* Codes for the standard feature types that are frequently tested */
+typedef enum {
+    GXF_OTHER_TYPE,
+    GXF_GENE_TYPE,
+    GXF_TRANSCRIPT_TYPE,
+    GXF_EXON_TYPE,
+    GXF_CDS_TYPE
+} GxfTypeCode;
+
+/*
+ * Interned value of the seqid, source, type, score, strand or phase column.
+ * These come from small vocabularies, so each distinct value is stored once
+ * in a global table and never freed, and features only keep a pointer to
+ * it.  Values can be compared by address.  The type code is set if the
+ * value is a standard feature type.  Interning is thread-safe.
+ */
+class GxfColumnValue {
+    private:
+    friend class GxfColumnValueTable;
+    const string fValue;
+    const GxfTypeCode fTypeCode;
+
+    GxfColumnValue(const string& value);
+
+    public:
+    /* get the interned value for a string */
+    static const GxfColumnValue* intern(const string& value);
+
+    /* get the interned value for a string view */
+    static const GxfColumnValue* intern(const StringView& value) {
+        return intern(value.toString());
+    }
+
+    const string& getValue() const {
+        return fValue;
+    }
+    GxfTypeCode getTypeCode() const {
+        return fTypeCode;
+    }
+};
+
+/* Attribute/value pair.  Maybe multi-valued.  Attributes are shared
+ * between copies of an AttrVals and reference counted, so they are only
+ * modified while being built, before being shared. */
+class AttrVal {
+    private:
+    const AttrName* fName;
     StringVector fVals;
+    mutable atomic<int> fRefCount;
 
     static void checkName(const string& name) {
         if (stringEmpty(name)) {
             throw invalid_argument("empty attribute name");
         }
     }
+    static const AttrName* internName(const string& name) {
+        checkName(name);
+        return AttrName::intern(name);
+    }
     static void checkVal(const string& val) {
         if (stringEmpty(val)) {
             throw invalid_argument("empty attribute value");
@@ -92,32 +170,68 @@ class AttrVal {
 
     public:
     AttrVal(const string& name, const string& val):
-        fName(name) {
-        checkName(name);
+        fName(internName(name)), fRefCount(1) {
+        checkVal(val);
+        fVals.push_back(val);
+    }
+
+    AttrVal(const AttrName* name, const string& val):
+        fName(name), fRefCount(1) {
+        checkName(name->getName());
         checkVal(val);
         fVals.push_back(val);
     }
 
     AttrVal(const string& name, const StringVector& vals):
-        fName(name), fVals(vals) {
-        checkName(name);
+        fName(internName(name)), fVals(vals), fRefCount(1) {
         for (int i = 0; i < vals.size(); i++) {
             checkVal(vals[i]);
         }
     }
 
-    /* add a value */
+    /* add a value, the attribute must not be shared */
     void addVal(const string& val) {
+        assert(fRefCount == 1);
         checkVal(val);
         fVals.push_back(val);
     }
     
-    /* copy constructor */
+    /* copy constructor, the copy is not shared */
     AttrVal(const AttrVal& src):
-        fName(src.fName), fVals(src.fVals) {
+        fName(src.fName), fVals(src.fVals), fRefCount(1) {
+    }
+
+    /* move constructor, the source must not be shared */
+    AttrVal(AttrVal&& src):
+        fName(src.fName), fVals(std::move(src.fVals)), fRefCount(1) {
+    }
+
+    /* add a reference to share the attribute */
+    AttrVal* addRef() const {
+        fRefCount.fetch_add(1, memory_order_relaxed);
+        return const_cast<AttrVal*>(this);
+    }
+
+    /* drop a reference, freeing the attribute if it is no longer shared */
+    static void release(AttrVal* attrVal) {
+        if (attrVal->fRefCount.fetch_sub(1, memory_order_acq_rel) == 1) {
+            delete attrVal;
+        }
+    }
+
+    /* allocate attributes from a pool */
+    static void* operator new(size_t size) {
+        return ObjectPool<sizeof(AttrVal)>::alloc(size);
+    }
+    static void operator delete(void* ptr,
+                                size_t size) {
+        ObjectPool<sizeof(AttrVal)>::release(ptr, size);
     }
 
     const string& getName() const {
+        return fName->getName();
+    }
+    const AttrName* getNameKey() const {
         return fName;
     }
     const string& getVal(int iVal=0) const {
@@ -135,26 +249,60 @@ class AttrVal {
 typedef vector<AttrVal*> AttrValVector;
 
 /* list of attributes,  Multi-valued attributes (tag) are stored as multiple 
- * entries. */
+ * entries.  Copies share the attributes copy-on-write, so a mapped feature
+ * only allocates the attributes it adds or replaces. */
 class AttrVals: public AttrValVector {
     // n.b.  this keeps pointers rather than values due to reallocation if vector changes
+    private:
+    void releaseAll() {
+        for (size_t i = 0; i < size(); i++) {
+            AttrVal::release((*this)[i]);
+        }
+        clear();
+    }
+
     public:
     /* empty constructor */
     AttrVals() {
     }
 
-    /* copy constructor */
+    /* copy constructor, sharing the attributes */
     AttrVals(const AttrVals& src) {
+        reserve(src.size());
         for (size_t i = 0; i < src.size(); i++) {
-            push_back(new AttrVal(*(src[i])));
+            push_back(src[i]->addRef());
+        }
+    }
+
+    /* move constructor */
+    AttrVals(AttrVals&& src):
+        AttrValVector(std::move(src)) {
+    }
+
+    /* assignment, sharing the attributes */
+    AttrVals& operator=(const AttrVals& src) {
+        if (this != &src) {
+            releaseAll();
+            reserve(src.size());
+            for (size_t i = 0; i < src.size(); i++) {
+                push_back(src[i]->addRef());
+            }
         }
+        return *this;
+    }
+
+    /* move assignment */
+    AttrVals& operator=(AttrVals&& src) {
+        if (this != &src) {
+            releaseAll();
+            swap(src);
+        }
+        return *this;
     }
     
     /* destructor */
     ~AttrVals() {
-        for (size_t i = 0; i < size(); i++) {
-            delete (*this)[i];
-        }
+        releaseAll();
     }
 
     /* does the attribute exist */
@@ -172,6 +320,17 @@ class AttrVals: public AttrValVector {
         return -1;
     }
 
+    /* find the index of the first attribute with an interned name or -1 if
+     * not found */
+    int findIdx(const AttrName* name) const {
+        for (int i = 0; i < size(); i++) {
+            if ((*this)[i]->getNameKey() == name) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
     
     /* get a attribute, NULL if it doesn't exist */
     const AttrVal* find(const string& name) const {
@@ -182,6 +341,16 @@ class AttrVals: public AttrValVector {
             return (*this)[i];
         }
     }
+
+    /* get a attribute by interned name, NULL if it doesn't exist */
+    const AttrVal* find(const AttrName* name) const {
+        int i = findIdx(name);
+        if (i < 0) {
+            return NULL;
+        } else {
+            return (*this)[i];
+        }
+    }
     
     
     /* get a attribute, error it doesn't exist */
@@ -197,20 +366,27 @@ class AttrVals: public AttrValVector {
     void add(const AttrVal& attrVal) {
         push_back(new AttrVal(attrVal));
     }
+    void add(AttrVal&& attrVal) {
+        push_back(new AttrVal(std::move(attrVal)));
+    }
 
     /* insert an attribute at the front */
     void push(const AttrVal& attrVal) {
         insert(begin(), new AttrVal(attrVal));
     }
 
-    /* add or replace an attribute */
+    /* add or replace an attribute, only the replaced attribute is
+     * unshared */
     void update(const AttrVal& attrVal) {
-        int idx = findIdx(attrVal.getName());
+        update(AttrVal(attrVal));
+    }
+    void update(AttrVal&& attrVal) {
+        int idx = findIdx(attrVal.getNameKey());
         if (idx < 0) {
-            add(attrVal);
+            add(std::move(attrVal));
         } else {
-            delete (*this)[idx];
-            (*this)[idx] = new AttrVal(attrVal);
+            AttrVal::release((*this)[idx]);
+            (*this)[idx] = new AttrVal(std::move(attrVal));
         }
     }
 
@@ -218,7 +394,7 @@ class AttrVals: public AttrValVector {
     void remove(const string& attrName) {
         int idx = findIdx(attrName);
         if (idx >= 0) {
-            delete (*this)[idx];
+            AttrVal::release((*this)[idx]);
             erase(begin()+idx);
         }
     }
@@ -257,6 +433,20 @@ public:
     static const string EXON_ID_ATTR;
     static const string EXON_NUMBER_ATTR;
     static const string TAG_ATTR;
+
+    // interned standard attribute names, for fast lookup
+    static const AttrName* const ID_KEY;
+    static const AttrName* const PARENT_KEY;
+    static const AttrName* const GENE_ID_KEY;
+    static const AttrName* const GENE_NAME_KEY;
+    static const AttrName* const GENE_TYPE_KEY;
+    static const AttrName* const GENE_HAVANA_KEY;
+    static const AttrName* const TRANSCRIPT_ID_KEY;
+    static const AttrName* const TRANSCRIPT_NAME_KEY;
+    static const AttrName* const TRANSCRIPT_TYPE_KEY;
+    static const AttrName* const TRANSCRIPT_HAVANA_KEY;
+    static const AttrName* const EXON_ID_KEY;
+    static const AttrName* const TAG_KEY;
     
     /* source names */
     static const string SOURCE_HAVANA;
@@ -266,26 +456,28 @@ public:
     static const string PAR_Y_SUFFIX;
     
     private:
-    // columns parsed from file.
-    const string fSeqid;
-    const string fSource;
-    const string fType;
+    // columns parsed from file, other than coordinates these are interned
+    const GxfColumnValue* fSeqid;
+    const GxfColumnValue* fSource;
+    const GxfColumnValue* fType;
     const int fStart;
     const int fEnd;
-    const string fScore;
-    const string fStrand;
-    const string fPhase;
+    const GxfColumnValue* fScore;
+    const GxfColumnValue* fStrand;
+    const GxfColumnValue* fPhase;
     AttrVals fAttrs;     // attribute maybe modified
 
-    // derived values from attributes
-    
-    
     public:
     /* construct a new feature object */
     GxfFeature(const string& seqid, const string& source, const string& type,
                int start, int end, const string& score, const string& strand,
                const string& phase, const AttrVals& attrs);
 
+    /* construct a new feature object from interned values */
+    GxfFeature(const GxfColumnValue* seqid, const GxfColumnValue* source, const GxfColumnValue* type,
+               int start, int end, const GxfColumnValue* score, const GxfColumnValue* strand,
+               const GxfColumnValue* phase, const AttrVals& attrs);
+
     /* clone the feature */
     GxfFeature* clone() const {
         return new GxfFeature(fSeqid, fSource, fType, fStart, fEnd, fScore, fStrand, fPhase, fAttrs);
@@ -295,18 +487,33 @@ public:
     virtual ~GxfFeature() {
     }
 
+    /* allocate features from a pool */
+    static void* operator new(size_t size) {
+        return ObjectPool<sizeof(GxfFeature)>::alloc(size);
+    }
+    static void operator delete(void* ptr,
+                                size_t size) {
+        ObjectPool<sizeof(GxfFeature)>::release(ptr, size);
+    }
+
     /* convert all columns, except attributes, to a string */
     string baseColumnsAsString() const;
+
+    /* append all columns, except attributes, to a buffer */
+    void formatBaseColumns(string& buf) const;
     
     /* accessors */
     const string& getSeqid() const {
-        return fSeqid;
+        return fSeqid->getValue();
     }
     const string& getSource() const {
-        return fSource;
+        return fSource->getValue();
     }
     const string& getType() const {
-        return fType;
+        return fType->getValue();
+    }
+    GxfTypeCode getTypeCode() const {
+        return fType->getTypeCode();
     }
     int getStart() const {
         return fStart;
@@ -319,13 +526,17 @@ public:
         return (fEnd - fStart)+1;
     }
     const string& getScore() const {
-        return fScore;
+        return fScore->getValue();
     }
     const string& getStrand() const {
-        return fStrand;
+        return fStrand->getValue();
+    }
+    /* get the strand as a character */
+    char getStrandChar() const {
+        return fStrand->getValue()[0];
     }
     const string& getPhase() const {
-        return fPhase;
+        return fPhase->getValue();
     }
 
     /* get all attribute */
@@ -369,9 +580,20 @@ public:
         }
     }
 
+    /* get a attribute value by interned name, default it doesn't exist */
+    const string& getAttrValue(const AttrName* name,
+                               const string& defaultVal) const {
+        const AttrVal* attrVal = fAttrs.find(name);
+        if (attrVal == NULL) {
+            return defaultVal;
+        } else {
+            return attrVal->getVal();
+        }
+    }
+
     /* Does this node have the PAR tag for chrY? */
     bool isParY() const {
-        const AttrVal* tagAttr = findAttr(GxfFeature::TAG_ATTR);
+        const AttrVal* tagAttr = fAttrs.find(GxfFeature::TAG_KEY);
         if (tagAttr != NULL) {
             for (int i = 0; i < tagAttr->size(); i++) {
                 if (tagAttr->getVal(i) == "PAR") {
@@ -433,7 +655,7 @@ class GxfFeatureVector: public vector<GxfFeature*> {
     void sort() {
         std::sort(begin(), end(),
                   [](const GxfFeature* a, const GxfFeature* b) -> bool {
-                      if (a->getStrand() == "+") {
+                      if (a->getStrandChar() == '+') {
                           return a->getStart() > b->getStart();
                       } else {
                           return a->getStart() < b->getStart();
@@ -447,19 +669,26 @@ class GxfFeatureVector: public vector<GxfFeature*> {
  */
 class GxfParser {
     private:
-    FIOStream* fIn;  // input stream
+    FIOStream* fFileIn;  // file being read, NULL if reading a stream
+    istream* fIn;        // input stream, either fFileIn or not owned
     queue<GxfRecord*> fPending; // FIFO of pushed records to be read before file
+    string fLine;               // current line, reused to avoid allocation
+    StringViewVector fColumns;  // columns of current line, reference fLine
 
-    StringVector splitFeatureLine(const string& line) const;
+    void splitFeatureLine(const string& line);
     GxfRecord* read();
 
     protected:
-    /* parse a feature */
-    virtual GxfFeature* parseFeature(const StringVector& columns) = 0;
+    /* parse a feature from columns that reference the line buffer; strings
+     * to be kept must be copied */
+    virtual GxfFeature* parseFeature(const StringViewVector& columns) = 0;
     
     /* constructor that opens file */
     GxfParser(const string& fileName);
 
+    /* constructor that reads a stream, which is not owned */
+    GxfParser(istream& in);
+
     public:
     /* destructor */
     virtual ~GxfParser();
@@ -472,6 +701,11 @@ class GxfParser {
     static GxfParser *factory(const string& fileName,
                               GxfFormat gxfFormat=GXF_UNKNOWN_FORMAT);
 
+    /* Factory to create a parser reading an in-memory or other stream,
+     * which is not owned. */
+    static GxfParser *factory(istream& in,
+                              GxfFormat gxfFormat);
+
     /* Read the next record, either queued by push() or from the file , use
      * instanceOf to determine the type.  Return NULL on EOF.
      */
@@ -488,17 +722,27 @@ class GxfParser {
  */
 class GxfWriter {
     private:
-    FIOStream* fOut;  // output stream
+    static const size_t bufferSize = 1024 * 1024;
+    FIOStream* fFileOut;  // file being written, NULL if writing a stream
+    ostream* fOut;        // output stream, either fFileOut or not owned
+    string fBuf;      // lines are formatted into this buffer and written in bulk
+
+    void flushIfFull();
+    void checkOutput() const;
 
     protected:
-    /* format a feature line */
-    virtual string formatFeature(const GxfFeature* feature) = 0;
+    /* format a feature line, appending it to buf */
+    virtual void formatFeature(const GxfFeature* feature,
+                               string& buf) = 0;
     
     public:
     /* constructor that opens file */
     GxfWriter(const string& fileName);
 
-    /* destructor */
+    /* constructor that writes a stream, which is not owned */
+    GxfWriter(ostream& out);
+
+    /* destructor, close() should be called first to detect errors */
     virtual ~GxfWriter();
 
     /* get the format being written */
@@ -508,14 +752,34 @@ class GxfWriter {
                               ParIdHackMethod parIdHackMethod,
                               GxfFormat gxfFormat=GXF_UNKNOWN_FORMAT);
 
+    /* Factory to create a writer to an in-memory or other stream, which is
+     * not owned. */
+    static GxfWriter *factory(ostream& out,
+                              ParIdHackMethod parIdHackMethod,
+                              GxfFormat gxfFormat);
+
     /* copy a file to output, normally used for a header */
     void copyFile(const string& inFile);
 
+    /* format one GxF record as a line, appending it to buf, without
+     * writing it */
+    void format(const GxfRecord* gxfRecord,
+                string& buf);
+
     /* write one GxF record. */
     void write(const GxfRecord* gxfRecord);
 
     /* write one GxF line. */
     void write(const string& line);
-    
+
+    /* write lines formatted with format() */
+    void writeFormatted(const string& lines);
+
+    /* write any buffered output to the file */
+    void flush();
+
+    /* write any buffered output and close the file, if one was opened,
+     * throwing an exception on write errors */
+    void close();
 };
 #endif
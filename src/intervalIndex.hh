@@ -0,0 +1,202 @@
+/*
+ * Flat interval index.
+ */
+#ifndef intervalIndex_hh
+#define intervalIndex_hh
+#include <assert.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+using namespace std;
+
+/*
+ * Index of intervals on sequences, each with an associated value.  Intervals
+ * are stored per sequence in an array sorted by start, with an implicit
+ * balanced binary tree laid over the array that records the maximum end of
+ * each subtree (an augmented interval tree without pointers).  All intervals
+ * are added, then build() is called once before queries.  Queries don't
+ * allocate beyond the result vector, and are safe to run from multiple
+ * threads once built.  Coordinates are zero-based, half-open.
+ */
+template<class T>
+class IntervalIndex {
+    private:
+    struct Entry {
+        int start;
+        int end;
+        int maxEnd;  // maximum end in the subtree rooted at this entry
+        T val;
+    };
+    typedef vector<Entry> EntryVector;
+
+    /* intervals of one sequence */
+    struct SeqIntervals {
+        EntryVector entries;  // sorted by start after build
+        int rootLevel;        // level of tree root, -1 if empty
+        SeqIntervals():
+            rootLevel(-1) {
+        }
+    };
+    typedef map<string, SeqIntervals> SeqIntervalsMap;
+    typedef typename SeqIntervalsMap::iterator SeqIntervalsMapIter;
+    typedef typename SeqIntervalsMap::const_iterator SeqIntervalsMapConstIter;
+
+    /* stack entry for tree traversal */
+    struct TraverseNode {
+        int level;
+        int idx;
+        bool leftDone;
+    };
+
+    SeqIntervalsMap fSeqs;
+    bool fBuilt;
+
+    /* order by start, ties are kept in the order added */
+    static bool startLessThan(const Entry& entry1,
+                              const Entry& entry2) {
+        return entry1.start < entry2.start;
+    }
+
+    /* compute the maximum ends of the implicit tree, returning the level of
+     * the root. Leaves are at even indexes, a node at level k has the
+     * lowest k bits set. */
+    static int buildTree(EntryVector& entries) {
+        int n = entries.size();
+        if (n == 0) {
+            return -1;
+        }
+        int lastIdx = 0, lastMaxEnd = 0;
+        for (int i = 0; i < n; i += 2) {
+            lastIdx = i;
+            lastMaxEnd = entries[i].maxEnd = entries[i].end;
+        }
+        int level;
+        for (level = 1; (1 << level) <= n; level++) {
+            int halfStep = 1 << (level - 1);
+            for (int i = (halfStep << 1) - 1; i < n; i += (halfStep << 2)) {
+                int leftMaxEnd = entries[i - halfStep].maxEnd;
+                int rightMaxEnd = (i + halfStep < n) ? entries[i + halfStep].maxEnd : lastMaxEnd;
+                entries[i].maxEnd = max(entries[i].end, max(leftMaxEnd, rightMaxEnd));
+            }
+            // move to the parent of the last node
+            lastIdx = ((lastIdx >> level) & 1) ? lastIdx - halfStep : lastIdx + halfStep;
+            if ((lastIdx < n) and (entries[lastIdx].maxEnd > lastMaxEnd)) {
+                lastMaxEnd = entries[lastIdx].maxEnd;
+            }
+        }
+        return level - 1;
+    }
+
+    /* collect overlapping entries in a small subtree by a linear scan */
+    static void scanSubtree(const EntryVector& entries,
+                            const TraverseNode& node,
+                            int start,
+                            int end,
+                            vector<T>& hits) {
+        int n = entries.size();
+        int iFirst = (node.idx >> node.level) << node.level;
+        int iLast = min(iFirst + (1 << (node.level + 1)) - 1, n);
+        for (int i = iFirst; (i < iLast) and (entries[i].start < end); i++) {
+            if (start < entries[i].end) {
+                hits.push_back(entries[i].val);
+            }
+        }
+    }
+
+    /* collect overlapping entries of a sequence, in start order */
+    static void findOverlapping(const SeqIntervals& seqIntervals,
+                                int start,
+                                int end,
+                                vector<T>& hits) {
+        static const int smallSubtreeLevel = 3;
+        const EntryVector& entries = seqIntervals.entries;
+        int n = entries.size();
+        TraverseNode stack[64];
+        int top = 0;
+        TraverseNode root = {seqIntervals.rootLevel, (1 << seqIntervals.rootLevel) - 1, false};
+        stack[top++] = root;
+        while (top > 0) {
+            TraverseNode node = stack[--top];
+            if (node.level <= smallSubtreeLevel) {
+                scanSubtree(entries, node, start, end, hits);
+            } else if (not node.leftDone) {
+                // revisit node after the left child, which is only
+                // searched if it could overlap
+                int leftIdx = node.idx - (1 << (node.level - 1));
+                TraverseNode revisit = {node.level, node.idx, true};
+                stack[top++] = revisit;
+                if ((leftIdx >= n) or (entries[leftIdx].maxEnd > start)) {
+                    TraverseNode left = {node.level - 1, leftIdx, false};
+                    stack[top++] = left;
+                }
+            } else if ((node.idx < n) and (entries[node.idx].start < end)) {
+                if (start < entries[node.idx].end) {
+                    hits.push_back(entries[node.idx].val);
+                }
+                TraverseNode right = {node.level - 1, node.idx + (1 << (node.level - 1)), false};
+                stack[top++] = right;
+            }
+        }
+    }
+
+    public:
+    /* constructor */
+    IntervalIndex():
+        fBuilt(false) {
+    }
+
+    /* add an interval, must be called before build */
+    void add(const string& seqid,
+             int start,
+             int end,
+             const T& val) {
+        assert(not fBuilt);
+        Entry entry = {start, end, end, val};
+        fSeqs[seqid].entries.push_back(entry);
+    }
+
+    /* sort and index the intervals */
+    void build() {
+        for (SeqIntervalsMapIter it = fSeqs.begin(); it != fSeqs.end(); it++) {
+            EntryVector& entries = it->second.entries;
+            stable_sort(entries.begin(), entries.end(), startLessThan);
+            it->second.rootLevel = buildTree(entries);
+        }
+        fBuilt = true;
+    }
+
+    /* append values of intervals overlapping the range to hits, in order of
+     * interval start */
+    void overlapping(const string& seqid,
+                     int start,
+                     int end,
+                     vector<T>& hits) const {
+        assert(fBuilt);
+        SeqIntervalsMapConstIter it = fSeqs.find(seqid);
+        if ((it != fSeqs.end()) and (it->second.rootLevel >= 0)) {
+            findOverlapping(it->second, start, end, hits);
+        }
+    }
+
+    /* are there any intervals that overlap the range? */
+    bool anyOverlap(const string& seqid,
+                    int start,
+                    int end) const {
+        vector<T> hits;
+        overlapping(seqid, start, end, hits);
+        return hits.size() > 0;
+    }
+
+    /* append all values in the index to a vector */
+    void getValues(vector<T>& values) const {
+        for (SeqIntervalsMapConstIter it = fSeqs.begin(); it != fSeqs.end(); it++) {
+            const EntryVector& entries = it->second.entries;
+            for (size_t i = 0; i < entries.size(); i++) {
+                values.push_back(entries[i].val);
+            }
+        }
+    }
+};
+
+#endif
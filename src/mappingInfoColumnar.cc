@@ -0,0 +1,266 @@
+/*
+ * Columnar binary form of the mapping info.
+ */
+#include "mappingInfoColumnar.hh"
+#include "featureTree.hh"
+#include <string.h>
+#include <errno.h>
+#include <fstream>
+#include <stdexcept>
+#include <stdint.h>
+
+static const char fileMagic[8] = {'G', 'B', 'M', 'I', 'N', 'F', 'O', '\0'};
+static const uint32_t fileVersion = 1;
+static const int columnNameSize = 32;
+static const uint64_t headerBytes = 24;
+static const uint64_t directoryEntryBytes = 64;
+
+/* write an unsigned integer in little-endian order */
+static void writeLE(ostream& fh,
+                    uint64_t value,
+                    int numBytes) {
+    char buf[8];
+    for (int i = 0; i < numBytes; i++) {
+        buf[i] = char((value >> (8 * i)) & 0xff);
+    }
+    fh.write(buf, numBytes);
+}
+
+/* write zeros to pad to an eight byte boundary */
+static void writePadding(ostream& fh,
+                         uint64_t numBytes) {
+    static const char zeros[8] = {0};
+    fh.write(zeros, (8 - (numBytes % 8)) % 8);
+}
+
+/* round up to an eight byte boundary */
+static uint64_t alignBytes(uint64_t numBytes) {
+    return (numBytes + 7) & ~uint64_t(7);
+}
+
+/* a string array, as offsets and characters */
+class StringArray {
+    private:
+    vector<uint32_t> fOffsets;
+    string fChars;
+
+    public:
+    StringArray():
+        fOffsets(1, 0) {
+    }
+    size_t size() const {
+        return fOffsets.size() - 1;
+    }
+    void add(const string& str) {
+        if ((fChars.size() + str.size()) > UINT32_MAX) {
+            throw length_error("mapping info columnar string data exceeds 4GB");
+        }
+        fChars += str;
+        fOffsets.push_back(fChars.size());
+    }
+    uint64_t getBytes() const {
+        return (4 * fOffsets.size()) + fChars.size();
+    }
+    void write(ostream& fh) const {
+        for (size_t i = 0; i < fOffsets.size(); i++) {
+            writeLE(fh, fOffsets[i], 4);
+        }
+        fh.write(fChars.data(), fChars.size());
+    }
+};
+
+/* column of 32-bit integers */
+class MappingInfoColumnar::Int32Column: public Column {
+    private:
+    vector<int32_t> fValues;
+
+    public:
+    Int32Column(const string& name):
+        Column(name) {
+    }
+    virtual ColumnType getType() const {
+        return COLUMN_INT32;
+    }
+    void add(int value) {
+        fValues.push_back(value);
+    }
+    virtual uint64_t getDataBytes() const {
+        return 4 * fValues.size();
+    }
+    virtual void writeData(ostream& fh) const {
+        for (size_t i = 0; i < fValues.size(); i++) {
+            writeLE(fh, uint32_t(fValues[i]), 4);
+        }
+    }
+};
+
+/* dictionary encoded column of strings */
+class MappingInfoColumnar::DictColumn: public Column {
+    private:
+    vector<uint32_t> fCodes;
+    StringArray fEntries;
+    map<string, uint32_t> fEntryCodes;
+
+    public:
+    DictColumn(const string& name):
+        Column(name) {
+    }
+    virtual ColumnType getType() const {
+        return (fEntries.size() <= 65536) ? COLUMN_DICT16 : COLUMN_DICT32;
+    }
+    int getCodeBytes() const {
+        return (getType() == COLUMN_DICT16) ? 2 : 4;
+    }
+    void add(const string& value) {
+        map<string, uint32_t>::const_iterator it = fEntryCodes.find(value);
+        if (it == fEntryCodes.end()) {
+            it = fEntryCodes.insert(make_pair(value, uint32_t(fEntries.size()))).first;
+            fEntries.add(value);
+        }
+        fCodes.push_back(it->second);
+    }
+    virtual uint32_t getDictSize() const {
+        return fEntries.size();
+    }
+    virtual uint64_t getDataBytes() const {
+        return getCodeBytes() * fCodes.size();
+    }
+    virtual void writeData(ostream& fh) const {
+        int codeBytes = getCodeBytes();
+        for (size_t i = 0; i < fCodes.size(); i++) {
+            writeLE(fh, fCodes[i], codeBytes);
+        }
+    }
+    virtual uint64_t getDictBytes() const {
+        return fEntries.getBytes();
+    }
+    virtual void writeDict(ostream& fh) const {
+        fEntries.write(fh);
+    }
+};
+
+/* column of arbitrary strings */
+class MappingInfoColumnar::StringColumn: public Column {
+    private:
+    StringArray fValues;
+
+    public:
+    StringColumn(const string& name):
+        Column(name) {
+    }
+    virtual ColumnType getType() const {
+        return COLUMN_STRING;
+    }
+    void add(const string& value) {
+        fValues.add(value);
+    }
+    virtual uint64_t getDataBytes() const {
+        return fValues.getBytes();
+    }
+    virtual void writeData(ostream& fh) const {
+        fValues.write(fh);
+    }
+};
+
+/* create a column and add it to the list */
+template<class ColumnClass>
+ColumnClass* MappingInfoColumnar::addColumn(const string& name) {
+    ColumnClass* column = new ColumnClass(name);
+    fColumns.push_back(column);
+    return column;
+}
+
+/* constructor, columns are in the same order as the TSV */
+MappingInfoColumnar::MappingInfoColumnar():
+    fNumRows(0),
+    fGeneNum(addColumn<Int32Column>("geneNum")),
+    fRecType(addColumn<DictColumn>("recType")),
+    fFeatType(addColumn<DictColumn>("featType")),
+    fFeatId(addColumn<StringColumn>("featId")),
+    fFeatOttId(addColumn<StringColumn>("featOttId")),
+    fFeatName(addColumn<StringColumn>("featName")),
+    fFeatBiotype(addColumn<DictColumn>("featBiotype")),
+    fFeatSource(addColumn<DictColumn>("featSource")),
+    fFeatChrom(addColumn<DictColumn>("featChrom")),
+    fFeatStart(addColumn<Int32Column>("featStart")),
+    fFeatEnd(addColumn<Int32Column>("featEnd")),
+    fFeatStrand(addColumn<DictColumn>("featStrand")),
+    fMappingStatus(addColumn<DictColumn>("mappingStatus")),
+    fMappingCount(addColumn<Int32Column>("mappingCount")),
+    fTargetStatus(addColumn<DictColumn>("targetStatus")) {
+}
+
+/* destructor */
+MappingInfoColumnar::~MappingInfoColumnar() {
+    for (size_t i = 0; i < fColumns.size(); i++) {
+        delete fColumns[i];
+    }
+}
+
+/* add a mapping info record */
+void MappingInfoColumnar::add(int geneNum,
+                              const string& recType,
+                              const string& featType,
+                              const FeatureNode* feature,
+                              RemapStatus mappingStatus,
+                              int mappingCount,
+                              TargetStatus targetStatus) {
+    fGeneNum->add(geneNum);
+    fRecType->add(recType);
+    fFeatType->add(featType);
+    fFeatId->add(feature->getTypeId());
+    fFeatOttId->add(feature->getHavanaTypeId());
+    fFeatName->add(feature->getTypeName());
+    fFeatBiotype->add(feature->getTypeBiotype());
+    fFeatSource->add(feature->getSource());
+    fFeatChrom->add(feature->getSeqid());
+    fFeatStart->add(feature->getStart());
+    fFeatEnd->add(feature->getEnd());
+    fFeatStrand->add(feature->getStrand());
+    fMappingStatus->add(remapStatusToStr(mappingStatus));
+    fMappingCount->add(mappingCount);
+    fTargetStatus->add(targetStatusToStr(targetStatus));
+    fNumRows++;
+}
+
+/* write the file */
+void MappingInfoColumnar::write(const string& outFile) const {
+    ofstream fh(outFile.c_str(), ios::out | ios::binary);
+    if (not fh.is_open()) {
+        throw ios_base::failure("can't open mapping info \"" + outFile + "\" for write access: " + strerror(errno));
+    }
+    fh.write(fileMagic, sizeof(fileMagic));
+    writeLE(fh, fileVersion, 4);
+    writeLE(fh, fColumns.size(), 4);
+    writeLE(fh, fNumRows, 8);
+
+    // directory, with sections laid out after it in column order
+    uint64_t offset = headerBytes + (directoryEntryBytes * fColumns.size());
+    for (size_t i = 0; i < fColumns.size(); i++) {
+        const Column* column = fColumns[i];
+        char name[columnNameSize];
+        memset(name, 0, sizeof(name));
+        strncpy(name, column->fName.c_str(), sizeof(name) - 1);
+        fh.write(name, sizeof(name));
+        writeLE(fh, column->getType(), 4);
+        writeLE(fh, column->getDictSize(), 4);
+        uint64_t dataOffset = offset;
+        offset += alignBytes(column->getDataBytes());
+        uint64_t dictOffset = (column->getDictBytes() > 0) ? offset : 0;
+        offset += alignBytes(column->getDictBytes());
+        writeLE(fh, dataOffset, 8);
+        writeLE(fh, dictOffset, 8);
+        writeLE(fh, 0, 8);
+    }
+    for (size_t i = 0; i < fColumns.size(); i++) {
+        const Column* column = fColumns[i];
+        column->writeData(fh);
+        writePadding(fh, column->getDataBytes());
+        column->writeDict(fh);
+        writePadding(fh, column->getDictBytes());
+    }
+    fh.close();
+    if (fh.fail()) {
+        throw ios_base::failure("error writing mapping info \"" + outFile + "\"");
+    }
+}
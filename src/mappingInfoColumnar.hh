@@ -0,0 +1,115 @@
+/*
+ * Columnar binary form of the mapping info.
+ */
+#ifndef mappingInfoColumnar_hh
+#define mappingInfoColumnar_hh
+#include <string>
+#include <vector>
+#include <map>
+#include <iostream>
+#include <stdint.h>
+#include "remapStatus.hh"
+using namespace std;
+class FeatureNode;
+
+/*
+ * Collects the mapping info records by column and writes them to a binary
+ * file that can be memory mapped, with categorical columns dictionary
+ * encoded.  This contains the same columns as the mapping info TSV, plus
+ * the feature source.  The format, all little-endian with each section
+ * starting on an eight byte boundary, is:
+ *
+ *   header:      char magic[8] "GBMINFO\0", uint32 version (1),
+ *                uint32 numColumns, uint64 numRows
+ *   directory:   numColumns entries of
+ *                char name[32] (NUL padded), uint32 type, uint32 dictSize,
+ *                uint64 dataOffset, uint64 dictOffset, uint64 reserved
+ *   column data, by type:
+ *     INT32:     int32 values[numRows]
+ *     DICT16:    uint16 codes[numRows], with the dictionary at dictOffset
+ *                as uint32 offsets[dictSize+1] followed by the characters
+ *     DICT32:    as DICT16, with uint32 codes, if there are more than 65536
+ *                entries
+ *     STRING:    uint32 offsets[numRows+1] followed by the characters
+ *
+ * Offsets of strings are from the start of their characters, the end of
+ * string i is offsets[i+1].  lib/gencode/mappingInfoColumnar.py reads it.
+ */
+class MappingInfoColumnar {
+    public:
+    /* column types */
+    typedef enum {
+        COLUMN_INT32 = 1,
+        COLUMN_DICT16 = 2,
+        COLUMN_DICT32 = 3,
+        COLUMN_STRING = 4
+    } ColumnType;
+
+    private:
+    /* a column, with the bytes of its data and dictionary sections */
+    class Column {
+        public:
+        const string fName;
+        Column(const string& name):
+            fName(name) {
+        }
+        virtual ~Column() {
+        }
+        virtual ColumnType getType() const = 0;
+        virtual uint32_t getDictSize() const {
+            return 0;
+        }
+        virtual uint64_t getDataBytes() const = 0;
+        virtual void writeData(ostream& fh) const = 0;
+        virtual uint64_t getDictBytes() const {
+            return 0;
+        }
+        virtual void writeDict(ostream& fh) const {
+        }
+    };
+    class Int32Column;
+    class DictColumn;
+    class StringColumn;
+
+    uint64_t fNumRows;
+    vector<Column*> fColumns;
+    Int32Column* fGeneNum;
+    DictColumn* fRecType;
+    DictColumn* fFeatType;
+    StringColumn* fFeatId;
+    StringColumn* fFeatOttId;
+    StringColumn* fFeatName;
+    DictColumn* fFeatBiotype;
+    DictColumn* fFeatSource;
+    DictColumn* fFeatChrom;
+    Int32Column* fFeatStart;
+    Int32Column* fFeatEnd;
+    DictColumn* fFeatStrand;
+    DictColumn* fMappingStatus;
+    Int32Column* fMappingCount;
+    DictColumn* fTargetStatus;
+
+    template<class ColumnClass>
+    ColumnClass* addColumn(const string& name);
+
+    public:
+    /* constructor */
+    MappingInfoColumnar();
+
+    /* destructor */
+    ~MappingInfoColumnar();
+
+    /* add a mapping info record */
+    void add(int geneNum,
+             const string& recType,
+             const string& featType,
+             const FeatureNode* feature,
+             RemapStatus mappingStatus,
+             int mappingCount,
+             TargetStatus targetStatus);
+
+    /* write the file */
+    void write(const string& outFile) const;
+};
+
+#endif
@@ -0,0 +1,248 @@
+/*
+ * Resident server that maps GxF fragments.
+ */
+#include "mappingServer.hh"
+#include "geneMapper.hh"
+#include "annotationSet.hh"
+#include "srcGenes.hh"
+#include "globals.hh"
+#include <sstream>
+#include <stdexcept>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+static const string requestHeader = "#gencodeBackmap\t";
+static const string endLine = "#end";
+
+/*
+ * streambuf reading and writing a socket file descriptor.
+ */
+class FdStreamBuf: public streambuf {
+    private:
+    static const int bufSize = 64 * 1024;
+    int fFd;
+    char fInBuf[bufSize];
+    char fOutBuf[bufSize];
+
+    /* write the buffered output, return false on error */
+    bool writeOut() {
+        const char* next = pbase();
+        while (next < pptr()) {
+            ssize_t cnt = ::send(fFd, next, pptr() - next, MSG_NOSIGNAL);  // no SIGPIPE if client disconnects
+            if (cnt < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            next += cnt;
+        }
+        setp(fOutBuf, fOutBuf + bufSize);
+        return true;
+    }
+
+    protected:
+    virtual int underflow() {
+        ssize_t cnt;
+        while (((cnt = ::read(fFd, fInBuf, bufSize)) < 0) and (errno == EINTR)) {
+        }
+        if (cnt <= 0) {
+            return traits_type::eof();
+        }
+        setg(fInBuf, fInBuf, fInBuf + cnt);
+        return traits_type::to_int_type(fInBuf[0]);
+    }
+
+    virtual int overflow(int ch) {
+        if (not writeOut()) {
+            return traits_type::eof();
+        }
+        if (ch != traits_type::eof()) {
+            *pptr() = ch;
+            pbump(1);
+        }
+        return traits_type::not_eof(ch);
+    }
+
+    virtual int sync() {
+        return writeOut() ? 0 : -1;
+    }
+
+    public:
+    /* constructor, fd is not owned */
+    FdStreamBuf(int fd):
+        fFd(fd) {
+        setg(fInBuf, fInBuf, fInBuf);
+        setp(fOutBuf, fOutBuf + bufSize);
+    }
+};
+
+/* constructor, objects are not owned */
+MappingServer::MappingServer(const TransMap* genomeTransMap,
+                             const AnnotationSet* targetAnnotations,
+                             const AnnotationSet* previousMappedAnnotations,
+                             const AnnotationSet* previousSrcAnnotations,
+                             const BedMap* targetPatchMap,
+                             const string& substituteTargetVersion,
+                             unsigned useTargetFlags,
+                             bool onlyManualForTargetSubstituteOverlap,
+                             ParIdHackMethod parIdHackMethod,
+                             const string& headerFile,
+                             int numThreads):
+    fGenomeTransMap(genomeTransMap),
+    fTargetAnnotations(targetAnnotations),
+    fPreviousMappedAnnotations(previousMappedAnnotations),
+    fPreviousSrcAnnotations(previousSrcAnnotations),
+    fTargetPatchMap(targetPatchMap),
+    fSubstituteTargetVersion(substituteTargetVersion),
+    fUseTargetFlags(useTargetFlags),
+    fOnlyManualForTargetSubstituteOverlap(onlyManualForTargetSubstituteOverlap),
+    fParIdHackMethod(parIdHackMethod),
+    fHeaderFile(headerFile),
+    fNumThreads(numThreads) {
+}
+
+/* Parse a request header line, getting the format */
+GxfFormat MappingServer::parseRequestHeader(const string& line) {
+    if (not stringStartsWith(line, requestHeader)) {
+        throw invalid_argument("expected request header \"" + requestHeader + "gff3|gtf\", got: " + line);
+    }
+    string formatName = line.substr(requestHeader.size());
+    if (formatName == "gff3") {
+        return GFF3_FORMAT;
+    } else if (formatName == "gtf") {
+        return GTF_FORMAT;
+    } else {
+        throw invalid_argument("request format must be gff3 or gtf, got: " + formatName);
+    }
+}
+
+/* Read the GxF lines of a request, through the end line */
+string MappingServer::readRequestBody(istream& in) {
+    string requestGxf, line;
+    while (getline(in, line)) {
+        if (line == endLine) {
+            return requestGxf;
+        }
+        requestGxf += line;
+        requestGxf += '\n';
+    }
+    throw invalid_argument("request not terminated by " + endLine);
+}
+
+/* map the genes in a request, writing the response */
+void MappingServer::mapRequest(GxfFormat gxfFormat,
+                               const string& requestGxf,
+                               ostream& out) {
+    istringstream requestFh(requestGxf);
+    AnnotationSet srcAnnotations(requestFh, gxfFormat);
+    LoadedSrcGenes srcGenes(&srcAnnotations);
+    GeneMapper geneMapper(&srcGenes, fGenomeTransMap, NULL, fTargetAnnotations,
+                          fPreviousMappedAnnotations, fPreviousSrcAnnotations,
+                          fTargetPatchMap, fSubstituteTargetVersion,
+                          fUseTargetFlags, fOnlyManualForTargetSubstituteOverlap,
+                          fNumThreads);
+    geneMapper.setCopyTargetGenes(false);
+    ostringstream mappedFh, mappingInfoFh;
+    GxfWriter* mappedGxfFh = GxfWriter::factory(mappedFh, fParIdHackMethod, gxfFormat);
+    if (fHeaderFile.size() > 0) {
+        mappedGxfFh->copyFile(fHeaderFile);
+    }
+    geneMapper.mapGxf(*mappedGxfFh, mappingInfoFh, NULL);
+    mappedGxfFh->flush();
+    delete mappedGxfFh;
+
+    out << "#mapped\n" << mappedFh.str()
+        << "#mappingInfo\n" << mappingInfoFh.str()
+        << endLine << "\n";
+}
+
+/* Process one request.  Errors are returned to the client; return false
+ * on EOF. */
+bool MappingServer::processRequest(istream& in,
+                                   ostream& out) {
+    string line;
+    if (not getline(in, line)) {
+        return false;
+    }
+    bool validHeader = false;
+    try {
+        GxfFormat gxfFormat = parseRequestHeader(line);
+        validHeader = true;
+        string requestGxf = readRequestBody(in);
+        ostringstream response;
+        mapRequest(gxfFormat, requestGxf, response);
+        out << response.str();
+    } catch (const exception& ex) {
+        if (gVerbose) {
+            cerr << "request failed: " << ex.what() << endl;
+        }
+        out << "#error\t" << ex.what() << "\n" << endLine << "\n";
+        if (not validHeader) {
+            // skip rest of a bad request
+            while (getline(in, line) and (line != endLine)) {
+            }
+        }
+    }
+    out.flush();
+    return not in.eof();
+}
+
+/* Process requests from a stream until EOF */
+void MappingServer::processRequests(istream& in,
+                                    ostream& out) {
+    while (processRequest(in, out)) {
+    }
+}
+
+/* listen on a Unix domain socket, serving each connection in turn */
+void MappingServer::serveSocket(const string& socketPath) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(addr.sun_path)) {
+        throw invalid_argument("socket path too long: " + socketPath);
+    }
+    strcpy(addr.sun_path, socketPath.c_str());
+    int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd < 0) {
+        throw ios_base::failure(string("can't create socket: ") + strerror(errno));
+    }
+    unlink(socketPath.c_str());
+    if ((bind(listenFd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0)
+        or (listen(listenFd, 8) < 0)) {
+        string msg = "can't listen on socket \"" + socketPath + "\": " + strerror(errno);
+        close(listenFd);
+        throw ios_base::failure(msg);
+    }
+    if (gVerbose) {
+        cerr << "listening on " << socketPath << endl;
+    }
+    while (true) {
+        int connFd = accept(listenFd, NULL, NULL);
+        if (connFd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            string msg = string("accept failed: ") + strerror(errno);
+            close(listenFd);
+            throw ios_base::failure(msg);
+        }
+        FdStreamBuf connBuf(connFd);
+        iostream conn(&connBuf);
+        processRequests(conn, conn);
+        close(connFd);
+    }
+}
+
+/* Serve requests on stdin/stdout or a Unix domain socket */
+void MappingServer::serve(const string& socketPath) {
+    if (socketPath == "-") {
+        processRequests(cin, cout);
+    } else {
+        serveSocket(socketPath);
+    }
+}
@@ -0,0 +1,82 @@
+/*
+ * Resident server that maps GxF fragments.
+ */
+#ifndef mappingServer_hh
+#define mappingServer_hh
+#include <string>
+#include <iostream>
+#include "gxf.hh"
+using namespace std;
+class TransMap;
+class AnnotationSet;
+class BedMap;
+
+/*
+ * Server that keeps the mapping alignments and the target and previous
+ * annotations loaded, and maps GxF fragments sent to it, so that a few
+ * edited genes can be remapped without the startup cost of a full run.
+ * Requests and responses are line-based:
+ *
+ *   request:   #gencodeBackmap  gff3|gtf
+ *              GxF lines
+ *              #end
+ *   response:  #mapped
+ *              mapped GxF lines
+ *              #mappingInfo
+ *              mapping info TSV, including header
+ *              #end
+ *   or:        #error  message
+ *              #end
+ *
+ * Each request is mapped independently, as if it was the entire input.
+ * Target genes are not copied.  Requests are processed one at a time.
+ */
+class MappingServer {
+    private:
+    const TransMap* fGenomeTransMap;
+    const AnnotationSet* fTargetAnnotations;
+    const AnnotationSet* fPreviousMappedAnnotations;
+    const AnnotationSet* fPreviousSrcAnnotations;
+    const BedMap* fTargetPatchMap;
+    const string fSubstituteTargetVersion;
+    const unsigned fUseTargetFlags;
+    const bool fOnlyManualForTargetSubstituteOverlap;
+    const ParIdHackMethod fParIdHackMethod;
+    const string fHeaderFile;
+    const int fNumThreads;
+
+    static GxfFormat parseRequestHeader(const string& line);
+    static string readRequestBody(istream& in);
+    void mapRequest(GxfFormat gxfFormat,
+                    const string& requestGxf,
+                    ostream& out);
+    bool processRequest(istream& in,
+                        ostream& out);
+    void serveSocket(const string& socketPath);
+
+    public:
+    /* constructor, objects are not owned */
+    MappingServer(const TransMap* genomeTransMap,
+                  const AnnotationSet* targetAnnotations,
+                  const AnnotationSet* previousMappedAnnotations,
+                  const AnnotationSet* previousSrcAnnotations,
+                  const BedMap* targetPatchMap,
+                  const string& substituteTargetVersion,
+                  unsigned useTargetFlags,
+                  bool onlyManualForTargetSubstituteOverlap,
+                  ParIdHackMethod parIdHackMethod,
+                  const string& headerFile,
+                  int numThreads);
+
+    /* Process requests from a stream until EOF */
+    void processRequests(istream& in,
+                         ostream& out);
+
+    /* Serve requests.  If socketPath is "-", requests are read from stdin
+     * and responses written to stdout until EOF.  Otherwise listen for
+     * connections on a Unix domain socket until killed, with any number of
+     * requests on each connection. */
+    void serve(const string& socketPath);
+};
+
+#endif
@@ -0,0 +1,315 @@
+/*
+ * Summary counts of mapping results, collected during mapping.
+ */
+#include "mappingSummary.hh"
+#include "featureTree.hh"
+#include "typeOps.hh"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fstream>
+#include <stdexcept>
+
+/* biotype functions, in the order they are sorted, from
+ * lib/gencode/gencodeBioTypes.py */
+static const char* bioTypeFunctionNames[] = {
+    "pseudo", "coding", "nonCoding", "problem", "unknown"
+};
+typedef enum {
+    BIOTYPE_FUNC_PSEUDO,
+    BIOTYPE_FUNC_CODING,
+    BIOTYPE_FUNC_NON_CODING,
+    BIOTYPE_FUNC_PROBLEM,
+    BIOTYPE_FUNC_UNKNOWN  // biotype not in table
+} BioTypeFunction;
+
+/* biotypes of each function, terminated by NULL */
+static const char* bioTypesCoding[] = {
+    "IG_C_gene", "IG_D_gene", "IG_J_gene", "IG_V_gene", "IG_LV_gene",
+    "polymorphic_pseudogene", "protein_coding", "nonsense_mediated_decay",
+    "TR_gene", "TR_C_gene", "TR_D_gene", "TR_J_gene", "TR_V_gene",
+    "non_stop_decay", NULL
+};
+static const char* bioTypesNonCoding[] = {
+    "antisense", "antisense_RNA", "lincRNA", "miRNA", "misc_RNA", "ncrna_host",
+    "Mt_rRNA", "Mt_tRNA", "non_coding", "processed_transcript", "rRNA",
+    "snoRNA", "scRNA", "snRNA", "3prime_overlapping_ncrna",
+    "3prime_overlapping_ncRNA", "sense_intronic", "sense_overlapping",
+    "known_ncrna", "macro_lncRNA", "ribozyme", "scaRNA", "sRNA", "vaultRNA",
+    "bidirectional_promoter_lncrna", "bidirectional_promoter_lncRNA", NULL
+};
+static const char* bioTypesProblem[] = {
+    "retained_intron", "TEC", "disrupted_domain", "ambiguous_orf", NULL
+};
+static const char* bioTypesPseudo[] = {
+    "IG_J_pseudogene", "IG_pseudogene", "IG_V_pseudogene", "miRNA_pseudogene",
+    "misc_RNA_pseudogene", "Mt_tRNA_pseudogene", "processed_pseudogene",
+    "pseudogene", "rRNA_pseudogene", "scRNA_pseudogene", "snoRNA_pseudogene",
+    "snRNA_pseudogene", "transcribed_processed_pseudogene",
+    "transcribed_unprocessed_pseudogene", "tRNA_pseudogene", "TR_pseudogene",
+    "unitary_pseudogene", "transcribed_unitary_pseudogene",
+    "unprocessed_pseudogene", "IG_C_pseudogene", "IG_D_pseudogene",
+    "TR_J_pseudogene", "TR_V_pseudogene", "retrotransposed",
+    "translated_processed_pseudogene", "translated_unprocessed_pseudogene", NULL
+};
+
+/* add biotypes to the function map */
+static void addBioTypeFunctions(const char** bioTypes,
+                                BioTypeFunction bioTypeFunction,
+                                map<string, BioTypeFunction>& bioTypeFunctions) {
+    for (int i = 0; bioTypes[i] != NULL; i++) {
+        bioTypeFunctions[bioTypes[i]] = bioTypeFunction;
+    }
+}
+
+/* build the map of biotypes to functions */
+static map<string, BioTypeFunction> buildBioTypeFunctions() {
+    map<string, BioTypeFunction> bioTypeFunctions;
+    addBioTypeFunctions(bioTypesCoding, BIOTYPE_FUNC_CODING, bioTypeFunctions);
+    addBioTypeFunctions(bioTypesNonCoding, BIOTYPE_FUNC_NON_CODING, bioTypeFunctions);
+    addBioTypeFunctions(bioTypesProblem, BIOTYPE_FUNC_PROBLEM, bioTypeFunctions);
+    addBioTypeFunctions(bioTypesPseudo, BIOTYPE_FUNC_PSEUDO, bioTypeFunctions);
+    return bioTypeFunctions;
+}
+
+/* get the function of a biotype */
+static BioTypeFunction getBioTypeFunction(const string& bioType) {
+    static const map<string, BioTypeFunction> bioTypeFunctions = buildBioTypeFunctions();
+    map<string, BioTypeFunction>::const_iterator it = bioTypeFunctions.find(bioType);
+    return (it == bioTypeFunctions.end()) ? BIOTYPE_FUNC_UNKNOWN : it->second;
+}
+
+/* smallest power of ten that is at least the genomic length */
+static long orderOfMagnitudeBin(const FeatureNode* feature) {
+    long size = (feature->getEnd() - feature->getStart()) + 1;
+    long magBin = 1;
+    while (size > magBin) {
+        magBin *= 10;
+    }
+    return magBin;
+}
+
+/* format a frequency the same as mapInfoSummary */
+static string fmtRate(int count,
+                      int total) {
+    if (total == 0) {
+        return "0.0";
+    }
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%0.2f", double(count) / total);
+    return buf;
+}
+
+/* get the column name for a key */
+const string& MappingSummary::keyTypeName(KeyType keyType) {
+    static const string names[] = {
+        "", "biotype", "biocat", "genomicSize", "mappingStatus", "targetStatus", "multimap", "targetSubst"
+    };
+    return names[keyType];
+}
+
+/* get the value of a key for a record */
+MappingSummary::KeyValue MappingSummary::getKeyValue(KeyType keyType,
+                                                     const string& recType,
+                                                     const FeatureNode* feature,
+                                                     RemapStatus mappingStatus,
+                                                     int mappingCount,
+                                                     TargetStatus targetStatus) {
+    switch (keyType) {
+        case KEY_BIOTYPE:
+            return KeyValue(0, feature->getTypeBiotype());
+        case KEY_BIOCAT: {
+            BioTypeFunction bioTypeFunction = getBioTypeFunction(feature->getTypeBiotype());
+            return KeyValue(bioTypeFunction, bioTypeFunctionNames[bioTypeFunction]);
+        }
+        case KEY_GENOMIC_SIZE: {
+            long magBin = orderOfMagnitudeBin(feature);
+            return KeyValue(magBin, toString(magBin));
+        }
+        case KEY_MAPPING_STATUS:
+            return KeyValue(0, remapStatusToStr(mappingStatus));
+        case KEY_TARGET_STATUS:
+            return KeyValue(0, targetStatusToStr(targetStatus));
+        case KEY_MULTIMAP:
+            return KeyValue(0, (mappingCount > 1) ? "yes" : "no");
+        case KEY_TARGET_SUBST:
+            // inverted sense is the same as mapInfoSummary, which the
+            // existing reports are based on
+            return KeyValue(0, (recType != "targetSubst") ? "yes" : "no");
+        case KEY_NONE:
+            break;
+    }
+    throw logic_error("MappingSummary::getKeyValue: invalid key type");
+}
+
+/* count a mapping info record */
+void MappingSummary::count(const string& recType,
+                           const string& featType,
+                           const FeatureNode* feature,
+                           RemapStatus mappingStatus,
+                           int mappingCount,
+                           TargetStatus targetStatus) {
+    if (not (((recType == "map") or (recType == "targetSubst")) and (featType == fFeatType))) {
+        return;
+    }
+    RowKey rowKey;
+    for (size_t i = 0; i < fRowKeyTypes.size(); i++) {
+        rowKey.push_back(getKeyValue(fRowKeyTypes[i], recType, feature, mappingStatus, mappingCount, targetStatus));
+    }
+    KeyValue columnKey = (fColumnKeyType == KEY_NONE) ? KeyValue(0, "count")
+        : getKeyValue(fColumnKeyType, recType, feature, mappingStatus, mappingCount, targetStatus);
+    fCounts[rowKey][columnKey]++;
+    fRowTotals[rowKey]++;
+    fColumnTotals[columnKey]++;
+}
+
+/* write a row of values */
+void MappingSummary::writeRow(ostream& fh,
+                              const vector<string>& row) const {
+    for (size_t i = 0; i < row.size(); i++) {
+        if (i > 0) {
+            fh << "\t";
+        }
+        fh << row[i];
+    }
+    fh << "\n";
+}
+
+/* write the header, with the key columns followed by the value columns */
+void MappingSummary::writeHeader(ostream& fh,
+                                 const vector<string>& valueColumns) const {
+    vector<string> header;
+    for (size_t i = 0; i < fRowKeyTypes.size(); i++) {
+        header.push_back(keyTypeName(fRowKeyTypes[i]));
+    }
+    header.insert(header.end(), valueColumns.begin(), valueColumns.end());
+    writeRow(fh, header);
+}
+
+/* get the key columns of the totals row */
+vector<string> MappingSummary::getTotalsRowKey() const {
+    return vector<string>(fRowKeyTypes.size(), "all");
+}
+
+/* write counts and frequencies */
+void MappingSummary::writeCountsFreqs(ostream& fh) const {
+    int total = 0;
+    for (ColumnCounts::const_iterator it = fColumnTotals.begin(); it != fColumnTotals.end(); it++) {
+        total += it->second;
+    }
+    writeHeader(fh, {"count", "freq"});
+    for (map<RowKey, ColumnCounts>::const_iterator it = fCounts.begin(); it != fCounts.end(); it++) {
+        vector<string> row;
+        for (size_t i = 0; i < it->first.size(); i++) {
+            row.push_back(it->first[i].label);
+        }
+        int cnt = fRowTotals.find(it->first)->second;
+        row.push_back(toString(cnt));
+        row.push_back(fmtRate(cnt, total));
+        writeRow(fh, row);
+    }
+    vector<string> row = getTotalsRowKey();
+    row.push_back(toString(total));
+    row.push_back(fmtRate(total, total));
+    writeRow(fh, row);
+}
+
+/* write one row of a matrix */
+void MappingSummary::writeMatrixRow(ostream& fh,
+                                    const vector<string>& rowKey,
+                                    const ColumnCounts& rowCounts,
+                                    int rowTotal) const {
+    vector<string> row = rowKey;
+    int rowSum = 0;
+    for (ColumnCounts::const_iterator it = fColumnTotals.begin(); it != fColumnTotals.end(); it++) {
+        ColumnCounts::const_iterator cntIt = rowCounts.find(it->first);
+        int cnt = (cntIt == rowCounts.end()) ? 0 : cntIt->second;
+        rowSum += cnt;
+        if (fMatrixFormat == MATRIX_ROW_FREQS) {
+            row.push_back(fmtRate(cnt, rowTotal));
+        } else if (fMatrixFormat == MATRIX_COLUMN_FREQS) {
+            row.push_back(fmtRate(cnt, it->second));
+        } else {
+            row.push_back(toString(cnt));
+        }
+    }
+    // column frequencies have no total, as with mapInfoSummary
+    if (fMatrixFormat == MATRIX_ROW_FREQS) {
+        row.push_back(fmtRate(rowSum, rowTotal));
+    } else if (fMatrixFormat == MATRIX_COUNTS) {
+        row.push_back(toString(rowSum));
+    }
+    writeRow(fh, row);
+}
+
+/* write a matrix, with a column for each column key */
+void MappingSummary::writeMatrix(ostream& fh) const {
+    vector<string> valueColumns;
+    for (ColumnCounts::const_iterator it = fColumnTotals.begin(); it != fColumnTotals.end(); it++) {
+        valueColumns.push_back(it->first.label);
+    }
+    valueColumns.push_back("total");
+    writeHeader(fh, valueColumns);
+    for (map<RowKey, ColumnCounts>::const_iterator it = fCounts.begin(); it != fCounts.end(); it++) {
+        vector<string> rowKey;
+        for (size_t i = 0; i < it->first.size(); i++) {
+            rowKey.push_back(it->first[i].label);
+        }
+        writeMatrixRow(fh, rowKey, it->second, fRowTotals.find(it->first)->second);
+    }
+    if (fMatrixFormat != MATRIX_ROW_FREQS) {
+        writeMatrixRow(fh, getTotalsRowKey(), fColumnTotals, 0);
+    }
+}
+
+/* write the table as a TSV */
+void MappingSummary::write(ostream& fh) const {
+    if (fColumnKeyType == KEY_NONE) {
+        writeCountsFreqs(fh);
+    } else {
+        writeMatrix(fh);
+    }
+}
+
+/* constructor, creating the standard tables */
+MappingSummaries::MappingSummaries() {
+    typedef MappingSummary MS;
+    fSummaries.push_back(new MS("gene", "gene", {MS::KEY_MAPPING_STATUS}));
+    fSummaries.push_back(new MS("gene.biotype", "gene", {MS::KEY_BIOTYPE, MS::KEY_MAPPING_STATUS}));
+    fSummaries.push_back(new MS("trans", "trans", {MS::KEY_MAPPING_STATUS}));
+    fSummaries.push_back(new MS("trans.biotype", "trans", {MS::KEY_BIOTYPE, MS::KEY_MAPPING_STATUS}));
+    fSummaries.push_back(new MS("trans.biocat", "trans", {MS::KEY_BIOCAT, MS::KEY_MAPPING_STATUS}));
+    fSummaries.push_back(new MS("trans.biocat.multimap", "trans", {MS::KEY_BIOCAT, MS::KEY_MULTIMAP}));
+    fSummaries.push_back(new MS("trans.targetSubst", "trans", {MS::KEY_TARGET_STATUS, MS::KEY_TARGET_SUBST}));
+    fSummaries.push_back(new MS("trans.genomicSize.matrix", "trans", {MS::KEY_MAPPING_STATUS},
+                                MS::KEY_GENOMIC_SIZE));
+    fSummaries.push_back(new MS("trans.biocat.matrix", "trans", {MS::KEY_BIOCAT},
+                                MS::KEY_MAPPING_STATUS));
+    fSummaries.push_back(new MS("trans.biocat.rowFreq.matrix", "trans", {MS::KEY_BIOCAT},
+                                MS::KEY_MAPPING_STATUS, MS::MATRIX_ROW_FREQS));
+    fSummaries.push_back(new MS("trans.biocat.columnFreq.matrix", "trans", {MS::KEY_BIOCAT},
+                                MS::KEY_MAPPING_STATUS, MS::MATRIX_COLUMN_FREQS));
+}
+
+/* destructor */
+MappingSummaries::~MappingSummaries() {
+    for (size_t i = 0; i < fSummaries.size(); i++) {
+        delete fSummaries[i];
+    }
+}
+
+/* write each table to a file */
+void MappingSummaries::write(const string& outPrefix) const {
+    for (size_t i = 0; i < fSummaries.size(); i++) {
+        string outFile = outPrefix + fSummaries[i]->getName() + ".tsv";
+        ofstream fh(outFile.c_str());
+        if (not fh.is_open()) {
+            throw ios_base::failure("can't open mapping summary \"" + outFile + "\" for write access: " + strerror(errno));
+        }
+        fSummaries[i]->write(fh);
+        fh.close();
+        if (fh.fail()) {
+            throw ios_base::failure("error writing mapping summary \"" + outFile + "\"");
+        }
+    }
+}
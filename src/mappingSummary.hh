@@ -0,0 +1,150 @@
+/*
+ * Summary counts of mapping results, collected during mapping.
+ */
+#ifndef mappingSummary_hh
+#define mappingSummary_hh
+#include <string>
+#include <vector>
+#include <map>
+#include <iostream>
+#include "remapStatus.hh"
+using namespace std;
+class FeatureNode;
+
+/*
+ * Counts of the mapped genes or transcripts by a combination of
+ * categories, optionally as a matrix with another category as the columns.
+ * This is the same table as bin/mapInfoSummary produces from the mapping
+ * info TSV: only map and targetSubst records are counted, and the rows are
+ * written in sorted order followed by a row of totals.
+ */
+class MappingSummary {
+    public:
+    /* category used as a row or column key */
+    typedef enum {
+        KEY_NONE,
+        KEY_BIOTYPE,         // feature biotype
+        KEY_BIOCAT,          // function of biotype: coding, nonCoding, ...
+        KEY_GENOMIC_SIZE,    // order of magnitude of genomic length
+        KEY_MAPPING_STATUS,
+        KEY_TARGET_STATUS,
+        KEY_MULTIMAP,        // mapped to more than one location
+        KEY_TARGET_SUBST     // as defined by mapInfoSummary
+    } KeyType;
+    typedef vector<KeyType> KeyTypeVector;
+
+    /* how to write a matrix */
+    typedef enum {
+        MATRIX_COUNTS,
+        MATRIX_ROW_FREQS,
+        MATRIX_COLUMN_FREQS
+    } MatrixFormat;
+
+    private:
+    /* value of a key, ordered by rank, then label */
+    struct KeyValue {
+        long rank;
+        string label;
+        KeyValue(long rank,
+                 const string& label):
+            rank(rank), label(label) {
+        }
+        bool operator<(const KeyValue& other) const {
+            return (rank < other.rank) or ((rank == other.rank) and (label < other.label));
+        }
+    };
+    typedef vector<KeyValue> RowKey;
+    typedef map<KeyValue, int> ColumnCounts;
+
+    const string fName;
+    const string fFeatType;   // gene or trans
+    const KeyTypeVector fRowKeyTypes;
+    const KeyType fColumnKeyType;  // KEY_NONE if not a matrix
+    const MatrixFormat fMatrixFormat;
+    map<RowKey, ColumnCounts> fCounts;
+    map<RowKey, int> fRowTotals;
+    ColumnCounts fColumnTotals;
+
+    static const string& keyTypeName(KeyType keyType);
+    static KeyValue getKeyValue(KeyType keyType,
+                                const string& recType,
+                                const FeatureNode* feature,
+                                RemapStatus mappingStatus,
+                                int mappingCount,
+                                TargetStatus targetStatus);
+    void writeRow(ostream& fh,
+                  const vector<string>& row) const;
+    void writeHeader(ostream& fh,
+                     const vector<string>& valueColumns) const;
+    vector<string> getTotalsRowKey() const;
+    void writeCountsFreqs(ostream& fh) const;
+    void writeMatrixRow(ostream& fh,
+                        const vector<string>& rowKey,
+                        const ColumnCounts& rowCounts,
+                        int rowTotal) const;
+    void writeMatrix(ostream& fh) const;
+
+    public:
+    /* Constructor.  featType is gene or trans. If columnKeyType is not
+     * KEY_NONE, a matrix is written. */
+    MappingSummary(const string& name,
+                   const string& featType,
+                   const KeyTypeVector& rowKeyTypes,
+                   KeyType columnKeyType = KEY_NONE,
+                   MatrixFormat matrixFormat = MATRIX_COUNTS):
+        fName(name),
+        fFeatType(featType),
+        fRowKeyTypes(rowKeyTypes),
+        fColumnKeyType(columnKeyType),
+        fMatrixFormat(matrixFormat) {
+    }
+
+    /* get the name, used to name the output file */
+    const string& getName() const {
+        return fName;
+    }
+
+    /* count a mapping info record */
+    void count(const string& recType,
+               const string& featType,
+               const FeatureNode* feature,
+               RemapStatus mappingStatus,
+               int mappingCount,
+               TargetStatus targetStatus);
+
+    /* write the table as a TSV */
+    void write(ostream& fh) const;
+};
+
+/*
+ * The standard set of summary tables, all counted from the same mapping
+ * info records.
+ */
+class MappingSummaries {
+    private:
+    vector<MappingSummary*> fSummaries;
+
+    public:
+    /* constructor, creating the standard tables */
+    MappingSummaries();
+
+    /* destructor */
+    ~MappingSummaries();
+
+    /* count a mapping info record in all tables */
+    void count(const string& recType,
+               const string& featType,
+               const FeatureNode* feature,
+               RemapStatus mappingStatus,
+               int mappingCount,
+               TargetStatus targetStatus) {
+        for (size_t i = 0; i < fSummaries.size(); i++) {
+            fSummaries[i]->count(recType, featType, feature, mappingStatus, mappingCount, targetStatus);
+        }
+    }
+
+    /* write each table to a file named outPrefix + name + ".tsv" */
+    void write(const string& outPrefix) const;
+};
+
+#endif
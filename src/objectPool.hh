@@ -0,0 +1,124 @@
+/*
+ * Pool allocator for small, frequently allocated objects.
+ */
+#ifndef objectPool_hh
+#define objectPool_hh
+#include <cstdlib>
+#include <new>
+#include <mutex>
+
+/*
+ * Allocator of fixed size blocks, used to implement class operator new and
+ * delete for the feature tree objects that are allocated and freed in large
+ * numbers.  Memory is obtained in chunks that are never returned, and freed
+ * blocks are kept on a free list for reuse.  Each thread has its own free
+ * list, so no locking is done except when a thread runs out of blocks or
+ * exits, at which time blocks are exchanged with a shared free list.  A
+ * block maybe freed by a different thread than allocated it.  Requests of
+ * other sizes, such as for a derived class, are passed to the global
+ * allocator.
+ */
+template<size_t objSize>
+class ObjectPool {
+    private:
+    static const size_t blockSize = ((objSize + 15) / 16) * 16;
+    static const int chunkBlocks = 256;
+
+    /* free block, linked through its first word */
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    /* shared free list */
+    struct SharedList {
+        FreeBlock* head;
+        std::mutex mutex;
+        SharedList():
+            head(NULL) {
+        }
+    };
+
+    /* per-thread free list, returned to the shared list on thread exit */
+    struct ThreadList {
+        FreeBlock* head;
+        ThreadList():
+            head(NULL) {
+        }
+        ~ThreadList() {
+            SharedList& shared = getSharedList();
+            std::lock_guard<std::mutex> lock(shared.mutex);
+            while (head != NULL) {
+                FreeBlock* block = head;
+                head = block->next;
+                block->next = shared.head;
+                shared.head = block;
+            }
+        }
+    };
+
+    static SharedList& getSharedList() {
+        static SharedList shared;
+        return shared;
+    }
+
+    static ThreadList& getThreadList() {
+        static thread_local ThreadList threadList;
+        return threadList;
+    }
+
+    /* refill an empty thread free list from the shared list, or a new
+     * chunk */
+    static void refill(ThreadList& threadList) {
+        SharedList& shared = getSharedList();
+        {
+            std::lock_guard<std::mutex> lock(shared.mutex);
+            if (shared.head != NULL) {
+                threadList.head = shared.head;
+                shared.head = NULL;
+                return;
+            }
+        }
+        char* chunk = static_cast<char*>(malloc(blockSize * chunkBlocks));
+        if (chunk == NULL) {
+            throw std::bad_alloc();
+        }
+        for (int i = chunkBlocks - 1; i >= 0; i--) {
+            FreeBlock* block = reinterpret_cast<FreeBlock*>(chunk + (i * blockSize));
+            block->next = threadList.head;
+            threadList.head = block;
+        }
+    }
+
+    public:
+    /* allocate an object of size bytes */
+    static void* alloc(size_t size) {
+        if (size != objSize) {
+            return ::operator new(size);
+        }
+        ThreadList& threadList = getThreadList();
+        if (threadList.head == NULL) {
+            refill(threadList);
+        }
+        FreeBlock* block = threadList.head;
+        threadList.head = block->next;
+        return block;
+    }
+
+    /* free an object of size bytes */
+    static void release(void* ptr,
+                        size_t size) {
+        if (ptr == NULL) {
+            return;
+        }
+        if (size != objSize) {
+            ::operator delete(ptr);
+            return;
+        }
+        ThreadList& threadList = getThreadList();
+        FreeBlock* block = static_cast<FreeBlock*>(ptr);
+        block->next = threadList.head;
+        threadList.head = block;
+    }
+};
+
+#endif
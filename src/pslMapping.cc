@@ -7,8 +7,7 @@
 #include <iostream>
 
 // FIXME: passing down features to this level in simple container is annoying.
-// It would be better to have a sort function passed it, but we had all the
-// core dump issues with sort, put algorithm here for now.
+// It would be better to have a sort function passed it.
 
 /* constructor, sort mapped PSLs */
 PslMapping::PslMapping(struct psl* srcPsl,
@@ -26,10 +25,11 @@ PslMapping::PslMapping(struct psl* srcPsl,
 
 /* free up psls */
 PslMapping::~PslMapping() {
-    pslFree(&fSrcPsl);
+    pslCompactFree(&fSrcPsl);
     for (size_t i = 0; i < fMappedPsls.size(); i++) {
         pslFree(&(fMappedPsls[i]));
     }
+    fPrunedPsls.free();
 }
 
 /* calculate the number of aligned bases */
@@ -65,45 +65,6 @@ void PslMapping::dump(ostream& fh,
     }
 }
 
-/* comparison functor based on lowest store. */
-class ScoreCmp {
-    public:
-    struct psl* fSrcPsl;
-    
-    ScoreCmp(struct psl* srcPsl):
-        fSrcPsl(srcPsl) {
-    }
-
-    int operator()(struct psl* mappedPsl1,
-                   struct psl* mappedPsl2) const {
-        return -(PslMapping::calcPslMappingScore(fSrcPsl, mappedPsl1)
-                 - PslMapping::calcPslMappingScore(fSrcPsl, mappedPsl2));
-    }
-};
-
-
-#if 0
-// FIXME: with this seemingly correct sort, the C++ library goes of the end of the vector and SEGVs
-// this happens on g++ 4.8.2 on Linux and 4.9 on OS/X (Mac ports).  It doesn't happen with
-// clang on OS/X.
-/* sort with best (lowest score) first */
-void PslMapping::sortMappedPsls() {
-    //sort(fMappedPsls.begin(), fMappedPsls.end(), ScoreCmp(fSrcPsl));
-    std::sort(fMappedPsls.begin(), fMappedPsls.end(),
-              [this](const struct psl* a, const struct psl* b) -> bool {
-                  return (PslMapping::calcPslMappingScore(this->fSrcPsl, a)
-                          - PslMapping::calcPslMappingScore(this->fSrcPsl, b));
-              });
-    if (fMappedPsls.size() > 0) {
-        fMappedPsl = fMappedPsls[0];
-    }
-}
-#else
-/* globals for use in comparison because qsort doesn't have a client data */
-static struct psl* gSrcPsl = NULL;
-static const FeatureNode* gPrimaryTarget = NULL;
-static const FeatureNode* gSecondaryTarget = NULL;
-
 /* compute fraction of overlap similarity for a psl and a target feature. */
 static float targetSimilarity(const struct psl *mappedPsl,
                               const FeatureNode* targetFeature) {
@@ -118,78 +79,57 @@ static float targetSimilarity(const struct psl *mappedPsl,
     return float(2*(minEnd - maxStart)) / float((mappedPsl->tEnd-mappedPsl->tStart) + targetFeature->length());
 }
 
-/* compare function based on target similarity. */
-static int targetSimilarityCmp(const struct psl *mappedPsl1,
-                               const struct psl *mappedPsl2,
-                               const FeatureNode* targetFeature) {
-    // don't think we need an approximate compare, because it will be 0.0 if no overlap,
-    // and don't know why very close overlap would happen
-    float sim1 = targetSimilarity(mappedPsl1, targetFeature);
-    float sim2 = targetSimilarity(mappedPsl2, targetFeature);
-    if (sim1 < sim2) {
-        return -1;
-    } else if (sim1 > sim2) {
-        return 1;
-    } else {
-        return 0;
-    }
-}
-
-/* compare by span similarity */
-static int spanSimilarityCmp(const struct psl *mappedPsl1,
-                             const struct psl *mappedPsl2) {
-    int srcSpan = (gSrcPsl->tEnd - gSrcPsl->tStart);
-    int span1Diff = abs(srcSpan - (mappedPsl1->tEnd - mappedPsl1->tStart));
-    int span2Diff = abs(srcSpan - (mappedPsl2->tEnd - mappedPsl2->tStart));
-    // rank smallest span change best (reverse sort)
-    if (span1Diff < span2Diff) {
-        return -1;
-    } else if (span1Diff > span2Diff) {
-        return 1;
-    } else {
-        return 0;
+/* Sort key of a mapped PSL, computed once per PSL rather than in each
+ * comparison, which matters in regions with many overlapping chains. */
+struct MappedPslRank {
+    float primarySimilarity;    // higher is better
+    float secondarySimilarity;  // higher is better
+    int spanDiff;               // lower is better
+    int mappingScore;           // lower is better
+    struct psl* mappedPsl;
+
+    MappedPslRank(const struct psl* srcPsl,
+                  struct psl* mappedPsl,
+                  const FeatureNode* primaryTarget,
+                  const FeatureNode* secondaryTarget):
+        primarySimilarity((primaryTarget != NULL) ? targetSimilarity(mappedPsl, primaryTarget) : 0.0),
+        secondarySimilarity((secondaryTarget != NULL) ? targetSimilarity(mappedPsl, secondaryTarget) : 0.0),
+        spanDiff(abs((srcPsl->tEnd - srcPsl->tStart) - (mappedPsl->tEnd - mappedPsl->tStart))),
+        mappingScore(PslMapping::calcPslMappingScore(srcPsl, mappedPsl)),
+        mappedPsl(mappedPsl) {
     }
-}
 
-/* compare two psl to see which is better mapped. */
-static int mapScoreCmp(const void *va, const void *vb) {
-    const struct psl *mappedPsl1 = *static_cast<const struct psl *const*>(va);
-    const struct psl *mappedPsl2 = *static_cast<const struct psl *const*>(vb);
-    if (gPrimaryTarget != NULL) {
-        int diff = targetSimilarityCmp(mappedPsl1, mappedPsl2, gPrimaryTarget);
-        if (diff != 0) {
-            return -diff; // inverse sort
+    /* is this a better mapping than another */
+    bool operator<(const MappedPslRank& other) const {
+        // don't think we need an approximate compare, because it will be 0.0 if no overlap,
+        // and don't know why very close overlap would happen
+        if (primarySimilarity != other.primarySimilarity) {
+            return primarySimilarity > other.primarySimilarity;
+        } else if (secondarySimilarity != other.secondarySimilarity) {
+            return secondarySimilarity > other.secondarySimilarity;
+        } else if (spanDiff != other.spanDiff) {
+            return spanDiff < other.spanDiff;
+        } else {
+            // FIXME: this maybe silly
+            return mappingScore < other.mappingScore;
         }
     }
-    if (gSecondaryTarget != NULL) {
-        int diff = targetSimilarityCmp(mappedPsl1, mappedPsl2, gSecondaryTarget);
-        if (diff != 0) {
-            return -diff; // inverse sort
-        }
-    }
-    int diff = spanSimilarityCmp(mappedPsl1, mappedPsl2);
-    if (diff != 0) {
-        return diff;
-    }
-    // FIXME: this maybe silly
-    return (PslMapping::calcPslMappingScore(gSrcPsl, mappedPsl1)
-            - PslMapping::calcPslMappingScore(gSrcPsl, mappedPsl2));
-}
+};
 
-/* sort with best (lowest score) first */
+/* sort with best (lowest score) first, equal mappings are kept in their
+ * current order */
 void PslMapping::sortMappedPsls(const FeatureNode* primaryTarget,
                                 const FeatureNode* secondaryTarget) {
-    gSrcPsl = fSrcPsl;
-    gPrimaryTarget = primaryTarget;
-    gSecondaryTarget = secondaryTarget;
-    qsort(static_cast<struct psl**>(&(fMappedPsls[0])), fMappedPsls.size(), sizeof(struct psl*), mapScoreCmp);
-    gSrcPsl = NULL;
-    gPrimaryTarget = gSecondaryTarget = NULL;
+    vector<MappedPslRank> ranks;
+    ranks.reserve(fMappedPsls.size());
+    for (size_t i = 0; i < fMappedPsls.size(); i++) {
+        ranks.push_back(MappedPslRank(fSrcPsl, fMappedPsls[i], primaryTarget, secondaryTarget));
+    }
+    stable_sort(ranks.begin(), ranks.end());
+    for (size_t i = 0; i < ranks.size(); i++) {
+        fMappedPsls[i] = ranks[i].mappedPsl;
+    }
     if (fMappedPsls.size() > 0) {
         fMappedPsl = fMappedPsls[0];
     }
 }
-#endif
-
-
-
@@ -13,11 +13,13 @@ class PslMapping {
     struct psl* fSrcPsl;
     struct psl* fMappedPsl; // best mapped PSL, or NULL if none mapped
     PslVector fMappedPsls;  // all mapped PSLs, [0] is fMappedPsl
+    PslVector fPrunedPsls;  // mappings through candidates dropped by the limit, only written
 
     static int numAlignedBases(const struct psl* psl);
 
     public:
-    /* constructor, sort mapped PSLs */
+    /* constructor, sort mapped PSLs.  Takes ownership of the PSLs, srcPsl
+     * must be created by pslCompactNew. */
     PslMapping(struct psl* srcPsl,
                PslVector& mappedPsls,
                const FeatureNode* primaryTarget=NULL,
@@ -43,15 +45,25 @@ class PslMapping {
     void sortMappedPsls(const FeatureNode* primaryTarget=NULL,
                         const FeatureNode* secondaryTarget=NULL);
 
+    /* Save the mappings through the alignments dropped by the mapping
+     * candidate limit, which are only written, not used.  Takes ownership
+     * of the PSLs. */
+    void setPrunedPsls(PslVector& prunedPsls) {
+        fPrunedPsls = prunedPsls;
+    }
+
     /* are there any mappings? */
     bool haveMappings() const {
         return fMappedPsls.size() > 0;
     }
 
-    /** write the mapped PSLs */
+    /** write the mapped PSLs, followed by any pruned ones */
     void writeMapped(ostream& fh) const {
         for (size_t i = 0; i < fMappedPsls.size(); i++) {
-            fh << pslToString(fMappedPsls[i]) << endl;
+            fh << pslToString(fMappedPsls[i]) << "\n";
+        }
+        for (size_t i = 0; i < fPrunedPsls.size(); i++) {
+            fh << pslToString(fPrunedPsls[i]) << "\n";
         }
     }
     
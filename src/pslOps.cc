@@ -1,5 +1,63 @@
 #include "pslOps.hh"
 
+/* free all PSLs in the vector, which were created by pslCompactNew */
+void PslVector::freeCompact() {
+    for (int i = 0; i < size(); i++) {
+        pslCompactFree(&((*this)[i]));
+    }
+    clear();
+}
+
+/* Create a PSL in a single allocation */
+struct psl* pslCompactNew(const char* qName, unsigned qSize, int qStart, int qEnd,
+                          const char* tName, unsigned tSize, int tStart, int tEnd,
+                          const char* strand, unsigned blockSpace) {
+    size_t qNameSize = strlen(qName) + 1;
+    size_t tNameSize = strlen(tName) + 1;
+    size_t blocksSize = blockSpace * sizeof(unsigned);
+    // needMem zeros memory
+    char* mem = static_cast<char*>(needMem(sizeof(struct psl) + (3 * blocksSize) + qNameSize + tNameSize));
+    struct psl* psl = reinterpret_cast<struct psl*>(mem);
+    char* next = mem + sizeof(struct psl);
+    psl->blockSizes = reinterpret_cast<unsigned*>(next);
+    psl->qStarts = reinterpret_cast<unsigned*>(next + blocksSize);
+    psl->tStarts = reinterpret_cast<unsigned*>(next + (2 * blocksSize));
+    next += 3 * blocksSize;
+    psl->qName = next;
+    memcpy(psl->qName, qName, qNameSize);
+    psl->tName = next + qNameSize;
+    memcpy(psl->tName, tName, tNameSize);
+    strncpy(psl->strand, strand, sizeof(psl->strand) - 1);
+    psl->qSize = qSize;
+    psl->qStart = qStart;
+    psl->qEnd = qEnd;
+    psl->tSize = tSize;
+    psl->tStart = tStart;
+    psl->tEnd = tEnd;
+    return psl;
+}
+
+/* Copy a PSL into a compact PSL. */
+struct psl* pslCompactClone(const struct psl* psl) {
+    struct psl* newPsl = pslCompactNew(psl->qName, psl->qSize, psl->qStart, psl->qEnd,
+                                       psl->tName, psl->tSize, psl->tStart, psl->tEnd,
+                                       psl->strand, psl->blockCount);
+    newPsl->match = psl->match;
+    newPsl->misMatch = psl->misMatch;
+    newPsl->repMatch = psl->repMatch;
+    newPsl->nCount = psl->nCount;
+    newPsl->qNumInsert = psl->qNumInsert;
+    newPsl->qBaseInsert = psl->qBaseInsert;
+    newPsl->tNumInsert = psl->tNumInsert;
+    newPsl->tBaseInsert = psl->tBaseInsert;
+    newPsl->blockCount = psl->blockCount;
+    size_t blocksSize = psl->blockCount * sizeof(unsigned);
+    memcpy(newPsl->blockSizes, psl->blockSizes, blocksSize);
+    memcpy(newPsl->qStarts, psl->qStarts, blocksSize);
+    memcpy(newPsl->tStarts, psl->tStarts, blocksSize);
+    return newPsl;
+}
+
 /*
  * convert an autoSql unsiged array to a commastring */
 static string unsignedArrayToString(unsigned len,
@@ -19,8 +19,32 @@ class PslVector: public vector<struct psl*> {
         }
         clear();
     }
+
+    /* free all PSLs in the vector, which were created by pslCompactNew */
+    void freeCompact();
 };
 
+/*
+ * Create a PSL with the structure, block arrays and names in a single
+ * allocation, rather than the six of pslNew.  This is used for the source
+ * PSLs built from features, of which there is one for every feature mapped.
+ * Blocks are added with pslAddBlock, up to blockSpace.  Compact PSLs can be
+ * used anywhere a PSL is read or modified in place, but must be freed with
+ * pslCompactFree().
+ */
+struct psl* pslCompactNew(const char* qName, unsigned qSize, int qStart, int qEnd,
+                          const char* tName, unsigned tSize, int tStart, int tEnd,
+                          const char* strand, unsigned blockSpace);
+
+/* Copy a PSL into a compact PSL. */
+struct psl* pslCompactClone(const struct psl* psl);
+
+/* free a PSL created by pslCompactNew or pslCompactClone */
+static inline void pslCompactFree(struct psl** pslPtr) {
+    freeMem(*pslPtr);
+    *pslPtr = NULL;
+}
+
 /*
  * convert a PSL to a string for debuging purposes.
  */
@@ -49,6 +49,25 @@ const string& remapStatusToStr(RemapStatus remapStatus) {
     return emptyString;
 }
 
+/* all remap status values, used to parse strings */
+static const RemapStatus allRemapStatus[] = {
+    REMAP_STATUS_NONE, REMAP_STATUS_FULL_CONTIG, REMAP_STATUS_FULL_FRAGMENT,
+    REMAP_STATUS_PARTIAL, REMAP_STATUS_DELETED, REMAP_STATUS_NO_SEQ_MAP,
+    REMAP_STATUS_GENE_CONFLICT, REMAP_STATUS_GENE_SIZE_CHANGE,
+    REMAP_STATUS_AUTO_SMALL_NCRNA, REMAP_STATUS_AUTOMATIC_GENE,
+    REMAP_STATUS_PSEUDOGENE, REMAP_STATUS_INELIGIBLE, REMAP_STATUS_ERROR
+};
+
+/* Convert a string to a remap status, error if not valid */
+RemapStatus remapStatusFromStr(const string& remapStatusStr) {
+    for (size_t i = 0; i < sizeof(allRemapStatus) / sizeof(allRemapStatus[0]); i++) {
+        if (remapStatusToStr(allRemapStatus[i]) == remapStatusStr) {
+            return allRemapStatus[i];
+        }
+    }
+    throw invalid_argument("invalid remap status: \"" + remapStatusStr + "\"");
+}
+
 /* target status strings */
 static const string TARGET_STATUS_NA_STR = "na";
 static const string TARGET_STATUS_NEW_STR = "new";
@@ -76,3 +95,13 @@ const string& targetStatusToStr(TargetStatus targetStatus) {
     }
     return emptyString;
 }
+
+/* convert a string to a target status, error if not valid */
+TargetStatus targetStatusFromStr(const string& targetStatusStr) {
+    for (int targetStatus = TARGET_STATUS_NA; targetStatus <= TARGET_STATUS_ERROR; targetStatus++) {
+        if (targetStatusToStr(TargetStatus(targetStatus)) == targetStatusStr) {
+            return TargetStatus(targetStatus);
+        }
+    }
+    throw invalid_argument("invalid target status: \"" + targetStatusStr + "\"");
+}
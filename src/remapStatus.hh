@@ -27,6 +27,9 @@ typedef enum {
 /* Convert a remap status to a string  */
 const string& remapStatusToStr(RemapStatus remapStatus);
 
+/* Convert a string to a remap status, error if not valid */
+RemapStatus remapStatusFromStr(const string& remapStatusStr);
+
 
 /* target status */
 typedef enum {
@@ -41,5 +44,8 @@ typedef enum {
 /* convert a target status to a string  */
 const string& targetStatusToStr(TargetStatus targetStatus);
 
+/* convert a string to a target status, error if not valid */
+TargetStatus targetStatusFromStr(const string& targetStatusStr);
+
 #endif
 
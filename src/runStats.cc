@@ -0,0 +1,115 @@
+/*
+ * Collection of run time statistics.
+ */
+#include "runStats.hh"
+#include "FIOStream.hh"
+#include <sys/resource.h>
+#include <algorithm>
+#include <functional>
+
+/* statistics collection, NULL if not enabled */
+RunStats* gRunStats = NULL;
+
+/* constructor */
+RunStats::RunStats() {
+    for (int i = 0; i < numLatencyBuckets; i++) {
+        fLatencyBuckets[i] = 0;
+    }
+}
+
+/* get the peak resident set size of the process */
+long RunStats::getPeakRssKb() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) < 0) {
+        return 0;
+    }
+    return usage.ru_maxrss;  // kilobytes on Linux
+}
+
+/* add time for one occurrence of a phase */
+void RunStats::addPhase(const string& name,
+                        double wallSecs,
+                        double cpuSecs) {
+    long peakRssKb = getPeakRssKb();
+    lock_guard<mutex> lock(fMutex);
+    map<string, int>::const_iterator it = fPhaseIdxs.find(name);
+    if (it == fPhaseIdxs.end()) {
+        it = fPhaseIdxs.insert(make_pair(name, int(fPhases.size()))).first;
+        fPhases.push_back(Phase(name));
+    }
+    Phase& phase = fPhases[it->second];
+    phase.count++;
+    phase.wallSecs += wallSecs;
+    phase.cpuSecs += cpuSecs;
+    phase.peakRssKb = peakRssKb;
+}
+
+/* increment a counter */
+void RunStats::addCount(const string& name,
+                        long count) {
+    lock_guard<mutex> lock(fMutex);
+    map<string, int>::const_iterator it = fCounterIdxs.find(name);
+    if (it == fCounterIdxs.end()) {
+        it = fCounterIdxs.insert(make_pair(name, int(fCounters.size()))).first;
+        fCounters.push_back(make_pair(name, 0L));
+    }
+    fCounters[it->second].second += count;
+}
+
+/* record the time to project one gene */
+void RunStats::addGeneLatency(const string& geneDesc,
+                              double wallSecs) {
+    long usecs = long(wallSecs * 1.0e6);
+    int iBucket = 0;
+    while ((iBucket < numLatencyBuckets - 1) and ((1L << (iBucket + 1)) <= usecs)) {
+        iBucket++;
+    }
+    lock_guard<mutex> lock(fMutex);
+    fLatencyBuckets[iBucket]++;
+    if (fSlowestGenes.size() < numSlowestGenes) {
+        fSlowestGenes.push_back(GeneLatency(wallSecs, geneDesc));
+        push_heap(fSlowestGenes.begin(), fSlowestGenes.end(), greater<GeneLatency>());
+    } else if (wallSecs > fSlowestGenes.front().first) {
+        pop_heap(fSlowestGenes.begin(), fSlowestGenes.end(), greater<GeneLatency>());
+        fSlowestGenes.back() = GeneLatency(wallSecs, geneDesc);
+        push_heap(fSlowestGenes.begin(), fSlowestGenes.end(), greater<GeneLatency>());
+    }
+}
+
+/* write the report */
+void RunStats::write(const string& statsFile) const {
+    lock_guard<mutex> lock(fMutex);
+    FIOStream fh(statsFile, ios::out);
+    fh << "# phases" << endl
+       << "phase\tcount\twallSecs\tcpuSecs\tpeakRssMb" << endl;
+    fh.setf(ios::fixed);
+    fh.precision(3);
+    for (size_t i = 0; i < fPhases.size(); i++) {
+        const Phase& phase = fPhases[i];
+        fh << phase.name << "\t" << phase.count << "\t" << phase.wallSecs << "\t"
+           << phase.cpuSecs << "\t" << (phase.peakRssKb / 1024.0) << endl;
+    }
+    fh << endl << "# counters" << endl
+       << "counter\tcount" << endl;
+    for (size_t i = 0; i < fCounters.size(); i++) {
+        fh << fCounters[i].first << "\t" << fCounters[i].second << endl;
+    }
+    fh << endl << "# gene projection latency" << endl
+       << "minUsecs\tgenes" << endl;
+    for (int i = 0; i < numLatencyBuckets; i++) {
+        if (fLatencyBuckets[i] > 0) {
+            fh << ((i == 0) ? 0 : (1L << i)) << "\t" << fLatencyBuckets[i] << endl;
+        }
+    }
+    vector<GeneLatency> slowestGenes(fSlowestGenes);
+    sort(slowestGenes.begin(), slowestGenes.end(), greater<GeneLatency>());
+    fh << endl << "# slowest genes" << endl
+       << "secs\tgene" << endl;
+    for (size_t i = 0; i < slowestGenes.size(); i++) {
+        fh << slowestGenes[i].first << "\t" << slowestGenes[i].second << endl;
+    }
+    fh.close();
+    if (fh.fail()) {
+        throw ios_base::failure("error writing stats file: " + statsFile);
+    }
+}
@@ -0,0 +1,124 @@
+/*
+ * Collection of run time statistics.
+ */
+#ifndef runStats_hh
+#define runStats_hh
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <time.h>
+using namespace std;
+
+/*
+ * Counters, accumulated wall and CPU time of each phase of the program, and
+ * gene projection latencies, written as a report with --stats.  Collection
+ * is done through the global gRunStats, which is NULL if statistics are not
+ * enabled, so the only overhead in that case is a NULL check.  Methods are
+ * thread-safe.
+ */
+class RunStats {
+    private:
+    static const int numLatencyBuckets = 32;  // powers of two of microseconds
+    static const int numSlowestGenes = 20;
+
+    /* accumulated time for a phase */
+    struct Phase {
+        string name;
+        long count;
+        double wallSecs;
+        double cpuSecs;
+        long peakRssKb;  // process peak RSS when the phase last completed
+        Phase(const string& name):
+            name(name), count(0), wallSecs(0.0), cpuSecs(0.0), peakRssKb(0) {
+        }
+    };
+    typedef pair<double, string> GeneLatency;
+
+    vector<Phase> fPhases;   // in order of first use
+    map<string, int> fPhaseIdxs;
+    vector<pair<string, long> > fCounters;  // in order of first use
+    map<string, int> fCounterIdxs;
+    long fLatencyBuckets[numLatencyBuckets];
+    vector<GeneLatency> fSlowestGenes;  // min-heap
+    mutable mutex fMutex;
+
+    static long getPeakRssKb();
+
+    public:
+    /* constructor */
+    RunStats();
+
+    /* add time for one occurrence of a phase */
+    void addPhase(const string& name,
+                  double wallSecs,
+                  double cpuSecs);
+
+    /* increment a counter */
+    void addCount(const string& name,
+                  long count = 1);
+
+    /* record the time to project one gene */
+    void addGeneLatency(const string& geneDesc,
+                        double wallSecs);
+
+    /* write the report */
+    void write(const string& statsFile) const;
+};
+
+/* statistics collection, NULL if not enabled */
+extern RunStats* gRunStats;
+
+/*
+ * Time a phase from construction until stop() or destruction, adding it to
+ * gRunStats if enabled.  If inWorker is true, only the CPU time of the
+ * calling thread is counted, otherwise that of the process.
+ */
+class PhaseTimer {
+    private:
+    string fName;
+    clockid_t fCpuClock;
+    bool fRunning;
+    struct timespec fWallStart;
+    struct timespec fCpuStart;
+
+    static double elapsed(const struct timespec& start,
+                          const struct timespec& end) {
+        return (end.tv_sec - start.tv_sec) + ((end.tv_nsec - start.tv_nsec) * 1.0e-9);
+    }
+
+    public:
+    /* constructor, starts timing */
+    PhaseTimer(const string& name,
+               bool inWorker = false):
+        fCpuClock(inWorker ? CLOCK_THREAD_CPUTIME_ID : CLOCK_PROCESS_CPUTIME_ID),
+        fRunning(gRunStats != NULL) {
+        if (fRunning) {
+            fName = name;
+            clock_gettime(CLOCK_MONOTONIC, &fWallStart);
+            clock_gettime(fCpuClock, &fCpuStart);
+        }
+    }
+
+    /* destructor, stops timing if still running */
+    ~PhaseTimer() {
+        stop();
+    }
+
+    /* stop timing and record the phase, returning the wall time in
+     * seconds, or zero if not enabled */
+    double stop() {
+        if (not fRunning) {
+            return 0.0;
+        }
+        fRunning = false;
+        struct timespec wallEnd, cpuEnd;
+        clock_gettime(CLOCK_MONOTONIC, &wallEnd);
+        clock_gettime(fCpuClock, &cpuEnd);
+        double wallSecs = elapsed(fWallStart, wallEnd);
+        gRunStats->addPhase(fName, wallSecs, elapsed(fCpuStart, cpuEnd));
+        return wallSecs;
+    }
+};
+
+#endif
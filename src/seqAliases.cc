@@ -0,0 +1,47 @@
+/*
+ * Renaming of mapping alignment sequences.
+ */
+#include "seqAliases.hh"
+#include "typeOps.hh"
+#include "FIOStream.hh"
+#include <stdexcept>
+
+/* parse a lift line of: offset oldName oldSize newName newSize */
+void SeqAliases::parseLiftLine(const string& line) {
+    StringVector cols = stringSplit(line, '\t');
+    bool isOk = (cols.size() == 5);
+    int offset = isOk ? stringToInt(cols[0], &isOk) : 0;
+    int oldSize = isOk ? stringToInt(cols[2], &isOk) : 0;
+    int newSize = isOk ? stringToInt(cols[4], &isOk) : 0;
+    if (not isOk) {
+        throw invalid_argument("invalid lift record in " + fLiftFile + ": " + line);
+    }
+    if ((offset != 0) or (oldSize != newSize)) {
+        throw invalid_argument("sequence aliases must only rename sequences, with a zero offset and the same size: "
+                               + fLiftFile + ": " + line);
+    }
+    if (not fAliases.insert(make_pair(cols[1], Alias(cols[3], newSize))).second) {
+        throw invalid_argument("duplicate sequence in " + fLiftFile + ": " + cols[1]);
+    }
+}
+
+/* constructor, loads the lift file */
+SeqAliases::SeqAliases(const string& liftFile):
+    fLiftFile(liftFile) {
+    FIOStream liftFh(liftFile);
+    string line;
+    while (getline(liftFh, line)) {
+        if (not (stringEmpty(line) or (line[0] == '#'))) {
+            parseLiftLine(line);
+        }
+    }
+}
+
+/* get the alias of a sequence, error if it is not in the table */
+const SeqAliases::Alias& SeqAliases::get(const string& seqName) const {
+    map<string, Alias>::const_iterator it = fAliases.find(seqName);
+    if (it == fAliases.end()) {
+        throw invalid_argument("mapping alignment sequence not found in sequence aliases " + fLiftFile + ": " + seqName);
+    }
+    return it->second;
+}
@@ -0,0 +1,45 @@
+/*
+ * Renaming of mapping alignment sequences.
+ */
+#ifndef seqAliases_hh
+#define seqAliases_hh
+#include <string>
+#include <map>
+using namespace std;
+
+/*
+ * Table of new names for the sequences of one genome, loaded from a UCSC
+ * lift file, such as created by ncbiAssemblyReportConvert lift.  Only
+ * renaming is supported, so all offsets must be zero and the old and new
+ * sizes the same.
+ */
+class SeqAliases {
+    public:
+    /* new name and size of a sequence */
+    class Alias {
+        public:
+        string fName;
+        int fSize;
+
+        Alias(const string& name,
+              int size):
+            fName(name),
+            fSize(size) {
+        }
+    };
+
+    private:
+    const string fLiftFile;
+    map<string, Alias> fAliases;
+
+    void parseLiftLine(const string& line);
+
+    public:
+    /* constructor, loads the lift file */
+    SeqAliases(const string& liftFile);
+
+    /* get the alias of a sequence, error if it is not in the table */
+    const Alias& get(const string& seqName) const;
+};
+
+#endif
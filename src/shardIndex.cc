@@ -0,0 +1,150 @@
+/*
+ * Index of the outputs of mapping one shard of the source genes.
+ */
+#include "shardIndex.hh"
+#include "FIOStream.hh"
+#include "transMap.hh"
+#include <algorithm>
+#include <stdexcept>
+
+/* format is a header line of:
+ *   #gencodeBackmapShard v1 shardNum numShards
+ * followed by rows of:
+ *   mappedGxf file
+ *   mappingInfoTsv file
+ *   transcriptPsls file
+ *   gene srcGeneIdx geneNumIncr numInfoRows numMappedGenes numPslRows
+ *   mapped idOrName isParY
+ *   referenced idOrName isParY
+ */
+static const string shardIndexHeader = "#gencodeBackmapShard\tv1";
+
+/* parse an integer column */
+static int parseIntCol(const string& col,
+                       const string& desc) {
+    bool isOk = true;
+    int val = stringToInt(col, &isOk);
+    if (not isOk) {
+        throw invalid_argument("invalid " + desc + ": " + col);
+    }
+    return val;
+}
+
+/* parse a shard specification of the form i/n */
+void ShardIndex::parseShardSpec(const string& spec,
+                                int& shardNum,
+                                int& numShards) {
+    StringVector parts = stringSplit(spec, '/');
+    bool isOk1 = true, isOk2 = true;
+    if (parts.size() == 2) {
+        shardNum = stringToInt(parts[0], &isOk1);
+        numShards = stringToInt(parts[1], &isOk2);
+    }
+    if ((parts.size() != 2) or (not isOk1) or (not isOk2)
+        or (numShards < 1) or (shardNum < 1) or (shardNum > numShards)) {
+        throw invalid_argument("shard must be of the form i/n, with 1 <= i <= n: " + spec);
+    }
+}
+
+/* Assign sequences to shards, largest first to the least loaded shard */
+map<string, int> ShardIndex::assignSeqShards(const GenomeSizeMap& seqSizes,
+                                             int numShards) {
+    vector<pair<int, string> > seqs;
+    for (GenomeSizeMap::const_iterator it = seqSizes.begin(); it != seqSizes.end(); it++) {
+        seqs.push_back(make_pair(-it->second, it->first));  // largest first, then by name
+    }
+    sort(seqs.begin(), seqs.end());
+    vector<long> shardSizes(numShards, 0);
+    map<string, int> seqShards;
+    for (size_t i = 0; i < seqs.size(); i++) {
+        int iShard = min_element(shardSizes.begin(), shardSizes.end()) - shardSizes.begin();
+        shardSizes[iShard] -= seqs[i].first;
+        seqShards[seqs[i].second] = iShard + 1;
+    }
+    return seqShards;
+}
+
+/* write a set of ids */
+void ShardIndex::writeIdKeys(ostream& fh,
+                             const string& recType,
+                             const IdKeySet& idKeys) {
+    for (IdKeySet::const_iterator it = idKeys.begin(); it != idKeys.end(); it++) {
+        fh << recType << "\t" << it->first << "\t" << it->second << "\n";
+    }
+}
+
+/* write to a file */
+void ShardIndex::write(const string& indexFile) const {
+    FIOStream fh(indexFile, ios::out);
+    fh << shardIndexHeader << "\t" << fShardNum << "\t" << fNumShards << "\n"
+       << "mappedGxf\t" << fMappedGxf << "\n"
+       << "mappingInfoTsv\t" << fMappingInfoTsv << "\n";
+    if (fTranscriptPsls.size() > 0) {
+        fh << "transcriptPsls\t" << fTranscriptPsls << "\n";
+    }
+    for (size_t i = 0; i < fGeneRecords.size(); i++) {
+        const GeneRecord& rec = fGeneRecords[i];
+        fh << "gene\t" << rec.srcGeneIdx << "\t" << rec.geneNumIncr << "\t" << rec.numInfoRows
+           << "\t" << rec.numMappedGenes << "\t" << rec.numPslRows << "\n";
+    }
+    writeIdKeys(fh, "mapped", fMappedIds);
+    writeIdKeys(fh, "referenced", fReferencedIds);
+    fh.close();
+    if (fh.fail()) {
+        throw ios_base::failure("error writing shard index: " + indexFile);
+    }
+}
+
+/* parse an id row */
+void ShardIndex::readIdKey(const StringVector& row,
+                           IdKeySet& idKeys) {
+    if (row.size() != 3) {
+        throw invalid_argument("expected 3 columns");
+    }
+    idKeys.insert(IdKey(row[1], (parseIntCol(row[2], "isParY") != 0)));
+}
+
+/* load from a file */
+ShardIndex* ShardIndex::load(const string& indexFile) {
+    FIOStream fh(indexFile);
+    string line;
+    if ((not fh.readLine(line)) or (not stringStartsWith(line, shardIndexHeader + "\t"))) {
+        throw invalid_argument("not a shard index file: " + indexFile);
+    }
+    ShardIndex* shardIndex = NULL;
+    try {
+        StringVector header = stringSplit(line, '\t');
+        if (header.size() != 4) {
+            throw invalid_argument("invalid header");
+        }
+        shardIndex = new ShardIndex(parseIntCol(header[2], "shardNum"), parseIntCol(header[3], "numShards"), "", "", "");
+        while (fh.readLine(line)) {
+            StringVector row = stringSplit(line, '\t');
+            if ((row[0] == "gene") and (row.size() == 6)) {
+                GeneRecord rec;
+                rec.srcGeneIdx = parseIntCol(row[1], "srcGeneIdx");
+                rec.geneNumIncr = (parseIntCol(row[2], "geneNumIncr") != 0);
+                rec.numInfoRows = parseIntCol(row[3], "numInfoRows");
+                rec.numMappedGenes = parseIntCol(row[4], "numMappedGenes");
+                rec.numPslRows = parseIntCol(row[5], "numPslRows");
+                shardIndex->fGeneRecords.push_back(rec);
+            } else if (row[0] == "mapped") {
+                readIdKey(row, shardIndex->fMappedIds);
+            } else if (row[0] == "referenced") {
+                readIdKey(row, shardIndex->fReferencedIds);
+            } else if ((row[0] == "mappedGxf") and (row.size() == 2)) {
+                shardIndex->fMappedGxf = row[1];
+            } else if ((row[0] == "mappingInfoTsv") and (row.size() == 2)) {
+                shardIndex->fMappingInfoTsv = row[1];
+            } else if ((row[0] == "transcriptPsls") and (row.size() == 2)) {
+                shardIndex->fTranscriptPsls = row[1];
+            } else {
+                throw invalid_argument("invalid row: " + line);
+            }
+        }
+    } catch (const exception& ex) {
+        delete shardIndex;
+        throw invalid_argument("error parsing shard index \"" + indexFile + "\": " + ex.what());
+    }
+    return shardIndex;
+}
@@ -0,0 +1,92 @@
+/*
+ * Index of the outputs of mapping one shard of the source genes.
+ */
+#ifndef shardIndex_hh
+#define shardIndex_hh
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <ostream>
+#include "typeOps.hh"
+using namespace std;
+class GenomeSizeMap;
+
+/*
+ * With --shard=i/n, only the source genes on the chromosomes assigned to
+ * shard i are mapped, and this index is written to allow the outputs of all
+ * the shards to be merged into the same results as a single run.  For each
+ * source gene that produced output, in input order, it records the gene's
+ * index in the input, whether the gene number of the mapping info was
+ * incremented, and the number of mapping info rows, mapped genes and
+ * transcript PSLs written.  It also has the base ids and names recorded as
+ * mapped by the shard, used by the merge to decide which target genes to
+ * copy, and every id and name referenced by the shard.  If an id or name is
+ * referenced by more than one shard, mapping decisions in one shard could
+ * have depended on genes in another, and the merge fails.
+ */
+class ShardIndex {
+    public:
+    /* output of one source gene */
+    struct GeneRecord {
+        int srcGeneIdx;    // index of the gene in the source GxF
+        bool geneNumIncr;  // was the mapping info gene number incremented?
+        int numInfoRows;
+        int numMappedGenes;
+        int numPslRows;
+    };
+    typedef vector<GeneRecord> GeneRecordVector;
+
+    /* (id or name, isParY) as used by GeneMapper */
+    typedef pair<string, bool> IdKey;
+    typedef set<IdKey> IdKeySet;
+
+    int fShardNum;      // one-based
+    int fNumShards;
+    string fMappedGxf;  // outputs of the shard
+    string fMappingInfoTsv;
+    string fTranscriptPsls;  // empty if not written
+    GeneRecordVector fGeneRecords;  // in input order
+    IdKeySet fMappedIds;
+    IdKeySet fReferencedIds;
+
+    private:
+    static void readIdKey(const StringVector& row,
+                          IdKeySet& idKeys);
+    static void writeIdKeys(ostream& fh,
+                            const string& recType,
+                            const IdKeySet& idKeys);
+
+    public:
+    /* constructor */
+    ShardIndex(int shardNum,
+               int numShards,
+               const string& mappedGxf,
+               const string& mappingInfoTsv,
+               const string& transcriptPsls):
+        fShardNum(shardNum),
+        fNumShards(numShards),
+        fMappedGxf(mappedGxf),
+        fMappingInfoTsv(mappingInfoTsv),
+        fTranscriptPsls(transcriptPsls) {
+    }
+
+    /* parse a shard specification of the form i/n */
+    static void parseShardSpec(const string& spec,
+                               int& shardNum,
+                               int& numShards);
+
+    /* Assign sequences to shards.  Sequences are taken from largest to
+     * smallest and each assigned to the shard with the least total size
+     * so far.  Genes on sequences not assigned are in shard 1. */
+    static map<string, int> assignSeqShards(const GenomeSizeMap& seqSizes,
+                                            int numShards);
+
+    /* write to a file */
+    void write(const string& indexFile) const;
+
+    /* load from a file */
+    static ShardIndex* load(const string& indexFile);
+};
+
+#endif
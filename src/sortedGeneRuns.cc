@@ -0,0 +1,203 @@
+/*
+ * External sort of genes being written to a GxF.
+ */
+#include "sortedGeneRuns.hh"
+#include "featureTree.hh"
+#include "annotationSet.hh"
+#include "globals.hh"
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fstream>
+#include <queue>
+#include <algorithm>
+#include <stdexcept>
+
+/* Reads a run file, which has for each gene a line of:
+ *   seqid start end addOrder textBytes
+ * followed by the formatted text. */
+class SortedGeneRuns::RunReader {
+    private:
+    const string fRunFile;
+    ifstream fIn;
+
+    public:
+    GeneText fCurrent;  // current gene, valid if next() returned true
+
+    RunReader(const string& runFile):
+        fRunFile(runFile),
+        fIn(runFile.c_str(), ios::in | ios::binary) {
+        if (not fIn.is_open()) {
+            throw ios_base::failure("can't open sort run \"" + runFile + "\": " + strerror(errno));
+        }
+    }
+
+    /* read the next gene, returning false at EOF */
+    bool next() {
+        string line;
+        if (not getline(fIn, line)) {
+            if (fIn.bad()) {
+                throw ios_base::failure("error reading sort run \"" + fRunFile + "\"");
+            }
+            return false;
+        }
+        StringVector cols = stringSplit(line, '\t');
+        if (cols.size() != 5) {
+            throw invalid_argument("corrupt sort run \"" + fRunFile + "\": " + line);
+        }
+        fCurrent.seqid = cols[0];
+        fCurrent.start = stringToInt(cols[1]);
+        fCurrent.end = stringToInt(cols[2]);
+        fCurrent.addOrder = stol(cols[3]);
+        fCurrent.text.resize(stol(cols[4]));
+        fIn.read(&(fCurrent.text[0]), fCurrent.text.size());
+        if (size_t(fIn.gcount()) != fCurrent.text.size()) {
+            throw ios_base::failure("sort run \"" + fRunFile + "\" is truncated");
+        }
+        return true;
+    }
+};
+
+/* constructor */
+SortedGeneRuns::SortedGeneRuns(GxfWriter& gxfFh,
+                               const string& tmpPrefix,
+                               size_t memoryLimit):
+    fGxfFh(gxfFh),
+    fTmpPrefix(tmpPrefix),
+    fMemoryLimit(memoryLimit),
+    fRunBytes(0),
+    fNumRuns(0),
+    fNumGenes(0) {
+}
+
+/* destructor */
+SortedGeneRuns::~SortedGeneRuns() {
+    removeRunFiles();
+}
+
+/* compare in the same order as FeatureNodeVector::sortChrom(), keeping
+ * the order added for the same location */
+bool SortedGeneRuns::geneTextLessThan(const GeneText& a,
+                                      const GeneText& b) {
+    if (a.seqid != b.seqid) {
+        return chromLessThan(a.seqid, b.seqid);
+    } else if (a.start != b.start) {
+        return a.start < b.start;
+    } else if (a.end != b.end) {
+        return a.end < b.end;
+    } else {
+        return a.addOrder < b.addOrder;
+    }
+}
+
+/* recursively format a feature tree, in the order AnnotationSet writes it */
+void SortedGeneRuns::formatFeature(const FeatureNode* feature,
+                                   string& buf) {
+    fGxfFh.format(feature->getGxfFeature(), buf);
+    for (size_t i = 0; i < feature->getNumChildren(); i++) {
+        formatFeature(feature->getChild(i), buf);
+    }
+}
+
+/* add a gene */
+void SortedGeneRuns::add(const FeatureNode* gene) {
+    fRun.push_back(GeneText());
+    GeneText& geneText = fRun.back();
+    geneText.seqid = gene->getSeqid();
+    geneText.start = gene->getStart();
+    geneText.end = gene->getEnd();
+    geneText.addOrder = fNumGenes++;
+    formatFeature(gene, geneText.text);
+    fRunBytes += sizeof(GeneText) + geneText.seqid.size() + geneText.text.size();
+    if (fRunBytes > fMemoryLimit) {
+        writeRun();
+    }
+}
+
+/* sort the genes in memory and write them to a new run file */
+void SortedGeneRuns::writeRun() {
+    sort(fRun.begin(), fRun.end(), geneTextLessThan);
+    string runFile = fTmpPrefix + "." + toString(fNumRuns++) + ".run";
+    fRunFiles.push_back(runFile);
+    ofstream fh(runFile.c_str(), ios::out | ios::binary);
+    if (not fh.is_open()) {
+        throw ios_base::failure("can't open sort run \"" + runFile + "\" for write access: " + strerror(errno));
+    }
+    for (size_t i = 0; i < fRun.size(); i++) {
+        const GeneText& geneText = fRun[i];
+        fh << geneText.seqid << '\t' << geneText.start << '\t' << geneText.end << '\t'
+           << geneText.addOrder << '\t' << geneText.text.size() << '\n'
+           << geneText.text;
+    }
+    fh.close();
+    if (fh.fail()) {
+        throw ios_base::failure("error writing sort run \"" + runFile + "\"");
+    }
+    if (gVerbose) {
+        cerr << "wrote sort run " << runFile << ": " << fRun.size() << " genes" << endl;
+    }
+    fRun.clear();
+    fRunBytes = 0;
+}
+
+/* remove the temporary files */
+void SortedGeneRuns::removeRunFiles() {
+    for (size_t i = 0; i < fRunFiles.size(); i++) {
+        unlink(fRunFiles[i].c_str());
+    }
+    fRunFiles.clear();
+}
+
+/* order run readers so the priority queue returns the least gene */
+struct SortedGeneRuns::RunReaderGreater {
+    bool operator()(const RunReader* a,
+                    const RunReader* b) const {
+        return geneTextLessThan(b->fCurrent, a->fCurrent);
+    }
+};
+
+/* write all genes in sorted order */
+void SortedGeneRuns::write(AnnotationSet& seqRegionSet) {
+    if (fRunFiles.empty()) {
+        // everything fit in memory
+        sort(fRun.begin(), fRun.end(), geneTextLessThan);
+        for (size_t i = 0; i < fRun.size(); i++) {
+            seqRegionSet.writeSeqRegionIfNeeded(fRun[i].seqid, fGxfFh);
+            fGxfFh.writeFormatted(fRun[i].text);
+        }
+        fRun.clear();
+        fRunBytes = 0;
+        return;
+    }
+    if (not fRun.empty()) {
+        writeRun();
+    }
+    vector<RunReader*> readers;
+    try {
+        priority_queue<RunReader*, vector<RunReader*>, RunReaderGreater> pending;
+        for (size_t i = 0; i < fRunFiles.size(); i++) {
+            readers.push_back(new RunReader(fRunFiles[i]));
+            if (readers.back()->next()) {
+                pending.push(readers.back());
+            }
+        }
+        while (not pending.empty()) {
+            RunReader* reader = pending.top();
+            pending.pop();
+            seqRegionSet.writeSeqRegionIfNeeded(reader->fCurrent.seqid, fGxfFh);
+            fGxfFh.writeFormatted(reader->fCurrent.text);
+            if (reader->next()) {
+                pending.push(reader);
+            }
+        }
+    } catch (...) {
+        for (size_t i = 0; i < readers.size(); i++) {
+            delete readers[i];
+        }
+        throw;
+    }
+    for (size_t i = 0; i < readers.size(); i++) {
+        delete readers[i];
+    }
+    removeRunFiles();
+}
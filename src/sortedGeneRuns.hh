@@ -0,0 +1,80 @@
+/*
+ * External sort of genes being written to a GxF.
+ */
+#ifndef sortedGeneRuns_hh
+#define sortedGeneRuns_hh
+#include <string>
+#include <vector>
+#include <iostream>
+#include "typeOps.hh"
+using namespace std;
+class FeatureNode;
+class GxfWriter;
+class AnnotationSet;
+
+/*
+ * Sorts genes for output in the same chromosome order as
+ * AnnotationSet::sortGenes() without keeping the trees in memory.  Each
+ * gene is formatted when it is added and the tree can be freed.  When the
+ * formatted genes exceed the memory limit, they are sorted and written to
+ * a temporary run file.  The runs are merged when the output is written.
+ * Genes with the same location are kept in the order they were added.
+ */
+class SortedGeneRuns {
+    private:
+    /* formatted gene with its sort key */
+    struct GeneText {
+        string seqid;
+        int start;
+        int end;
+        long addOrder;
+        string text;
+    };
+    class RunReader;
+    struct RunReaderGreater;
+
+    GxfWriter& fGxfFh;
+    const string fTmpPrefix;
+    const size_t fMemoryLimit;
+    vector<GeneText> fRun;    // genes not yet written to a run
+    size_t fRunBytes;         // approximate memory used by fRun
+    StringVector fRunFiles;   // files not yet removed
+    int fNumRuns;
+    long fNumGenes;
+
+    static bool geneTextLessThan(const GeneText& a,
+                                 const GeneText& b);
+    void formatFeature(const FeatureNode* feature,
+                       string& buf);
+    void writeRun();
+    void removeRunFiles();
+
+    public:
+    /* Constructor.  Genes are formatted and later written by gxfFh,
+     * which is not owned.  Run files are named tmpPrefix.n.run. */
+    SortedGeneRuns(GxfWriter& gxfFh,
+                   const string& tmpPrefix,
+                   size_t memoryLimit);
+
+    /* destructor, removes run files */
+    ~SortedGeneRuns();
+
+    /* add a gene, which is not owned and may be freed afterwards */
+    void add(const FeatureNode* gene);
+
+    /* get the number of genes added */
+    long getNumGenes() const {
+        return fNumGenes;
+    }
+
+    /* get the number of runs written to temporary files */
+    int getNumRuns() const {
+        return fNumRuns;
+    }
+
+    /* Write all genes to the GxF in sorted order, preceded by the GFF3
+     * ##sequence-region lines from seqRegionSet. */
+    void write(AnnotationSet& seqRegionSet);
+};
+
+#endif
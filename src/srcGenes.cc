@@ -0,0 +1,79 @@
+/*
+ * Source of genes to map.
+ */
+#include "srcGenes.hh"
+#include "annotationSet.hh"
+#include "gxf.hh"
+
+/* get the next gene, or NULL when there are no more. */
+FeatureNode* LoadedSrcGenes::nextGene() {
+    const FeatureNodeVector& genes = fAnnotations->getGenes();
+    if (fNextIdx < genes.size()) {
+        return genes[fNextIdx++];
+    } else {
+        return NULL;
+    }
+}
+
+/* Is there a single gene or transcript with the base id? */
+bool LoadedSrcGenes::haveFeatureId(const string& id,
+                                   bool isParY) const {
+    return fAnnotations->getFeatureById(id, isParY) != NULL;
+}
+
+/* count an id key */
+void StreamingSrcGenes::addIdKey(const string& key) {
+    fIdCounts[key]++;
+}
+
+/* first pass over file to collect gene and transcript ids, using the same
+ * keys as AnnotationSet */
+void StreamingSrcGenes::loadIds(const string& gxfFile) {
+    GxfParser* gxfParser = GxfParser::factory(gxfFile);
+    GxfRecord* gxfRecord;
+    while ((gxfRecord = gxfParser->next()) != NULL) {
+        GxfFeature* feature = dynamic_cast<GxfFeature*>(gxfRecord);
+        if ((feature != NULL)
+            and ((feature->getTypeCode() == GXF_GENE_TYPE) or (feature->getTypeCode() == GXF_TRANSCRIPT_TYPE))) {
+            addIdKey(AnnotationSet::mkFeatureIdKey(getBaseId(feature->getTypeId()), feature->isParY()));
+            if (feature->getHavanaTypeId() != "") {
+                addIdKey(AnnotationSet::mkFeatureIdKey(getBaseId(feature->getHavanaTypeId()), feature->isParY()));
+            }
+        }
+        delete gxfRecord;
+    }
+    delete gxfParser;
+}
+
+/* constructor, reads ids and opens file for reading genes */
+StreamingSrcGenes::StreamingSrcGenes(const string& gxfFile):
+    fGxfParser(NULL) {
+    loadIds(gxfFile);
+    fGxfParser = GxfParser::factory(gxfFile);
+}
+
+/* destructor */
+StreamingSrcGenes::~StreamingSrcGenes() {
+    delete fGxfParser;
+}
+
+/* read the next gene, or NULL at EOF */
+FeatureNode* StreamingSrcGenes::nextGene() {
+    GxfRecord* gxfRecord;
+    while ((gxfRecord = fGxfParser->next()) != NULL) {
+        if (instanceOf(gxfRecord, GxfFeature)) {
+            GxfFeature* geneFeature = dynamic_cast<GxfFeature*>(gxfRecord);
+            return GeneTree::geneTreeFactory(fGxfParser, geneFeature);
+        } else {
+            delete gxfRecord;
+        }
+    }
+    return NULL;
+}
+
+/* Is there a single gene or transcript with the base id? */
+bool StreamingSrcGenes::haveFeatureId(const string& id,
+                                      bool isParY) const {
+    IdCountMapConstIter it = fIdCounts.find(AnnotationSet::mkFeatureIdKey(getBaseId(id), isParY));
+    return (it != fIdCounts.end()) and (it->second == 1);
+}
@@ -0,0 +1,99 @@
+/*
+ * Source of genes to map.
+ */
+#ifndef srcGenes_hh
+#define srcGenes_hh
+#include <string>
+#include <map>
+#include "featureTree.hh"
+class AnnotationSet;
+class GxfParser;
+
+/*
+ * Source genes to map.  Genes are obtained in file order with nextGene()
+ * and must be passed to releaseGene() when done, as they maybe freed.
+ */
+class SrcGenes {
+    public:
+    /* destructor */
+    virtual ~SrcGenes() {
+    }
+
+    /* get the next gene, or NULL when there are no more. */
+    virtual FeatureNode* nextGene() = 0;
+
+    /* done with a gene returned by nextGene */
+    virtual void releaseGene(FeatureNode* gene) = 0;
+
+    /* Is there a single gene or transcript with the base id of id in the
+     * source?  Same result as AnnotationSet::getFeatureById() != NULL. */
+    virtual bool haveFeatureId(const string& id,
+                               bool isParY) const = 0;
+};
+
+/*
+ * Source genes from an AnnotationSet loaded in memory.
+ */
+class LoadedSrcGenes: public SrcGenes {
+    private:
+    const AnnotationSet* fAnnotations;  // not owned
+    int fNextIdx;
+
+    public:
+    /* constructor */
+    LoadedSrcGenes(const AnnotationSet* annotations):
+        fAnnotations(annotations),
+        fNextIdx(0) {
+    }
+
+    /* get the next gene, or NULL when there are no more. */
+    virtual FeatureNode* nextGene();
+
+    /* done with a gene, does nothing */
+    virtual void releaseGene(FeatureNode* gene) {
+    }
+
+    /* Is there a single gene or transcript with the base id? */
+    virtual bool haveFeatureId(const string& id,
+                               bool isParY) const;
+};
+
+/*
+ * Source genes read from a GxF file one gene at a time, with each gene
+ * freed when released. An initial pass over the file collects the gene and
+ * transcript ids, so id queries can be answered for genes not yet read.
+ * The file is read twice, so it can't be a pipe.
+ */
+class StreamingSrcGenes: public SrcGenes {
+    private:
+    // count of features for id key
+    typedef map<string, int> IdCountMap;
+    typedef IdCountMap::const_iterator IdCountMapConstIter;
+
+    IdCountMap fIdCounts;
+    GxfParser* fGxfParser;
+
+    void addIdKey(const string& key);
+    void loadIds(const string& gxfFile);
+
+    public:
+    /* constructor, reads ids and opens file for reading genes */
+    StreamingSrcGenes(const string& gxfFile);
+
+    /* destructor */
+    virtual ~StreamingSrcGenes();
+
+    /* read the next gene, or NULL at EOF */
+    virtual FeatureNode* nextGene();
+
+    /* free the gene */
+    virtual void releaseGene(FeatureNode* gene) {
+        delete gene;
+    }
+
+    /* Is there a single gene or transcript with the base id? */
+    virtual bool haveFeatureId(const string& id,
+                               bool isParY) const;
+};
+
+#endif
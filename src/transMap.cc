@@ -2,54 +2,220 @@
  * transmap projection of annotations
  */
 #include "transMap.hh"
+#include "seqAliases.hh"
 #include "typeOps.hh"
+#include "runStats.hh"
+#include "bgzfStreamBuf.hh"
+#include "htslib/bgzf.h"
 #include <iostream>
+#include <algorithm>
+#include <string.h>
+#include <stdio.h>
+#include <thread>
+#include <set>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-/* slCat that reverses parameter order, as the first list in rangeTreeAddVal
- * mergeVals function tends to be larger in degenerate cases of a huge number
- * of chains */
-static void *slCatReversed(void *va, void *vb) {
-    return slCat(vb, va);
-}
+int TransMap::sMaxMappingCandidates = 0;
 
-/* is a mapping alignment file a chain or psl? */
-/* add a map align object to the genomeRangeTree */
+/* add a map align object to the index */
 void TransMap::mapAlnsAdd(struct psl *mapPsl) {
-    genomeRangeTreeAddVal(fMapAlns, mapPsl->qName, mapPsl->qStart, mapPsl->qEnd, mapPsl, slCatReversed);
+    fMapAlns.add(mapPsl->qName, mapPsl->qStart, mapPsl->qEnd, mapPsl);
     fQuerySizes.add(mapPsl->qName, mapPsl->qSize);
     fTargetSizes.add(mapPsl->tName, mapPsl->tSize);
 }
 
 /* constructor */
 TransMap::TransMap():
-    fMapAlns(genomeRangeTreeNew()) {
+    fCachePsls(NULL),
+    fCacheMem(NULL),
+    fCacheMemSize(0) {
 }
 
 /* destructor */
 TransMap::~TransMap() {
-    struct hashCookie cookie = hashFirst(fMapAlns->jkhash);
-    struct hashEl* chromEl;
-    while ((chromEl = hashNext(&cookie)) != NULL) {
-        for (struct range* range = genomeRangeTreeList(fMapAlns, chromEl->name);
-             range != NULL; range = range->next) {
-            struct psl* head = static_cast<struct psl*>(range->val);
-            pslFreeList(&head);
-        }
+    if (fCacheMem != NULL) {
+        delete[] fCachePsls;
+        munmap(fCacheMem, fCacheMemSize);
+    } else {
+        PslVector mapPsls;
+        fMapAlns.getValues(mapPsls);
+        mapPsls.free();
     }
-    
-    genomeRangeTreeFree(&fMapAlns);
 }
 
 
 
+/* Find the first block of a mapping PSL with a query end after pos, which
+ * is in the query strand coordinates.  Blocks are in ascending order, so
+ * this is a binary search, written without branches in the loop so the
+ * perhaps tens of thousands of blocks of a chain are searched without
+ * mispredictions.  Returns blockCount if there is none. */
+static int findFirstMapBlock(const struct psl* mapPsl,
+                             unsigned pos) {
+    const unsigned* qStarts = mapPsl->qStarts;
+    const unsigned* blockSizes = mapPsl->blockSizes;
+    int base = 0;
+    int len = mapPsl->blockCount;
+    if (len == 0) {
+        return 0;
+    }
+    while (len > 1) {
+        int half = len / 2;
+        int mid = base + half;
+        base = ((qStarts[mid] + blockSizes[mid]) <= pos) ? mid : base;
+        len -= half;
+    }
+    return base + (((qStarts[base] + blockSizes[base]) <= pos) ? 1 : 0);
+}
+
+/* Make a view of the blocks of a mapping PSL that overlap the target range
+ * of an input PSL, sharing the block arrays.  pslTransMap scans the mapping
+ * blocks linearly from the first, which dominates mapping through long
+ * chains.  Blocks outside of the range can't produce any mapped blocks, so
+ * the result of mapping through the view is the same.  Return false if
+ * no blocks overlap. */
+static bool makeMapPslView(const struct psl* inPsl,
+                           const struct psl* mapPsl,
+                           struct psl* mapView) {
+    // input target range in mapping query strand coordinates
+    int start = inPsl->tStart, end = inPsl->tEnd;
+    if (pslQStrand(const_cast<struct psl*>(mapPsl)) == '-') {
+        reverseIntRange(&start, &end, mapPsl->qSize);
+    }
+    int iFirst = findFirstMapBlock(mapPsl, start);
+    int iEnd = iFirst;
+    while ((iEnd < mapPsl->blockCount) and (mapPsl->qStarts[iEnd] < end)) {
+        iEnd++;
+    }
+    if (iFirst == iEnd) {
+        return false;
+    }
+    *mapView = *mapPsl;
+    mapView->next = NULL;
+    mapView->blockCount = iEnd - iFirst;
+    mapView->blockSizes = mapPsl->blockSizes + iFirst;
+    mapView->qStarts = mapPsl->qStarts + iFirst;
+    mapView->tStarts = mapPsl->tStarts + iFirst;
+    int iLast = mapView->blockCount - 1;
+    mapView->qStart = pslQStart(mapView, 0);
+    mapView->qEnd = pslQEnd(mapView, iLast);
+    if (pslQStrand(mapView) == '-') {
+        reverseIntRange(&mapView->qStart, &mapView->qEnd, mapView->qSize);
+    }
+    mapView->tStart = pslTStart(mapView, 0);
+    mapView->tEnd = pslTEnd(mapView, iLast);
+    if (pslTStrand(mapView) == '-') {
+        reverseIntRange(&mapView->tStart, &mapView->tEnd, mapView->tSize);
+    }
+    return true;
+}
+
+/* get the positive strand target range of the i-th block of a PSL, in
+ * ascending order */
+static void getAscendingTBlock(struct psl* psl,
+                               int i,
+                               int* start,
+                               int* end) {
+    if (pslTStrand(psl) == '-') {
+        i = psl->blockCount - 1 - i;
+    }
+    *start = psl->tStarts[i];
+    *end = psl->tStarts[i] + psl->blockSizes[i];
+    if (pslTStrand(psl) == '-') {
+        reverseIntRange(start, end, psl->tSize);
+    }
+}
+
+/* get the positive strand query range of the i-th block of a PSL, in
+ * ascending order */
+static void getAscendingQBlock(struct psl* psl,
+                               int i,
+                               int* start,
+                               int* end) {
+    if (pslQStrand(psl) == '-') {
+        i = psl->blockCount - 1 - i;
+    }
+    *start = psl->qStarts[i];
+    *end = psl->qStarts[i] + psl->blockSizes[i];
+    if (pslQStrand(psl) == '-') {
+        reverseIntRange(start, end, psl->qSize);
+    }
+}
+
+/* Cheaply score a mapping alignment as a candidate for mapping an input
+ * PSL, as the number of input aligned bases covered by the mapping blocks.
+ * This is the number of bases that would be mapped, without building the
+ * mapped PSL. */
+int TransMap::calcCandidateScore(struct psl* inPsl,
+                                 struct psl* mapPsl) {
+    struct psl mapView;
+    if (not makeMapPslView(inPsl, mapPsl, &mapView)) {
+        return 0;
+    }
+    int score = 0;
+    int iIn = 0, iMap = 0;
+    while ((iIn < inPsl->blockCount) and (iMap < mapView.blockCount)) {
+        int inStart, inEnd, mapStart, mapEnd;
+        getAscendingTBlock(inPsl, iIn, &inStart, &inEnd);
+        getAscendingQBlock(&mapView, iMap, &mapStart, &mapEnd);
+        score += max(0, min(inEnd, mapEnd) - max(inStart, mapStart));
+        if (inEnd < mapEnd) {
+            iIn++;
+        } else {
+            iMap++;
+        }
+    }
+    return score;
+}
+
+/* If there are more mapping alignments than the maximum number of
+ * candidates, keep the highest scoring ones, in their current order.  Ties
+ * are broken by keeping the first.  The dropped alignments are added to
+ * prunedMapPsls if it is not NULL. */
+void TransMap::selectMapCandidates(struct psl* inPsl,
+                                   PslVector& mapPsls,
+                                   PslVector* prunedMapPsls) {
+    if ((sMaxMappingCandidates == 0) or (mapPsls.size() <= sMaxMappingCandidates)) {
+        return;
+    }
+    vector<pair<int, int> > ranks;  // (-score, index)
+    ranks.reserve(mapPsls.size());
+    for (int i = 0; i < mapPsls.size(); i++) {
+        ranks.push_back(make_pair(-calcCandidateScore(inPsl, mapPsls[i]), i));
+    }
+    nth_element(ranks.begin(), ranks.begin() + sMaxMappingCandidates, ranks.end());
+    vector<bool> keep(mapPsls.size(), false);
+    for (int i = 0; i < sMaxMappingCandidates; i++) {
+        keep[ranks[i].second] = true;
+    }
+    int iKeep = 0;
+    for (int i = 0; i < mapPsls.size(); i++) {
+        if (keep[i]) {
+            mapPsls[iKeep++] = mapPsls[i];
+        } else if (prunedMapPsls != NULL) {
+            prunedMapPsls->push_back(mapPsls[i]);
+        }
+    }
+    if (gRunStats != NULL) {
+        gRunStats->addCount("mapping candidates pruned", mapPsls.size() - iKeep);
+    }
+    mapPsls.resize(iKeep);
+}
+
 /* map one pair of query and mapping PSL */
 void TransMap::mapPslPair(struct psl *inPsl,
                           struct psl *mapPsl,
-                          PslVector& allMappedPsls) const {
+                          PslVector& allMappedPsls) {
     if (inPsl->tSize != mapPsl->qSize)
         errAbort(toCharStr("Error: inPsl %s tSize (%d) != mapping alignment %s qSize (%d) (perhaps you need to specify -swapMap?)"),
                  inPsl->tName, inPsl->tSize, mapPsl->qName, mapPsl->qSize);
-    struct psl* mappedPsls = pslTransMap(pslTransMapKeepTrans, inPsl, mapPsl);
+    struct psl mapView;
+    if (not makeMapPslView(inPsl, mapPsl, &mapView)) {
+        return;  // no mapping blocks overlap
+    }
+    struct psl* mappedPsls = pslTransMap(pslTransMapKeepTrans, inPsl, &mapView);
     struct psl* mappedPsl;
     while ((mappedPsl = static_cast<struct psl*>(slPopHead(&mappedPsls))) != NULL) {
         if (pslQStrand(mappedPsl) != pslQStrand(inPsl)) {
@@ -62,16 +228,109 @@ void TransMap::mapPslPair(struct psl *inPsl,
 /* Map a single input PSL and return a list of resulting mappings.  * Keep PSL
 in the same query order, even if it creates a `-' on the target. */
 PslVector TransMap::mapPsl(struct psl* inPsl) const {
+    PslVector overMapPsls;
+    fMapAlns.overlapping(inPsl->tName, inPsl->tStart, inPsl->tEnd, overMapPsls);
+    selectMapCandidates(inPsl, overMapPsls);
     PslVector mappedPsls;
-    struct range *overMapAlns = genomeRangeTreeAllOverlapping(fMapAlns, inPsl->tName, inPsl->tStart, inPsl->tEnd);
-    for (struct range *overMapAln = overMapAlns; overMapAln != NULL; overMapAln = overMapAln->next) {
-        for (struct psl *overMapPsl = static_cast<struct psl*>(overMapAln->val); overMapPsl != NULL; overMapPsl = overMapPsl->next) {
-            mapPslPair(inPsl, overMapPsl, mappedPsls);
-        }
+    for (size_t i = 0; i < overMapPsls.size(); i++) {
+        mapPslPair(inPsl, overMapPsls[i], mappedPsls);
     }
     return mappedPsls;
 }
 
+/* Map a cluster of overlapping input PSL, given by order[iStart..iEnd),
+ * which are sorted by target start and end at or before clusterEnd.  The mapping alignments for the whole
+ * cluster are obtained with one query, and a list of alignments that
+ * could overlap the current input is maintained as the inputs are swept.
+ * This keeps the alignments in start order, the same as mapPsl. */
+void TransMap::mapPslCluster(const PslVector& inPsls,
+                             const vector<int>& order,
+                             int iStart,
+                             int iEnd,
+                             int clusterEnd,
+                             vector<PslVector>& mappedPsls,
+                             vector<PslVector>* prunedMappedPsls) const {
+    struct psl* firstPsl = inPsls[order[iStart]];
+    PslVector overMapPsls;
+    fMapAlns.overlapping(firstPsl->tName, firstPsl->tStart, clusterEnd, overMapPsls);
+
+    PslVector activeMapPsls;
+    int iNextMap = 0;
+    for (int i = iStart; i < iEnd; i++) {
+        struct psl* inPsl = inPsls[order[i]];
+        // add alignments starting before the end of this input
+        while ((iNextMap < overMapPsls.size()) and (overMapPsls[iNextMap]->qStart < inPsl->tEnd)) {
+            activeMapPsls.push_back(overMapPsls[iNextMap++]);
+        }
+        // drop alignments ending before this input, they can't overlap later inputs
+        int iKeep = 0;
+        for (int j = 0; j < activeMapPsls.size(); j++) {
+            if (activeMapPsls[j]->qEnd > inPsl->tStart) {
+                activeMapPsls[iKeep++] = activeMapPsls[j];
+            }
+        }
+        activeMapPsls.resize(iKeep);
+        if (sMaxMappingCandidates == 0) {
+            for (int j = 0; j < activeMapPsls.size(); j++) {
+                if (activeMapPsls[j]->qStart < inPsl->tEnd) {
+                    mapPslPair(inPsl, activeMapPsls[j], mappedPsls[order[i]]);
+                }
+            }
+        } else {
+            PslVector candMapPsls;
+            for (int j = 0; j < activeMapPsls.size(); j++) {
+                if (activeMapPsls[j]->qStart < inPsl->tEnd) {
+                    candMapPsls.push_back(activeMapPsls[j]);
+                }
+            }
+            PslVector prunedMapPsls;
+            selectMapCandidates(inPsl, candMapPsls, ((prunedMappedPsls != NULL) ? &prunedMapPsls : NULL));
+            for (int j = 0; j < candMapPsls.size(); j++) {
+                mapPslPair(inPsl, candMapPsls[j], mappedPsls[order[i]]);
+            }
+            for (int j = 0; j < prunedMapPsls.size(); j++) {
+                mapPslPair(inPsl, prunedMapPsls[j], (*prunedMappedPsls)[order[i]]);
+            }
+        }
+    }
+}
+
+/* Map a set of input PSLs, returning the mappings of each input in the same
+ * order as the input. */
+void TransMap::mapPsls(const PslVector& inPsls,
+                       vector<PslVector>& mappedPsls,
+                       vector<PslVector>* prunedMappedPsls) const {
+    mappedPsls.assign(inPsls.size(), PslVector());
+    if (prunedMappedPsls != NULL) {
+        prunedMappedPsls->assign(inPsls.size(), PslVector());
+    }
+    vector<int> order;
+    for (int i = 0; i < inPsls.size(); i++) {
+        order.push_back(i);
+    }
+    stable_sort(order.begin(), order.end(),
+                [&inPsls](int i1, int i2) -> bool {
+                    int diff = strcmp(inPsls[i1]->tName, inPsls[i2]->tName);
+                    return (diff != 0) ? (diff < 0) : (inPsls[i1]->tStart < inPsls[i2]->tStart);
+                });
+
+    // find clusters of overlapping inputs on the same sequence
+    int iStart = 0;
+    while (iStart < order.size()) {
+        struct psl* firstPsl = inPsls[order[iStart]];
+        int clusterEnd = firstPsl->tEnd;
+        int iEnd = iStart + 1;
+        while ((iEnd < order.size())
+               and (strcmp(inPsls[order[iEnd]]->tName, firstPsl->tName) == 0)
+               and (inPsls[order[iEnd]]->tStart < clusterEnd)) {
+            clusterEnd = max(clusterEnd, inPsls[order[iEnd]]->tEnd);
+            iEnd++;
+        }
+        mapPslCluster(inPsls, order, iStart, iEnd, clusterEnd, mappedPsls, prunedMappedPsls);
+        iStart = iEnd;
+    }
+}
+
 /* convert a chain to a psl, ignoring match counts, etc */
 static struct psl* chainToPsl(struct chain *ch) {
     int qStart = ch->qStart, qEnd = ch->qEnd;
@@ -100,19 +359,88 @@ static void swapPsls(struct psl** psls) {
     *psls = swappedPsls;
 }
 
+/* get the alias of one side of an alignment, or keep the name if there
+ * are no aliases */
+static SeqAliases::Alias getSeqAlias(const SeqAliases* seqAliases,
+                                     const char* seqName,
+                                     int seqSize) {
+    return (seqAliases == NULL) ? SeqAliases::Alias(seqName, seqSize) : seqAliases->get(seqName);
+}
+
+/* change the name of one side of a PSL */
+static void renamePslSeq(char** seqNamePtr,
+                         const string& newName) {
+    if (newName != *seqNamePtr) {
+        freeMem(*seqNamePtr);
+        *seqNamePtr = cloneString(toCharStr(newName));
+    }
+}
+
+/* Rename the sequences of PSLs, replacing alignments of a sequence of a
+ * different size than its alias with an identity alignment, as described
+ * in factoryFromPsls().  Order of the PSLs is kept. */
+static void aliasPslSeqs(struct psl** psls,
+                         const SeqAliases* querySeqAliases,
+                         const SeqAliases* targetSeqAliases) {
+    struct psl* aliasedPsls = NULL;
+    set<string> identitySeqs;
+    struct psl* psl;
+    while ((psl = static_cast<struct psl*>(slPopHead(psls))) != NULL) {
+        SeqAliases::Alias qAlias = getSeqAlias(querySeqAliases, psl->qName, psl->qSize);
+        SeqAliases::Alias tAlias = getSeqAlias(targetSeqAliases, psl->tName, psl->tSize);
+        if ((qAlias.fSize == int(psl->qSize)) and (tAlias.fSize == int(psl->tSize))) {
+            renamePslSeq(&psl->qName, qAlias.fName);
+            renamePslSeq(&psl->tName, tAlias.fName);
+            slAddHead(&aliasedPsls, psl);
+        } else if ((qAlias.fName == tAlias.fName) and (qAlias.fSize == tAlias.fSize)) {
+            if (identitySeqs.insert(qAlias.fName).second) {
+                struct psl* identityPsl = pslNew(toCharStr(qAlias.fName), qAlias.fSize, 0, qAlias.fSize,
+                                                 toCharStr(tAlias.fName), tAlias.fSize, 0, tAlias.fSize,
+                                                 toCharStr("+"), 1, 0);
+                pslAddBlock(identityPsl, 0, 0, qAlias.fSize);
+                slAddHead(&aliasedPsls, identityPsl);
+            }
+            pslFree(&psl);
+        } else {
+            string msg = "mapping alignment sequence sizes don't match the sequence aliases: "
+                + string(psl->qName) + " " + toString(psl->qSize) + " => " + qAlias.fName + " " + toString(qAlias.fSize)
+                + ", " + string(psl->tName) + " " + toString(psl->tSize) + " => " + tAlias.fName + " " + toString(tAlias.fSize);
+            pslFree(&psl);
+            pslFreeList(&aliasedPsls);
+            pslFreeList(psls);
+            throw invalid_argument(msg);
+        }
+    }
+    slReverse(&aliasedPsls);
+    *psls = aliasedPsls;
+}
+
 /* factory from a list of psls */
 TransMap* TransMap::factoryFromPsls(struct psl** psls,
-                                    bool swapMap) {
+                                    bool swapMap,
+                                    const MappingQueryRanges* queryRanges,
+                                    const SeqAliases* querySeqAliases,
+                                    const SeqAliases* targetSeqAliases) {
     if (swapMap) {
         swapPsls(psls);
     }
+    if ((querySeqAliases != NULL) or (targetSeqAliases != NULL)) {
+        aliasPslSeqs(psls, querySeqAliases, targetSeqAliases);
+    }
     slSort(psls, pslCmpTarget);
     
     TransMap* transMap = new TransMap();
     struct psl* psl;
     while ((psl = static_cast<struct psl*>(slPopHead(psls))) != NULL) {
-        transMap->mapAlnsAdd(psl);
+        if ((queryRanges == NULL) or queryRanges->anyOverlap(psl->qName, psl->qStart, psl->qEnd)) {
+            transMap->mapAlnsAdd(psl);
+        } else {
+            transMap->fQuerySizes.add(psl->qName, psl->qSize);
+            transMap->fTargetSizes.add(psl->tName, psl->tSize);
+            pslFree(&psl);
+        }
     }
+    transMap->fMapAlns.build();
     return transMap;
 }
 
@@ -123,26 +451,259 @@ TransMap* TransMap::factoryFromPsl(struct psl* psl,
     return factoryFromPsls(&psls, swapMap);
 }
 
-/* factory from a psl file */
-TransMap* TransMap::factoryFromPslFile(const string& pslFile,
-                                       bool swapMap) {
-    struct psl* psls = pslLoadAll(toCharStr(pslFile));
-    return factoryFromPsls(&psls, swapMap);
+/* Read an alignment file into memory, followed by a zero byte.  BGZF files
+ * are decompressed using numThreads htslib threads.  Return false if the
+ * file is compressed in another way, and so must be read serially.  The
+ * buffer is sized from the file size, so an uncompressed file is read in one
+ * call, and doubled if a BGZF file expands more than expected. */
+static bool readAlignFile(const string& fileName,
+                          int numThreads,
+                          vector<char>& text) {
+    static const size_t minReadSize = 1024 * 1024;
+    static const size_t bgzfExpansion = 4;  // typical for PSL or chains
+    bool isCompressed = stringEndsWith(fileName, ".gz");
+    if (isCompressed and not BgzfStreamBuf::isBgzfFile(fileName)) {
+        return false;
+    }
+    BGZF* bgzfFh = NULL;
+    FILE* fh = NULL;
+    if (isCompressed) {
+        bgzfFh = bgzf_open(fileName.c_str(), "r");
+        if (bgzfFh != NULL) {
+            bgzf_mt(bgzfFh, numThreads, 256);
+        }
+    } else {
+        fh = fopen(fileName.c_str(), "r");
+    }
+    if ((bgzfFh == NULL) and (fh == NULL)) {
+        throw ios_base::failure("can't open mapping alignments: " + fileName);
+    }
+    struct stat st;
+    size_t fileSize = (stat(fileName.c_str(), &st) == 0) ? st.st_size : 0;
+    text.resize(max(minReadSize, ((bgzfFh != NULL) ? (bgzfExpansion * fileSize) : fileSize) + 1));
+    size_t size = 0;
+    ssize_t num;
+    do {
+        if (size == text.size()) {
+            text.resize(2 * text.size());
+        }
+        num = (bgzfFh != NULL) ? bgzf_read(bgzfFh, &text[size], text.size() - size)
+            : fread(&text[size], 1, text.size() - size, fh);
+        if (num > 0) {
+            size += num;
+        }
+    } while (num > 0);
+    bool isOk = (bgzfFh != NULL) ? ((num == 0) and (bgzf_close(bgzfFh) == 0))
+        : ((not ferror(fh)) and (fclose(fh) == 0));
+    if (not isOk) {
+        throw ios_base::failure("error reading mapping alignments: " + fileName);
+    }
+    text.resize(size + 1);
+    text[size] = '\0';
+    return true;
 }
 
+/* get the offset after the header of a PSL file, if it has one */
+static size_t skipPslHeader(const vector<char>& text) {
+    static const int pslHeaderLines = 5;
+    size_t off = 0;
+    if (strncmp(&text[0], "psLayout", 8) == 0) {
+        for (int i = 0; (i < pslHeaderLines) and (text[off] != '\0'); i++) {
+            const char* newline = strchr(&text[off], '\n');
+            off = (newline == NULL) ? (text.size() - 1) : ((newline - &text[0]) + 1);
+        }
+    }
+    return off;
+}
 
-/* factory from a chain file */
-TransMap* TransMap::factoryFromChainFile(const string& chainFile,
-                                         bool swapMap) {
+/* Split text, starting at startOff, into about numChunks chunks at the
+ * start of records, which are lines beginning with recordPrefix.  Each chunk
+ * is made a zero terminated string by replacing the preceding newline,
+ * returning the start of each chunk. */
+static vector<char*> splitAlignText(vector<char>& text,
+                                    size_t startOff,
+                                    const string& recordPrefix,
+                                    int numChunks) {
+    size_t size = text.size() - 1;  // excluding terminator
+    string recordStart = "\n" + recordPrefix;
+    vector<char*> chunks;
+    chunks.push_back(&text[startOff]);
+    size_t chunkOff = startOff;
+    for (int iChunk = 1; iChunk < numChunks; iChunk++) {
+        size_t searchOff = max(chunkOff, startOff + (((size - startOff) * iChunk) / numChunks));
+        const char* next = strstr(&text[searchOff], recordStart.c_str());
+        if (next == NULL) {
+            break;
+        }
+        size_t newlineOff = next - &text[0];
+        text[newlineOff] = '\0';
+        chunkOff = newlineOff + 1;
+        chunks.push_back(&text[chunkOff]);
+    }
+    return chunks;
+}
+
+/* Does a chain, given by its header, overlap the query ranges, which are
+ * in the mapping query coordinates after swapping.  True if there are no
+ * query ranges. */
+static bool isChainInQueryRanges(const struct chain* ch,
+                                 bool swapMap,
+                                 const MappingQueryRanges* queryRanges) {
+    if (queryRanges == NULL) {
+        return true;
+    } else if (swapMap) {
+        return queryRanges->anyOverlap(ch->tName, ch->tStart, ch->tEnd);
+    } else {
+        int start = ch->qStart, end = ch->qEnd;
+        if (ch->qStrand == '-') {
+            reverseIntRange(&start, &end, ch->qSize);
+        }
+        return queryRanges->anyOverlap(ch->qName, start, end);
+    }
+}
+
+/* Make a PSL without blocks from the header of a chain that is not
+ * loaded.  factoryFromPsls() drops it, only keeping the sequence sizes. */
+static struct psl* chainHeaderToPsl(const struct chain* ch) {
+    int qStart = ch->qStart, qEnd = ch->qEnd;
+    if (ch->qStrand == '-') {
+        reverseIntRange(&qStart, &qEnd, ch->qSize);
+    }
+    char strand[2] = {ch->qStrand, '\0'};
+    return pslNew(ch->qName, ch->qSize, qStart, qEnd,
+                  ch->tName, ch->tSize, ch->tStart, ch->tEnd,
+                  strand, 1, 0);
+}
+
+/* skip the block lines of a chain, up to and including the last one, which
+ * has only the block size */
+static void skipChainBlocks(struct lineFile* chLf) {
+    char* row[3];
+    while (lineFileChopNext(chLf, row, ArraySize(row)) > 1) {
+        continue;
+    }
+}
+
+/* Read chains, returning PSLs in reverse order.  The blocks of chains not
+ * overlapping queryRanges are not parsed, see isChainInQueryRanges(). */
+static struct psl* readChains(struct lineFile* chLf,
+                              bool swapMap,
+                              const MappingQueryRanges* queryRanges) {
     struct psl* psls = NULL;
     struct chain *ch;
-    struct lineFile *chLf = lineFileOpen(toCharStr(chainFile), TRUE);
-    while ((ch = chainRead(chLf)) != NULL) {
-        slAddHead(&psls, chainToPsl(ch));
+    while ((ch = chainReadChainLine(chLf)) != NULL) {
+        if (isChainInQueryRanges(ch, swapMap, queryRanges)) {
+            chainReadBlocks(chLf, ch);
+            slAddHead(&psls, chainToPsl(ch));
+        } else {
+            skipChainBlocks(chLf);
+            slAddHead(&psls, chainHeaderToPsl(ch));
+        }
         chainFree(&ch);
     }
+    return psls;
+}
+
+/* parse the chains in a chunk, returning PSLs in reverse order */
+static struct psl* parseChainChunk(const string& chainFile,
+                                   char* chunk,
+                                   bool swapMap,
+                                   const MappingQueryRanges* queryRanges) {
+    struct lineFile *chLf = lineFileOnString(toCharStr(chainFile), TRUE, chunk);
+    struct psl* psls = readChains(chLf, swapMap, queryRanges);
     lineFileClose(&chLf);
-    return factoryFromPsls(&psls, swapMap);
+    return psls;
 }
 
+/* parse the PSLs in a chunk, returning PSLs in order */
+static struct psl* parsePslChunk(const string& pslFile,
+                                 char* chunk) {
+    struct psl* psls = NULL;
+    struct lineFile *pslLf = lineFileOnString(toCharStr(pslFile), TRUE, chunk);
+    char* row[PSL_NUM_COLS + 2];  // allow pslx sequence columns
+    int wordCount;
+    while ((wordCount = lineFileChopNext(pslLf, row, ArraySize(row))) > 0) {
+        lineFileExpectAtLeast(pslLf, PSL_NUM_COLS, wordCount);
+        slAddHead(&psls, pslLoad(row));
+    }
+    lineFileClose(&pslLf);
+    slReverse(&psls);
+    return psls;
+}
+
+/* Parse an alignment file in chunks on multiple threads.  The PSLs are
+ * returned in the same order as parsing serially, so the mapping index is
+ * identical.  For chains, swapMap and queryRanges are passed to
+ * readChains().  Returns false if the file can't be read this way. */
+static bool parallelReadAligns(const string& fileName,
+                               bool isChain,
+                               int numThreads,
+                               bool swapMap,
+                               const MappingQueryRanges* queryRanges,
+                               struct psl** pslsRet) {
+    vector<char> text;
+    if (not readAlignFile(fileName, numThreads, text)) {
+        return false;
+    }
+    vector<char*> chunks = splitAlignText(text, (isChain ? 0 : skipPslHeader(text)),
+                                          (isChain ? "chain " : ""), numThreads);
+    vector<struct psl*> chunkPsls(chunks.size(), NULL);
+    vector<std::thread> threads;
+    for (int iChunk = 0; iChunk < chunks.size(); iChunk++) {
+        threads.push_back(std::thread([&, iChunk]() {
+                    chunkPsls[iChunk] = isChain ? parseChainChunk(fileName, chunks[iChunk], swapMap, queryRanges)
+                        : parsePslChunk(fileName, chunks[iChunk]);
+                }));
+    }
+    for (int iChunk = 0; iChunk < threads.size(); iChunk++) {
+        threads[iChunk].join();
+    }
+    // serial chain reading builds the list in reverse order
+    struct psl* psls = NULL;
+    for (int iChunk = 0; iChunk < chunkPsls.size(); iChunk++) {
+        int iNext = isChain ? (chunkPsls.size() - 1) - iChunk : iChunk;
+        psls = static_cast<struct psl*>(slCat(psls, chunkPsls[iNext]));
+    }
+    *pslsRet = psls;
+    return true;
+}
+
+/* factory from a psl file */
+TransMap* TransMap::factoryFromPslFile(const string& pslFile,
+                                       bool swapMap,
+                                       int numThreads,
+                                       const MappingQueryRanges* queryRanges,
+                                       const SeqAliases* querySeqAliases,
+                                       const SeqAliases* targetSeqAliases) {
+    PhaseTimer readTimer("read mapping PSLs");
+    struct psl* psls = NULL;
+    if ((numThreads <= 1) or not parallelReadAligns(pslFile, false, numThreads, swapMap, queryRanges, &psls)) {
+        psls = pslLoadAll(toCharStr(pslFile));
+    }
+    readTimer.stop();
+    return factoryFromPsls(&psls, swapMap, queryRanges, querySeqAliases, targetSeqAliases);
+}
+
+
+/* factory from a chain file */
+TransMap* TransMap::factoryFromChainFile(const string& chainFile,
+                                         bool swapMap,
+                                         int numThreads,
+                                         const MappingQueryRanges* queryRanges,
+                                         const SeqAliases* querySeqAliases,
+                                         const SeqAliases* targetSeqAliases) {
+    PhaseTimer readTimer("read mapping chains");
+    // chains outside of the query ranges are skipped while reading, unless
+    // they are renamed, as the ranges use the aliases
+    bool aliasing = (querySeqAliases != NULL) or (targetSeqAliases != NULL);
+    const MappingQueryRanges* headerQueryRanges = aliasing ? NULL : queryRanges;
+    struct psl* psls = NULL;
+    if ((numThreads <= 1) or not parallelReadAligns(chainFile, true, numThreads, swapMap, headerQueryRanges, &psls)) {
+        struct lineFile *chLf = lineFileOpen(toCharStr(chainFile), TRUE);
+        psls = readChains(chLf, swapMap, headerQueryRanges);
+        lineFileClose(&chLf);
+    }
+    readTimer.stop();
+    return factoryFromPsls(&psls, swapMap, queryRanges, querySeqAliases, targetSeqAliases);
+}
 
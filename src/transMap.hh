@@ -6,7 +6,9 @@
 #include <string>
 #include <map>
 #include "pslOps.hh"
+#include "intervalIndex.hh"
 using namespace std;
+class SeqAliases;
 
 
 class GenomeSizeMap: public map<const string, int> {
@@ -30,12 +32,26 @@ class GenomeSizeMap: public map<const string, int> {
     }
 };
 
+/* Query ranges of the mapping alignments to load, used to only load the
+ * alignments needed to map a subset of the genes.  The values are not
+ * used. */
+typedef IntervalIndex<int> MappingQueryRanges;
+
 /*
  * transmap via alignment chains
  */
 class TransMap {
+    friend class TransMapCache;
     private:
-    struct genomeRangeTree* fMapAlns;  // mapping alingments
+    IntervalIndex<struct psl*> fMapAlns;  // mapping alignments, indexed by query range
+
+    // if loaded from a mapping cache, the PSLs are in this array and their
+    // block arrays and names are in the memory mapped file.
+    struct psl* fCachePsls;
+    void* fCacheMem;
+    size_t fCacheMemSize;
+
+    static int sMaxMappingCandidates;  // 0 for no limit
 
     public:
     GenomeSizeMap fQuerySizes;   // query sequence sizes
@@ -43,9 +59,18 @@ class TransMap {
    
     private:
     void mapAlnsAdd(struct psl *mapPsl);
-    void mapPslPair(struct psl *inPsl,
-                    struct psl *mapPsl,
-                    PslVector& allMappedPsls) const;
+    void mapPslCluster(const PslVector& inPsls,
+                       const vector<int>& order,
+                       int iStart,
+                       int iEnd,
+                       int clusterEnd,
+                       vector<PslVector>& mappedPsls,
+                       vector<PslVector>* prunedMappedPsls) const;
+    static int calcCandidateScore(struct psl* inPsl,
+                                  struct psl* mapPsl);
+    static void selectMapCandidates(struct psl* inPsl,
+                                    PslVector& mapPsls,
+                                    PslVector* prunedMapPsls = NULL);
 
     /* is a mapping alignment file a chain or psl? */
     static bool isChainMappingAlign(const string& fileName) {
@@ -63,34 +88,69 @@ class TransMap {
     TransMap();
 
     public:
-    /* consumes PSLs */
+    /* consumes PSLs.  If queryRanges is not NULL, only alignments
+     * overlapping them are kept, however the sizes of all sequences are
+     * recorded.  If querySeqAliases or targetSeqAliases are not NULL,
+     * the sequences of that side of the alignments, after swapping, are
+     * renamed.  An alignment whose sequence size doesn't match its alias
+     * is an error, unless both sides have the same alias and size, in
+     * which case the alignment is replaced by an identity alignment of
+     * the aliased sequence.  This is used for the hg19 chrM, which differs
+     * from the GRCh37 chrM. */
     static TransMap* factoryFromPsls(struct psl** psls,
-                                     bool swapMap);
+                                     bool swapMap,
+                                     const MappingQueryRanges* queryRanges = NULL,
+                                     const SeqAliases* querySeqAliases = NULL,
+                                     const SeqAliases* targetSeqAliases = NULL);
 
     /* clones PSL */
     static TransMap* factoryFromPsl(struct psl* psl,
                                     bool swapMap);
 
-    /* factory from a chain file */
+    /* factory from a chain file.  If numThreads is greater than one, an
+     * uncompressed or BGZF file is parsed in chunks on multiple threads.
+     * queryRanges and the sequence aliases are the same as for
+     * factoryFromPsls. */
     static TransMap* factoryFromChainFile(const string& chainFile,
-                                      bool swapMap);
-    /* factory from a  psl file */
+                                          bool swapMap,
+                                          int numThreads = 1,
+                                          const MappingQueryRanges* queryRanges = NULL,
+                                          const SeqAliases* querySeqAliases = NULL,
+                                          const SeqAliases* targetSeqAliases = NULL);
+    /* factory from a psl file, numThreads, queryRanges and the sequence
+     * aliases are the same as for chains */
     static TransMap* factoryFromPslFile(const string& pslFile,
-                                        bool swapMap);
+                                        bool swapMap,
+                                        int numThreads = 1,
+                                        const MappingQueryRanges* queryRanges = NULL,
+                                        const SeqAliases* querySeqAliases = NULL,
+                                        const SeqAliases* targetSeqAliases = NULL);
     
     /* factory from a chain or psl file */
     static TransMap* factoryFromFile(const string& fileName,
-                                     bool swapMap) {
+                                     bool swapMap,
+                                     int numThreads = 1,
+                                     const MappingQueryRanges* queryRanges = NULL,
+                                     const SeqAliases* querySeqAliases = NULL,
+                                     const SeqAliases* targetSeqAliases = NULL) {
         if (isChainMappingAlign(fileName)) {
-            return factoryFromChainFile(fileName, swapMap);
+            return factoryFromChainFile(fileName, swapMap, numThreads, queryRanges, querySeqAliases, targetSeqAliases);
         } else {
-            return factoryFromPslFile(fileName, swapMap);
+            return factoryFromPslFile(fileName, swapMap, numThreads, queryRanges, querySeqAliases, targetSeqAliases);
         }
     }
     
     /* destructor */
     ~TransMap();
 
+    /* Limit the number of mapping alignments an input PSL is projected
+     * through.  When more overlap it, such as in segmental duplications
+     * with many overlapping chains, the ones whose blocks cover the most
+     * input aligned bases are kept.  Zero, the default, is no limit. */
+    static void setMaxMappingCandidates(int maxCandidates) {
+        sMaxMappingCandidates = maxCandidates;
+    }
+
     /* do we have a mapping query sequence */
     bool haveQuerySeq(const string& qName) const {
         return fQuerySizes.have(qName);
@@ -111,9 +171,28 @@ class TransMap {
         return fTargetSizes.get(tName);
     }
     
+    /* Map an input PSL through one mapping alignment, adding the results to
+     * allMappedPsls.  Keep PSL in the same query order, even if it creates a
+     * `-' on the target. */
+    static void mapPslPair(struct psl *inPsl,
+                           struct psl *mapPsl,
+                           PslVector& allMappedPsls);
+
     /* Map a single input PSL and return a list of resulting mappings.  Keep
      * PSL in the same query order, even if it creates a `-' on the target. */
     PslVector mapPsl(struct psl* inPsl) const;
+
+    /* Map a set of input PSLs, such as the exons of all transcripts of a
+     * gene, returning the mappings of each input in mappedPsls, in the same
+     * order as the input.  Results are the same as calling mapPsl() on each
+     * input, however the mapping alignments are fetched once for each cluster
+     * of overlapping inputs and swept in position order.  If
+     * prunedMappedPsls is not NULL, the inputs are also mapped through the
+     * alignments dropped by the candidate limit and these mappings are
+     * returned in it, so they can be reported without being used. */
+    void mapPsls(const PslVector& inPsls,
+                 vector<PslVector>& mappedPsls,
+                 vector<PslVector>* prunedMappedPsls = NULL) const;
 };
 
 /* Vector of transmap objects.  Doesn't own them. */
@@ -0,0 +1,322 @@
+/*
+ * Binary cache of mapping alignments.
+ */
+#include "transMapCache.hh"
+#include "transMap.hh"
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <map>
+#include <vector>
+#include <iostream>
+#include <stdexcept>
+
+/* layout is:
+ *   Header
+ *   CachePsl[numPsls]
+ *   uint32_t blocks[numBlockWords]  - blockSizes, qStarts, tStarts of each PSL
+ *   uint64_t nameOffsets[numNames]  - offsets of names in file
+ *   char names[]                    - zero-terminated sequence names
+ * Sections are 8-byte aligned.
+ */
+static const char cacheMagic[8] = "GBMCACH";
+static const uint32_t cacheVersion = 1;
+static const uint32_t cacheByteOrder = 0x01020304;
+
+/* file header */
+struct TransMapCache::Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t alignFileSize;
+    int64_t alignFileMTime;
+    uint32_t swapMap;
+    uint32_t numNames;
+    uint64_t numPsls;
+    uint64_t pslsOffset;
+    uint64_t blocksOffset;
+    uint64_t nameOffsetsOffset;
+    uint64_t fileSize;
+};
+
+/* fixed-size part of a PSL */
+struct TransMapCache::CachePsl {
+    uint32_t match;
+    uint32_t misMatch;
+    uint32_t repMatch;
+    uint32_t nCount;
+    uint32_t qNumInsert;
+    int32_t qBaseInsert;
+    uint32_t tNumInsert;
+    int32_t tBaseInsert;
+    char strand[4];
+    uint32_t qNameIdx;
+    uint32_t qSize;
+    int32_t qStart;
+    int32_t qEnd;
+    uint32_t tNameIdx;
+    uint32_t tSize;
+    int32_t tStart;
+    int32_t tEnd;
+    uint32_t blockCount;
+    uint32_t pad;
+    uint64_t blocksIdx;  // index in blocks array
+};
+
+/* round up to 8-byte alignment */
+static uint64_t align8(uint64_t off) {
+    return (off + 7) & ~uint64_t(7);
+}
+
+/* get status of a file, throwing on error */
+static struct stat statFile(const string& fileName) {
+    struct stat st;
+    if (stat(fileName.c_str(), &st) < 0) {
+        throw ios_base::failure("can't stat \"" + fileName + "\": " + strerror(errno));
+    }
+    return st;
+}
+
+/* write data to the cache, throwing on error */
+static void writeData(FILE* fh,
+                      const void* data,
+                      size_t size,
+                      const string& cacheFile) {
+    if ((size > 0) and (fwrite(data, 1, size, fh) != size)) {
+        throw ios_base::failure("error writing mapping cache \"" + cacheFile + "\": " + strerror(errno));
+    }
+}
+
+/* pad to 8-byte alignment */
+static void writePad(FILE* fh,
+                     uint64_t& off,
+                     const string& cacheFile) {
+    static const char zeros[8] = {0};
+    uint64_t alignedOff = align8(off);
+    writeData(fh, zeros, alignedOff - off, cacheFile);
+    off = alignedOff;
+}
+
+/* read the cache header, return false if not a readable cache of the
+ * current version */
+bool TransMapCache::readHeader(const string& cacheFile,
+                               Header& header) {
+    FILE* fh = fopen(cacheFile.c_str(), "r");
+    if (fh == NULL) {
+        return false;
+    }
+    bool ok = (fread(&header, sizeof(Header), 1, fh) == 1);
+    fclose(fh);
+    return ok and (memcmp(header.magic, cacheMagic, sizeof(cacheMagic)) == 0)
+        and (header.version == cacheVersion)
+        and (header.byteOrder == cacheByteOrder);
+}
+
+/* check if a cache file exists and is current for the alignment file */
+bool TransMapCache::isCurrent(const string& cacheFile,
+                              const string& alignFile,
+                              bool swapMap) {
+    Header header;
+    if (not readHeader(cacheFile, header)) {
+        return false;
+    }
+    struct stat alignStat = statFile(alignFile);
+    struct stat cacheStat = statFile(cacheFile);
+    return (header.alignFileSize == uint64_t(alignStat.st_size))
+        and (header.alignFileMTime == int64_t(alignStat.st_mtime))
+        and (header.swapMap == uint32_t(swapMap))
+        and (header.fileSize == uint64_t(cacheStat.st_size));
+}
+
+/* write the cache to a temporary file then rename, so that a partial cache
+ * is never seen */
+void TransMapCache::write(const TransMap* transMap,
+                          const string& cacheFile,
+                          const string& alignFile,
+                          bool swapMap) {
+    PslVector psls;
+    transMap->fMapAlns.getValues(psls);
+
+    // intern sequence names
+    map<string, uint32_t> nameIdxMap;
+    vector<string> names;
+    vector<CachePsl> cachePsls(psls.size());
+    vector<uint32_t> blocks;
+    for (size_t i = 0; i < psls.size(); i++) {
+        const struct psl* psl = psls[i];
+        CachePsl& cachePsl = cachePsls[i];
+        memset(&cachePsl, 0, sizeof(CachePsl));
+        const char* seqNames[2] = {psl->qName, psl->tName};
+        uint32_t seqIdxs[2];
+        for (int j = 0; j < 2; j++) {
+            map<string, uint32_t>::const_iterator it = nameIdxMap.find(seqNames[j]);
+            if (it == nameIdxMap.end()) {
+                it = nameIdxMap.insert(make_pair(string(seqNames[j]), uint32_t(names.size()))).first;
+                names.push_back(seqNames[j]);
+            }
+            seqIdxs[j] = it->second;
+        }
+        cachePsl.match = psl->match;
+        cachePsl.misMatch = psl->misMatch;
+        cachePsl.repMatch = psl->repMatch;
+        cachePsl.nCount = psl->nCount;
+        cachePsl.qNumInsert = psl->qNumInsert;
+        cachePsl.qBaseInsert = psl->qBaseInsert;
+        cachePsl.tNumInsert = psl->tNumInsert;
+        cachePsl.tBaseInsert = psl->tBaseInsert;
+        strncpy(cachePsl.strand, psl->strand, sizeof(cachePsl.strand)-1);
+        cachePsl.qNameIdx = seqIdxs[0];
+        cachePsl.qSize = psl->qSize;
+        cachePsl.qStart = psl->qStart;
+        cachePsl.qEnd = psl->qEnd;
+        cachePsl.tNameIdx = seqIdxs[1];
+        cachePsl.tSize = psl->tSize;
+        cachePsl.tStart = psl->tStart;
+        cachePsl.tEnd = psl->tEnd;
+        cachePsl.blockCount = psl->blockCount;
+        cachePsl.blocksIdx = blocks.size();
+        blocks.insert(blocks.end(), psl->blockSizes, psl->blockSizes + psl->blockCount);
+        blocks.insert(blocks.end(), psl->qStarts, psl->qStarts + psl->blockCount);
+        blocks.insert(blocks.end(), psl->tStarts, psl->tStarts + psl->blockCount);
+    }
+
+    // layout
+    Header header;
+    memset(&header, 0, sizeof(Header));
+    memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+    header.version = cacheVersion;
+    header.byteOrder = cacheByteOrder;
+    struct stat alignStat = statFile(alignFile);
+    header.alignFileSize = alignStat.st_size;
+    header.alignFileMTime = alignStat.st_mtime;
+    header.swapMap = swapMap;
+    header.numNames = names.size();
+    header.numPsls = cachePsls.size();
+    header.pslsOffset = align8(sizeof(Header));
+    header.blocksOffset = align8(header.pslsOffset + (cachePsls.size() * sizeof(CachePsl)));
+    header.nameOffsetsOffset = align8(header.blocksOffset + (blocks.size() * sizeof(uint32_t)));
+    vector<uint64_t> nameOffsets(names.size());
+    uint64_t off = header.nameOffsetsOffset + (names.size() * sizeof(uint64_t));
+    for (size_t i = 0; i < names.size(); i++) {
+        nameOffsets[i] = off;
+        off += names[i].size() + 1;
+    }
+    header.fileSize = off;
+
+    string tmpCacheFile = cacheFile + ".tmp." + toString(getpid());
+    FILE* fh = fopen(tmpCacheFile.c_str(), "w");
+    if (fh == NULL) {
+        throw ios_base::failure("can't open mapping cache \"" + tmpCacheFile + "\" for write access: " + strerror(errno));
+    }
+    try {
+        off = 0;
+        writeData(fh, &header, sizeof(Header), tmpCacheFile);
+        off += sizeof(Header);
+        writePad(fh, off, tmpCacheFile);
+        writeData(fh, cachePsls.data(), cachePsls.size() * sizeof(CachePsl), tmpCacheFile);
+        off += cachePsls.size() * sizeof(CachePsl);
+        writePad(fh, off, tmpCacheFile);
+        writeData(fh, blocks.data(), blocks.size() * sizeof(uint32_t), tmpCacheFile);
+        off += blocks.size() * sizeof(uint32_t);
+        writePad(fh, off, tmpCacheFile);
+        writeData(fh, nameOffsets.data(), nameOffsets.size() * sizeof(uint64_t), tmpCacheFile);
+        for (size_t i = 0; i < names.size(); i++) {
+            writeData(fh, names[i].c_str(), names[i].size() + 1, tmpCacheFile);
+        }
+        if (fclose(fh) != 0) {
+            fh = NULL;
+            throw ios_base::failure("error closing mapping cache \"" + tmpCacheFile + "\": " + strerror(errno));
+        }
+        fh = NULL;
+        if (rename(tmpCacheFile.c_str(), cacheFile.c_str()) < 0) {
+            throw ios_base::failure("can't rename \"" + tmpCacheFile + "\" to \"" + cacheFile + "\": " + strerror(errno));
+        }
+    } catch (...) {
+        if (fh != NULL) {
+            fclose(fh);
+        }
+        unlink(tmpCacheFile.c_str());
+        throw;
+    }
+}
+
+/* memory map the cache and build the TransMap.  PSLs point into the mapped
+ * memory, which is mapped private and writable so kent functions taking
+ * non-const pointers are safe. */
+TransMap* TransMapCache::load(const string& cacheFile) {
+    int fd = open(cacheFile.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw ios_base::failure("can't open mapping cache \"" + cacheFile + "\": " + strerror(errno));
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        throw ios_base::failure("can't stat mapping cache \"" + cacheFile + "\": " + strerror(errno));
+    }
+    void* mem = mmap(NULL, st.st_size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED) {
+        throw ios_base::failure("can't mmap mapping cache \"" + cacheFile + "\": " + strerror(errno));
+    }
+    char* base = static_cast<char*>(mem);
+    const Header* header = reinterpret_cast<const Header*>(base);
+    if ((uint64_t(st.st_size) < sizeof(Header)) or (header->fileSize != uint64_t(st.st_size))) {
+        munmap(mem, st.st_size);
+        throw invalid_argument("corrupt mapping cache: " + cacheFile);
+    }
+    const CachePsl* cachePsls = reinterpret_cast<const CachePsl*>(base + header->pslsOffset);
+    uint32_t* blocks = reinterpret_cast<uint32_t*>(base + header->blocksOffset);
+    const uint64_t* nameOffsets = reinterpret_cast<const uint64_t*>(base + header->nameOffsetsOffset);
+
+    TransMap* transMap = new TransMap();
+    transMap->fCacheMem = mem;
+    transMap->fCacheMemSize = st.st_size;
+    transMap->fCachePsls = new struct psl[header->numPsls]();
+    for (uint64_t i = 0; i < header->numPsls; i++) {
+        const CachePsl& cachePsl = cachePsls[i];
+        struct psl* psl = &(transMap->fCachePsls[i]);
+        psl->match = cachePsl.match;
+        psl->misMatch = cachePsl.misMatch;
+        psl->repMatch = cachePsl.repMatch;
+        psl->nCount = cachePsl.nCount;
+        psl->qNumInsert = cachePsl.qNumInsert;
+        psl->qBaseInsert = cachePsl.qBaseInsert;
+        psl->tNumInsert = cachePsl.tNumInsert;
+        psl->tBaseInsert = cachePsl.tBaseInsert;
+        strncpy(psl->strand, cachePsl.strand, sizeof(psl->strand)-1);
+        psl->qName = base + nameOffsets[cachePsl.qNameIdx];
+        psl->qSize = cachePsl.qSize;
+        psl->qStart = cachePsl.qStart;
+        psl->qEnd = cachePsl.qEnd;
+        psl->tName = base + nameOffsets[cachePsl.tNameIdx];
+        psl->tSize = cachePsl.tSize;
+        psl->tStart = cachePsl.tStart;
+        psl->tEnd = cachePsl.tEnd;
+        psl->blockCount = cachePsl.blockCount;
+        psl->blockSizes = blocks + cachePsl.blocksIdx;
+        psl->qStarts = psl->blockSizes + psl->blockCount;
+        psl->tStarts = psl->qStarts + psl->blockCount;
+        transMap->mapAlnsAdd(psl);
+    }
+    transMap->fMapAlns.build();
+    return transMap;
+}
+
+/* Get a TransMap from the cache if it is current for the alignment file,
+ * otherwise load the alignment file and write a new cache. */
+TransMap* TransMapCache::factory(const string& alignFile,
+                                 bool swapMap,
+                                 const string& cacheFile,
+                                 int numThreads) {
+    if (isCurrent(cacheFile, alignFile, swapMap)) {
+        return load(cacheFile);
+    } else {
+        TransMap* transMap = TransMap::factoryFromFile(alignFile, swapMap, numThreads);
+        write(transMap, cacheFile, alignFile, swapMap);
+        return transMap;
+    }
+}
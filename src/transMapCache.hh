@@ -0,0 +1,44 @@
+/*
+ * Binary cache of mapping alignments.
+ */
+#ifndef transMapCache_hh
+#define transMapCache_hh
+#include <string>
+using namespace std;
+class TransMap;
+
+/*
+ * Binary cache of the swapped and sorted mapping alignments of a TransMap.
+ * This avoids parsing and sorting the chain or PSL file on every run.  The
+ * cache file is memory mapped when loaded, with the PSL block arrays and
+ * sequence names used in place.  The size and modification time of the
+ * alignment file and the swap flag are recorded in the cache and it is
+ * rebuilt if they don't match.  The cache is in native byte order.
+ */
+class TransMapCache {
+    private:
+    struct Header;
+    struct CachePsl;
+
+    static bool readHeader(const string& cacheFile,
+                           Header& header);
+    static bool isCurrent(const string& cacheFile,
+                          const string& alignFile,
+                          bool swapMap);
+    static void write(const TransMap* transMap,
+                      const string& cacheFile,
+                      const string& alignFile,
+                      bool swapMap);
+    static TransMap* load(const string& cacheFile);
+
+    public:
+    /* Get a TransMap from the cache if it is current for the alignment file,
+     * otherwise load the alignment file with numThreads and write a new
+     * cache. */
+    static TransMap* factory(const string& alignFile,
+                             bool swapMap,
+                             const string& cacheFile,
+                             int numThreads = 1);
+};
+
+#endif
@@ -10,15 +10,9 @@
 #include <stdexcept>
 #include <iostream>
 
-/* build transcript exons PSL to query and mapping to target genome.
- * Return NULL if no mappings for whatever reason.*/
-PslMapping* TranscriptMapper::allExonsTransMap(const FeatureNode* transcript) const {
-    const string& qName(transcript->getAttr(GxfFeature::TRANSCRIPT_ID_ATTR)->getVal());
-    FeatureNodeVector exons;
-    transcript->getMatchingType(exons, GxfFeature::EXON);
-
-    // get alignment of exons to srcGenome and to targetGenome
-    PslMapping* exonsMapping = FeatureTransMap(fGenomeTransMap).mapFeatures(qName, exons);
+/* finish the mapping of a transcript's exons to the target genome, sorting
+ * the mappings.  Return NULL if no mappings for whatever reason.*/
+PslMapping* TranscriptMapper::selectExonsMapping(PslMapping* exonsMapping) const {
     if (exonsMapping == NULL) {
         return NULL;  // source sequence not in map
     }
@@ -35,12 +29,20 @@ PslMapping* TranscriptMapper::allExonsTransMap(const FeatureNode* transcript) co
     }
 }
 
-/* create transMap objects used to do two level mapping via exons. */
-const TransMapVector TranscriptMapper::makeViaExonsTransMap(const PslMapping* exonsMapping) {
-    TransMapVector transMaps;
-    transMaps.push_back(TransMap::factoryFromPsl(exonsMapping->getSrcPsl(), true)); // swap map genomeA to exons
-    transMaps.push_back(TransMap::factoryFromPsl(exonsMapping->getMappedPsl(), false)); // exons to genomeB
-    return transMaps;
+/* Build PSLs of the exons of each transcript and map them to the target
+ * genome together. */
+void TranscriptMapper::mapTranscriptsExons(const TransMap* genomeTransMap,
+                                           ExonsMappingCache* exonsMappingCache,
+                                           const FeatureNodeVector& transcripts,
+                                           vector<PslMapping*>& exonsMappings,
+                                           bool keepPruned) {
+    StringVector qNames;
+    vector<FeatureNodeVector> exonSets(transcripts.size());
+    for (int i = 0; i < transcripts.size(); i++) {
+        qNames.push_back(transcripts[i]->getAttr(GxfFeature::TRANSCRIPT_ID_ATTR)->getVal());
+        transcripts[i]->getMatchingType(exonSets[i], GxfFeature::EXON);
+    }
+    FeatureTransMap(genomeTransMap).mapFeatureSets(qNames, exonSets, exonsMappings, exonsMappingCache, keepPruned);
 }
 
 /* get PSL of feature mapping */
@@ -93,6 +95,7 @@ ResultFeatureTrees TranscriptMapper::mapTranscriptFeature(const FeatureNode* tra
 /* constructor, targetAnnotations can be NULL */
 TranscriptMapper::TranscriptMapper(const TransMap* genomeTransMap,
                                    const FeatureNode* transcript,
+                                   PslMapping* exonsMapping,
                                    const AnnotationSet* targetAnnotations,
                                    bool srcSeqInMapping,
                                    ostream* transcriptPslFh):
@@ -102,7 +105,7 @@ TranscriptMapper::TranscriptMapper(const TransMap* genomeTransMap,
     fViaExonsFeatureTransMap(NULL),
     fTargetGene(NULL),
     fTargetTranscript(NULL) {
-    assert(transcript->getType() == GxfFeature::TRANSCRIPT);
+    assert(transcript->getTypeCode() == GXF_TRANSCRIPT_TYPE);
 
     // if available, find target transcripts to use in selecting multiple mappings.  Special handling
     // for PAR requires sequence id.
@@ -113,21 +116,19 @@ TranscriptMapper::TranscriptMapper(const TransMap* genomeTransMap,
                                                               transcript->isParY());
     }
 
-    // map all exons together, this will be used to project the other exons
-    fExonsMapping = allExonsTransMap(transcript);
+    // all exons mapped together, this will be used to project the other exons
+    fExonsMapping = selectExonsMapping(exonsMapping);
     if (fExonsMapping != NULL) {
         if (transcriptPslFh != NULL) {
             fExonsMapping->writeMapped(*transcriptPslFh);
         }
-        fVaiExonsTransMaps = makeViaExonsTransMap(fExonsMapping);
-        fViaExonsFeatureTransMap = new FeatureTransMap(fVaiExonsTransMaps);
+        fViaExonsFeatureTransMap = new ViaExonsFeatureTransMap(fExonsMapping);
     }
 }
 
 /* destructor */
 TranscriptMapper::~TranscriptMapper() {
     delete fExonsMapping;
-    fVaiExonsTransMaps.free();
     delete fViaExonsFeatureTransMap;
 }
 
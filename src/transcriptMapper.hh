@@ -5,10 +5,11 @@
 #define transcriptMapper_hh
 class TransMap;
 class PslMapping;
-class FeatureTransMap;
+class ViaExonsFeatureTransMap;
 class FeatureNode;
 class AnnotationSet;
 class ResultFeatureTrees;
+class ExonsMappingCache;
 #include "featureTree.hh"
 #include "transMap.hh"
 
@@ -27,23 +28,35 @@ class TranscriptMapper {
     const TransMap* fGenomeTransMap;
     const bool fSrcSeqInMapping;                 // do we have source sequence in genomic mapps
     const PslMapping* fExonsMapping;            // exons as psl and genome mapping of exons.
-    TransMapVector fVaiExonsTransMaps;          // transmap objects that are combined
-    const FeatureTransMap* fViaExonsFeatureTransMap;   // two-level transmap, NULL if can't map (owned)
+    const ViaExonsFeatureTransMap* fViaExonsFeatureTransMap;   // two-level transmap, NULL if can't map (owned)
     const FeatureNode* fTargetGene;                     // target annotations for this transcript, if any, to help
     const FeatureNode* fTargetTranscript;               // selecting between multiple mappings.
     static const bool debug = 0;
     
-    PslMapping* allExonsTransMap(const FeatureNode* transcript) const;
-    static const TransMapVector makeViaExonsTransMap(const PslMapping* exonsMapping);
+    PslMapping* selectExonsMapping(PslMapping* exonsMapping) const;
     PslMapping* featurePslMap(const FeatureNode* feature);
     TransMappedFeature mapFeature(const FeatureNode* feature);
     TransMappedFeature mapFeatures(const FeatureNode* feature);
     ResultFeatureTrees mapTranscriptFeature(const FeatureNode* transcript);
 
     public:
-    /* constructor, targetAnnotations can be NULL */
+    /* Map the exons of a set of transcripts, normally those of a gene, to
+     * the target genome together.  Entries of exonsMappings are passed to
+     * the constructor and are NULL if the source sequence is not in the
+     * mapping alignments.  exonsMappingCache maybe NULL.  If keepPruned is
+     * set, the mappings through alignments dropped by the mapping candidate
+     * limit are kept to be written with transcriptPslFh. */
+    static void mapTranscriptsExons(const TransMap* genomeTransMap,
+                                    ExonsMappingCache* exonsMappingCache,
+                                    const FeatureNodeVector& transcripts,
+                                    vector<PslMapping*>& exonsMappings,
+                                    bool keepPruned = false);
+
+    /* constructor, exonsMapping is from mapTranscriptsExons and maybe NULL,
+     * ownership is passed to this object. targetAnnotations can be NULL */
     TranscriptMapper(const TransMap* genomeTransMap,
                      const FeatureNode* transcript,
+                     PslMapping* exonsMapping,
                      const AnnotationSet* targetAnnotations,
                      bool srcSeqInMapping,
                      ostream* transcriptPslFh);
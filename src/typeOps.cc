@@ -61,6 +61,23 @@ StringVector stringSplit(const string& str,
     return strs;
 }
 
+/*
+ * Split a string view into a vector of views given a separator character.
+ * The vector is cleared first, so it can be reused.
+ */
+void stringViewSplit(const StringView& str,
+                     char separator,
+                     StringViewVector& parts) {
+    parts.clear();
+    size_t prevIdx = 0;
+    size_t sepIdx;
+    while ((sepIdx = str.find(separator, prevIdx)) != StringView::npos) {
+        parts.push_back(str.substr(prevIdx, sepIdx - prevIdx));
+        prevIdx = sepIdx + 1;
+    }
+    parts.push_back(str.substr(prevIdx));
+}
+
 /*
  * Join a string into a vector into a string
  */
@@ -84,3 +101,21 @@ string toString(int num) {
     sprintf(buf, "%d", num);
     return string(buf);
 }
+
+/*
+ * append the text of an integer to a string without a temporary
+ */
+void appendInt(string& buf,
+               int num) {
+    char digits[16];
+    int iDigit = sizeof(digits);
+    unsigned int unum = (num < 0) ? -static_cast<unsigned int>(num) : num;
+    do {
+        digits[--iDigit] = '0' + (unum % 10);
+        unum /= 10;
+    } while (unum != 0);
+    if (num < 0) {
+        digits[--iDigit] = '-';
+    }
+    buf.append(digits + iDigit, sizeof(digits) - iDigit);
+}
@@ -6,6 +6,10 @@
 #include <vector>
 #include <string>
 #include <set>
+#include <cstring>
+#include <cctype>
+#include <algorithm>
+#include <stdint.h>
 using namespace std;
 
 #include <typeinfo>
@@ -101,9 +105,117 @@ inline string stringTrim(const string& s, const string& t = whitespace) {
     return stringLtrim(stringRtrim(s, t), t);
 }
 
+/*
+ * Non-owning view of a range of characters, used to tokenize a line without
+ * copying each token.  The viewed characters must outlive the view.
+ */
+class StringView {
+    private:
+    const char* fData;
+    size_t fSize;
+
+    public:
+    static const size_t npos = string::npos;
+
+    /* constructors */
+    StringView():
+        fData(NULL), fSize(0) {
+    }
+    StringView(const char* data,
+               size_t size):
+        fData(data), fSize(size) {
+    }
+    StringView(const string& str):
+        fData(str.data()), fSize(str.size()) {
+    }
+
+    const char* data() const {
+        return fData;
+    }
+    size_t size() const {
+        return fSize;
+    }
+    bool empty() const {
+        return fSize == 0;
+    }
+    char operator[](size_t i) const {
+        return fData[i];
+    }
+
+    /* find a character at or after pos, or npos */
+    size_t find(char ch,
+                size_t pos = 0) const {
+        const void* p = (pos < fSize) ? memchr(fData + pos, ch, fSize - pos) : NULL;
+        return (p == NULL) ? npos : static_cast<const char*>(p) - fData;
+    }
+
+    /* get a view of a sub-range */
+    StringView substr(size_t pos,
+                      size_t n = npos) const {
+        if (pos > fSize) {
+            pos = fSize;
+        }
+        return StringView(fData + pos, min(n, fSize - pos));
+    }
+
+    /* remove whitespace from both ends */
+    StringView trim() const {
+        size_t iStart = 0, iEnd = fSize;
+        while ((iStart < iEnd) and isspace(fData[iStart])) {
+            iStart++;
+        }
+        while ((iEnd > iStart) and isspace(fData[iEnd - 1])) {
+            iEnd--;
+        }
+        return StringView(fData + iStart, iEnd - iStart);
+    }
+
+    /* compare to a string */
+    bool operator==(const string& str) const {
+        return (fSize == str.size()) and (memcmp(fData, str.data(), fSize) == 0);
+    }
+
+    /* compare to another view */
+    bool operator==(const StringView& other) const {
+        return (fSize == other.fSize) and (memcmp(fData, other.fData, fSize) == 0);
+    }
+
+    /* copy to a string */
+    string toString() const {
+        return string(fData, fSize);
+    }
+};
+
+/* vector of string views */
+typedef vector<StringView> StringViewVector;
+
+/* hash function for string views, used in hash tables of views of strings
+ * that outlive the table */
+struct StringViewHash {
+    size_t operator()(const StringView& str) const {
+        uint64_t hash = 14695981039346656037ULL;
+        for (size_t i = 0; i < str.size(); i++) {
+            hash = (hash ^ static_cast<unsigned char>(str[i])) * 1099511628211ULL;
+        }
+        return size_t(hash);
+    }
+};
+
+/*
+ * Split a string view into a vector of views given a separator character.
+ * The vector is cleared first, so it can be reused.
+ */
+void stringViewSplit(const StringView& str,
+                     char separator,
+                     StringViewVector& parts);
+
 /** Convert an integer to a string. */
 string toString(int num);
 
+/* append the text of an integer to a string without a temporary */
+void appendInt(string& buf,
+               int num);
+
 /** Convert an character to a string. */
 inline string charToString(char ch) {
     return string(1, ch);